@@ -0,0 +1,343 @@
+/**
+ * Claude API Client - Arena allocator for the request lifecycle
+ *
+ * See arena.h for how the arena is used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <cjson/cJSON.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN_UP(n) (((n) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+/* Every allocation is preceded by its size, so it can be grown or rewound */
+#define ARENA_HEADER_SIZE ARENA_ALIGN_UP(sizeof(size_t))
+
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t capacity;        /* usable bytes after the block header */
+    size_t used;
+};
+
+#define ARENA_BLOCK_HEADER_SIZE ARENA_ALIGN_UP(sizeof(struct ArenaBlock))
+
+struct Arena {
+    struct ArenaBlock *first;
+    struct ArenaBlock *current;     /* block allocations are taken from */
+    struct ArenaBlock *last_block;  /* tail of the block list */
+    char *last;                     /* most recent allocation, or NULL */
+    size_t block_size;
+    size_t used;
+    size_t peak;
+    size_t allocations;
+    struct Arena *next_idle;        /* link while parked in a pool */
+};
+
+struct ArenaPool {
+    pthread_mutex_t lock;
+    struct Arena *idle;
+    size_t idle_count;
+    size_t max_idle;
+    size_t block_size;
+};
+
+/* Arena used by mem_*() on this thread */
+static __thread struct Arena *current_arena = NULL;
+
+static pthread_once_t json_hooks_once = PTHREAD_ONCE_INIT;
+
+static char* block_data(struct ArenaBlock *block) {
+    return (char *)block + ARENA_BLOCK_HEADER_SIZE;
+}
+
+static size_t* allocation_header(void *ptr) {
+    return (size_t *)((char *)ptr - ARENA_HEADER_SIZE);
+}
+
+static struct ArenaBlock* arena_add_block(struct Arena *arena, size_t needed) {
+    size_t capacity = needed > arena->block_size ? needed : arena->block_size;
+    struct ArenaBlock *block = malloc(ARENA_BLOCK_HEADER_SIZE + capacity);
+    if (!block) {
+        fprintf(stderr, "Error: Memory allocation failed for arena block (%zu bytes)\n", capacity);
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+
+    if (arena->last_block) {
+        arena->last_block->next = block;
+    } else {
+        arena->first = block;
+    }
+    arena->last_block = block;
+    return block;
+}
+
+// Function to create an empty arena; blocks are allocated on first use
+struct Arena* arena_create(size_t block_size) {
+    struct Arena *arena = calloc(1, sizeof(*arena));
+    if (!arena) {
+        fprintf(stderr, "Error: Memory allocation failed for arena\n");
+        return NULL;
+    }
+    arena->block_size = ARENA_ALIGN_UP(block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE);
+    return arena;
+}
+
+// Function to free an arena and everything allocated from it
+void arena_destroy(struct Arena *arena) {
+    if (!arena) return;
+
+    if (current_arena == arena) {
+        current_arena = NULL;
+    }
+
+    struct ArenaBlock *block = arena->first;
+    while (block) {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+// Function to release all allocations at once while keeping the blocks
+void arena_reset(struct Arena *arena) {
+    for (struct ArenaBlock *block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+    arena->last = NULL;
+    arena->used = 0;
+    arena->allocations = 0;
+}
+
+// Function to allocate size bytes from the arena
+void* arena_alloc(struct Arena *arena, size_t size) {
+    size_t needed = ARENA_HEADER_SIZE + ARENA_ALIGN_UP(size);
+    if (needed < size) {
+        fprintf(stderr, "Error: Arena allocation too large (%zu bytes)\n", size);
+        return NULL;
+    }
+
+    // Take the first block from the current one on that still has room
+    struct ArenaBlock *block = arena->current ? arena->current : arena->first;
+    while (block && block->capacity - block->used < needed) {
+        block = block->next;
+    }
+    if (!block) {
+        block = arena_add_block(arena, needed);
+        if (!block) return NULL;
+    }
+    arena->current = block;
+
+    char *ptr = block_data(block) + block->used + ARENA_HEADER_SIZE;
+    *allocation_header(ptr) = size;
+    block->used += needed;
+
+    arena->last = ptr;
+    arena->used += needed;
+    arena->allocations++;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    return ptr;
+}
+
+// Function to resize an arena allocation; the latest one grows in place
+void* arena_realloc(struct Arena *arena, void *ptr, size_t size) {
+    if (!ptr) {
+        return arena_alloc(arena, size);
+    }
+
+    size_t old_size = *allocation_header(ptr);
+    if (size <= old_size) {
+        return ptr;
+    }
+
+    struct ArenaBlock *block = arena->current;
+    if (ptr == arena->last) {
+        size_t grow = ARENA_ALIGN_UP(size) - ARENA_ALIGN_UP(old_size);
+        if (ARENA_ALIGN_UP(size) >= size && block->capacity - block->used >= grow) {
+            block->used += grow;
+            arena->used += grow;
+            if (arena->used > arena->peak) {
+                arena->peak = arena->used;
+            }
+            *allocation_header(ptr) = size;
+            return ptr;
+        }
+    }
+
+    void *moved = arena_alloc(arena, size);
+    if (!moved) return NULL;
+    memcpy(moved, ptr, old_size);
+    return moved;
+}
+
+// Function to give back an arena allocation; only the latest one is reclaimed
+void arena_free(struct Arena *arena, void *ptr) {
+    if (!ptr || ptr != arena->last) return;
+
+    size_t needed = ARENA_HEADER_SIZE + ARENA_ALIGN_UP(*allocation_header(ptr));
+    arena->current->used -= needed;
+    arena->used -= needed;
+    arena->last = NULL;
+}
+
+// Function to check whether ptr was allocated from the arena
+int arena_owns(const struct Arena *arena, const void *ptr) {
+    const char *p = (const char *)ptr;
+    for (struct ArenaBlock *block = arena->first; block; block = block->next) {
+        const char *data = block_data(block);
+        if (p >= data && p < data + block->capacity) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void arena_get_stats(const struct Arena *arena, struct ArenaStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (struct ArenaBlock *block = arena->first; block; block = block->next) {
+        stats->blocks++;
+        stats->reserved += block->capacity;
+    }
+    stats->used = arena->used;
+    stats->peak = arena->peak;
+    stats->allocations = arena->allocations;
+}
+
+static void install_json_hooks(void) {
+    cJSON_Hooks hooks;
+    hooks.malloc_fn = mem_alloc;
+    hooks.free_fn = mem_free;
+    cJSON_InitHooks(&hooks);
+}
+
+// Function to route this thread's client allocations to arena (NULL: the heap)
+struct Arena* arena_activate(struct Arena *arena) {
+    pthread_once(&json_hooks_once, install_json_hooks);
+
+    struct Arena *previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+struct Arena* arena_current(void) {
+    return current_arena;
+}
+
+void* mem_alloc(size_t size) {
+    return current_arena ? arena_alloc(current_arena, size) : malloc(size);
+}
+
+void* mem_calloc(size_t nmemb, size_t size) {
+    if (size && nmemb > (size_t)-1 / size) {
+        return NULL;
+    }
+
+    void *ptr = mem_alloc(nmemb * size);
+    if (ptr) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+void* mem_realloc(void *ptr, size_t size) {
+    if (current_arena && (!ptr || arena_owns(current_arena, ptr))) {
+        return arena_realloc(current_arena, ptr, size);
+    }
+    return realloc(ptr, size);
+}
+
+void mem_free(void *ptr) {
+    if (!ptr) return;
+
+    if (current_arena && arena_owns(current_arena, ptr)) {
+        arena_free(current_arena, ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+// Function to create a pool that keeps up to max_idle arenas for reuse
+struct ArenaPool* arena_pool_create(size_t max_idle, size_t block_size) {
+    struct ArenaPool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        fprintf(stderr, "Error: Memory allocation failed for arena pool\n");
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to initialize arena pool lock\n");
+        free(pool);
+        return NULL;
+    }
+
+    pool->max_idle = max_idle;
+    pool->block_size = block_size;
+    return pool;
+}
+
+void arena_pool_destroy(struct ArenaPool *pool) {
+    if (!pool) return;
+
+    while (pool->idle) {
+        struct Arena *arena = pool->idle;
+        pool->idle = arena->next_idle;
+        arena_destroy(arena);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+// Function to take a reset arena from the pool, creating one if it is empty
+struct Arena* arena_pool_acquire(struct ArenaPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    struct Arena *arena = pool->idle;
+    if (arena) {
+        pool->idle = arena->next_idle;
+        pool->idle_count--;
+        arena->next_idle = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return arena ? arena : arena_create(pool->block_size);
+}
+
+// Function to hand an arena back; its allocations are released
+void arena_pool_release(struct ArenaPool *pool, struct Arena *arena) {
+    if (!arena) return;
+
+    if (current_arena == arena) {
+        current_arena = NULL;
+    }
+
+    // Don't let one huge request pin its memory in the pool
+    struct ArenaStats stats;
+    arena_get_stats(arena, &stats);
+    if (stats.reserved > ARENA_POOL_RETAIN_LIMIT) {
+        arena_destroy(arena);
+        return;
+    }
+
+    arena_reset(arena);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->idle_count < pool->max_idle) {
+        arena->next_idle = pool->idle;
+        pool->idle = arena;
+        pool->idle_count++;
+        arena = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    arena_destroy(arena);
+}
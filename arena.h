@@ -0,0 +1,68 @@
+/**
+ * Claude API Client - Arena allocator for the request lifecycle
+ *
+ * An arena owns every allocation made for one request: paths, key, profile,
+ * prompt, cJSON nodes, the response buffer and the parsed title and
+ * description. Allocation is a pointer bump inside large blocks, and the
+ * whole request is released at once with arena_reset() or arena_destroy().
+ *
+ * The client code allocates through mem_alloc()/mem_realloc()/mem_free().
+ * These use the arena activated on the calling thread, or the heap when
+ * none is active, so the library still works without an arena. While an
+ * arena is active cJSON allocates through it too (see cJSON_InitHooks).
+ *
+ * Batch and long-running modes take one arena per in-flight request from an
+ * ArenaPool. Released arenas keep their blocks, so once the pool is warm a
+ * request of a familiar size does no allocator work at all.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Default size of one arena block; larger allocations get their own block */
+#define ARENA_DEFAULT_BLOCK_SIZE (64UL * 1024)
+
+/* Alignment of every arena allocation */
+#define ARENA_ALIGNMENT 16
+
+/* Arenas holding more than this are freed instead of returning to a pool */
+#define ARENA_POOL_RETAIN_LIMIT (64UL * 1024 * 1024)
+
+struct Arena;
+struct ArenaPool;
+
+/* Usage counters of one arena */
+struct ArenaStats {
+    size_t blocks;          /* blocks currently held */
+    size_t reserved;        /* bytes held in blocks */
+    size_t used;            /* bytes handed out since the last reset */
+    size_t peak;            /* high-water mark of used */
+    size_t allocations;     /* allocations since the last reset */
+};
+
+struct Arena* arena_create(size_t block_size);
+void arena_destroy(struct Arena *arena);
+void arena_reset(struct Arena *arena);
+void* arena_alloc(struct Arena *arena, size_t size);
+void* arena_realloc(struct Arena *arena, void *ptr, size_t size);
+void arena_free(struct Arena *arena, void *ptr);
+int arena_owns(const struct Arena *arena, const void *ptr);
+void arena_get_stats(const struct Arena *arena, struct ArenaStats *stats);
+
+/* Arena used by mem_*() on the calling thread; returns the previous one */
+struct Arena* arena_activate(struct Arena *arena);
+struct Arena* arena_current(void);
+
+void* mem_alloc(size_t size);
+void* mem_calloc(size_t nmemb, size_t size);
+void* mem_realloc(void *ptr, size_t size);
+void mem_free(void *ptr);
+
+struct ArenaPool* arena_pool_create(size_t max_idle, size_t block_size);
+void arena_pool_destroy(struct ArenaPool *pool);
+struct Arena* arena_pool_acquire(struct ArenaPool *pool);
+void arena_pool_release(struct ArenaPool *pool, struct Arena *arena);
+
+#endif /* ARENA_H */
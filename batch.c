@@ -0,0 +1,606 @@
+/**
+ * Claude API Client - Message Batches mode for bulk jobs
+ *
+ * See batch.h. Both directions keep memory flat in the number of diffs: the
+ * prompt for each diff is built in a scratch arena that is reset once its
+ * request is appended to the submission, and the results are parsed line
+ * by line while they download, each in the same scratch arena.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cjson/cJSON.h>
+
+#include "claude_client.h"
+#include "batch.h"
+#include "route.h"
+#include "ledger.h"
+
+#define BATCH_STATE_MAGIC "commit-ai-batch 1"
+#define BATCH_ENDPOINT "/v1/messages/batches"
+
+/* Interval between batch status checks (--batch-poll) */
+long batch_poll_ms = BATCH_DEFAULT_POLL_MS;
+
+/* One request of a submitted batch, as listed in the state file */
+struct BatchEntry {
+    const char *custom_id;
+    const char *path;
+};
+
+/* State of the JSONL results download */
+struct ResultStream {
+    struct MemoryStruct buffer;     /* bytes after the last complete line */
+    size_t scanned;                 /* bytes of buffer already searched for '\n' */
+    const struct BatchEntry *entries;
+    size_t count;
+    struct Arena *scratch;
+    const char *output_dir;
+    size_t succeeded;
+    size_t failed;
+    long status;                    /* HTTP status of the last status line seen */
+};
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static int append_text(struct MemoryStruct *out, const char *text) {
+    size_t len = strlen(text);
+    return WriteMemoryCallback((void *)text, 1, len, out) == len;
+}
+
+/*
+ * Function to copy the next diff path of a --diff-list into path, skipping
+ * blank lines and # comments. Returns 1 for a path, 0 at the end, -1 on error.
+ */
+int diff_list_next(const char **cursor, char *path, size_t path_size) {
+    while (**cursor) {
+        const char *start = *cursor;
+        const char *end = strchr(start, '\n');
+        *cursor = end ? end + 1 : start + strlen(start);
+        if (!end) end = *cursor;
+
+        while (start < end && (*start == ' ' || *start == '\t')) start++;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+        if (start == end || *start == '#') continue;
+
+        size_t len = (size_t)(end - start);
+        if (len >= path_size) {
+            fprintf(stderr, "Error: Path in diff list is too long: %.64s...\n", start);
+            return -1;
+        }
+        memcpy(path, start, len);
+        path[len] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+// Function to name a listed diff "<index>-<file name>", using only custom_id characters
+void diff_list_id(size_t index, const char *path, char *id) {
+    int len = snprintf(id, BATCH_CUSTOM_ID_MAX + 1, "%zu-", index);
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    for (; *name && len < BATCH_CUSTOM_ID_MAX; name++) {
+        char c = *name;
+        int allowed = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                      (c >= '0' && c <= '9') || c == '-' || c == '_';
+        id[len++] = allowed ? c : '_';
+    }
+    id[len] = '\0';
+}
+
+/* Build the request for one diff in the scratch arena and append it to body */
+static int append_request(struct MemoryStruct *body, struct Arena *scratch, const char *profile,
+                          const char *path, size_t index) {
+    char custom_id[BATCH_CUSTOM_ID_MAX + 1];
+    diff_list_id(index, path, custom_id);
+
+    struct Arena *previous = arena_activate(scratch);
+    char *params = NULL;
+    char *diff = read_file(path);
+    if (diff && !*diff) {
+        fprintf(stderr, "Error: Diff is empty: %s\n", path);
+    } else if (diff) {
+        // With --route each request names its tier's model; there is nothing to escalate to
+        const char *model = api_model;
+        if (route_mode) {
+            api_model = route_tier_model(route_tier(diff));
+        }
+        cJSON *payload = build_request_payload(profile, diff);
+        api_model = model;
+        if (payload) {
+            params = cJSON_PrintUnformatted(payload);
+            cJSON_Delete(payload);
+            if (!params) {
+                fprintf(stderr, "Error: Failed to convert JSON to string\n");
+            }
+        }
+    }
+    arena_activate(previous);
+
+    int ok = params != NULL;
+    if (ok) {
+        char head[BATCH_CUSTOM_ID_MAX + 32];
+        snprintf(head, sizeof(head), "%s{\"custom_id\":\"%s\",\"params\":",
+                 index > 0 ? "," : "", custom_id);
+        ok = append_text(body, head) && append_text(body, params) && append_text(body, "}");
+    }
+
+    arena_reset(scratch);
+    return ok;
+}
+
+/* Write the batch id and the custom_id of every listed diff to state_path */
+static int store_batch_state(const char *state_path, const char *batch_id, const char *list) {
+    size_t tmp_len = strlen(state_path) + 32;
+    char *tmp_path = mem_alloc(tmp_len);
+    if (!tmp_path) {
+        fprintf(stderr, "Error: Memory allocation failed for batch state path\n");
+        return 0;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp.%ld", state_path, (long)getpid());
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open file: %s (%s)\n", tmp_path, strerror(errno));
+        mem_free(tmp_path);
+        return 0;
+    }
+
+    fprintf(file, "%s\nid %s\n", BATCH_STATE_MAGIC, batch_id);
+
+    // Same walk as the submission, so the custom_ids match
+    const char *cursor = list;
+    char path[DIFF_LIST_MAX_PATH];
+    char custom_id[BATCH_CUSTOM_ID_MAX + 1];
+    for (size_t index = 0; diff_list_next(&cursor, path, sizeof(path)) == 1; index++) {
+        diff_list_id(index, path, custom_id);
+        fprintf(file, "%s\t%s\n", custom_id, path);
+    }
+
+    int ok = ferror(file) == 0;
+    ok &= fclose(file) == 0;
+    if (ok && rename(tmp_path, state_path) != 0) {
+        fprintf(stderr, "Error: Failed to store batch state (%s)\n", strerror(errno));
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(tmp_path);
+    }
+
+    mem_free(tmp_path);
+    return ok;
+}
+
+// Function to submit one Messages request per listed diff as a single batch
+int batch_submit(const char *api_key, const char *profile, const char *diff_list_path,
+                 const char *state_path) {
+    char *list = read_file(diff_list_path);
+    if (!list) return 0;
+
+    struct Arena *scratch = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+    if (!scratch) {
+        mem_free(list);
+        return 0;
+    }
+
+    // {"requests":[{"custom_id":...,"params":{...}},...]}
+    struct MemoryStruct body;
+    memset(&body, 0, sizeof(body));
+    int ok = append_text(&body, "{\"requests\":[");
+
+    const char *cursor = list;
+    char path[DIFF_LIST_MAX_PATH];
+    size_t count = 0;
+    int more;
+    while (ok && (more = diff_list_next(&cursor, path, sizeof(path))) != 0) {
+        if (more < 0) {
+            ok = 0;
+        } else if (count == BATCH_MAX_REQUESTS) {
+            fprintf(stderr, "Error: A batch holds at most %d requests, split %s\n",
+                    BATCH_MAX_REQUESTS, diff_list_path);
+            ok = 0;
+        } else {
+            ok = append_request(&body, scratch, profile, path, count++);
+        }
+    }
+    arena_destroy(scratch);
+
+    ok = ok && append_text(&body, "]}");
+    if (ok && count == 0) {
+        fprintf(stderr, "Error: No diffs listed in %s\n", diff_list_path);
+        ok = 0;
+    }
+    if (ok && body.size > BATCH_MAX_BYTES) {
+        fprintf(stderr, "Error: Batch request is %zu bytes, the limit is %lu; split %s\n",
+                body.size, BATCH_MAX_BYTES, diff_list_path);
+        ok = 0;
+    }
+    if (!ok) {
+        mem_free(body.memory);
+        mem_free(list);
+        return 0;
+    }
+
+    debug_print("Batch request payload created (%zu requests, %zu bytes)", count, body.size);
+    printf("Submitting %zu requests to the Message Batches API...\n", count);
+
+    struct MemoryStruct response;
+    memset(&response, 0, sizeof(response));
+    long http_code = 0;
+    ok = api_request(api_key, BATCH_ENDPOINT, body.memory, WriteMemoryCallback, &response,
+                     NULL, NULL, &http_code) && memory_reserve(&response, 0);
+    mem_free(body.memory);
+
+    if (ok && (http_code < 200 || http_code >= 300)) {
+        fprintf(stderr, "Error: API request failed with HTTP code %ld\n", http_code);
+        fprintf(stderr, "Response: %s\n", response.memory);
+        ok = 0;
+    }
+
+    cJSON *root = ok ? cJSON_Parse(response.memory) : NULL;
+    const char *batch_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "id"));
+    if (ok && !batch_id) {
+        fprintf(stderr, "Error: Batch id not found in the response\n");
+        ok = 0;
+    }
+
+    if (ok) {
+        ok = store_batch_state(state_path, batch_id, list);
+    }
+    if (ok) {
+        printf("Submitted batch %s; collect it with --batch-collect %s\n", batch_id, state_path);
+    }
+
+    cJSON_Delete(root);
+    mem_free(response.memory);
+    mem_free(list);
+    return ok;
+}
+
+/*
+ * Split the state file text in place into the batch id and its entries.
+ * Entry i is the request whose custom_id starts with "i-".
+ */
+static int parse_batch_state(char *state, const char *state_path, const char **batch_id,
+                             struct BatchEntry **entries, size_t *count) {
+    size_t magic_len = strlen(BATCH_STATE_MAGIC);
+    if (strncmp(state, BATCH_STATE_MAGIC "\nid ", magic_len + 4) != 0) {
+        fprintf(stderr, "Error: Not a batch state file: %s\n", state_path);
+        return 0;
+    }
+
+    char *id = state + magic_len + 4;
+    char *line = strchr(id, '\n');
+    if (line) *line++ = '\0';
+
+    // The id goes into a URL path, so only accept what the API generates
+    if (!*id || strspn(id, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") != strlen(id)) {
+        fprintf(stderr, "Error: Invalid batch id in %s\n", state_path);
+        return 0;
+    }
+    *batch_id = id;
+
+    size_t lines = 0;
+    for (const char *p = line; p && *p; p++) {
+        if (*p == '\n') lines++;
+    }
+
+    *entries = mem_calloc(lines + 1, sizeof(**entries));
+    if (!*entries) {
+        fprintf(stderr, "Error: Memory allocation failed for batch entries\n");
+        return 0;
+    }
+
+    *count = 0;
+    while (line && *line) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        char *tab = strchr(line, '\t');
+        if (!tab) {
+            fprintf(stderr, "Error: Malformed entry in %s: %s\n", state_path, line);
+            return 0;
+        }
+        *tab = '\0';
+        (*entries)[*count].custom_id = line;
+        (*entries)[*count].path = tab + 1;
+        (*count)++;
+        line = next;
+    }
+    return 1;
+}
+
+/* Entry for a custom_id from the results, or NULL if the batch has no such request */
+static const struct BatchEntry* find_entry(const struct ResultStream *stream, const char *custom_id) {
+    char *end = NULL;
+    unsigned long index = strtoul(custom_id, &end, 10);
+    if (end == custom_id || *end != '-' || index >= stream->count) {
+        return NULL;
+    }
+    const struct BatchEntry *entry = &stream->entries[index];
+    return strcmp(entry->custom_id, custom_id) == 0 ? entry : NULL;
+}
+
+// Function to print the result for a listed diff and save it as <output_dir>/<id>.md
+int emit_diff_result(const char *path, const char *id, const char *title, const char *description,
+                     const char *output_dir) {
+    printf("==> %s <==\n", path);
+    printf("TITLE: %s\n\n", title);
+    printf("DESCRIPTION:\n%s\n\n", description);
+
+    if (!output_dir) {
+        return 1;
+    }
+
+    size_t len = strlen(output_dir) + strlen(id) + 5;
+    char *file_path = mem_alloc(len);
+    if (!file_path) {
+        fprintf(stderr, "Error: Memory allocation failed for output path\n");
+        return 0;
+    }
+    snprintf(file_path, len, "%s/%s.md", output_dir, id);
+    int ok = save_results_to_file(file_path, title, description);
+    mem_free(file_path);
+    return ok;
+}
+
+/* Print one succeeded result and save it under the output directory */
+static int emit_result(const struct ResultStream *stream, const struct BatchEntry *entry,
+                       const char *message) {
+    char *title = NULL;
+    char *description = NULL;
+    if (!parse_claude_response(message, &title, &description)) {
+        return 0;
+    }
+    return emit_diff_result(entry->path, entry->custom_id, title, description, stream->output_dir);
+}
+
+/* HTTP status an errored result would have had as a direct request, from its error type */
+static long result_error_status(const char *error_type) {
+    static const struct { const char *type; long status; } statuses[] = {
+        { "invalid_request_error", 400 }, { "authentication_error", 401 },
+        { "permission_error", 403 }, { "not_found_error", 404 },
+        { "request_too_large", 413 }, { "rate_limit_error", 429 },
+        { "api_error", 500 }, { "overloaded_error", 529 }
+    };
+    for (size_t i = 0; error_type && i < sizeof(statuses) / sizeof(statuses[0]); i++) {
+        if (strcmp(statuses[i].type, error_type) == 0) return statuses[i].status;
+    }
+    return 0;
+}
+
+/*
+ * Append a ledger record for one result: 200 with the message's usage when
+ * it succeeded, the status of its error type when it errored and 0 when it
+ * was canceled or expired. A batch has no per-request time, so latency is -1.
+ */
+static void record_result(const struct BatchEntry *entry, long http_code, const char *model,
+                          const char *message) {
+    if (!ledger_path) return;
+    struct stat st;
+    ledger_diff_bytes = stat(entry->path, &st) == 0 ? (size_t)st.st_size : 0;
+    ledger_record(model, http_code, -1, message);
+}
+
+/* Handle one JSONL result line; everything it allocates lives in the scratch arena */
+static void handle_result_line(struct ResultStream *stream, const char *line) {
+    struct Arena *previous = arena_activate(stream->scratch);
+
+    cJSON *root = cJSON_Parse(line);
+    const char *custom_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "custom_id"));
+    cJSON *result = cJSON_GetObjectItemCaseSensitive(root, "result");
+    const char *type = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(result, "type"));
+    const struct BatchEntry *entry = custom_id ? find_entry(stream, custom_id) : NULL;
+
+    int ok = 0;
+    if (!custom_id || !type) {
+        fprintf(stderr, "Error: Malformed batch result: %.120s\n", line);
+    } else if (!entry) {
+        fprintf(stderr, "Error: Result for unknown request %s\n", custom_id);
+    } else if (strcmp(type, "succeeded") == 0) {
+        cJSON *reply = cJSON_GetObjectItemCaseSensitive(result, "message");
+        char *message = cJSON_PrintUnformatted(reply);
+        record_result(entry, 200, cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(reply, "model")),
+                      message);
+        ok = message && emit_result(stream, entry, message);
+        if (!ok) {
+            fprintf(stderr, "Error: Failed to parse the result for %s\n", entry->path);
+        }
+    } else {
+        // errored results carry {"type":"error","error":{"type":...,"message":...}}
+        cJSON *error = cJSON_GetObjectItemCaseSensitive(result, "error");
+        cJSON *inner = cJSON_GetObjectItemCaseSensitive(error, "error");
+        const char *reason = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(inner ? inner : error, "message"));
+        const char *error_type = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(inner ? inner : error, "type"));
+        record_result(entry, strcmp(type, "errored") == 0 ? result_error_status(error_type) : 0, NULL, NULL);
+        fprintf(stderr, "Error: Request for %s %s%s%s\n", entry->path, type,
+                reason ? ": " : "", reason ? reason : "");
+    }
+
+    if (ok) {
+        stream->succeeded++;
+    } else {
+        stream->failed++;
+    }
+
+    cJSON_Delete(root);
+    arena_activate(previous);
+    arena_reset(stream->scratch);
+}
+
+/* Header callback for the results download: remembers the HTTP status before the body */
+static size_t result_header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    struct ResultStream *stream = userdata;
+    size_t realsize = size * nitems;
+
+    // Redirects and 100 Continue send more than one status line; the last one counts
+    if (realsize > 5 && memcmp(buffer, "HTTP/", 5) == 0) {
+        const char *space = memchr(buffer, ' ', realsize);
+        stream->status = space ? strtol(space + 1, NULL, 10) : 0;
+    }
+    return realsize;
+}
+
+/* Write callback for the results download: handles each line once it is complete */
+static size_t result_stream_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    struct ResultStream *stream = userp;
+    size_t realsize = WriteMemoryCallback(contents, size, nmemb, &stream->buffer);
+    if (realsize != size * nmemb) {
+        return realsize;
+    }
+
+    // An error body is not JSONL; keep all of it for the error message
+    if (stream->status < 200 || stream->status >= 300) {
+        return realsize;
+    }
+
+    char *data = stream->buffer.memory;
+    char *line = data;
+    char *newline;
+    while ((newline = memchr(data + stream->scanned, '\n', stream->buffer.size - stream->scanned))) {
+        *newline = '\0';
+        if (newline > line) {
+            handle_result_line(stream, line);
+        }
+        line = newline + 1;
+        stream->scanned = (size_t)(line - data);
+    }
+
+    // Keep only the partial line for the next call
+    size_t consumed = (size_t)(line - data);
+    memmove(data, line, stream->buffer.size - consumed);
+    stream->buffer.size -= consumed;
+    stream->buffer.memory[stream->buffer.size] = '\0';
+    stream->scanned = stream->buffer.size;
+    return realsize;
+}
+
+/* Poll the batch until it has ended; returns 0 on errors or when the deadline passes */
+static int wait_for_batch(const char *api_key, const char *batch_id, struct Arena *scratch) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", BATCH_ENDPOINT, batch_id);
+
+    for (;;) {
+        struct Arena *previous = arena_activate(scratch);
+        struct MemoryStruct status;
+        memset(&status, 0, sizeof(status));
+        long http_code = 0;
+        int state = -1;  // -1 error, 0 still processing, 1 ended
+
+        if (api_request(api_key, path, NULL, WriteMemoryCallback, &status, NULL, NULL, &http_code) &&
+            memory_reserve(&status, 0)) {
+            if (http_code < 200 || http_code >= 300) {
+                fprintf(stderr, "Error: API request failed with HTTP code %ld\n", http_code);
+                fprintf(stderr, "Response: %s\n", status.memory);
+            } else {
+                cJSON *root = cJSON_Parse(status.memory);
+                const char *processing = cJSON_GetStringValue(
+                    cJSON_GetObjectItemCaseSensitive(root, "processing_status"));
+                cJSON *counts = cJSON_GetObjectItemCaseSensitive(root, "request_counts");
+                if (!processing) {
+                    fprintf(stderr, "Error: Batch status not found in the response\n");
+                } else {
+                    printf("Batch %s: %s (%.0f processing, %.0f succeeded, %.0f errored)\n",
+                           batch_id, processing,
+                           cJSON_GetNumberValue(cJSON_GetObjectItemCaseSensitive(counts, "processing")),
+                           cJSON_GetNumberValue(cJSON_GetObjectItemCaseSensitive(counts, "succeeded")),
+                           cJSON_GetNumberValue(cJSON_GetObjectItemCaseSensitive(counts, "errored")));
+                    fflush(stdout);
+                    state = strcmp(processing, "ended") == 0;
+                }
+                cJSON_Delete(root);
+            }
+        }
+
+        arena_activate(previous);
+        arena_reset(scratch);
+        if (state != 0) {
+            return state == 1;
+        }
+
+        // Never sleep past --deadline; one last check happens at the deadline
+        long wait = batch_poll_ms;
+        long remaining = deadline_remaining_ms();
+        if (remaining == 0) {
+            fprintf(stderr, "Error: Batch %s has not ended before the deadline\n", batch_id);
+            return 0;
+        }
+        if (remaining > 0 && remaining < wait) {
+            wait = remaining;
+        }
+        sleep_ms(wait);
+    }
+}
+
+// Function to wait for a submitted batch and print the result for every diff
+int batch_collect(const char *api_key, const char *state_path, const char *output_dir) {
+    char *state = read_file(state_path);
+    if (!state) return 0;
+
+    const char *batch_id = NULL;
+    struct BatchEntry *entries = NULL;
+    size_t count = 0;
+    if (!parse_batch_state(state, state_path, &batch_id, &entries, &count)) {
+        mem_free(entries);
+        mem_free(state);
+        return 0;
+    }
+    debug_print("Batch %s has %zu requests", batch_id, count);
+
+    struct ResultStream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.entries = entries;
+    stream.count = count;
+    stream.output_dir = output_dir;
+    stream.scratch = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+    if (!stream.scratch) {
+        mem_free(entries);
+        mem_free(state);
+        return 0;
+    }
+
+    int ok = wait_for_batch(api_key, batch_id, stream.scratch);
+    if (ok) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s/results", BATCH_ENDPOINT, batch_id);
+        long http_code = 0;
+        ok = api_request(api_key, path, NULL, result_stream_callback, &stream,
+                         result_header_callback, &stream, &http_code);
+
+        if (ok && (http_code < 200 || http_code >= 300)) {
+            fprintf(stderr, "Error: API request failed with HTTP code %ld\n", http_code);
+            fprintf(stderr, "Response: %s\n", stream.buffer.memory ? stream.buffer.memory : "");
+            ok = 0;
+        } else if (ok && stream.buffer.size > 0) {
+            // The last line may come without a newline
+            handle_result_line(&stream, stream.buffer.memory);
+        }
+    }
+
+    if (ok) {
+        size_t handled = stream.succeeded + stream.failed;
+        size_t missing = handled < count ? count - handled : 0;
+        printf("Batch %s: %zu succeeded, %zu failed, %zu missing\n",
+               batch_id, stream.succeeded, stream.failed, missing);
+        ok = stream.failed == 0 && missing == 0;
+    }
+
+    arena_destroy(stream.scratch);
+    mem_free(stream.buffer.memory);
+    mem_free(entries);
+    mem_free(state);
+    return ok;
+}
@@ -0,0 +1,51 @@
+/**
+ * Claude API Client - Message Batches mode for bulk jobs
+ *
+ * For jobs over many diffs where latency does not matter but cost and rate
+ * limits do. --batch-submit packs one Messages request per diff listed in
+ * --diff-list into a single Message Batches submission and stores the batch
+ * id in a small state file:
+ *
+ *   commit-ai-batch 1
+ *   id <batch id>
+ *   <custom_id>\t<diff path>
+ *   ...
+ *
+ * --batch-collect reads the state file, polls the batch every --batch-poll
+ * ms until it has ended, then streams the JSONL results and parses each one
+ * with parse_claude_response() as it arrives. Results are printed per diff,
+ * and with -o <dir> also saved as <dir>/<custom_id>.md.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+/* Default interval between batch status checks */
+#define BATCH_DEFAULT_POLL_MS 30000
+
+/* Limits of one Message Batches submission */
+#define BATCH_MAX_REQUESTS 100000
+#define BATCH_MAX_BYTES (256UL * 1024 * 1024)
+
+/* Longest custom_id the API accepts */
+#define BATCH_CUSTOM_ID_MAX 64
+
+/* Longest diff path accepted in a --diff-list */
+#define DIFF_LIST_MAX_PATH 4096
+
+/* Interval between batch status checks (--batch-poll) */
+extern long batch_poll_ms;
+
+/* --diff-list helpers, shared with the other modes that take a list */
+int diff_list_next(const char **cursor, char *path, size_t path_size);
+void diff_list_id(size_t index, const char *path, char *id);
+int emit_diff_result(const char *path, const char *id, const char *title, const char *description,
+                     const char *output_dir);
+
+int batch_submit(const char *api_key, const char *profile, const char *diff_list_path,
+                 const char *state_path);
+int batch_collect(const char *api_key, const char *state_path, const char *output_dir);
+
+#endif /* BATCH_H */
@@ -0,0 +1,167 @@
+/**
+ * Claude API Client - Several candidate messages from one request
+ *
+ * See candidates.h. The reply is split with the same section finder as a
+ * packed reply.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <cjson/cJSON.h>
+
+#include "claude_client.h"
+#include "pack.h"
+#include "route.h"
+#include "candidates.h"
+#include "ledger.h"
+
+#define CANDIDATE_MARKER "=== CANDIDATE "
+#define CANDIDATE_END_MARKER "=== END CANDIDATE "
+
+static const char *candidates_instructions =
+    "\n\nInstead of one title and description, write %zu alternatives with clearly different "
+    "titles. Answer with %zu sections, from \"=== CANDIDATE 1 ===\" to \"=== CANDIDATE %zu ===\". "
+    "Start each section with that line, followed by the title on its own line, a blank line and "
+    "the description. Do not write anything outside the sections.";
+
+/* The single-message prompt with the section instructions appended */
+static char* build_candidates_prompt(const char *profile, const char *git_diff, size_t count) {
+    char *prompt = build_prompt(profile, git_diff);
+    if (!prompt) return NULL;
+
+    size_t prompt_len = strlen(prompt);
+    int extra_len = snprintf(NULL, 0, candidates_instructions, count, count, count);
+    char *content = extra_len > 0 ? mem_realloc(prompt, prompt_len + (size_t)extra_len + 1) : NULL;
+    if (!content) {
+        fprintf(stderr, "Error: Memory allocation failed for content string\n");
+        mem_free(prompt);
+        return NULL;
+    }
+    snprintf(content + prompt_len, (size_t)extra_len + 1, candidates_instructions, count, count, count);
+    return content;
+}
+
+// Function to ask for count alternative messages in one request; returns how many came back
+size_t request_candidates(const char *api_key, const char *profile, const char *git_diff,
+                          size_t count, struct Candidate *candidates) {
+    char *content = build_candidates_prompt(profile, git_diff, count);
+    if (!content) return 0;
+
+    const char *model = api_model;
+    if (route_mode) {
+        api_model = route_tier_model(route_tier(git_diff));
+    }
+    cJSON *payload = build_message_payload(content, (int)(CANDIDATES_OUTPUT_TOKENS * count));
+    api_model = model;
+    mem_free(content);
+
+    ledger_diff_bytes = strlen(git_diff);
+    char *response = payload ? send_claude_request(api_key, payload) : NULL;
+    cJSON_Delete(payload);
+
+    size_t text_len = 0;
+    char *text = response ? extract_response_text(response, &text_len, NULL) : NULL;
+    mem_free(response);
+    if (!text) return 0;
+
+    const char *starts[CANDIDATES_MAX];
+    size_t lens[CANDIDATES_MAX];
+    memset(starts, 0, sizeof(starts));
+    memset(lens, 0, sizeof(lens));
+    find_sections(text, CANDIDATE_MARKER, CANDIDATE_END_MARKER, count, starts, lens);
+
+    size_t received = 0;
+    for (size_t n = 0; n < count; n++) {
+        if (!starts[n] || lens[n] == 0) continue;
+
+        char *section = mem_alloc(lens[n] + 1);
+        if (!section) {
+            fprintf(stderr, "Error: Memory allocation failed for candidate\n");
+            break;
+        }
+        memcpy(section, starts[n], lens[n]);
+        section[lens[n]] = '\0';
+        if (split_response_text(section, lens[n], &candidates[received].title,
+                                &candidates[received].description)) {
+            received++;
+        }
+    }
+
+    // A reply without sections is still one usable message
+    if (received == 0) {
+        debug_print("No candidate sections in the reply, using it as one message");
+        return split_response_text(text, text_len, &candidates[0].title, &candidates[0].description);
+    }
+    if (received < count) {
+        fprintf(stderr, "Warning: Got %zu of %zu candidates\n", received, count);
+    }
+
+    mem_free(text);
+    return received;
+}
+
+// Function to let the user pick a candidate on the terminal; returns 0 if not interactive
+int choose_candidate(const struct Candidate *candidates, size_t count, size_t *choice) {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        return 0;
+    }
+
+    printf("\n");
+    for (size_t i = 0; i < count; i++) {
+        printf("  [%zu] %s\n", i + 1, candidates[i].title);
+    }
+
+    char line[32];
+    for (;;) {
+        printf("\nPick a message [1-%zu] (default 1): ", count);
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin)) {
+            *choice = 0;
+            break;
+        }
+
+        char *end = NULL;
+        long picked = strtol(line, &end, 10);
+        if (end == line && (*end == '\n' || *end == '\0')) {
+            *choice = 0;
+            break;
+        }
+        if (end != line && (*end == '\n' || *end == '\0') && picked >= 1 && (size_t)picked <= count) {
+            *choice = (size_t)picked - 1;
+            break;
+        }
+        printf("Please enter a number from 1 to %zu", count);
+    }
+    printf("\n");
+    return 1;
+}
+
+// Function to print every candidate
+void print_candidates(const struct Candidate *candidates, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        printf("CANDIDATE %zu\n", i + 1);
+        printf("TITLE: %s\n\n", candidates[i].title);
+        printf("DESCRIPTION:\n%s\n\n", candidates[i].description);
+    }
+}
+
+// Function to save every candidate, separated by "---" lines
+int save_candidates_to_file(const char *file_path, const struct Candidate *candidates, size_t count) {
+    FILE *file = fopen(file_path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open output file: %s (%s)\n", file_path, strerror(errno));
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "%s# %s\n\n%s\n", i > 0 ? "\n---\n\n" : "",
+                candidates[i].title, candidates[i].description);
+    }
+    fclose(file);
+
+    printf("Results saved to: %s\n", file_path);
+    return 1;
+}
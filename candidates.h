@@ -0,0 +1,38 @@
+/**
+ * Claude API Client - Several candidate messages from one request
+ *
+ * --candidates N asks for N alternative titles and descriptions in a single
+ * request instead of running the tool again for each: the usual prompt,
+ * followed by instructions to answer with N sections that each start with
+ * a "=== CANDIDATE <n> ===" line. The wall time is one round trip with a
+ * longer answer, not N round trips.
+ *
+ * When stdin and stdout are terminals the candidates are listed and the
+ * one picked is printed and saved to -o like a single result. Otherwise
+ * all of them are printed, and -o gets all of them, separated by "---"
+ * lines.
+ */
+
+#ifndef CANDIDATES_H
+#define CANDIDATES_H
+
+#include <stddef.h>
+
+/* Most candidates asked for in one request */
+#define CANDIDATES_MAX 8
+
+/* Output tokens allowed per candidate */
+#define CANDIDATES_OUTPUT_TOKENS 512
+
+struct Candidate {
+    char *title;
+    char *description;
+};
+
+size_t request_candidates(const char *api_key, const char *profile, const char *git_diff,
+                          size_t count, struct Candidate *candidates);
+int choose_candidate(const struct Candidate *candidates, size_t count, size_t *choice);
+void print_candidates(const struct Candidate *candidates, size_t count);
+int save_candidates_to_file(const char *file_path, const struct Candidate *candidates, size_t count);
+
+#endif /* CANDIDATES_H */
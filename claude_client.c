@@ -0,0 +1,1364 @@
+/**
+ * Claude API Client - C Implementation
+ *
+ * Request construction, transport and response parsing for the Claude
+ * Messages API. The command line front end lives in main.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdarg.h>
+#include <pwd.h>
+
+#include "claude_client.h"
+#include "replay.h"
+#include "symbols.h"
+#include "openai.h"
+#include "ledger.h"
+#include "eventlog.h"
+#include "latency.h"
+#include "keypool.h"
+#include "probes.h"
+
+/* Debug mode flag */
+int debug_mode = 0;
+
+/* Base URL of the Messages API; overridden with -u or ANTHROPIC_BASE_URL */
+const char *api_base_url = DEFAULT_API_BASE_URL;
+
+/* Model named in every request; overridden with --model */
+const char *api_model = DEFAULT_MODEL;
+
+/* Monotonic time (ms) by which the API call must finish, or 0 (--deadline) */
+long long api_deadline_ms = 0;
+
+// Function to read the monotonic clock in milliseconds
+long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000L;
+}
+
+// Function to get the time left before api_deadline_ms: -1 without a deadline
+long deadline_remaining_ms(void) {
+    if (!api_deadline_ms) {
+        return -1;
+    }
+    long long left = api_deadline_ms - monotonic_ms();
+    return left > 0 ? (long)left : 0;
+}
+
+// Function to make sure a memory buffer can hold `needed` bytes plus a terminator
+int memory_reserve(struct MemoryStruct *mem, size_t needed) {
+    if (needed < mem->capacity) {
+        return 1;
+    }
+
+    char *ptr = mem_realloc(mem->memory, needed + 1);
+    if (!ptr) {
+        fprintf(stderr, "Error: Not enough memory (realloc returned NULL)\n");
+        return 0;
+    }
+
+    mem->memory = ptr;
+    mem->capacity = needed + 1;
+    mem->memory[mem->size] = 0;
+    return 1;
+}
+
+// Callback function for cURL to write received data
+size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
+
+    // Grow geometrically unless the buffer was already sized from Content-Length
+    if (mem->size + realsize + 1 > mem->capacity) {
+        size_t target = mem->capacity ? mem->capacity * 2 : RESPONSE_INITIAL_CAPACITY;
+        if (target < mem->size + realsize + 1) {
+            target = mem->size + realsize + 1;
+        }
+        if (!memory_reserve(mem, target - 1)) {
+            return 0;
+        }
+        mem->reallocs++;
+    }
+
+    memcpy(&(mem->memory[mem->size]), contents, realsize);
+    mem->size += realsize;
+    mem->memory[mem->size] = 0;
+    mem->chunks++;
+
+    return realsize;
+}
+
+// Callback function for cURL header lines; sizes the buffer from Content-Length
+size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    size_t realsize = size * nitems;
+    struct MemoryStruct *mem = (struct MemoryStruct *)userdata;
+    static const char name[] = "content-length:";
+    const size_t name_len = sizeof(name) - 1;
+
+    if (realsize <= name_len) {
+        return realsize;
+    }
+
+    for (size_t i = 0; i < name_len; i++) {
+        char c = buffer[i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (c != name[i]) return realsize;
+    }
+
+    size_t length = 0;
+    size_t i = name_len;
+    while (i < realsize && (buffer[i] == ' ' || buffer[i] == '\t')) i++;
+    while (i < realsize && buffer[i] >= '0' && buffer[i] <= '9') {
+        length = length * 10 + (size_t)(buffer[i] - '0');
+        if (length > RESPONSE_MAX_PREALLOC) {
+            // Don't trust absurd lengths; geometric growth handles the rest
+            length = RESPONSE_MAX_PREALLOC;
+            break;
+        }
+        i++;
+    }
+
+    if (length > 0 && memory_reserve(mem, length)) {
+        debug_print("Preallocated %zu bytes from Content-Length", length);
+    }
+    return realsize;
+}
+
+/* Function for string duplication (strdup might not be available in C99) */
+char* str_duplicate(const char *str) {
+    if (str == NULL) return NULL;
+
+    size_t len = strlen(str) + 1;
+    char *dup = mem_alloc(len);
+    if (dup != NULL) {
+        memcpy(dup, str, len);
+    }
+    return dup;
+}
+
+/* Get home directory */
+const char* get_home_dir(void) {
+    const char *home_dir;
+
+    // Get home directory
+    if ((home_dir = getenv("HOME")) == NULL) {
+        struct passwd *pwd = getpwuid(getuid());
+        if (pwd == NULL) {
+            fprintf(stderr, "Error: Could not determine home directory\n");
+            return NULL;
+        }
+        home_dir = pwd->pw_dir;
+    }
+
+    return home_dir;
+}
+
+/* Get default profile path */
+char* get_default_profile_path(void) {
+    const char *home_dir = get_home_dir();
+    if (!home_dir) return NULL;
+
+    // Construct the default profile path
+    size_t path_len = strlen(home_dir) + strlen("/.config/claude/profile.txt") + 1;
+    char *path = mem_alloc(path_len);
+    if (path == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for default profile path\n");
+        return NULL;
+    }
+
+    snprintf(path, path_len, "%s/.config/claude/profile.txt", home_dir);
+    return path;
+}
+
+/* Get default API key path */
+char* get_default_api_key_path(void) {
+    const char *home_dir = get_home_dir();
+    if (!home_dir) return NULL;
+
+    // Construct the default API key path
+    size_t path_len = strlen(home_dir) + strlen("/.config/claude/api_key.txt") + 1;
+    char *path = mem_alloc(path_len);
+    if (path == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for default API key path\n");
+        return NULL;
+    }
+
+    snprintf(path, path_len, "%s/.config/claude/api_key.txt", home_dir);
+    return path;
+}
+
+/* Debug print function: records the event, formatted when the log is flushed */
+void debug_print(const char *format, ...) {
+    if (!debug_mode && !event_log_path) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    event_log_record(format, args);
+    va_end(args);
+}
+
+// Function to check if a file exists
+int file_exists(const char* file_path) {
+    return access(file_path, F_OK) == 0;
+}
+
+// Function to read file contents into a string
+char* read_file(const char* file_path) {
+    PROBE1(read_file__start, file_path);
+    FILE *file = fopen(file_path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open file: %s (%s)\n",
+                file_path, strerror(errno));
+        return NULL;
+    }
+
+    debug_print("Opened file: %s", file_path);
+
+    // Get file size
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    debug_print("File size: %ld bytes", file_size);
+
+    // Allocate memory for the file content
+    char *buffer = mem_alloc(file_size + 1);
+    if (!buffer) {
+        fprintf(stderr, "Error: Memory allocation failed for file content\n");
+        fclose(file);
+        return NULL;
+    }
+
+    // Read file content
+    size_t read_size = fread(buffer, 1, file_size, file);
+    buffer[read_size] = '\0';  // Null-terminate the string
+
+    if (read_size != (size_t)file_size) {
+        fprintf(stderr, "Warning: Read %zu bytes, expected %ld bytes\n",
+                read_size, file_size);
+    }
+
+    fclose(file);
+    PROBE2(read_file__done, file_path, read_size);
+    return buffer;
+}
+
+// Function to trim whitespace from a string
+void trim_string(char *str) {
+    if (!str) return;
+
+    // Trim leading whitespace
+    char *start = str;
+    while (*start && (*start == ' ' || *start == '\n' || *start == '\r' || *start == '\t')) {
+        start++;
+    }
+
+    if (start != str) {
+        memmove(str, start, strlen(start) + 1);
+    }
+
+    // Trim trailing whitespace
+    char *end = str + strlen(str) - 1;
+    while (end > str && (*end == ' ' || *end == '\n' || *end == '\r' || *end == '\t')) {
+        *end = '\0';
+        end--;
+    }
+
+    debug_print("Trimmed string to %zu characters", strlen(str));
+}
+
+// Function to read API key from file
+char* read_api_key(const char* file_path) {
+    char *api_key = read_file(file_path);
+    if (api_key) {
+        trim_string(api_key);
+        debug_print("Successfully read API key (length: %zu)", strlen(api_key));
+    }
+    return api_key;
+}
+
+// Function to join the API base URL and an endpoint path
+char* build_api_url(const char* base_url, const char* path) {
+    if (!base_url || !*base_url) {
+        base_url = DEFAULT_API_BASE_URL;
+    }
+
+    // Drop trailing slashes so "http://host:port/" and "http://host:port" both work
+    size_t base_len = strlen(base_url);
+    while (base_len > 0 && base_url[base_len - 1] == '/') {
+        base_len--;
+    }
+
+    size_t url_len = base_len + strlen(path) + 1;
+    char *url = mem_alloc(url_len);
+    if (!url) {
+        fprintf(stderr, "Error: Memory allocation failed for API URL\n");
+        return NULL;
+    }
+
+    snprintf(url, url_len, "%.*s%s", (int)base_len, base_url, path);
+    return url;
+}
+
+// Function to build the user prompt from the profile and git diff
+char* build_prompt(const char* profile, const char* git_diff) {
+    PROBE(prompt__start);
+
+    // Construct the content string
+    const char *content_template = "Here is my profile:\n\n%s\n\nHere is a git diff that needs review:\n\n%s\n\nPlease provide a concise title and description of the changes.";
+    const char *digest_template = "Here is my profile:\n\n%s\n\nHere is a summary of the symbols changed by the diff:\n\n%s\nHere is a git diff that needs review:\n\n%s\n\nPlease provide a concise title and description of the changes.";
+    const char *compact_template = "Here is my profile:\n\n%s\n\nHere is a summary of the symbols changed by the diff:\n\n%s\nHere is the git diff that needs review, with context lines dropped and long hunks shortened:\n\n%s\n\nPlease provide a concise title and description of the changes.";
+
+    // With --digest, put the changed symbols in front of the (condensed) diff
+    char *digest = NULL;
+    char *condensed = NULL;
+    if (digest_mode != DIGEST_OFF) {
+        digest = build_symbol_digest(git_diff);
+        if (!digest) {
+            return NULL;
+        }
+        if (!*digest) {
+            debug_print("No changed symbols found, sending the diff as is");
+        } else if (digest_mode == DIGEST_COMPACT) {
+            condensed = compact_diff(git_diff);
+            if (!condensed) {
+                mem_free(digest);
+                return NULL;
+            }
+        }
+    }
+
+    // Calculate the length needed for the content string
+    int content_len;
+    if (condensed) {
+        content_len = snprintf(NULL, 0, compact_template, profile, digest, condensed);
+    } else if (digest && *digest) {
+        content_len = snprintf(NULL, 0, digest_template, profile, digest, git_diff);
+    } else {
+        content_len = snprintf(NULL, 0, content_template, profile, git_diff);
+    }
+    if (content_len < 0) {
+        fprintf(stderr, "Error: Failed to format content string\n");
+        mem_free(condensed);
+        mem_free(digest);
+        return NULL;
+    }
+
+    char *content = mem_alloc((size_t)content_len + 1);
+    if (!content) {
+        fprintf(stderr, "Error: Memory allocation failed for content string\n");
+        mem_free(condensed);
+        mem_free(digest);
+        return NULL;
+    }
+
+    // Format the content string
+    if (condensed) {
+        snprintf(content, (size_t)content_len + 1, compact_template, profile, digest, condensed);
+    } else if (digest && *digest) {
+        snprintf(content, (size_t)content_len + 1, digest_template, profile, digest, git_diff);
+    } else {
+        snprintf(content, (size_t)content_len + 1, content_template, profile, git_diff);
+    }
+    debug_print("Content length: %d bytes", content_len);
+    PROBE1(prompt__done, content_len);
+
+    mem_free(condensed);
+    mem_free(digest);
+    return content;
+}
+
+// Function to build a Messages API request payload around one user message
+cJSON* build_message_payload(const char* content, int max_tokens) {
+    // Create payload as JSON
+    cJSON *root = cJSON_CreateObject();
+    if (!root) {
+        fprintf(stderr, "Error: Failed to create JSON object\n");
+        return NULL;
+    }
+
+    cJSON_AddStringToObject(root, "model", api_model);
+    cJSON_AddNumberToObject(root, "max_tokens", max_tokens);
+    cJSON_AddNumberToObject(root, "temperature", 0.5);
+
+    cJSON *messages = cJSON_AddArrayToObject(root, "messages");
+    if (!messages) {
+        fprintf(stderr, "Error: Failed to create JSON array\n");
+        cJSON_Delete(root);
+        return NULL;
+    }
+
+    cJSON *message = cJSON_CreateObject();
+    if (!message) {
+        fprintf(stderr, "Error: Failed to create JSON message object\n");
+        cJSON_Delete(root);
+        return NULL;
+    }
+    cJSON_AddItemToArray(messages, message);
+
+    cJSON_AddStringToObject(message, "role", "user");
+
+    if (!cJSON_AddStringToObject(message, "content", content)) {
+        fprintf(stderr, "Error: Failed to add content to JSON message\n");
+        cJSON_Delete(root);
+        return NULL;
+    }
+
+    return root;
+}
+
+// Function to build the Messages API request payload
+cJSON* build_request_payload(const char* profile, const char* git_diff) {
+    char *content = build_prompt(profile, git_diff);
+    if (!content) {
+        return NULL;
+    }
+
+    cJSON *root = build_message_payload(content, REQUEST_MAX_TOKENS);
+    mem_free(content);
+    return root;
+}
+
+/* Backends, in the order --backend lists them */
+static const struct ApiBackend *const backends[] = { &anthropic_backend, &openai_backend };
+
+/* Backend requests are sent to (--backend) */
+const struct ApiBackend *api_backend = &anthropic_backend;
+
+// Function to look up a backend by its --backend name
+const struct ApiBackend* find_backend(const char *name) {
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            return backends[i];
+        }
+    }
+    fprintf(stderr, "Error: Unknown backend: %s (use anthropic or openai)\n", name);
+    return NULL;
+}
+
+// Function to add a "name: value" header of any length to a cURL header list
+struct curl_slist* append_header(struct curl_slist *headers, const char *name, const char *value) {
+    size_t len = strlen(name) + strlen(value) + 3;
+    char *line = mem_alloc(len);
+    if (!line) {
+        fprintf(stderr, "Error: Memory allocation failed for a request header\n");
+        return headers;
+    }
+    snprintf(line, len, "%s: %s", name, value);
+    struct curl_slist *appended = curl_slist_append(headers, line);  // copies line
+    mem_free(line);
+    return appended ? appended : headers;
+}
+
+static struct curl_slist* anthropic_add_headers(struct curl_slist *headers, const char *api_key) {
+    headers = append_header(headers, "x-api-key", api_key);
+    return curl_slist_append(headers, "anthropic-version: 2023-06-01");
+}
+
+static char* anthropic_print_payload(const cJSON *payload) {
+    return cJSON_Print(payload);
+}
+
+/* The response is read into a MemoryStruct, sized from Content-Length when known */
+static void* anthropic_reader_open(void) {
+    struct MemoryStruct *chunk = mem_calloc(1, sizeof(*chunk));
+    if (!chunk) {
+        fprintf(stderr, "Error: Memory allocation failed for response\n");
+    }
+    return chunk;
+}
+
+static size_t anthropic_reader_write(void *contents, size_t size, size_t nmemb, void *reader) {
+    PROBE1(chunk, size * nmemb);
+    return WriteMemoryCallback(contents, size, nmemb, reader);
+}
+
+static size_t anthropic_reader_header(char *buffer, size_t size, size_t nitems, void *reader) {
+    return HeaderCallback(buffer, size, nitems, reader);
+}
+
+static char* anthropic_reader_close(void *reader, long http_code) {
+    struct MemoryStruct *chunk = reader;
+    char *body = NULL;
+
+    // Make sure there is a terminated buffer even for an empty body
+    if (http_code && memory_reserve(chunk, 0)) {
+        // Hand the buffer over to the caller instead of copying it
+        body = chunk->memory;
+        chunk->memory = NULL;
+        debug_print("API response received (length: %zu, %zu chunks, %zu reallocations)",
+                    chunk->size, chunk->chunks, chunk->reallocs);
+    }
+
+    mem_free(chunk->memory);
+    mem_free(chunk);
+    return body;
+}
+
+/* The Messages API, as described throughout this file */
+const struct ApiBackend anthropic_backend = {
+    "anthropic", "/v1/messages", DEFAULT_API_BASE_URL, 1,
+    anthropic_add_headers, anthropic_print_payload,
+    anthropic_reader_open, anthropic_reader_write, anthropic_reader_header, anthropic_reader_close
+};
+
+/*
+ * Create a cURL handle for url with the API headers, the timeouts (a
+ * --deadline budget replaces the defaults) and verbose output in debug mode.
+ * body is sent as a POST; NULL makes it a GET.
+ */
+CURL* open_api_handle(const struct ApiBackend *backend, const char* api_key,
+                      const char* url, const char* body, struct curl_slist **headers) {
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        fprintf(stderr, "Error: Failed to initialize cURL\n");
+        return NULL;
+    }
+
+    debug_print("cURL initialized");
+    debug_print("API endpoint: %s", url);
+
+    // Set cURL options
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+
+    // Set HTTP headers
+    *headers = NULL;
+    if (body) {
+        *headers = curl_slist_append(*headers, "Content-Type: application/json");
+    }
+
+    *headers = backend->add_headers(*headers, api_key);
+
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, *headers);
+
+    // Set request data
+    if (body) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+    }
+
+    // Set timeouts; a --deadline budget replaces the defaults
+    long budget_ms = deadline_remaining_ms();
+    if (budget_ms >= 0) {
+        budget_ms = budget_ms > 0 ? budget_ms : 1;
+        debug_print("Deadline: %ld ms left for the request", budget_ms);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, budget_ms);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, budget_ms < 10000L ? budget_ms : 10000L);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 120L); // 2 minute timeout
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L); // 10 seconds to connect
+    }
+
+    // Enable verbose output in debug mode
+    if (debug_mode) {
+        curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+    }
+
+    return curl;
+}
+
+/*
+ * Run the transfer; returns 1 and sets *http_code if a response was
+ * received. With transfer, also fills in cURL's phase timings.
+ */
+static int run_api_handle(CURL *curl, long *http_code, struct LatencyTransfer *transfer) {
+    debug_print("Sending API request...");
+
+    // Remember the request time
+    time_t request_start = time(NULL);
+
+    // Perform the request
+    PROBE(http__start);
+    CURLcode res = curl_easy_perform(curl);
+
+    // Calculate request duration
+    time_t request_end = time(NULL);
+    debug_print("API request completed in %ld seconds", (long)(request_end - request_start));
+
+    // Check for errors
+    if (res != CURLE_OK) {
+        fprintf(stderr, "Error: cURL request failed: %s\n", curl_easy_strerror(res));
+        return 0;
+    }
+
+    // Get HTTP response code
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_code);
+    PROBE1(http__done, *http_code);
+
+    if (transfer) {
+        curl_off_t connect = 0, tls = 0, ttfb = 0, total = 0;
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+        transfer->connect_us = (long long)connect;
+        transfer->tls_us = tls > 0 ? (long long)(tls - connect) : -1;  // 0 without TLS
+        transfer->ttfb_us = (long long)ttfb;
+        transfer->total_us = (long long)total;
+    }
+    return 1;
+}
+
+/* Header callback that also reads the rate limit headers for the key pool */
+struct HeaderTap {
+    size_t (*header_fn)(char *, size_t, size_t, void *);
+    void *header_data;
+    struct RateLimitHeaders *limits;
+};
+
+static size_t tap_header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    struct HeaderTap *tap = userdata;
+    rate_limit_header(tap->limits, buffer, size * nitems);
+    return tap->header_fn(buffer, size, nitems, tap->header_data);
+}
+
+/*
+ * Send the request over HTTP; returns 1 if a response was received. With
+ * limits, the rate limit headers of the response are stored there.
+ */
+static int perform_http_request(const char* api_key, const char* json_string, void *reader,
+                                long *http_code, struct LatencyTransfer *transfer,
+                                struct RateLimitHeaders *limits) {
+    int transferred = 0;
+
+    // Build the endpoint URL from the configured base URL
+    char *url = build_api_url(api_base_url, api_backend->path);
+    if (!url) {
+        return 0;
+    }
+
+    struct curl_slist *headers = NULL;
+    CURL *curl = open_api_handle(api_backend, api_key, url, json_string, &headers);
+    if (!curl) {
+        mem_free(url);
+        return 0;
+    }
+
+    // Capture the exchange if recording was requested
+    struct Recorder *recorder = NULL;
+    if (record_dir) {
+        recorder = recorder_open(record_dir, json_string, api_backend->reader_write, reader,
+                                 api_backend->reader_header, reader);
+        if (!recorder) {
+            curl_slist_free_all(headers);
+            curl_easy_cleanup(curl);
+            mem_free(url);
+            return 0;
+        }
+    }
+
+    // Set write function
+    if (recorder) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, recorder_write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)recorder);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, recorder_header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *)recorder);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, api_backend->reader_write);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, reader);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, api_backend->reader_header);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, reader);
+    }
+    struct HeaderTap tap;
+    if (limits) {
+        tap.header_fn = recorder ? recorder_header_callback : api_backend->reader_header;
+        tap.header_data = recorder ? (void *)recorder : reader;
+        tap.limits = limits;
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, tap_header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *)&tap);
+    }
+
+    transferred = run_api_handle(curl, http_code, transfer);
+
+    if (recorder) {
+        recorder_close(recorder, transferred ? *http_code : 0);
+    }
+
+    // Clean up
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    mem_free(url);
+
+    return transferred;
+}
+
+/*
+ * Function to send a request to another API endpoint (path below the base
+ * URL). body is sent as a POST, NULL sends a GET. The response body goes to
+ * write_fn and the header lines to header_fn; without header_fn, a
+ * WriteMemoryCallback buffer is sized from Content-Length. Returns 1 if a
+ * response was received.
+ */
+int api_request(const char* api_key, const char* path, const char* body,
+                size_t (*write_fn)(void *, size_t, size_t, void *), void *write_data,
+                size_t (*header_fn)(char *, size_t, size_t, void *), void *header_data,
+                long *http_code) {
+    char *url = build_api_url(api_base_url, path);
+    if (!url) {
+        return 0;
+    }
+
+    // Only the Messages API has these endpoints
+    struct curl_slist *headers = NULL;
+    CURL *curl = open_api_handle(&anthropic_backend, api_key, url, body, &headers);
+    if (!curl) {
+        mem_free(url);
+        return 0;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_fn);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, write_data);
+    if (header_fn) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_fn);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, header_data);
+    } else if (write_fn == WriteMemoryCallback) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, write_data);
+    }
+
+    int transferred = run_api_handle(curl, http_code, NULL);
+
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    mem_free(url);
+
+    return transferred;
+}
+
+// Function to make a request to Claude API
+char* call_claude_api(const char* api_key, const char* profile, const char* git_diff) {
+    debug_print("Preparing API request");
+
+    cJSON *root = build_request_payload(profile, git_diff);
+    if (!root) {
+        return NULL;
+    }
+
+    ledger_diff_bytes = strlen(git_diff);
+    char *response = send_claude_request(api_key, root);
+    cJSON_Delete(root);
+    return response;
+}
+
+// Function to send a prepared payload to the backend and return the response body
+char* send_claude_request(const char* api_key, const cJSON* payload) {
+    PROBE(serialize__start);
+    char *json_string = api_backend->print_payload(payload);
+    if (!json_string) {
+        fprintf(stderr, "Error: Failed to convert JSON to string\n");
+        return NULL;
+    }
+
+    size_t json_len = strlen(json_string);
+    PROBE1(serialize__done, json_len);
+    debug_print("JSON request payload created (length: %zu)", json_len);
+
+    // With a key pool, a request refused for its key is tried again with another
+    int pooled = key_pool_size() > 0 && !replay_dir;
+    long estimated_tokens = (long)(json_len / 4) + 1;
+    size_t attempts = pooled ? key_pool_size() * KEY_POOL_RETRY_ROUNDS : 1;
+    const char *model = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(payload, "model"));
+    char *body = NULL;
+    long http_code = 0;
+    long long latency_ms = 0;
+    for (size_t attempt = 0; attempt < attempts; attempt++) {
+        const char *key = api_key;
+        int slot = -1;
+        struct RateLimitHeaders limits;
+        rate_limit_headers_init(&limits);
+        if (pooled) {
+            slot = key_pool_wait(estimated_tokens);
+            if (slot < 0) {
+                break;
+            }
+            key = key_pool_key(slot);
+            key_pool_begin(slot, estimated_tokens);
+        }
+
+        void *reader = api_backend->reader_open();
+        if (!reader) {
+            if (pooled) key_pool_finish(slot, estimated_tokens, 0, NULL);
+            break;
+        }
+
+        // Serve the response from a recording or send it over the network
+        long long start = monotonic_ms();
+        http_code = 0;
+        int transferred;
+        struct LatencyTransfer transfer = { -1, -1, -1, -1 };
+        if (replay_dir) {
+            transferred = replay_exchange(replay_dir, json_string, api_backend->reader_write, reader,
+                                          api_backend->reader_header, reader, &http_code);
+        } else {
+            transferred = perform_http_request(key, json_string, reader, &http_code, &transfer,
+                                               pooled ? &limits : NULL);
+        }
+
+        body = api_backend->reader_close(reader, transferred ? http_code : 0);
+        latency_ms = monotonic_ms() - start;
+        ledger_record(model, transferred ? http_code : 0, latency_ms, body);
+        if (transferred && !replay_dir) {
+            latency_add_transfer(model, ledger_diff_bytes, &transfer);
+        }
+        if (pooled) {
+            key_pool_finish(slot, estimated_tokens, transferred ? http_code : 0, &limits);
+        }
+
+        if (!pooled || !transferred || !key_pool_should_retry(http_code, attempt + 1)) {
+            break;
+        }
+        debug_print("HTTP %ld with key %d of the pool, trying another key", http_code, slot + 1);
+        mem_free(body);
+        body = NULL;
+    }
+
+    cJSON_free(json_string);
+    if (!body) {
+        return NULL;
+    }
+
+    debug_print("HTTP response code: %ld", http_code);
+    debug_print("%s backend answered in %lld ms", api_backend->name, latency_ms);
+
+    if (http_code < 200 || http_code >= 300) {
+        fprintf(stderr, "Error: API request failed with HTTP code %ld\n", http_code);
+        fprintf(stderr, "Response: %s\n", body);
+        mem_free(body);
+        return NULL;
+    }
+
+    return body;
+}
+
+/*
+ * Targeted response scanner
+ *
+ * parse_claude_response() only needs content[0].text and the usage block,
+ * so instead of building a cJSON DOM for the whole response we walk the
+ * JSON text once, skip every value we don't care about, and remember where
+ * the escaped text lives. The text is then unescaped straight into the
+ * caller's description buffer.
+ */
+
+#define JSON_MAX_DEPTH 64
+
+/* Cursor over the members of a JSON object */
+struct JsonCursor {
+    const char *p;
+    const char *end;
+    int first;
+};
+
+/* Result of scanning a Messages API response */
+struct ResponseScan {
+    int has_content;
+    int content_is_array;
+    int content_empty;
+    const char *text;       /* escaped text of content[0], not terminated */
+    size_t text_len;
+    int has_usage;
+    struct ClaudeUsage usage;
+    const char *error;      /* position of a syntax error, if any */
+};
+
+static const char* json_skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+/* p points at the opening quote; returns the position after the closing quote */
+static const char* json_skip_string(const char *p, const char *end) {
+    p++;
+    while (p < end) {
+        if (*p == '"') return p + 1;
+        if (*p == '\\') p++;
+        p++;
+    }
+    return NULL;
+}
+
+static const char* json_skip_value(const char *p, const char *end, int depth) {
+    p = json_skip_ws(p, end);
+    if (p >= end || depth > JSON_MAX_DEPTH) return NULL;
+
+    if (*p == '"') {
+        return json_skip_string(p, end);
+    }
+
+    if (*p == '{' || *p == '[') {
+        char close = (*p == '{') ? '}' : ']';
+        int is_object = (*p == '{');
+        p = json_skip_ws(p + 1, end);
+        if (p < end && *p == close) return p + 1;
+
+        while (p < end) {
+            if (is_object) {
+                if (*p != '"') return NULL;
+                p = json_skip_string(p, end);
+                if (!p) return NULL;
+                p = json_skip_ws(p, end);
+                if (p >= end || *p != ':') return NULL;
+                p++;
+            }
+            p = json_skip_value(p, end, depth + 1);
+            if (!p) return NULL;
+            p = json_skip_ws(p, end);
+            if (p < end && *p == ',') {
+                p = json_skip_ws(p + 1, end);
+                continue;
+            }
+            if (p < end && *p == close) return p + 1;
+            return NULL;
+        }
+        return NULL;
+    }
+
+    // Number or literal: consume until a structural character
+    const char *start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') {
+        p++;
+    }
+    return p > start ? p : NULL;
+}
+
+static int json_object_begin(struct JsonCursor *cursor, const char *p, const char *end) {
+    p = json_skip_ws(p, end);
+    if (p >= end || *p != '{') return 0;
+    cursor->p = p + 1;
+    cursor->end = end;
+    cursor->first = 1;
+    return 1;
+}
+
+/*
+ * Advance to the next member. Returns 1 with cursor->p at the value, 0 at the
+ * end of the object and -1 on a syntax error. The caller must move
+ * cursor->p past the value before calling again.
+ */
+static int json_object_next(struct JsonCursor *cursor, const char **key, size_t *key_len) {
+    const char *p = json_skip_ws(cursor->p, cursor->end);
+    if (p >= cursor->end) return -1;
+
+    if (*p == '}') {
+        cursor->p = p + 1;
+        return 0;
+    }
+    if (!cursor->first) {
+        if (*p != ',') {
+            cursor->p = p;
+            return -1;
+        }
+        p = json_skip_ws(p + 1, cursor->end);
+    }
+    cursor->first = 0;
+
+    if (p >= cursor->end || *p != '"') {
+        cursor->p = p;
+        return -1;
+    }
+    const char *key_end = json_skip_string(p, cursor->end);
+    if (!key_end) {
+        cursor->p = p;
+        return -1;
+    }
+    *key = p + 1;
+    *key_len = (size_t)(key_end - p - 2);
+
+    p = json_skip_ws(key_end, cursor->end);
+    if (p >= cursor->end || *p != ':') {
+        cursor->p = p;
+        return -1;
+    }
+    cursor->p = json_skip_ws(p + 1, cursor->end);
+    return 1;
+}
+
+static int json_key_is(const char *key, size_t key_len, const char *name) {
+    return strlen(name) == key_len && memcmp(key, name, key_len) == 0;
+}
+
+/* Scan the first element of the content array for its text field */
+static const char* scan_content(const char *p, const char *end, struct ResponseScan *scan) {
+    scan->content_is_array = 1;
+    p = json_skip_ws(p + 1, end);
+    if (p < end && *p == ']') {
+        scan->content_empty = 1;
+        return p + 1;
+    }
+
+    struct JsonCursor cursor;
+    if (json_object_begin(&cursor, p, end)) {
+        const char *key;
+        size_t key_len;
+        int rc;
+        while ((rc = json_object_next(&cursor, &key, &key_len)) == 1) {
+            if (json_key_is(key, key_len, "text") && cursor.p < end && *cursor.p == '"') {
+                const char *value_end = json_skip_string(cursor.p, end);
+                if (!value_end) return NULL;
+                scan->text = cursor.p + 1;
+                scan->text_len = (size_t)(value_end - cursor.p - 2);
+                cursor.p = value_end;
+            } else {
+                cursor.p = json_skip_value(cursor.p, end, 2);
+                if (!cursor.p) return NULL;
+            }
+        }
+        if (rc < 0) return NULL;
+        p = cursor.p;
+    } else {
+        p = json_skip_value(p, end, 1);
+        if (!p) return NULL;
+    }
+
+    // Skip the remaining elements
+    for (;;) {
+        p = json_skip_ws(p, end);
+        if (p >= end) return NULL;
+        if (*p == ']') return p + 1;
+        if (*p != ',') return NULL;
+        p = json_skip_value(p + 1, end, 1);
+        if (!p) return NULL;
+    }
+}
+
+/* Scan the usage object for token counts */
+static const char* scan_usage(const char *p, const char *end, struct ResponseScan *scan) {
+    struct JsonCursor cursor;
+    if (!json_object_begin(&cursor, p, end)) {
+        return json_skip_value(p, end, 1);
+    }
+
+    scan->has_usage = 1;
+    const char *key;
+    size_t key_len;
+    int rc;
+    while ((rc = json_object_next(&cursor, &key, &key_len)) == 1) {
+        long *field = NULL;
+        if (json_key_is(key, key_len, "input_tokens")) {
+            field = &scan->usage.input_tokens;
+        } else if (json_key_is(key, key_len, "output_tokens")) {
+            field = &scan->usage.output_tokens;
+        } else if (json_key_is(key, key_len, "cache_creation_input_tokens")) {
+            field = &scan->usage.cache_creation_input_tokens;
+        } else if (json_key_is(key, key_len, "cache_read_input_tokens")) {
+            field = &scan->usage.cache_read_input_tokens;
+        }
+        if (field && cursor.p < end && (*cursor.p == '-' || (*cursor.p >= '0' && *cursor.p <= '9'))) {
+            *field = strtol(cursor.p, NULL, 10);
+        }
+        cursor.p = json_skip_value(cursor.p, end, 2);
+        if (!cursor.p) return NULL;
+    }
+    return rc < 0 ? NULL : cursor.p;
+}
+
+static int scan_claude_response(const char *response, struct ResponseScan *scan) {
+    const char *end = response + strlen(response);
+    memset(scan, 0, sizeof(*scan));
+
+    struct JsonCursor cursor;
+    if (!json_object_begin(&cursor, response, end)) {
+        scan->error = json_skip_ws(response, end);
+        return 0;
+    }
+
+    const char *key;
+    size_t key_len;
+    int rc;
+    while ((rc = json_object_next(&cursor, &key, &key_len)) == 1) {
+        const char *next;
+        if (json_key_is(key, key_len, "content") && !scan->has_content) {
+            scan->has_content = 1;
+            next = (cursor.p < end && *cursor.p == '[') ? scan_content(cursor.p, end, scan)
+                                                        : json_skip_value(cursor.p, end, 1);
+        } else if (json_key_is(key, key_len, "usage") && !scan->has_usage) {
+            next = scan_usage(cursor.p, end, scan);
+        } else {
+            next = json_skip_value(cursor.p, end, 1);
+        }
+        if (!next) {
+            scan->error = cursor.p;
+            return 0;
+        }
+        cursor.p = next;
+    }
+
+    if (rc < 0) {
+        scan->error = cursor.p;
+        return 0;
+    }
+    return 1;
+}
+
+/* Append a code point as UTF-8 */
+static char* utf8_encode(char *out, unsigned long cp) {
+    if (cp < 0x80) {
+        *out++ = (char)cp;
+    } else if (cp < 0x800) {
+        *out++ = (char)(0xC0 | (cp >> 6));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = (char)(0xE0 | (cp >> 12));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (cp >> 18));
+        *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+static int parse_hex4(const char *p, const char *end, unsigned long *value) {
+    if (end - p < 4) return 0;
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        *value <<= 4;
+        if (c >= '0' && c <= '9') *value |= (unsigned long)(c - '0');
+        else if (c >= 'a' && c <= 'f') *value |= (unsigned long)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') *value |= (unsigned long)(c - 'A' + 10);
+        else return 0;
+    }
+    return 1;
+}
+
+/*
+ * Unescape a JSON string body into out (which must hold len + 1 bytes; the
+ * unescaped form is never longer). Stops at an embedded NUL like cJSON.
+ */
+static size_t json_unescape(const char *src, size_t len, char *out) {
+    const char *end = src + len;
+    char *start = out;
+
+    while (src < end) {
+        const char *run = src;
+        while (src < end && *src != '\\') src++;
+        memcpy(out, run, (size_t)(src - run));
+        out += src - run;
+        if (src >= end) break;
+
+        src++;
+        if (src >= end) break;
+        switch (*src) {
+            case 'n': *out++ = '\n'; break;
+            case 't': *out++ = '\t'; break;
+            case 'r': *out++ = '\r'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'u': {
+                unsigned long cp;
+                if (!parse_hex4(src + 1, end, &cp)) {
+                    *out++ = 'u';
+                    break;
+                }
+                src += 4;
+                if (cp >= 0xD800 && cp < 0xDC00 && end - src > 6 && src[1] == '\\' && src[2] == 'u') {
+                    unsigned long low;
+                    if (parse_hex4(src + 3, end, &low) && low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        src += 6;
+                    }
+                }
+                if (cp == 0) {
+                    *out = '\0';
+                    return (size_t)(out - start);
+                }
+                out = utf8_encode(out, cp);
+                break;
+            }
+            default: *out++ = *src; break;
+        }
+        src++;
+    }
+
+    *out = '\0';
+    return (size_t)(out - start);
+}
+
+// Function to parse Claude's response
+int parse_claude_response(const char* response, char** title, char** description) {
+    return parse_claude_response_with_usage(response, title, description, NULL);
+}
+
+/*
+ * Function to get the text of Claude's response, unescaped into a buffer
+ * the caller owns, and optionally its token usage; *text_len gets the length
+ */
+char* extract_response_text(const char* response, size_t* text_len, struct ClaudeUsage* usage) {
+    if (usage) {
+        memset(usage, 0, sizeof(*usage));
+    }
+
+    struct ResponseScan scan;
+    if (!scan_claude_response(response, &scan)) {
+        if (scan.error && *scan.error) {
+            fprintf(stderr, "Error: JSON parsing failed near: %s\n", scan.error);
+        } else {
+            fprintf(stderr, "Error: JSON parsing failed\n");
+        }
+        return NULL;
+    }
+
+    if (usage && scan.has_usage) {
+        *usage = scan.usage;
+        debug_print("Usage: %ld input, %ld output, %ld cache creation, %ld cache read tokens",
+                    usage->input_tokens, usage->output_tokens,
+                    usage->cache_creation_input_tokens, usage->cache_read_input_tokens);
+    }
+
+    if (!scan.has_content || !scan.content_is_array) {
+        fprintf(stderr, "Error: Invalid response format (content field not found or not an array)\n");
+        return NULL;
+    }
+
+    if (scan.content_empty) {
+        fprintf(stderr, "Error: Content array is empty\n");
+        return NULL;
+    }
+
+    if (!scan.text) {
+        fprintf(stderr, "Error: Text field not found or not a string\n");
+        return NULL;
+    }
+
+    // Unescape the text straight into the buffer that becomes the description
+    char *text = mem_alloc(scan.text_len + 1);
+    if (!text) {
+        fprintf(stderr, "Error: Memory allocation failed for description\n");
+        return NULL;
+    }
+    *text_len = json_unescape(scan.text, scan.text_len, text);
+
+    debug_print("Response text length: %zu bytes", *text_len);
+    return text;
+}
+
+// Function to read the token usage of a response; returns 0 if it has none
+int read_response_usage(const char* response, struct ClaudeUsage* usage) {
+    memset(usage, 0, sizeof(*usage));
+
+    struct ResponseScan scan;
+    if (!scan_claude_response(response, &scan) || !scan.has_usage) {
+        return 0;
+    }
+    *usage = scan.usage;
+    return 1;
+}
+
+/*
+ * Function to split response text into its first non-empty line (title) and
+ * the rest (description). Takes ownership of text, which becomes the
+ * description buffer.
+ */
+int split_response_text(char* text, size_t text_len, char** title, char** description) {
+    char *line_start = text;
+
+    // Skip empty lines at the beginning
+    while (*line_start && (*line_start == '\n' || *line_start == '\r')) {
+        line_start++;
+    }
+
+    // Find the end of the first non-empty line (title)
+    char *line_end = strchr(line_start, '\n');
+    if (line_end) {
+        size_t title_len = (size_t)(line_end - line_start);
+        *title = mem_alloc(title_len + 1);
+        if (!*title) {
+            fprintf(stderr, "Error: Memory allocation failed for title\n");
+            mem_free(text);
+            return 0;
+        }
+        memcpy(*title, line_start, title_len);
+        (*title)[title_len] = '\0';
+
+        debug_print("Title extracted: \"%s\"", *title);
+
+        // Description is everything after the title; move it to the front
+        size_t desc_len = text_len - (size_t)(line_end + 1 - text);
+        memmove(text, line_end + 1, desc_len + 1);
+        *description = text;
+
+        debug_print("Description extracted (length: %zu)", desc_len);
+    } else {
+        // Just one line in the response
+        debug_print("No newline found, using entire response as title");
+        if (line_start != text) {
+            memmove(text, line_start, strlen(line_start) + 1);
+        }
+        *title = text;
+        *description = str_duplicate("");
+        if (!*description) {
+            fprintf(stderr, "Error: Memory allocation failed for description\n");
+            mem_free(text);
+            *title = NULL;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Function to parse Claude's response and its token usage
+int parse_claude_response_with_usage(const char* response, char** title, char** description,
+                                     struct ClaudeUsage* usage) {
+    debug_print("Parsing API response");
+
+    if (!response || !title || !description) {
+        fprintf(stderr, "Error: Invalid parameters for response parsing\n");
+        return 0;
+    }
+
+    // Initialize output parameters
+    *title = NULL;
+    *description = NULL;
+
+    PROBE(parse__start);
+    long long parse_start = latency_enabled ? latency_now_us() : 0;
+    size_t text_len = 0;
+    char *text = extract_response_text(response, &text_len, usage);
+    int ok = text && split_response_text(text, text_len, title, description);
+    if (latency_enabled) {
+        latency_add_parse(latency_now_us() - parse_start);
+    }
+    PROBE2(parse__done, ok, text_len);
+    return ok;
+}
+
+// Function to save results to file
+int save_results_to_file(const char* file_path, const char* title, const char* description) {
+    if (!file_path || !title || !description) {
+        fprintf(stderr, "Error: Invalid parameters for saving results\n");
+        return 0;
+    }
+
+    PROBE1(save__start, file_path);
+    FILE *file = fopen(file_path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open output file: %s (%s)\n",
+                file_path, strerror(errno));
+        return 0;
+    }
+
+    int written = fprintf(file, "# %s\n\n%s", title, description);
+    fclose(file);
+    PROBE2(save__done, file_path, written);
+
+    printf("Results saved to: %s\n", file_path);
+    return 1;
+}
+
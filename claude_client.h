@@ -0,0 +1,133 @@
+/**
+ * Claude API Client - shared declarations
+ *
+ * Everything except the command line front end lives in claude_client.c so
+ * that other binaries (the benchmark suite in tools/) can link against the
+ * same request/response code the CLI uses.
+ *
+ * Strings and buffers returned by these functions are allocated with
+ * mem_alloc(): from the calling thread's active arena if there is one (see
+ * arena.h), otherwise from the heap. Release them with mem_free(), or all
+ * at once by resetting the arena.
+ */
+
+#ifndef CLAUDE_CLIENT_H
+#define CLAUDE_CLIENT_H
+
+#include <stddef.h>
+#include <cjson/cJSON.h>
+
+#include "arena.h"
+
+/* Default Messages API host; -u or ANTHROPIC_BASE_URL point elsewhere */
+#define DEFAULT_API_BASE_URL "https://api.anthropic.com"
+
+/* Debug mode flag */
+extern int debug_mode;
+
+/* Base URL the client sends requests to */
+extern const char *api_base_url;
+
+/* Model used unless --model or --route picks another */
+#define DEFAULT_MODEL "claude-3-7-sonnet-20250219"
+
+/* Model named in every request (--model) */
+extern const char *api_model;
+
+/* Monotonic time (ms) by which the API call must finish, or 0 (--deadline) */
+extern long long api_deadline_ms;
+
+/* max_tokens of a request for one diff */
+#define REQUEST_MAX_TOKENS 1024
+
+/* First allocation for a response without Content-Length */
+#define RESPONSE_INITIAL_CAPACITY 4096
+
+/* Upper bound on how much a Content-Length header may preallocate */
+#define RESPONSE_MAX_PREALLOC (64UL * 1024 * 1024)
+
+// Structure to hold memory buffer for CURL responses
+struct MemoryStruct {
+    char *memory;
+    size_t size;
+    size_t capacity;    /* bytes allocated, including the terminator */
+    size_t chunks;      /* write callbacks received */
+    size_t reallocs;    /* growth steps after the initial reservation */
+};
+
+struct curl_slist;
+
+/*
+ * A kind of server requests can be sent to. Requests are always built as
+ * Messages API payloads and answers are always handed back as Messages API
+ * response bodies, so build_prompt() and parse_claude_response() do not
+ * depend on the backend.
+ */
+struct ApiBackend {
+    const char *name;               /* --backend value */
+    const char *path;               /* endpoint below the base URL */
+    const char *default_base_url;
+    int needs_key;                  /* requests carry the API key file */
+    struct curl_slist* (*add_headers)(struct curl_slist *headers, const char *api_key);
+    /* Serialize a Messages payload for this server; release with cJSON_free() */
+    char* (*print_payload)(const cJSON *payload);
+    /* Per-request response state, fed through the cURL callbacks */
+    void* (*reader_open)(void);
+    size_t (*reader_write)(void *contents, size_t size, size_t nmemb, void *reader);
+    size_t (*reader_header)(char *buffer, size_t size, size_t nitems, void *reader);
+    /* Release the reader; returns a Messages API body for a 2xx, else the raw body */
+    char* (*reader_close)(void *reader, long http_code);
+};
+
+/* Backend requests are sent to (--backend) */
+extern const struct ApiBackend *api_backend;
+
+extern const struct ApiBackend anthropic_backend;
+
+/* Token counts from the usage block of a Messages API response */
+struct ClaudeUsage {
+    long input_tokens;
+    long output_tokens;
+    long cache_creation_input_tokens;
+    long cache_read_input_tokens;
+};
+
+/* Function declarations */
+const struct ApiBackend* find_backend(const char *name);
+char* str_duplicate(const char *str);
+const char* get_home_dir(void);
+char* get_default_profile_path(void);
+char* get_default_api_key_path(void);
+void debug_print(const char *format, ...);
+long long monotonic_ms(void);
+long deadline_remaining_ms(void);
+int file_exists(const char* file_path);
+char* read_file(const char* file_path);
+void trim_string(char *str);
+char* read_api_key(const char* file_path);
+char* build_api_url(const char* base_url, const char* path);
+struct curl_slist* append_header(struct curl_slist *headers, const char *name, const char *value);
+/* Returns a CURL easy handle; void* keeps curl.h out of this header */
+void* open_api_handle(const struct ApiBackend *backend, const char* api_key,
+                      const char* url, const char* body, struct curl_slist **headers);
+char* build_prompt(const char* profile, const char* git_diff);
+cJSON* build_message_payload(const char* content, int max_tokens);
+cJSON* build_request_payload(const char* profile, const char* git_diff);
+int memory_reserve(struct MemoryStruct *mem, size_t needed);
+size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp);
+size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata);
+char* call_claude_api(const char* api_key, const char* profile, const char* git_diff);
+char* send_claude_request(const char* api_key, const cJSON* payload);
+int api_request(const char* api_key, const char* path, const char* body,
+                size_t (*write_fn)(void *, size_t, size_t, void *), void *write_data,
+                size_t (*header_fn)(char *, size_t, size_t, void *), void *header_data,
+                long *http_code);
+char* extract_response_text(const char* response, size_t* text_len, struct ClaudeUsage* usage);
+int read_response_usage(const char* response, struct ClaudeUsage* usage);
+int split_response_text(char* text, size_t text_len, char** title, char** description);
+int parse_claude_response(const char* response, char** title, char** description);
+int parse_claude_response_with_usage(const char* response, char** title, char** description,
+                                     struct ClaudeUsage* usage);
+int save_results_to_file(const char* file_path, const char* title, const char* description);
+
+#endif /* CLAUDE_CLIENT_H */
@@ -0,0 +1,560 @@
+/**
+ * Claude API Client - In-memory debug event log
+ *
+ * See eventlog.h. A record is published seqlock style: the writer marks
+ * the slot busy with a compare-and-swap, fills it in and stores seq =
+ * position + 1 with release order. A writer that finds its slot busy (the
+ * ring lapped during another write) drops its event rather than wait. The
+ * flush accepts a slot only if seq matches before and after copying it and
+ * counts every other slot in range as dropped, so a slot being overwritten
+ * is never printed half old, half new.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "claude_client.h"
+#include "eventlog.h"
+
+/* Longest line written for one event; longer ones are cut */
+#define EVENT_LOG_MAX_LINE 1024
+
+/* Offset of the always empty string at the end of a record's strings */
+#define EVENT_LOG_EMPTY_STRING (EVENT_LOG_STRING_BYTES - 1)
+
+/* EVENT_LOG_RECORDS as text, for the dropped events line */
+#define EVENT_LOG_STRINGIFY(x) #x
+#define EVENT_LOG_TEXT(x) EVENT_LOG_STRINGIFY(x)
+#define EVENT_LOG_RECORDS_TEXT EVENT_LOG_TEXT(EVENT_LOG_RECORDS)
+
+/* seq of a slot being written */
+#define EVENT_LOG_BUSY (~0ULL)
+
+/* Offset standing for a NULL string argument */
+#define EVENT_LOG_NULL_STRING 0xFFFF
+
+/* One raw argument */
+union EventArg {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void *p;
+};
+
+/* One event: 128 bytes, two cache lines */
+struct EventRecord {
+    unsigned long long seq;         /* position + 1 once published, or busy */
+    unsigned long long time_ns;     /* since the log was installed */
+    const char *format;
+    union EventArg args[EVENT_LOG_MAX_ARGS];
+    unsigned char arg_count;        /* below the conversions in format: cut */
+    char strings[EVENT_LOG_STRING_BYTES];
+};
+
+/* A conversion of a format, as read at record and at flush time */
+struct FormatSpec {
+    const char *start;              /* the '%' */
+    const char *end;                /* past the conversion character */
+    char length;                    /* 'H' hh, 'h', 'l', 'q' ll, 'z', 'j', 't', 'L' or 0 */
+    char conversion;
+    int width_star;
+    int precision_star;
+    int precision;                  /* digits after '.', -1 without */
+};
+
+/* File the events are appended to on flush, or NULL (--log-file) */
+const char *event_log_path = NULL;
+
+static struct EventRecord ring[EVENT_LOG_RECORDS];
+static unsigned long long ring_head = 0;        /* next position to claim */
+static unsigned long long ring_tail = 0;        /* first position not flushed */
+static unsigned long long epoch_ns = 0;
+static int flushing = 0;
+static int header_written = 0;
+static int file_failed = 0;
+
+static unsigned long long clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+/* Read the conversion at p (just past a '%'); returns 0 for unsupported ones */
+static int parse_spec(const char *p, struct FormatSpec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->start = p - 1;
+    spec->precision = -1;
+
+    while (*p && strchr("-+ #0", *p)) p++;
+    if (*p == '*') {
+        spec->width_star = 1;
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->precision_star = 1;
+            p++;
+        } else {
+            spec->precision = 0;
+            while (*p >= '0' && *p <= '9') spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+
+    if (p[0] == 'h' && p[1] == 'h') {
+        spec->length = 'H';
+        p += 2;
+    } else if (p[0] == 'l' && p[1] == 'l') {
+        spec->length = 'q';
+        p += 2;
+    } else if (*p && strchr("hlzjtL", *p)) {
+        spec->length = *p++;
+    }
+
+    if (!*p || !strchr("diuxXocspfFeEgG%", *p)) return 0;
+    spec->conversion = *p;
+    spec->end = p + 1;
+    return 1;
+}
+
+/* Argument slots a conversion takes */
+static int spec_arg_count(const struct FormatSpec *spec) {
+    if (spec->conversion == '%') return 0;
+    return 1 + spec->width_star + spec->precision_star;
+}
+
+static long long read_signed(const struct FormatSpec *spec, va_list *args) {
+    switch (spec->length) {
+        case 'l': return va_arg(*args, long);
+        case 'q': return va_arg(*args, long long);
+        case 'z': return (long long)va_arg(*args, size_t);
+        case 'j': return (long long)va_arg(*args, intmax_t);
+        case 't': return (long long)va_arg(*args, ptrdiff_t);
+        default: return va_arg(*args, int);
+    }
+}
+
+static unsigned long long read_unsigned(const struct FormatSpec *spec, va_list *args) {
+    switch (spec->length) {
+        case 'l': return va_arg(*args, unsigned long);
+        case 'q': return va_arg(*args, unsigned long long);
+        case 'z': return va_arg(*args, size_t);
+        case 'j': return (unsigned long long)va_arg(*args, uintmax_t);
+        case 't': return (unsigned long long)va_arg(*args, ptrdiff_t);
+        case 'H': return (unsigned char)va_arg(*args, unsigned int);
+        case 'h': return (unsigned short)va_arg(*args, unsigned int);
+        default: return va_arg(*args, unsigned int);
+    }
+}
+
+/* Copy a string argument into the record; returns its offset */
+static unsigned long long copy_string(struct EventRecord *record, size_t *used,
+                                      const char *text, long long precision) {
+    if (!text) return EVENT_LOG_NULL_STRING;
+    if (*used >= EVENT_LOG_EMPTY_STRING) return EVENT_LOG_EMPTY_STRING;
+
+    size_t room = EVENT_LOG_EMPTY_STRING - *used;
+    if (precision >= 0 && (unsigned long long)precision < room) room = (size_t)precision;
+    size_t len = strnlen(text, room);
+    size_t offset = *used;
+    memcpy(record->strings + offset, text, len);
+    record->strings[offset + len] = '\0';
+    *used = offset + len + 1;
+    return offset;
+}
+
+// Function to store one event in the ring
+void event_log_record(const char *format, va_list args) {
+    unsigned long long pos = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+    struct EventRecord *record = &ring[pos & (EVENT_LOG_RECORDS - 1)];
+
+    unsigned long long seq = __atomic_load_n(&record->seq, __ATOMIC_RELAXED);
+    if (seq == EVENT_LOG_BUSY ||
+        !__atomic_compare_exchange_n(&record->seq, &seq, EVENT_LOG_BUSY, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->time_ns = clock_ns() - epoch_ns;
+    record->format = format;
+    record->strings[EVENT_LOG_EMPTY_STRING] = '\0';
+
+    va_list ap;
+    va_copy(ap, args);
+    int count = 0;
+    size_t used = 0;
+    for (const char *p = format; *p; p++) {
+        if (*p != '%') continue;
+        struct FormatSpec spec;
+        if (!parse_spec(p + 1, &spec) || count + spec_arg_count(&spec) > EVENT_LOG_MAX_ARGS) {
+            break;
+        }
+        p = spec.end - 1;
+
+        long long precision = spec.precision;
+        if (spec.width_star) record->args[count++].i = va_arg(ap, int);
+        if (spec.precision_star) precision = record->args[count++].i = va_arg(ap, int);
+
+        switch (spec.conversion) {
+            case 'd': case 'i':
+                record->args[count++].i = read_signed(&spec, &ap);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                record->args[count++].u = read_unsigned(&spec, &ap);
+                break;
+            case 'c':
+                record->args[count++].i = va_arg(ap, int);
+                break;
+            case 's':
+                record->args[count++].u = copy_string(record, &used, va_arg(ap, const char *), precision);
+                break;
+            case 'p':
+                record->args[count++].p = va_arg(ap, void *);
+                break;
+            case '%':
+                break;
+            default:
+                record->args[count++].d = spec.length == 'L' ? (double)va_arg(ap, long double) :
+                                                               va_arg(ap, double);
+                break;
+        }
+    }
+    va_end(ap);
+    record->arg_count = (unsigned char)count;
+
+    __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* Append the digits of value in base 8, 10 or 16, zero padded to width; returns the new end */
+static char* put_digits(char *out, unsigned long long value, unsigned base, const char *symbols, int width) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = symbols[value % base];
+        value /= base;
+    } while (value > 0);
+    while (n < width) digits[n++] = '0';
+    while (n > 0) *out++ = digits[--n];
+    return out;
+}
+
+static char* put_number(char *out, unsigned long long value, int width) {
+    return put_digits(out, value, 10, "0123456789", width);
+}
+
+/* Format one record the way printf would have; returns the length */
+static size_t format_record(const struct EventRecord *record, char *line, size_t size) {
+    size_t len = (size_t)snprintf(line, size, "[DEBUG +%llu.%03llums] ",
+                                  record->time_ns / 1000000ULL, record->time_ns / 1000ULL % 1000ULL);
+    int next = 0;
+    const char *p = record->format;
+
+    while (*p && len + 1 < size) {
+        if (*p != '%') {
+            line[len++] = *p++;
+            continue;
+        }
+        struct FormatSpec spec;
+        if (!parse_spec(p + 1, &spec) || next + spec_arg_count(&spec) > record->arg_count) {
+            len += (size_t)snprintf(line + len, size - len, "...");
+            break;
+        }
+        p = spec.end;
+        if (spec.conversion == '%') {
+            line[len++] = '%';
+            continue;
+        }
+
+        // Rebuild the conversion with literal widths and one length per type
+        char conversion[48];
+        size_t clen = 0;
+        for (const char *q = spec.start; q < spec.end - 1 && clen + 24 < sizeof(conversion); q++) {
+            if (*q == '*') {
+                clen += (size_t)snprintf(conversion + clen, sizeof(conversion) - clen, "%lld",
+                                         record->args[next++].i);
+            } else if (!strchr("hlzjtL", *q)) {
+                conversion[clen++] = *q;
+            }
+        }
+        if (strchr("diuxXo", spec.conversion)) {
+            conversion[clen++] = 'l';
+            conversion[clen++] = 'l';
+        }
+        conversion[clen++] = spec.conversion;
+        conversion[clen] = '\0';
+
+        const union EventArg *arg = &record->args[next++];
+        int n;
+        switch (spec.conversion) {
+            case 'd': case 'i': case 'c':
+                n = spec.conversion == 'c' ? snprintf(line + len, size - len, conversion, (int)arg->i) :
+                                             snprintf(line + len, size - len, conversion, arg->i);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                n = snprintf(line + len, size - len, conversion, arg->u);
+                break;
+            case 's':
+                n = snprintf(line + len, size - len, conversion,
+                             arg->u == EVENT_LOG_NULL_STRING ? "(null)" : record->strings + arg->u);
+                break;
+            case 'p':
+                n = snprintf(line + len, size - len, conversion, arg->p);
+                break;
+            default:
+                n = snprintf(line + len, size - len, conversion, arg->d);
+                break;
+        }
+        if (n > 0) len += (size_t)n;
+    }
+
+    if (len > size - 2) len = size - 2;
+    line[len++] = '\n';
+    return len;
+}
+
+/*
+ * Format one record without printf, for the signal handler: integers,
+ * strings and characters; flags and widths are ignored, floating point and
+ * pointers print as '?'. Returns the length.
+ */
+static size_t format_record_plain(const struct EventRecord *record, char *line, size_t size) {
+    char *p = line, *end = line + size - 32;    // room for a number and the newline
+    memcpy(p, "[DEBUG +", 8);
+    p = put_number(p + 8, record->time_ns / 1000000ULL, 0);
+    *p++ = '.';
+    p = put_number(p, record->time_ns / 1000ULL % 1000ULL, 3);
+    memcpy(p, "ms] ", 4);
+    p += 4;
+
+    int next = 0;
+    for (const char *f = record->format; *f && p < end; ) {
+        if (*f != '%') {
+            *p++ = *f++;
+            continue;
+        }
+        struct FormatSpec spec;
+        if (!parse_spec(f + 1, &spec) || next + spec_arg_count(&spec) > record->arg_count) {
+            memcpy(p, "...", 3);
+            p += 3;
+            break;
+        }
+        f = spec.end;
+        if (spec.conversion == '%') {
+            *p++ = '%';
+            continue;
+        }
+
+        long long precision = spec.precision;
+        if (spec.width_star) next++;
+        if (spec.precision_star) precision = record->args[next++].i;
+        const union EventArg *arg = &record->args[next++];
+        switch (spec.conversion) {
+            case 'd': case 'i':
+                if (arg->i < 0) *p++ = '-';
+                p = put_number(p, arg->i < 0 ? 0ULL - (unsigned long long)arg->i : (unsigned long long)arg->i, 0);
+                break;
+            case 'u':
+                p = put_number(p, arg->u, 0);
+                break;
+            case 'x':
+                p = put_digits(p, arg->u, 16, "0123456789abcdef", 0);
+                break;
+            case 'X':
+                p = put_digits(p, arg->u, 16, "0123456789ABCDEF", 0);
+                break;
+            case 'o':
+                p = put_digits(p, arg->u, 8, "01234567", 0);
+                break;
+            case 'c':
+                *p++ = (char)arg->i;
+                break;
+            case 's': {
+                const char *text = arg->u == EVENT_LOG_NULL_STRING ? "(null)" : record->strings + arg->u;
+                for (; *text && precision != 0 && p < end; precision--) *p++ = *text++;
+                break;
+            }
+            default:
+                *p++ = '?';
+                break;
+        }
+    }
+
+    *p++ = '\n';
+    return (size_t)(p - line);
+}
+
+static void write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+/* Write text to stderr with -v and to the log file */
+static void emit(int fd, const char *text, size_t len) {
+    if (debug_mode) write_all(STDERR_FILENO, text, len);
+    if (fd >= 0) write_all(fd, text, len);
+}
+
+/*
+ * Build the "# commit-ai pid <pid> at <UTC date>" header with arithmetic
+ * only: it is also written from a signal handler, where localtime() and
+ * snprintf() may deadlock on locks the interrupted code holds.
+ */
+static size_t format_header(char *out) {
+    static const char prefix[] = "# commit-ai pid ";
+    char *p = out;
+    memcpy(p, prefix, sizeof(prefix) - 1);
+    p = put_number(p + sizeof(prefix) - 1, (unsigned long long)getpid(), 0);
+    memcpy(p, " at ", 4);
+    p += 4;
+
+    // Civil date from days since 1970-01-01 (proleptic Gregorian calendar)
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    long long now = (long long)ts.tv_sec;
+    long long days = now / 86400, secs = now % 86400;
+    if (secs < 0) {
+        secs += 86400;
+        days--;
+    }
+    days += 719468;
+    long long era = (days >= 0 ? days : days - 146096) / 146097;
+    long long doe = days - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    long long day = doy - (153 * mp + 2) / 5 + 1;
+    long long month = mp < 10 ? mp + 3 : mp - 9;
+    long long year = yoe + era * 400 + (month <= 2);
+
+    p = put_number(p, (unsigned long long)year, 4);
+    *p++ = '-';
+    p = put_number(p, (unsigned long long)month, 2);
+    *p++ = '-';
+    p = put_number(p, (unsigned long long)day, 2);
+    *p++ = 'T';
+    p = put_number(p, (unsigned long long)(secs / 3600), 2);
+    *p++ = ':';
+    p = put_number(p, (unsigned long long)(secs / 60 % 60), 2);
+    *p++ = ':';
+    p = put_number(p, (unsigned long long)(secs % 60), 2);
+    *p++ = 'Z';
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+/* Write the events recorded since the last flush; in_signal avoids stdio */
+static void flush_events(int in_signal) {
+    // A fatal signal during a flush must not flush again
+    if (__atomic_exchange_n(&flushing, 1, __ATOMIC_ACQUIRE)) return;
+
+    unsigned long long head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    unsigned long long pos = ring_tail;
+    if (pos == head || (!debug_mode && !event_log_path)) {
+        ring_tail = head;
+        __atomic_store_n(&flushing, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    int fd = -1;
+    if (event_log_path && !file_failed) {
+        fd = open(event_log_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (fd < 0) {
+            file_failed = 1;
+            if (!in_signal) {
+                fprintf(stderr, "Warning: Failed to open log file %s (%s)\n", event_log_path, strerror(errno));
+            }
+        } else if (!header_written) {
+            char header[128];
+            write_all(fd, header, format_header(header));
+            header_written = 1;
+        }
+    }
+
+    char line[EVENT_LOG_MAX_LINE];
+    unsigned long long dropped = 0;
+    if (head - pos > EVENT_LOG_RECORDS) {
+        dropped = head - EVENT_LOG_RECORDS - pos;
+        pos = head - EVENT_LOG_RECORDS;
+    }
+    for (; pos < head; pos++) {
+        const struct EventRecord *slot = &ring[pos & (EVENT_LOG_RECORDS - 1)];
+        unsigned long long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == EVENT_LOG_BUSY) break;       // still being written: next flush
+        struct EventRecord copy;
+        memcpy(&copy, slot, sizeof(copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq != pos + 1 || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+            dropped++;                          // overwritten or never written
+            continue;
+        }
+        emit(fd, line, in_signal ? format_record_plain(&copy, line, sizeof(line)) :
+                                   format_record(&copy, line, sizeof(line)));
+    }
+    ring_tail = pos;
+
+    if (dropped > 0) {
+        static const char full[] = " events dropped (ring of " EVENT_LOG_RECORDS_TEXT " full)\n";
+        memcpy(line, "[DEBUG] ", 8);
+        char *p = put_number(line + 8, dropped, 0);
+        memcpy(p, full, sizeof(full) - 1);
+        emit(fd, line, (size_t)(p - line) + sizeof(full) - 1);
+    }
+    if (fd >= 0) close(fd);
+    __atomic_store_n(&flushing, 0, __ATOMIC_RELEASE);
+}
+
+// Function to write the events recorded since the last flush
+void event_log_flush(void) {
+    flush_events(0);
+}
+
+static void flush_at_exit(void) {
+    event_log_flush();
+}
+
+/* Keep the events leading up to a crash or kill, then die as before; no stdio here */
+static void flush_on_signal(int sig) {
+    flush_events(1);
+    raise(sig);
+}
+
+/* A forked child writes only its own events, under its own header */
+static void reset_in_child(void) {
+    ring_tail = ring_head;
+    header_written = 0;
+    flushing = 0;
+}
+
+// Function to start the clock and flush the log at exit and on fatal signals
+void event_log_install(void) {
+    static const int signals[] = { SIGSEGV, SIGBUS, SIGABRT, SIGFPE, SIGINT, SIGTERM };
+    epoch_ns = clock_ns();
+    atexit(flush_at_exit);
+    pthread_atfork(NULL, NULL, reset_in_child);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = flush_on_signal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+        sigaction(signals[i], &action, NULL);
+    }
+}
@@ -0,0 +1,49 @@
+/**
+ * Claude API Client - In-memory debug event log
+ *
+ * debug_print() no longer formats anything: it stores a fixed-size binary
+ * record (timestamp, format pointer, raw arguments, copies of string
+ * arguments) in a ring of EVENT_LOG_RECORDS slots. Writers claim a slot
+ * with one atomic increment and publish it with a sequence number, so
+ * threads never take a lock and a slow terminal never stalls a transfer.
+ *
+ * Records are turned into text only when the ring is flushed: to stderr
+ * with -v, and appended to the file named by --log-file (or COMMIT_AI_LOG)
+ * with a header naming the process. event_log_install() flushes at exit
+ * and on fatal signals, so the events before a crash are kept; the signal
+ * flush formats with plain arithmetic instead of stdio, so a signal that
+ * lands inside malloc or localtime cannot deadlock it. Long-lived
+ * loops such as --watch flush as they go. When the ring wraps before a
+ * flush, the oldest events are dropped and the dump says how many.
+ *
+ * Formats must be string literals: only the pointer is stored. Arguments
+ * are limited to EVENT_LOG_MAX_ARGS conversions of the kinds d i u x X o c
+ * s p f e g (with h, l, ll, z, j or t lengths and * width or precision);
+ * strings share EVENT_LOG_STRING_BYTES per record and are cut to fit.
+ */
+
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <stdarg.h>
+
+/* Slots in the ring; a power of two */
+#define EVENT_LOG_RECORDS 4096
+
+/* Arguments kept per record, counting * widths and precisions */
+#define EVENT_LOG_MAX_ARGS 6
+
+/* Bytes for copies of string arguments per record, terminators included */
+#define EVENT_LOG_STRING_BYTES 55
+
+/* Environment variable read when --log-file is not given */
+#define EVENT_LOG_ENV "COMMIT_AI_LOG"
+
+/* File the events are appended to on flush, or NULL (--log-file) */
+extern const char *event_log_path;
+
+void event_log_record(const char *format, va_list args);
+void event_log_flush(void);
+void event_log_install(void);
+
+#endif /* EVENTLOG_H */
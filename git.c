@@ -0,0 +1,312 @@
+/**
+ * Claude API Client - git plumbing helpers
+ *
+ * See git.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "claude_client.h"
+#include "git.h"
+
+/* How a git child is set up beyond its arguments */
+struct GitChild {
+    const char *index_file;     /* passed as GIT_INDEX_FILE, or NULL */
+    const char *input;          /* written to its stdin, or NULL for none */
+    size_t input_len;
+    int quiet;                  /* discard its stderr */
+};
+
+/*
+ * Write input to a git child's stdin. SIGPIPE is blocked for this thread
+ * only (other threads may be writing to git at the same time) and a
+ * SIGPIPE raised by the write is consumed before the mask is restored, so
+ * a git that exits early turns into EPIPE rather than killing the run.
+ */
+static void write_git_input(int fd, const char *input, size_t len, const char *const argv[]) {
+    sigset_t pipe_set, old_set, pending;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    sigpending(&pending);
+    int was_pending = sigismember(&pending, SIGPIPE);
+
+    int broken = 0;
+    for (size_t done = 0; done < len; ) {
+        ssize_t w = write(fd, input + done, len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) {
+            broken = errno == EPIPE;
+            debug_print("git %s stopped reading its input (%s)", argv[1] ? argv[1] : "", strerror(errno));
+            break;
+        }
+        done += (size_t)w;
+    }
+
+    // Drop only the SIGPIPE this write raised, never one that was already there
+    if (broken && !was_pending) {
+        struct timespec no_wait = { 0, 0 };
+        while (sigtimedwait(&pipe_set, NULL, &no_wait) < 0 && errno == EINTR) {
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+}
+
+/* Start git with argv; its stdout is readable from *out_fd if out_fd is given */
+static pid_t spawn_git(const char *const argv[], const struct GitChild *child, int *out_fd) {
+    int fds[2] = { -1, -1 };
+    int in_fds[2] = { -1, -1 };
+    if (out_fd && pipe(fds) != 0) {
+        fprintf(stderr, "Error: Failed to create pipe for git (%s)\n", strerror(errno));
+        return -1;
+    }
+    if (child->input && pipe(in_fds) != 0) {
+        fprintf(stderr, "Error: Failed to create pipe for git (%s)\n", strerror(errno));
+        if (out_fd) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to start git (%s)\n", strerror(errno));
+        if (out_fd) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+        if (child->input) {
+            close(in_fds[0]);
+            close(in_fds[1]);
+        }
+        return -1;
+    }
+
+    if (pid == 0) {
+        if (out_fd) {
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+        }
+        if (child->input) {
+            dup2(in_fds[0], STDIN_FILENO);
+            close(in_fds[0]);
+            close(in_fds[1]);
+        }
+        if (child->quiet) {
+            int null_fd = open("/dev/null", O_WRONLY);
+            if (null_fd >= 0) {
+                dup2(null_fd, STDERR_FILENO);
+                close(null_fd);
+            }
+        }
+        if (child->index_file) {
+            setenv("GIT_INDEX_FILE", child->index_file, 1);
+        }
+        execvp("git", (char *const *)argv);
+        fprintf(stderr, "Error: Failed to run git (%s)\n", strerror(errno));
+        _exit(127);
+    }
+
+    if (out_fd) {
+        close(fds[1]);
+        *out_fd = fds[0];
+    }
+    if (child->input) {
+        // Write all input up front; the commands fed this way print little
+        close(in_fds[0]);
+        write_git_input(in_fds[1], child->input, child->input_len, argv);
+        close(in_fds[1]);
+    }
+    return pid;
+}
+
+static int wait_git(pid_t pid, const char *const argv[]) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Error: Failed to wait for git (%s)\n", strerror(errno));
+            return 0;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        debug_print("git %s exited with status %d", argv[1] ? argv[1] : "",
+                    WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return 0;
+    }
+    return 1;
+}
+
+static char* capture_child(const char *const argv[], const struct GitChild *child) {
+    int fd = -1;
+    pid_t pid = spawn_git(argv, child, &fd);
+    if (pid < 0) return NULL;
+
+    struct MemoryStruct out;
+    memset(&out, 0, sizeof(out));
+    int ok = 1;
+    char buffer[65536];
+
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            fprintf(stderr, "Error: Failed to read git output (%s)\n", strerror(errno));
+            ok = 0;
+            break;
+        }
+        if (n == 0) break;
+        if (ok && WriteMemoryCallback(buffer, 1, (size_t)n, &out) != (size_t)n) {
+            ok = 0;  // keep draining so git can exit
+        }
+    }
+    close(fd);
+
+    ok = wait_git(pid, argv) && ok && memory_reserve(&out, 0);
+    if (!ok) {
+        mem_free(out.memory);
+        return NULL;
+    }
+    return out.memory;
+}
+
+// Function to run git and return its standard output, or NULL if it failed
+char* git_capture(const char *const argv[]) {
+    struct GitChild child = { NULL, NULL, 0, 0 };
+    return capture_child(argv, &child);
+}
+
+// Function to run git with input on its stdin and return its standard output
+char* git_capture_input(const char *const argv[], const char *input, size_t input_len) {
+    struct GitChild child = { NULL, input, input_len, 0 };
+    return capture_child(argv, &child);
+}
+
+// Function to run git without its error messages, for commands that may fail normally
+char* git_capture_quiet(const char *const argv[]) {
+    struct GitChild child = { NULL, NULL, 0, 1 };
+    return capture_child(argv, &child);
+}
+
+// Function to run git for its side effects; returns 1 if it exited with 0
+int git_run(const char *const argv[]) {
+    struct GitChild child = { NULL, NULL, 0, 0 };
+    pid_t pid = spawn_git(argv, &child, NULL);
+    if (pid < 0) return 0;
+    return wait_git(pid, argv);
+}
+
+/* git_capture() for commands that print a single line */
+static char* git_capture_line(const char *const argv[]) {
+    char *out = git_capture(argv);
+    if (out) {
+        trim_string(out);
+    }
+    return out;
+}
+
+// Function to get the absolute path of the repository's .git directory
+char* git_dir(void) {
+    const char *const argv[] = { "git", "rev-parse", "--absolute-git-dir", NULL };
+    char *dir = git_capture_line(argv);
+    if (!dir) {
+        fprintf(stderr, "Error: Not inside a git repository\n");
+    }
+    return dir;
+}
+
+/* Copy the file at from into the open descriptor to_fd */
+static int copy_file(const char *from, int to_fd) {
+    int from_fd = open(from, O_RDONLY);
+    if (from_fd < 0) {
+        debug_print("Cannot open %s (%s)", from, strerror(errno));
+        return 0;
+    }
+
+    char buffer[65536];
+    int ok = 1;
+    for (;;) {
+        ssize_t n = read(from_fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = (n == 0);
+            break;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(to_fd, buffer + done, (size_t)(n - done));
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) {
+                ok = 0;
+                break;
+            }
+            done += w;
+        }
+        if (!ok) break;
+    }
+    close(from_fd);
+    return ok;
+}
+
+/*
+ * Function to get the hash of the tree the index would commit.
+ *
+ * write-tree takes index.lock to refresh the cached trees, which would make
+ * a concurrent "git add" fail while a watcher is running. It is therefore
+ * run against a private copy of the index, leaving the real one untouched.
+ */
+char* git_staged_tree(void) {
+    const char *const path_argv[] = { "git", "rev-parse", "--git-path", "index", NULL };
+    char *index_path = git_capture_line(path_argv);
+    if (!index_path) return NULL;
+
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir || !*tmpdir) tmpdir = "/tmp";
+    size_t len = strlen(tmpdir) + sizeof("/commit-ai-index.XXXXXX");
+    char *copy_path = mem_alloc(len);
+    if (!copy_path) {
+        fprintf(stderr, "Error: Memory allocation failed for index copy path\n");
+        mem_free(index_path);
+        return NULL;
+    }
+    snprintf(copy_path, len, "%s/commit-ai-index.XXXXXX", tmpdir);
+
+    char *tree = NULL;
+    int fd = mkstemp(copy_path);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create %s (%s)\n", copy_path, strerror(errno));
+    } else {
+        int copied = copy_file(index_path, fd);
+        close(fd);
+        if (copied) {
+            const char *const argv[] = { "git", "write-tree", NULL };
+            struct GitChild child = { copy_path, NULL, 0, 0 };
+            tree = capture_child(argv, &child);
+            if (tree) {
+                trim_string(tree);
+            }
+        }
+        unlink(copy_path);
+    }
+
+    mem_free(copy_path);
+    mem_free(index_path);
+    return tree;
+}
+
+// Function to get the staged changes as a diff
+char* git_staged_diff(void) {
+    const char *const argv[] = { "git", "diff", "--cached", "--no-color", "--no-ext-diff", NULL };
+    return git_capture(argv);
+}
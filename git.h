@@ -0,0 +1,24 @@
+/**
+ * Claude API Client - git plumbing helpers
+ *
+ * Runs git as a child process (fork/exec, no shell) and captures its
+ * standard output. git's own error messages go to stderr unchanged, except
+ * for git_capture_quiet(). git_capture_input() writes all of its input
+ * before reading any output, so it is meant for commands that print little,
+ * like patch-id and hash-object.
+ */
+
+#ifndef GIT_H
+#define GIT_H
+
+#include <stddef.h>
+
+char* git_capture(const char *const argv[]);
+char* git_capture_input(const char *const argv[], const char *input, size_t input_len);
+char* git_capture_quiet(const char *const argv[]);
+int git_run(const char *const argv[]);
+char* git_dir(void);
+char* git_staged_tree(void);
+char* git_staged_diff(void);
+
+#endif /* GIT_H */
@@ -0,0 +1,542 @@
+/**
+ * Claude API Client - Read-ahead ingestion of diff files
+ *
+ * See ingest.h. Every listed file has a slot; reads are started for the
+ * slots in [next_take, next_take + depth) and the consumer waits only for
+ * the slot it takes. Files are opened and sized with open() and fstat() as
+ * their read is started, so at most depth descriptors are open at once.
+ */
+
+/* syscall() and MAP_POPULATE are outside POSIX */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define INGEST_HAVE_URING 1
+#endif
+#endif
+#endif
+
+#include "claude_client.h"
+#include "ingest.h"
+
+/* Largest single read; longer files are read in several */
+#define INGEST_MAX_READ (1U << 30)
+
+/* How files are read (--ingest) */
+enum IngestMode ingest_mode = INGEST_AUTO;
+
+/* Read-ahead window in files (--read-ahead) */
+long ingest_depth = INGEST_DEFAULT_DEPTH;
+
+enum FileState {
+    FILE_PENDING,                   /* read not started */
+    FILE_READING,
+    FILE_DONE,                      /* data or error ready to be taken */
+    FILE_TAKEN
+};
+
+struct IngestFile {
+    enum FileState state;
+    int fd;
+    char *data;
+    size_t size;                    /* bytes fstat() reported */
+    size_t done;                    /* bytes read so far */
+    int error;                      /* errno of a failed open or read */
+};
+
+#ifdef INGEST_HAVE_URING
+/* The rings shared with the kernel */
+struct Uring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned to_submit;             /* queued but not yet passed to the kernel */
+};
+#endif
+
+struct Ingest {
+    const char *const *paths;
+    struct IngestFile *files;
+    size_t count;
+    size_t depth;
+    size_t next_submit;             /* first slot whose read has not started */
+    size_t next_take;               /* slots below were taken or skipped */
+    size_t bytes;
+    long long start_ms;
+    int use_uring;
+#ifdef INGEST_HAVE_URING
+    struct Uring ring;
+    size_t inflight;                /* reads the kernel has not completed */
+    int draining;                   /* closing: finish short reads instead of continuing */
+#endif
+    pthread_mutex_t lock;           /* the fallback threads share next_submit and files */
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    pthread_t threads[INGEST_THREADS];
+    size_t thread_count;
+    int stop;
+};
+
+// Function to parse an --ingest mode name
+int parse_ingest_mode(const char *name, enum IngestMode *mode) {
+    if (strcmp(name, "auto") == 0) {
+        *mode = INGEST_AUTO;
+    } else if (strcmp(name, "io_uring") == 0) {
+        *mode = INGEST_URING;
+    } else if (strcmp(name, "threads") == 0) {
+        *mode = INGEST_THREADS_ONLY;
+    } else {
+        fprintf(stderr, "Error: Invalid ingest mode: %s (use auto, io_uring or threads)\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/* Buffers outlive whatever arena is active when their read starts */
+static char* heap_alloc(size_t size) {
+    struct Arena *previous = arena_activate(NULL);
+    char *data = mem_alloc(size);
+    arena_activate(previous);
+    return data;
+}
+
+/* Open and size a file and allocate its buffer; 0 if it is done already */
+static int open_file(struct IngestFile *file, const char *path) {
+    struct stat st;
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0 || fstat(file->fd, &st) != 0) {
+        file->error = errno;
+    } else if (!(file->data = heap_alloc((size_t)st.st_size + 1))) {
+        file->error = ENOMEM;
+    } else {
+        file->size = (size_t)st.st_size;
+        file->done = 0;
+        if (file->size > 0) return 1;
+    }
+    return 0;
+}
+
+/* Close a file whose read ended and publish its buffer */
+static void finish_file(struct Ingest *ingest, struct IngestFile *file) {
+    if (file->fd >= 0) {
+        close(file->fd);
+        file->fd = -1;
+    }
+    if (file->error) {
+        mem_free(file->data);
+        file->data = NULL;
+    } else if (file->data) {
+        file->data[file->done] = '\0';
+        ingest->bytes += file->done;
+    }
+    file->state = FILE_DONE;
+}
+
+#ifdef INGEST_HAVE_URING
+
+/* io_uring_enter(), retried when a signal interrupts it */
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    long ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return (int)ret;
+}
+
+static void uring_destroy(struct Uring *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    ring->fd = -1;
+}
+
+/* Set up a ring of at least entries slots; 0 if io_uring or its READ operation is unavailable */
+static int uring_setup(struct Uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        debug_print("io_uring unavailable (%s)", strerror(errno));
+        return 0;
+    }
+
+    // IORING_OP_READ arrived in Linux 5.6, together with the probe
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    int supported = probe &&
+                    syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                    probe->last_op >= IORING_OP_READ &&
+                    (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!supported) {
+        debug_print("io_uring has no read operation");
+        uring_destroy(ring);
+        return 0;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap ? ring->sq_ring :
+                    mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        fprintf(stderr, "Warning: Failed to map the io_uring rings (%s)\n", strerror(errno));
+        uring_destroy(ring);
+        return 0;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    debug_print("io_uring ready with %u entries", params.sq_entries);
+    return 1;
+}
+
+/* Queue a read of the rest of a file; the kernel sees it on the next uring_enter() */
+static void uring_queue_read(struct Ingest *ingest, size_t index) {
+    struct Uring *ring = &ingest->ring;
+    struct IngestFile *file = &ingest->files[index];
+    size_t remaining = file->size - file->done;
+
+    unsigned tail = *ring->sq_tail;
+    unsigned slot = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(file->data + file->done);
+    sqe->len = remaining < INGEST_MAX_READ ? (unsigned)remaining : INGEST_MAX_READ;
+    sqe->off = file->done;
+    sqe->user_data = index;
+    ring->sq_array[slot] = slot;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    ring->to_submit++;
+    ingest->inflight++;
+}
+
+/* Handle every completed read; short reads are continued */
+static void uring_reap(struct Ingest *ingest) {
+    struct Uring *ring = &ingest->ring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        size_t index = (size_t)cqe->user_data;
+        int res = cqe->res;
+        head++;
+
+        struct IngestFile *file = &ingest->files[index];
+        ingest->inflight--;
+        if (res < 0) {
+            file->error = -res;
+        } else {
+            file->done += (size_t)res;
+            if (res > 0 && file->done < file->size && !ingest->draining) {
+                uring_queue_read(ingest, index);
+                continue;
+            }
+        }
+        finish_file(ingest, file);
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Start reads for the window after next_take */
+static void uring_fill(struct Ingest *ingest) {
+    while (ingest->next_submit < ingest->count && ingest->next_submit < ingest->next_take + ingest->depth) {
+        size_t index = ingest->next_submit++;
+        struct IngestFile *file = &ingest->files[index];
+        file->state = FILE_READING;
+        if (open_file(file, ingest->paths[index])) {
+            uring_queue_read(ingest, index);
+        } else {
+            finish_file(ingest, file);
+        }
+    }
+}
+
+static size_t start_readers(struct Ingest *ingest);
+
+/*
+ * Give up on io_uring after io_uring_enter() failed with error: the reads
+ * still in the ring fail, and the files after them go to reader threads.
+ * The kernel may still write into the buffers of those reads, so they are
+ * never freed.
+ */
+static void uring_abandon(struct Ingest *ingest, int error) {
+    uring_reap(ingest);
+    for (size_t i = ingest->next_take; i < ingest->next_submit; i++) {
+        struct IngestFile *file = &ingest->files[i];
+        if (file->state != FILE_READING) continue;
+        file->data = NULL;          // left to the kernel on purpose
+        file->error = error;
+        finish_file(ingest, file);
+    }
+    ingest->inflight = 0;
+    ingest->ring.to_submit = 0;
+    uring_destroy(&ingest->ring);
+    ingest->use_uring = 0;
+
+    if (ingest->draining) return;
+    fprintf(stderr, "Warning: io_uring_enter failed (%s), reading the remaining files with threads\n",
+            strerror(error));
+    if (start_readers(ingest) == 0) {
+        // Nothing will read them: fail the rest rather than wait for them forever
+        for (size_t i = ingest->next_submit; i < ingest->count; i++) {
+            ingest->files[i].error = error;
+            finish_file(ingest, &ingest->files[i]);
+        }
+        ingest->next_submit = ingest->count;
+    }
+}
+
+/* Pass queued reads to the kernel, waiting for min_complete completions */
+static void uring_submit(struct Ingest *ingest, unsigned min_complete) {
+    struct Uring *ring = &ingest->ring;
+    if (ring->to_submit == 0 && min_complete == 0) return;
+    int submitted = uring_enter(ring->fd, ring->to_submit, min_complete,
+                                min_complete ? IORING_ENTER_GETEVENTS : 0);
+    if (submitted < 0) {
+        uring_abandon(ingest, errno);
+        return;
+    }
+    ring->to_submit -= (unsigned)submitted < ring->to_submit ? (unsigned)submitted : ring->to_submit;
+    uring_reap(ingest);
+}
+
+#endif /* INGEST_HAVE_URING */
+
+/* Fallback: read a whole file with plain read() calls */
+static void read_whole_file(struct IngestFile *file, const char *path) {
+    if (open_file(file, path)) {
+        while (file->done < file->size) {
+            ssize_t n = read(file->fd, file->data + file->done, file->size - file->done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) file->error = errno;
+            if (n <= 0) break;
+            file->done += (size_t)n;
+        }
+    }
+}
+
+static void* ingest_worker(void *arg) {
+    struct Ingest *ingest = arg;
+
+    pthread_mutex_lock(&ingest->lock);
+    for (;;) {
+        while (!ingest->stop && ingest->next_submit < ingest->count &&
+               ingest->next_submit >= ingest->next_take + ingest->depth) {
+            pthread_cond_wait(&ingest->work_cond, &ingest->lock);
+        }
+        if (ingest->stop || ingest->next_submit >= ingest->count) break;
+
+        size_t index = ingest->next_submit++;
+        struct IngestFile *file = &ingest->files[index];
+        file->state = FILE_READING;
+        pthread_mutex_unlock(&ingest->lock);
+
+        read_whole_file(file, ingest->paths[index]);
+
+        pthread_mutex_lock(&ingest->lock);
+        finish_file(ingest, file);
+        pthread_cond_broadcast(&ingest->done_cond);
+    }
+    pthread_mutex_unlock(&ingest->lock);
+    return NULL;
+}
+
+/* Start the fallback threads for the files from next_submit on; returns how many run */
+static size_t start_readers(struct Ingest *ingest) {
+    size_t remaining = ingest->count - ingest->next_submit;
+    size_t threads = remaining < INGEST_THREADS ? remaining : INGEST_THREADS;
+    if (threads > ingest->depth) threads = ingest->depth;
+    for (size_t i = 0; i < threads; i++) {
+        if (pthread_create(&ingest->threads[i], NULL, ingest_worker, ingest) != 0) break;
+        ingest->thread_count++;
+    }
+    return ingest->thread_count;
+}
+
+// Function to start reading the files in paths ahead of ingest_take()
+struct Ingest* ingest_open(const char *const *paths, size_t count) {
+    struct Ingest *ingest = calloc(1, sizeof(*ingest));
+    struct IngestFile *files = calloc(count ? count : 1, sizeof(*files));
+    if (!ingest || !files) {
+        fprintf(stderr, "Error: Memory allocation failed for file ingestion\n");
+        free(ingest);
+        free(files);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        files[i].fd = -1;
+    }
+    ingest->paths = paths;
+    ingest->files = files;
+    ingest->count = count;
+    ingest->depth = ingest_depth > 0 ? (size_t)ingest_depth : 1;
+    ingest->start_ms = monotonic_ms();
+    pthread_mutex_init(&ingest->lock, NULL);
+    pthread_cond_init(&ingest->work_cond, NULL);
+    pthread_cond_init(&ingest->done_cond, NULL);
+
+#ifdef INGEST_HAVE_URING
+    if (ingest_mode != INGEST_THREADS_ONLY) {
+        ingest->use_uring = uring_setup(&ingest->ring, (unsigned)ingest->depth);
+    }
+#endif
+    if (!ingest->use_uring && ingest_mode == INGEST_URING) {
+        fprintf(stderr, "Error: io_uring is not available (use --ingest threads)\n");
+        ingest_close(ingest);
+        return NULL;
+    }
+
+#ifdef INGEST_HAVE_URING
+    if (ingest->use_uring) {
+        uring_fill(ingest);
+        uring_submit(ingest, 0);
+        return ingest;  // threads have taken over if the submission failed
+    }
+#endif
+
+    if (count > 0 && start_readers(ingest) == 0) {
+        fprintf(stderr, "Error: Failed to start reader threads\n");
+        ingest_close(ingest);
+        return NULL;
+    }
+    debug_print("Reading %zu files with %zu threads", count, ingest->thread_count);
+    return ingest;
+}
+
+/* Release the buffers of slots below index that were skipped */
+static void skip_to(struct Ingest *ingest, size_t index) {
+    for (size_t i = ingest->next_take; i < index; i++) {
+        if (ingest->files[i].state == FILE_DONE) {
+            mem_free(ingest->files[i].data);
+            ingest->files[i].data = NULL;
+            ingest->files[i].state = FILE_TAKEN;
+        }
+    }
+    if (index + 1 > ingest->next_take) {
+        ingest->next_take = index + 1;
+    }
+}
+
+/*
+ * Function to take the contents of paths[index], waiting for its read; NULL
+ * (with an error printed) if it failed. Indexes must not decrease.
+ */
+char* ingest_take(struct Ingest *ingest, size_t index) {
+    if (index >= ingest->count || ingest->files[index].state == FILE_TAKEN) {
+        return NULL;
+    }
+    struct IngestFile *file = &ingest->files[index];
+
+#ifdef INGEST_HAVE_URING
+    if (ingest->use_uring) {
+        skip_to(ingest, index);
+        uring_fill(ingest);
+        uring_submit(ingest, 0);
+        while (ingest->use_uring && file->state != FILE_DONE && ingest->inflight > 0) {
+            uring_submit(ingest, 1);
+        }
+    }
+    if (!ingest->use_uring)
+#endif
+    {
+        pthread_mutex_lock(&ingest->lock);
+        skip_to(ingest, index);
+        pthread_cond_broadcast(&ingest->work_cond);
+        while (file->state != FILE_DONE) {
+            pthread_cond_wait(&ingest->done_cond, &ingest->lock);
+        }
+        pthread_mutex_unlock(&ingest->lock);
+    }
+
+    file->state = FILE_TAKEN;
+    if (file->error) {
+        fprintf(stderr, "Error: Failed to open file: %s (%s)\n", ingest->paths[index], strerror(file->error));
+        return NULL;
+    }
+    char *data = file->data;
+    file->data = NULL;
+    return data;
+}
+
+// Function to stop reading and release whatever was not taken
+void ingest_close(struct Ingest *ingest) {
+    if (!ingest) return;
+
+#ifdef INGEST_HAVE_URING
+    if (ingest->use_uring) {
+        // The kernel may still be writing into the buffers
+        ingest->draining = 1;
+        while (ingest->use_uring && ingest->inflight > 0) {
+            uring_submit(ingest, 1);
+        }
+        if (ingest->use_uring) uring_destroy(&ingest->ring);
+    }
+#endif
+
+    pthread_mutex_lock(&ingest->lock);
+    ingest->stop = 1;
+    pthread_cond_broadcast(&ingest->work_cond);
+    pthread_mutex_unlock(&ingest->lock);
+    for (size_t i = 0; i < ingest->thread_count; i++) {
+        pthread_join(ingest->threads[i], NULL);
+    }
+
+    debug_print("Read %zu bytes from %zu of %zu files with %s in %lld ms", ingest->bytes,
+                ingest->next_submit, ingest->count, ingest->use_uring ? "io_uring" : "threads",
+                monotonic_ms() - ingest->start_ms);
+
+    for (size_t i = 0; i < ingest->count; i++) {
+        if (ingest->files[i].fd >= 0) close(ingest->files[i].fd);
+        mem_free(ingest->files[i].data);
+    }
+    pthread_cond_destroy(&ingest->done_cond);
+    pthread_cond_destroy(&ingest->work_cond);
+    pthread_mutex_destroy(&ingest->lock);
+    free(ingest->files);
+    free(ingest);
+}
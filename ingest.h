@@ -0,0 +1,51 @@
+/**
+ * Claude API Client - Read-ahead ingestion of diff files
+ *
+ * A --diff-list (or -d <dir>) run reads thousands of diff files while it
+ * waits on the network. The files are read ahead of the request loop, with
+ * at most --read-ahead reads in flight or waiting to be taken:
+ *
+ *   io_uring  reads are queued to the kernel through the raw io_uring
+ *             syscalls (no liburing) and complete while the request loop
+ *             is blocked on the network; Linux 5.6 or later
+ *   threads   a few threads read whole files with open/fstat/read; used
+ *             where io_uring is missing or not allowed, and for the rest
+ *             of the list if io_uring_enter() fails mid-run (the reads
+ *             still in the ring then fail)
+ *
+ * --ingest auto (the default) tries io_uring first. Files are taken in list
+ * order; a buffer is the file's contents with a terminating NUL, allocated
+ * from the heap whatever arena is active, and released with mem_free().
+ */
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+
+/* Reads in flight or waiting to be taken (--read-ahead) */
+#define INGEST_DEFAULT_DEPTH 32
+
+/* Threads of the fallback reader */
+#define INGEST_THREADS 4
+
+enum IngestMode {
+    INGEST_AUTO,
+    INGEST_URING,
+    INGEST_THREADS_ONLY
+};
+
+/* How files are read (--ingest) */
+extern enum IngestMode ingest_mode;
+
+/* Read-ahead window in files (--read-ahead) */
+extern long ingest_depth;
+
+struct Ingest;
+
+int parse_ingest_mode(const char *name, enum IngestMode *mode);
+struct Ingest* ingest_open(const char *const *paths, size_t count);
+char* ingest_take(struct Ingest *ingest, size_t index);
+void ingest_close(struct Ingest *ingest);
+
+#endif /* INGEST_H */
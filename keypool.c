@@ -0,0 +1,324 @@
+/**
+ * Claude API Client - API key pool with rate limit budgets
+ *
+ * See keypool.h. Budgets are kept per key as the last remaining counts the
+ * server reported and the monotonic time their window resets; past that
+ * time the key is assumed to be fresh again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+
+#include "claude_client.h"
+#include "keypool.h"
+
+/* A key without budget headers yet is scored as if it had this many requests left */
+#define KEY_POOL_UNKNOWN_BUDGET 1000000L
+
+struct PoolKey {
+    const char *key;
+    long requests_remaining;        /* -1 until an answer reported it */
+    long tokens_remaining;
+    long long requests_reset_at;    /* monotonic ms; 0 when unknown */
+    long long tokens_reset_at;
+    long long cooldown_until;
+    long cooldowns;                 /* 429s in a row */
+    long inflight;
+    long reserved_tokens;           /* estimated tokens of the requests in flight */
+    unsigned long long last_used;
+    unsigned long requests;
+    unsigned long rate_limited;
+    int rejected;                   /* answered 401 or 403 */
+};
+
+/* Key pool file, or NULL (--key-pool) */
+const char *key_pool_path = NULL;
+
+static struct PoolKey pool[KEY_POOL_MAX_KEYS];
+static size_t pool_size = 0;
+static unsigned long long use_counter = 0;
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+// Function to read the keys of a pool file; returns the number of keys
+int key_pool_load(const char *path) {
+    char *text = read_file(path);
+    if (!text) {
+        return 0;
+    }
+
+    pool_size = 0;
+    for (char *line = text; *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        trim_string(line);
+        if (*line && *line != '#') {
+            if (pool_size == KEY_POOL_MAX_KEYS) {
+                fprintf(stderr, "Warning: Only the first %d keys of %s are used\n", KEY_POOL_MAX_KEYS, path);
+                break;
+            }
+            struct PoolKey *key = &pool[pool_size++];
+            memset(key, 0, sizeof(*key));
+            key->key = line;
+            key->requests_remaining = -1;
+            key->tokens_remaining = -1;
+        }
+        line = next ? next : line + strlen(line);
+    }
+
+    // The keys point into text, which lives as long as the run
+    if (pool_size == 0) {
+        fprintf(stderr, "Error: No keys in key pool file %s\n", path);
+        mem_free(text);
+        return 0;
+    }
+    debug_print("Loaded %zu keys from %s", pool_size, path);
+    return (int)pool_size;
+}
+
+// Function to return the number of keys in the pool (0 without a pool)
+size_t key_pool_size(void) {
+    return pool_size;
+}
+
+// Function to return the key in a slot of the pool
+const char* key_pool_key(int slot) {
+    return pool[slot].key;
+}
+
+/* Requests the key can take now; 0 if its budget is spent until its window resets */
+static long key_score(struct PoolKey *key, long long now, long estimated_tokens, long long *ready_at) {
+    if (key->rejected) {
+        return 0;
+    }
+    if (key->cooldown_until > now) {
+        *ready_at = key->cooldown_until;
+        return 0;
+    }
+
+    // Past the reset, a window is fresh again and its count unknown
+    if (key->requests_reset_at && key->requests_reset_at <= now) key->requests_remaining = -1;
+    if (key->tokens_reset_at && key->tokens_reset_at <= now) key->tokens_remaining = -1;
+
+    long requests = (key->requests_remaining >= 0 ? key->requests_remaining : KEY_POOL_UNKNOWN_BUDGET) -
+                    key->inflight;
+    if (requests <= 0) {
+        *ready_at = key->requests_reset_at;
+        return 0;
+    }
+    if (key->tokens_remaining >= 0) {
+        long tokens = key->tokens_remaining - key->reserved_tokens;
+        long fits = estimated_tokens > 0 ? tokens / estimated_tokens : tokens;
+        if (fits <= 0) {
+            *ready_at = key->tokens_reset_at;
+            return 0;
+        }
+        if (fits < requests) requests = fits;
+    }
+    return requests;
+}
+
+/*
+ * Function to choose the key for a request of about estimated_tokens input
+ * tokens: the one with the most requests left, then the least recently
+ * used. Returns -1 and sets *wait_ms to the time until a key recovers if
+ * none can take it now (-1 if none will).
+ */
+int key_pool_pick(long estimated_tokens, long *wait_ms) {
+    long long now = monotonic_ms();
+    long long earliest = LLONG_MAX;
+    int best = -1;
+    long best_score = 0;
+
+    for (size_t i = 0; i < pool_size; i++) {
+        long long ready_at = 0;
+        long score = key_score(&pool[i], now, estimated_tokens, &ready_at);
+        if (score == 0) {
+            if (ready_at > now && ready_at < earliest) earliest = ready_at;
+            continue;
+        }
+        if (best < 0 || score > best_score ||
+            (score == best_score && pool[i].last_used < pool[best].last_used)) {
+            best = (int)i;
+            best_score = score;
+        }
+    }
+
+    if (best < 0) {
+        *wait_ms = earliest == LLONG_MAX ? -1 : (long)(earliest - now);
+    }
+    return best;
+}
+
+/*
+ * Function to choose the key for a request without waiting, for event
+ * loops: 1 with *slot set (-1 without a pool), or 0 if every key is
+ * exhausted, with *retry_at_ms set to the monotonic time to try again.
+ */
+int key_pool_choose(long estimated_tokens, int *slot, long long *retry_at_ms) {
+    *slot = -1;
+    if (pool_size == 0) return 1;
+
+    long wait_ms = 0;
+    *slot = key_pool_pick(estimated_tokens, &wait_ms);
+    if (*slot >= 0) return 1;
+    *retry_at_ms = monotonic_ms() + (wait_ms >= 0 ? wait_ms : KEY_POOL_COOLDOWN_MS);
+    return 0;
+}
+
+// Function to choose a key, waiting for one to recover; returns -1 if none does in time
+int key_pool_wait(long estimated_tokens) {
+    for (;;) {
+        long wait_ms = 0;
+        int slot = key_pool_pick(estimated_tokens, &wait_ms);
+        if (slot >= 0) {
+            return slot;
+        }
+
+        long budget_ms = deadline_remaining_ms();
+        if (wait_ms < 0 || wait_ms > KEY_POOL_MAX_WAIT_MS || (budget_ms >= 0 && wait_ms > budget_ms)) {
+            fprintf(stderr, "Error: No key of the pool can take a request%s\n",
+                    wait_ms < 0 ? "" : " in time");
+            return -1;
+        }
+        debug_print("Every key of the pool is exhausted, waiting %ld ms", wait_ms);
+        sleep_ms(wait_ms > 0 ? wait_ms : 1);
+    }
+}
+
+// Function to tell whether a request refused for its key after attempts tries goes to another key
+int key_pool_should_retry(long http_code, size_t attempts) {
+    return (http_code == 429 || http_code == 401 || http_code == 403) &&
+           attempts < pool_size * KEY_POOL_RETRY_ROUNDS;
+}
+
+// Function to count a request against its key until it is answered
+void key_pool_begin(int slot, long estimated_tokens) {
+    struct PoolKey *key = &pool[slot];
+    key->inflight++;
+    key->reserved_tokens += estimated_tokens;
+    key->last_used = ++use_counter;
+    key->requests++;
+    debug_print("Using key %d of the pool (%ld requests left, %ld in flight)", slot + 1,
+                key->requests_remaining, key->inflight);
+}
+
+// Function to update a key's budget from the answer to a request sent with it
+void key_pool_finish(int slot, long estimated_tokens, long http_code,
+                     const struct RateLimitHeaders *limits) {
+    struct PoolKey *key = &pool[slot];
+    long long now = monotonic_ms();
+    key->inflight--;
+    key->reserved_tokens -= estimated_tokens;
+
+    // A count without a reset time is trusted for one default cooldown
+    if (limits && limits->requests_remaining >= 0) {
+        key->requests_remaining = limits->requests_remaining;
+        key->requests_reset_at = now + (limits->requests_reset_ms >= 0 ? limits->requests_reset_ms :
+                                        KEY_POOL_COOLDOWN_MS);
+    }
+    if (limits && limits->tokens_remaining >= 0) {
+        key->tokens_remaining = limits->tokens_remaining;
+        key->tokens_reset_at = now + (limits->tokens_reset_ms >= 0 ? limits->tokens_reset_ms :
+                                      KEY_POOL_COOLDOWN_MS);
+    }
+
+    if (http_code == 429) {
+        key->rate_limited++;
+        key->cooldowns++;
+        long long cooldown = limits && limits->retry_after_ms >= 0 ? limits->retry_after_ms : -1;
+        if (cooldown < 0) {
+            cooldown = KEY_POOL_COOLDOWN_MS;
+            for (long i = 1; i < key->cooldowns && cooldown < KEY_POOL_MAX_COOLDOWN_MS; i++) {
+                cooldown *= 2;
+            }
+            if (cooldown > KEY_POOL_MAX_COOLDOWN_MS) cooldown = KEY_POOL_MAX_COOLDOWN_MS;
+        }
+        key->cooldown_until = now + cooldown;
+        debug_print("Key %d of the pool was rate limited, cooling down for %lld ms", slot + 1, cooldown);
+    } else if (http_code == 401 || http_code == 403) {
+        key->rejected = 1;
+        fprintf(stderr, "Warning: Key %d of the pool was rejected (HTTP %ld), skipping it\n",
+                slot + 1, http_code);
+    } else if (http_code >= 200 && http_code < 300) {
+        key->cooldowns = 0;
+    }
+}
+
+// Function to print the requests and 429s of each key in debug mode
+void key_pool_summary(void) {
+    for (size_t i = 0; i < pool_size; i++) {
+        debug_print("Key %zu of the pool: %lu requests, %lu rate limited%s", i + 1, pool[i].requests,
+                    pool[i].rate_limited, pool[i].rejected ? ", rejected" : "");
+    }
+}
+
+// Function to reset a set of rate limit headers to "absent"
+void rate_limit_headers_init(struct RateLimitHeaders *limits) {
+    limits->requests_remaining = -1;
+    limits->tokens_remaining = -1;
+    limits->requests_reset_ms = -1;
+    limits->tokens_reset_ms = -1;
+    limits->retry_after_ms = -1;
+}
+
+/* Value of a header line if it is name (lowercase, with the colon), else NULL */
+static const char* header_value(const char *line, size_t len, const char *name) {
+    size_t name_len = strlen(name);
+    if (len <= name_len) return NULL;
+    for (size_t i = 0; i < name_len; i++) {
+        char c = line[i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (c != name[i]) return NULL;
+    }
+    const char *value = line + name_len;
+    while (value < line + len && (*value == ' ' || *value == '\t')) value++;
+    return value;
+}
+
+/* Days from 1970-01-01 to a civil date (proleptic Gregorian) */
+static long long days_from_civil(long long y, int m, int d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* Milliseconds from now until an RFC 3339 UTC time, or -1 if unreadable */
+static long long reset_in_ms(const char *value) {
+    int year, month, day, hour, minute, second;
+    if (sscanf(value, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6) {
+        return -1;
+    }
+    long long at = days_from_civil(year, month, day) * 86400LL + hour * 3600LL + minute * 60LL + second;
+    long long in = (at - (long long)time(NULL)) * 1000LL;
+    return in > 0 ? in : 0;
+}
+
+// Function to pick the rate limit headers out of a response header line
+void rate_limit_header(struct RateLimitHeaders *limits, const char *line, size_t len) {
+    const char *value;
+    if ((value = header_value(line, len, "anthropic-ratelimit-requests-remaining:")) != NULL) {
+        limits->requests_remaining = strtol(value, NULL, 10);
+    } else if ((value = header_value(line, len, "anthropic-ratelimit-tokens-remaining:")) != NULL) {
+        limits->tokens_remaining = strtol(value, NULL, 10);
+    } else if ((value = header_value(line, len, "anthropic-ratelimit-requests-reset:")) != NULL) {
+        limits->requests_reset_ms = reset_in_ms(value);
+    } else if ((value = header_value(line, len, "anthropic-ratelimit-tokens-reset:")) != NULL) {
+        limits->tokens_reset_ms = reset_in_ms(value);
+    } else if ((value = header_value(line, len, "retry-after:")) != NULL) {
+        limits->retry_after_ms = strtol(value, NULL, 10) * 1000L;
+    }
+}
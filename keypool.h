@@ -0,0 +1,71 @@
+/**
+ * Claude API Client - API key pool with rate limit budgets
+ *
+ * --key-pool <file> (or COMMIT_AI_KEY_POOL) names a file with one API key
+ * per line; blank lines and lines starting with '#' are skipped. Every
+ * request is sent with the key that has the most budget left:
+ *
+ *   - the anthropic-ratelimit-{requests,tokens}-{remaining,reset} headers of
+ *     each answer update the budget of the key it was sent with, until the
+ *     window resets
+ *   - a key with too few requests or tokens left for the next request is
+ *     skipped until its window resets
+ *   - a key answered with 429 cools down for the retry-after time (or a
+ *     doubling default without one) and the request is retried with
+ *     another key
+ *   - a key answered with 401 or 403 is dropped from the pool
+ *
+ * Requests in flight count against their key's budget, so concurrent
+ * requests (--serve) spread over the keys. When every key is exhausted a
+ * request waits for the earliest one to recover, up to KEY_POOL_MAX_WAIT_MS
+ * or the --deadline.
+ */
+
+#ifndef KEYPOOL_H
+#define KEYPOOL_H
+
+#include <stddef.h>
+
+/* Environment variable read when --key-pool is not given */
+#define KEY_POOL_ENV "COMMIT_AI_KEY_POOL"
+
+/* Keys read from a pool file; further lines are ignored */
+#define KEY_POOL_MAX_KEYS 64
+
+/* Cooldown after a 429 without retry-after; doubles with each 429 in a row */
+#define KEY_POOL_COOLDOWN_MS 5000L
+#define KEY_POOL_MAX_COOLDOWN_MS 120000L
+
+/* Longest a request waits for a key to recover */
+#define KEY_POOL_MAX_WAIT_MS 60000L
+
+/* A request is tried with at most this many keys per pool key before failing */
+#define KEY_POOL_RETRY_ROUNDS 2
+
+/* Rate limit headers of one answer; -1 where absent */
+struct RateLimitHeaders {
+    long requests_remaining;
+    long tokens_remaining;
+    long long requests_reset_ms;    /* until the request window resets */
+    long long tokens_reset_ms;      /* until the token window resets */
+    long long retry_after_ms;
+};
+
+/* Key pool file, or NULL (--key-pool) */
+extern const char *key_pool_path;
+
+int key_pool_load(const char *path);
+size_t key_pool_size(void);
+const char* key_pool_key(int slot);
+int key_pool_pick(long estimated_tokens, long *wait_ms);
+int key_pool_choose(long estimated_tokens, int *slot, long long *retry_at_ms);
+int key_pool_wait(long estimated_tokens);
+int key_pool_should_retry(long http_code, size_t attempts);
+void key_pool_begin(int slot, long estimated_tokens);
+void key_pool_finish(int slot, long estimated_tokens, long http_code,
+                     const struct RateLimitHeaders *limits);
+void key_pool_summary(void);
+void rate_limit_headers_init(struct RateLimitHeaders *limits);
+void rate_limit_header(struct RateLimitHeaders *limits, const char *line, size_t len);
+
+#endif /* KEYPOOL_H */
@@ -0,0 +1,482 @@
+/**
+ * Claude API Client - Persistent latency histograms
+ *
+ * See latency.h. The file is text, one sparse histogram per line:
+ *
+ *   commit-ai-latency 1
+ *   <phase> <size bucket> <model> <index>:<count> <index>:<count> ...
+ *
+ * where <index> is a histogram bucket (see bucket_index()). Text keeps the
+ * file small (most buckets are empty) and readable with grep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "claude_client.h"
+#include "latency.h"
+
+#define LATENCY_MAGIC "commit-ai-latency 1"
+#define LATENCY_DIR "commit-ai"
+#define LATENCY_FILE "latency.hist"
+
+/* Values below twice this are exact; above, each power of two gets this many buckets */
+#define LATENCY_SUB_BUCKETS 64
+
+/* Buckets up to 2^32 us (71 minutes); longer values land in the last one */
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS * 27)
+
+/* Samples the buffer first has room for; it doubles from there */
+#define LATENCY_INITIAL_PENDING 256
+
+/* Longest model name kept; longer names are cut */
+#define LATENCY_MODEL_LEN 64
+
+enum LatencyPhase {
+    PHASE_E2E,
+    PHASE_CONNECT,
+    PHASE_TLS,
+    PHASE_TTFB,
+    PHASE_TOTAL,
+    PHASE_PARSE,
+    PHASE_COUNT
+};
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "e2e", "connect", "tls", "ttfb", "total", "parse"
+};
+
+/* Diff size buckets, by upper bound in bytes; the last one is open */
+#define SIZE_BUCKETS 5
+static const size_t size_bounds[SIZE_BUCKETS - 1] = { 4096, 16384, 65536, 262144 };
+static const char *const size_names[SIZE_BUCKETS] = { "<4K", "<16K", "<64K", "<256K", ">=256K" };
+
+/* One measurement waiting to be merged */
+struct PendingSample {
+    int phase;
+    int size_bucket;
+    char model[LATENCY_MODEL_LEN];
+    long long us;
+};
+
+/* Histogram of one phase for one model and diff size */
+struct LatencySeries {
+    int phase;
+    int size_bucket;
+    char model[LATENCY_MODEL_LEN];
+    unsigned long long counts[LATENCY_BUCKETS];
+};
+
+struct LatencyTable {
+    struct LatencySeries *series;
+    size_t count;
+    size_t capacity;
+};
+
+/* Histogram file, LATENCY_OFF or NULL for the default (--latency-file) */
+const char *latency_path = NULL;
+
+/* Set by latency_begin(); nothing is measured before */
+int latency_enabled = 0;
+
+static long long run_start_us = 0;
+
+/*
+ * Guards the samples and the current request: with --pipeline and the
+ * release notes batch, one thread records transfers while another parses.
+ * The buffer is on the heap, not in whatever arena the recording thread
+ * has active, and is only merged into the file by latency_finish(), never
+ * from the network stage's event loop.
+ */
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct PendingSample *pending = NULL;
+static size_t pending_count = 0;
+static size_t pending_capacity = 0;
+
+/* Model and size of the last request, which parse and e2e are filed under */
+static char current_model[LATENCY_MODEL_LEN] = "";
+static int current_size_bucket = -1;
+
+// Function to read the monotonic clock in microseconds
+long long latency_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000L;
+}
+
+static int bucket_index(long long us) {
+    if (us < 2 * LATENCY_SUB_BUCKETS) return (int)us;
+    int msb = 63 - __builtin_clzll((unsigned long long)us);
+    int shift = msb - 6;
+    int index = LATENCY_SUB_BUCKETS * (shift + 1) + (int)((us >> shift) - LATENCY_SUB_BUCKETS);
+    return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+/* Highest value that lands in a bucket */
+static long long bucket_value(int index) {
+    if (index < 2 * LATENCY_SUB_BUCKETS) return index;
+    int shift = index / LATENCY_SUB_BUCKETS - 1;
+    long long sub = index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+static int size_bucket(size_t bytes) {
+    int bucket = 0;
+    while (bucket < SIZE_BUCKETS - 1 && bytes >= size_bounds[bucket]) bucket++;
+    return bucket;
+}
+
+/* Path of the histogram file, or NULL when recording is off */
+static const char* latency_file(int create_dir) {
+    static char path[4096];
+    if (latency_path) {
+        return strcmp(latency_path, LATENCY_OFF) == 0 ? NULL : latency_path;
+    }
+
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    char dir[4000];
+    if (cache_home && *cache_home) {
+        snprintf(dir, sizeof(dir), "%s", cache_home);
+    } else {
+        const char *home_dir = get_home_dir();
+        if (!home_dir) return NULL;
+        snprintf(dir, sizeof(dir), "%s/.cache", home_dir);
+    }
+    if (create_dir && mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, LATENCY_DIR);
+    if (create_dir && mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/%s/%s", dir, LATENCY_DIR, LATENCY_FILE);
+    return path;
+}
+
+// Function to start the end-to-end clock and turn measuring on
+void latency_begin(void) {
+    run_start_us = latency_now_us();
+    latency_enabled = latency_file(0) != NULL;
+}
+
+/* Buffer a sample under the model and size of the last request; pending_lock is held */
+static void add_sample(int phase, long long us) {
+    if (!latency_enabled || us < 0 || current_size_bucket < 0) return;
+    if (pending_count >= pending_capacity) {
+        size_t capacity = pending_capacity ? pending_capacity * 2 : LATENCY_INITIAL_PENDING;
+        struct PendingSample *grown = realloc(pending, capacity * sizeof(*grown));
+        if (!grown) return;  // the sample is lost, the run goes on
+        pending = grown;
+        pending_capacity = capacity;
+    }
+    struct PendingSample *sample = &pending[pending_count++];
+    sample->phase = phase;
+    sample->size_bucket = current_size_bucket;
+    snprintf(sample->model, sizeof(sample->model), "%s", current_model);
+    sample->us = us;
+}
+
+// Function to record the timings of one request to the API
+void latency_add_transfer(const char *model, size_t diff_bytes, const struct LatencyTransfer *transfer) {
+    if (!latency_enabled) return;
+
+    pthread_mutex_lock(&pending_lock);
+
+    // Model names go between spaces in the file
+    snprintf(current_model, sizeof(current_model), "%s", model && *model ? model : "-");
+    for (char *p = current_model; *p; p++) {
+        if (*p == ' ' || *p == '\t' || *p == '\n') *p = '_';
+    }
+    current_size_bucket = size_bucket(diff_bytes);
+
+    add_sample(PHASE_CONNECT, transfer->connect_us);
+    add_sample(PHASE_TLS, transfer->tls_us);
+    add_sample(PHASE_TTFB, transfer->ttfb_us);
+    add_sample(PHASE_TOTAL, transfer->total_us);
+    pthread_mutex_unlock(&pending_lock);
+}
+
+// Function to record the time taken to parse a response
+void latency_add_parse(long long us) {
+    pthread_mutex_lock(&pending_lock);
+    add_sample(PHASE_PARSE, us);
+    pthread_mutex_unlock(&pending_lock);
+}
+
+static struct LatencySeries* table_get(struct LatencyTable *table, int phase, int bucket,
+                                       const char *model) {
+    for (size_t i = 0; i < table->count; i++) {
+        struct LatencySeries *series = &table->series[i];
+        if (series->phase == phase && series->size_bucket == bucket &&
+            strcmp(series->model, model) == 0) {
+            return series;
+        }
+    }
+
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 16;
+        struct LatencySeries *series = mem_realloc(table->series, capacity * sizeof(*series));
+        if (!series) {
+            fprintf(stderr, "Error: Memory allocation failed for latency histograms\n");
+            return NULL;
+        }
+        table->series = series;
+        table->capacity = capacity;
+    }
+    struct LatencySeries *series = &table->series[table->count++];
+    memset(series, 0, sizeof(*series));
+    series->phase = phase;
+    series->size_bucket = bucket;
+    snprintf(series->model, sizeof(series->model), "%s", model);
+    return series;
+}
+
+static int find_name(const char *const *names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+/* Read the file into table; a missing file is an empty table */
+static int table_load(struct LatencyTable *table, const char *path) {
+    if (!file_exists(path)) return 1;
+    char *text = read_file(path);
+    if (!text) return 0;
+
+    if (strncmp(text, LATENCY_MAGIC "\n", sizeof(LATENCY_MAGIC)) != 0) {
+        fprintf(stderr, "Error: %s is not a latency histogram file\n", path);
+        mem_free(text);
+        return 0;
+    }
+
+    int ok = 1;
+    for (char *line = text + sizeof(LATENCY_MAGIC); ok && *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        char phase[16], bucket[16], model[LATENCY_MODEL_LEN];
+        int consumed = 0;
+        if (sscanf(line, "%15s %15s %63s%n", phase, bucket, model, &consumed) == 3) {
+            int phase_index = find_name(phase_names, PHASE_COUNT, phase);
+            int size_index = find_name(size_names, SIZE_BUCKETS, bucket);
+            struct LatencySeries *series = phase_index >= 0 && size_index >= 0 ?
+                                           table_get(table, phase_index, size_index, model) : NULL;
+            ok = series != NULL || phase_index < 0 || size_index < 0;
+            for (char *p = line + consumed; series && *p; ) {
+                char *end = NULL;
+                unsigned long index = strtoul(p, &end, 10);
+                if (end == p || *end != ':') break;
+                p = end + 1;
+                unsigned long long count = strtoull(p, &end, 10);
+                if (end == p) break;
+                p = end;
+                if (index < LATENCY_BUCKETS) series->counts[index] += count;
+            }
+        }
+        line = next ? next : line + strlen(line);
+    }
+
+    mem_free(text);
+    return ok;
+}
+
+/* Write table next to path, then rename it into place */
+static int table_store(const struct LatencyTable *table, const char *path) {
+    char tmp_path[4200];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%ld", path, (long)getpid());
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        fprintf(stderr, "Warning: Failed to open file: %s (%s)\n", tmp_path, strerror(errno));
+        return 0;
+    }
+
+    fprintf(file, "%s\n", LATENCY_MAGIC);
+    for (size_t i = 0; i < table->count; i++) {
+        const struct LatencySeries *series = &table->series[i];
+        fprintf(file, "%s %s %s", phase_names[series->phase], size_names[series->size_bucket],
+                series->model);
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            if (series->counts[b]) fprintf(file, " %d:%llu", b, series->counts[b]);
+        }
+        fputc('\n', file);
+    }
+
+    int ok = ferror(file) == 0;
+    ok &= fclose(file) == 0;
+    if (ok && rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Warning: Failed to update latency file %s (%s)\n", path, strerror(errno));
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+/* Lock <path>.lock, waiting for other runs; returns the fd or -1 */
+static int lock_latency_file(const char *path) {
+    char lock_path[4200];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    int fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Warning: Failed to open file: %s (%s)\n", lock_path, strerror(errno));
+        return -1;
+    }
+
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Warning: Failed to lock latency file (%s)\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/* Merge the buffered samples into the file; pending_lock is held */
+static int merge_pending(void) {
+    if (pending_count == 0) return 1;
+    const char *path = latency_file(1);
+    if (!path) {
+        pending_count = 0;
+        return 0;
+    }
+
+    int lock_fd = lock_latency_file(path);
+    if (lock_fd < 0) {
+        pending_count = 0;
+        return 0;
+    }
+
+    struct LatencyTable table;
+    memset(&table, 0, sizeof(table));
+    int ok = table_load(&table, path);
+    for (size_t i = 0; ok && i < pending_count; i++) {
+        const struct PendingSample *sample = &pending[i];
+        struct LatencySeries *series = table_get(&table, sample->phase, sample->size_bucket,
+                                                 sample->model);
+        ok = series != NULL;
+        if (series) series->counts[bucket_index(sample->us)]++;
+    }
+    ok = ok && table_store(&table, path);
+    debug_print("Merged %zu latency samples into %s", pending_count, path);
+
+    close(lock_fd);  // releases the lock
+    mem_free(table.series);
+    pending_count = 0;
+    return ok;
+}
+
+// Function to record the end-to-end time and merge everything into the file
+void latency_finish(int end_to_end) {
+    if (!latency_enabled) return;
+    pthread_mutex_lock(&pending_lock);
+    if (end_to_end) {
+        add_sample(PHASE_E2E, latency_now_us() - run_start_us);
+    }
+    struct Arena *previous = arena_activate(NULL);  // the table is freed right away
+    merge_pending();
+    arena_activate(previous);
+    free(pending);
+    pending = NULL;
+    pending_capacity = 0;
+    pthread_mutex_unlock(&pending_lock);
+}
+
+/* Value at quantile q of a histogram holding total samples, in us */
+static long long histogram_quantile(const unsigned long long *counts, unsigned long long total,
+                                    double q) {
+    unsigned long long rank = (unsigned long long)(q * (double)total + 0.999999);
+    if (rank == 0) rank = 1;
+    unsigned long long seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen >= rank) return bucket_value(b);
+    }
+    return bucket_value(LATENCY_BUCKETS - 1);
+}
+
+/* Print one line per phase of the series matching model or size bucket */
+static void print_group(const struct LatencyTable *table, const char *model, int bucket) {
+    static unsigned long long counts[LATENCY_BUCKETS];
+    printf("  %-9s %8s %10s %10s %10s %10s\n", "phase", "count", "p50 ms", "p90 ms", "p99 ms",
+           "p99.9 ms");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        memset(counts, 0, sizeof(counts));
+        unsigned long long total = 0;
+        for (size_t i = 0; i < table->count; i++) {
+            const struct LatencySeries *series = &table->series[i];
+            if (series->phase != phase) continue;
+            if (model && strcmp(series->model, model) != 0) continue;
+            if (!model && series->size_bucket != bucket) continue;
+            for (int b = 0; b < LATENCY_BUCKETS; b++) {
+                counts[b] += series->counts[b];
+                total += series->counts[b];
+            }
+        }
+        if (total == 0) continue;
+        printf("  %-9s %8llu %10.2f %10.2f %10.2f %10.2f\n", phase_names[phase], total,
+               histogram_quantile(counts, total, 0.50) / 1000.0,
+               histogram_quantile(counts, total, 0.90) / 1000.0,
+               histogram_quantile(counts, total, 0.99) / 1000.0,
+               histogram_quantile(counts, total, 0.999) / 1000.0);
+    }
+}
+
+// Function to print latency percentiles per model and per diff size
+int latency_report(void) {
+    const char *path = latency_file(0);
+    if (!path) {
+        fprintf(stderr, "Error: Latency recording is off (--latency-file %s)\n", LATENCY_OFF);
+        return 0;
+    }
+
+    struct LatencyTable table;
+    memset(&table, 0, sizeof(table));
+    if (!table_load(&table, path)) {
+        mem_free(table.series);
+        return 0;
+    }
+
+    printf("Latency file: %s\n", path);
+    if (table.count == 0) {
+        printf("No requests recorded yet\n");
+    }
+
+    // Models in order of first appearance
+    for (size_t i = 0; i < table.count; i++) {
+        int seen = 0;
+        for (size_t j = 0; j < i && !seen; j++) {
+            seen = strcmp(table.series[j].model, table.series[i].model) == 0;
+        }
+        if (seen) continue;
+        printf("\nModel %s\n", table.series[i].model);
+        print_group(&table, table.series[i].model, -1);
+    }
+
+    for (int bucket = 0; bucket < SIZE_BUCKETS; bucket++) {
+        int used = 0;
+        for (size_t i = 0; i < table.count && !used; i++) {
+            used = table.series[i].size_bucket == bucket;
+        }
+        if (!used) continue;
+        printf("\nDiff size %s\n", size_names[bucket]);
+        print_group(&table, NULL, bucket);
+    }
+
+    mem_free(table.series);
+    return 1;
+}
@@ -0,0 +1,58 @@
+/**
+ * Claude API Client - Persistent latency histograms
+ *
+ * Every run that sends a request adds its timings to a histogram file, by
+ * default $XDG_CACHE_HOME/commit-ai/latency.hist (~/.cache/... without
+ * XDG_CACHE_HOME). The phases recorded are:
+ *
+ *   e2e       start of the run to the end of it, for runs that sent a request
+ *   connect   DNS and TCP connect          (from cURL's timers)
+ *   tls       TLS handshake after connect  (HTTPS only)
+ *   ttfb      start of the request to its first response byte
+ *   total     the whole HTTP exchange
+ *   parse     response body to title and description
+ *
+ * Each (phase, model, diff size bucket) has an HDR-style histogram of
+ * microseconds: exact below 128 us, then 64 linear sub-buckets per power of
+ * two, so any value is kept within 1.6%. Samples are buffered in memory and
+ * merged into the file once per run, under an fcntl lock on <file>.lock and
+ * through a rename, so concurrent runs never lose each other's counts and
+ * readers never see a half-written file.
+ *
+ * --latency-report prints count, p50, p90, p99 and p99.9 of every phase per
+ * model and per diff size bucket.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+
+/* Environment variable read when --latency-file is not given */
+#define LATENCY_ENV "COMMIT_AI_LATENCY"
+
+/* --latency-file value that turns recording off */
+#define LATENCY_OFF "off"
+
+/* Timings of one HTTP exchange in microseconds; -1 when not measured */
+struct LatencyTransfer {
+    long long connect_us;
+    long long tls_us;
+    long long ttfb_us;
+    long long total_us;
+};
+
+/* Histogram file, LATENCY_OFF or NULL for the default (--latency-file) */
+extern const char *latency_path;
+
+/* Set by latency_begin(); nothing is measured before */
+extern int latency_enabled;
+
+long long latency_now_us(void);
+void latency_begin(void);
+void latency_add_transfer(const char *model, size_t diff_bytes, const struct LatencyTransfer *transfer);
+void latency_add_parse(long long us);
+void latency_finish(int end_to_end);
+int latency_report(void);
+
+#endif /* LATENCY_H */
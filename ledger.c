@@ -0,0 +1,352 @@
+/**
+ * Claude API Client - Token and latency ledger
+ *
+ * See ledger.h. --stats reads the whole file once, splits it into lines in
+ * place and picks the fields out of each record with strstr(): every record
+ * was written by ledger_record(), so there is no need for a JSON parser.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "claude_client.h"
+#include "git.h"
+#include "ledger.h"
+
+/* Longest record written; longer repo or model names are cut */
+#define LEDGER_MAX_RECORD 2048
+
+/* Width of the repo column in --stats */
+#define LEDGER_REPO_WIDTH 40
+
+/* Ledger file appended to, or NULL (--ledger) */
+const char *ledger_path = NULL;
+
+/* Diff bytes behind the next request; set by whoever builds the prompt */
+size_t ledger_diff_bytes = 0;
+
+/* Append text to a record as a JSON string; returns the new length */
+static size_t append_json_string(char *record, size_t len, size_t size, const char *text) {
+    if (len + 2 >= size) return len;
+    record[len++] = '"';
+    for (const unsigned char *p = (const unsigned char *)text; *p && len + 8 < size; p++) {
+        if (*p == '"' || *p == '\\') {
+            record[len++] = '\\';
+            record[len++] = (char)*p;
+        } else if (*p < 0x20) {
+            len += (size_t)snprintf(record + len, size - len, "\\u%04x", *p);
+        } else {
+            record[len++] = (char)*p;
+        }
+    }
+    record[len++] = '"';
+    record[len] = '\0';
+    return len;
+}
+
+/* Drop "user:token@" from a URL so credentials never reach the ledger */
+static void strip_credentials(char *url) {
+    char *scheme_end = strstr(url, "://");
+    if (!scheme_end) return;
+    char *host = scheme_end + 3;
+    char *at = strchr(host, '@');
+    char *slash = strchr(host, '/');
+    if (at && (!slash || at < slash)) {
+        memmove(host, at + 1, strlen(at + 1) + 1);
+    }
+}
+
+/* The repository a request belongs to, looked up once per run */
+static const char* ledger_repo(void) {
+    static char repo[512];
+    static int looked_up = 0;
+    if (looked_up) return repo;
+    looked_up = 1;
+
+    const char *const origin_argv[] = { "git", "config", "--get", "remote.origin.url", NULL };
+    const char *const toplevel_argv[] = { "git", "rev-parse", "--show-toplevel", NULL };
+    char *name = git_capture_quiet(origin_argv);
+    if (!name || !*name) {
+        mem_free(name);
+        name = git_capture_quiet(toplevel_argv);
+    }
+    if (name) {
+        trim_string(name);
+        strip_credentials(name);
+    }
+    snprintf(repo, sizeof(repo), "%s", name && *name ? name : "-");
+    mem_free(name);
+    return repo;
+}
+
+// Function to append a record for one request to the ledger
+void ledger_record(const char *model, long http_code, long long latency_ms, const char *response) {
+    if (!ledger_path) return;
+
+    struct ClaudeUsage usage;
+    memset(&usage, 0, sizeof(usage));
+    if (response && http_code >= 200 && http_code < 300) {
+        read_response_usage(response, &usage);
+    }
+
+    char record[LEDGER_MAX_RECORD];
+    size_t len = (size_t)snprintf(record, sizeof(record), "{\"ts\":%lld,\"repo\":", (long long)time(NULL));
+    len = append_json_string(record, len, sizeof(record) - 256, ledger_repo());
+    len += (size_t)snprintf(record + len, sizeof(record) - len, ",\"backend\":\"%s\",\"model\":",
+                            api_backend->name);
+    len = append_json_string(record, len, sizeof(record) - 256, model ? model : "-");
+    len += (size_t)snprintf(record + len, sizeof(record) - len,
+                            ",\"diff_bytes\":%zu,\"http\":%ld,\"latency_ms\":%lld,\"input\":%ld,"
+                            "\"output\":%ld,\"cache_read\":%ld,\"cache_write\":%ld}\n",
+                            ledger_diff_bytes, http_code, latency_ms, usage.input_tokens,
+                            usage.output_tokens, usage.cache_read_input_tokens,
+                            usage.cache_creation_input_tokens);
+
+    // One write per record keeps concurrent appends whole
+    int fd = open(ledger_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0 || write(fd, record, len) != (ssize_t)len) {
+        fprintf(stderr, "Warning: Failed to append to ledger %s (%s)\n", ledger_path, strerror(errno));
+    }
+    if (fd >= 0) close(fd);
+}
+
+/* Totals of one repository */
+struct RepoTotals {
+    const char *name;       /* NULL for an empty slot */
+    unsigned long long hash;
+    long long calls;
+    long long input;
+    long long output;
+    long long cache_read;
+    long long diff_bytes;
+};
+
+/* Open-addressing table of repositories */
+struct RepoTable {
+    struct RepoTotals *slots;
+    size_t capacity;        /* power of two */
+    size_t count;
+};
+
+static unsigned long long hash_name(const char *name) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int repo_table_grow(struct RepoTable *table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 64;
+    struct RepoTotals *slots = mem_calloc(capacity, sizeof(*slots));
+    if (!slots) {
+        fprintf(stderr, "Error: Memory allocation failed for ledger statistics\n");
+        return 0;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (!table->slots[i].name) continue;
+        size_t j = table->slots[i].hash & (capacity - 1);
+        while (slots[j].name) j = (j + 1) & (capacity - 1);
+        slots[j] = table->slots[i];
+    }
+    mem_free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return 1;
+}
+
+static struct RepoTotals* repo_table_get(struct RepoTable *table, const char *name) {
+    if ((table->count + 1) * 10 > table->capacity * 7 && !repo_table_grow(table)) {
+        return NULL;
+    }
+    unsigned long long hash = hash_name(name);
+    size_t i = hash & (table->capacity - 1);
+    while (table->slots[i].name) {
+        if (table->slots[i].hash == hash && strcmp(table->slots[i].name, name) == 0) {
+            return &table->slots[i];
+        }
+        i = (i + 1) & (table->capacity - 1);
+    }
+    table->slots[i].name = name;
+    table->slots[i].hash = hash;
+    table->count++;
+    return &table->slots[i];
+}
+
+/* Numeric field of a record; 0 when it is missing */
+static long long record_number(const char *record, const char *name) {
+    char key[32];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char *p = strstr(record, key);
+    return p ? strtoll(p + strlen(key), NULL, 10) : 0;
+}
+
+/* String field of a record, terminated in place (still escaped) */
+static const char* record_string(char *record, const char *name) {
+    char key[32];
+    snprintf(key, sizeof(key), "\"%s\":\"", name);
+    char *start = strstr(record, key);
+    if (!start) return "-";
+    start += strlen(key);
+    char *p = start;
+    while (*p && *p != '"') {
+        if (*p == '\\' && p[1]) p++;
+        p++;
+    }
+    *p = '\0';
+    return start;
+}
+
+/* Growable array of samples */
+struct Samples {
+    long long *values;
+    size_t count;
+    size_t capacity;
+};
+
+static int samples_add(struct Samples *samples, long long value) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 1024;
+        long long *values = mem_realloc(samples->values, capacity * sizeof(*values));
+        if (!values) {
+            fprintf(stderr, "Error: Memory allocation failed for ledger statistics\n");
+            return 0;
+        }
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = value;
+    return 1;
+}
+
+static int compare_long_long(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_repo_input(const void *a, const void *b) {
+    const struct RepoTotals *x = a, *y = b;
+    return (y->input > x->input) - (y->input < x->input);
+}
+
+/* Nearest-rank percentile of sorted samples */
+static long long percentile(const struct Samples *samples, double q) {
+    if (samples->count == 0) return 0;
+    size_t rank = (size_t)(q * (double)samples->count + 0.999999);
+    return samples->values[rank > 0 ? rank - 1 : 0];
+}
+
+static void print_percentiles(const char *label, struct Samples *samples) {
+    qsort(samples->values, samples->count, sizeof(*samples->values), compare_long_long);
+    printf("%-22s p50 %-8lld p90 %-8lld p99 %-8lld max %lld\n", label,
+           percentile(samples, 0.50), percentile(samples, 0.90), percentile(samples, 0.99),
+           samples->count ? samples->values[samples->count - 1] : 0);
+}
+
+static double per_kb(long long tokens, long long bytes) {
+    return bytes > 0 ? (double)tokens * 1024.0 / (double)bytes : 0.0;
+}
+
+// Function to print statistics over a ledger file
+int ledger_stats(const char *path) {
+    if (!path) {
+        fprintf(stderr, "Error: No ledger to read; use --ledger <file> or set %s\n", LEDGER_ENV);
+        return 0;
+    }
+    char *ledger = read_file(path);
+    if (!ledger) return 0;
+
+    struct RepoTable repos;
+    struct Samples latency, input, output;
+    memset(&repos, 0, sizeof(repos));
+    memset(&latency, 0, sizeof(latency));
+    memset(&input, 0, sizeof(input));
+    memset(&output, 0, sizeof(output));
+    long long calls = 0, failed = 0, total_input = 0, total_output = 0;
+    long long total_cache_read = 0, total_cache_write = 0, total_diff_bytes = 0;
+    int ok = 1;
+
+    for (char *line = ledger; ok && *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        if (*line != '{') {
+            line = next ? next : line + strlen(line);
+            continue;
+        }
+
+        calls++;
+        long long http = record_number(line, "http");
+        long long in = record_number(line, "input");
+        long long out = record_number(line, "output");
+        long long diff_bytes = record_number(line, "diff_bytes");
+        long long cache_read = record_number(line, "cache_read");
+        long long latency_ms = record_number(line, "latency_ms");
+        if (latency_ms >= 0) {
+            ok = samples_add(&latency, latency_ms);     // batch results have no latency (-1)
+        }
+        if (http < 200 || http >= 300) {
+            failed++;
+        } else {
+            ok = ok && samples_add(&input, in) && samples_add(&output, out);
+            total_input += in;
+            total_output += out;
+            total_cache_read += cache_read;
+            total_cache_write += record_number(line, "cache_write");
+            total_diff_bytes += diff_bytes;
+
+            struct RepoTotals *repo = ok ? repo_table_get(&repos, record_string(line, "repo")) : NULL;
+            ok = repo != NULL;
+            if (repo) {
+                repo->calls++;
+                repo->input += in;
+                repo->output += out;
+                repo->cache_read += cache_read;
+                repo->diff_bytes += diff_bytes;
+            }
+        }
+        line = next ? next : line + strlen(line);
+    }
+
+    if (ok) {
+        printf("Ledger: %s\n", path);
+        printf("Calls: %lld (%lld failed), %zu repos\n\n", calls, failed, repos.count);
+        print_percentiles("Latency (ms):", &latency);
+        print_percentiles("Input tokens/call:", &input);
+        print_percentiles("Output tokens/call:", &output);
+        printf("\nTokens: %lld input, %lld output, %lld cache read, %lld cache write\n",
+               total_input, total_output, total_cache_read, total_cache_write);
+        printf("Input tokens per KB of diff: %.1f\n", per_kb(total_input, total_diff_bytes));
+
+        // Pack the used slots and list the most expensive repositories first
+        size_t used = 0;
+        for (size_t i = 0; i < repos.capacity; i++) {
+            if (repos.slots[i].name) repos.slots[used++] = repos.slots[i];
+        }
+        qsort(repos.slots, used, sizeof(*repos.slots), compare_repo_input);
+        if (used > 0) {
+            printf("\n%-*s %7s %10s %8s %9s %7s\n", LEDGER_REPO_WIDTH, "Repo", "Calls", "Input",
+                   "Output", "Diff KB", "In/KB");
+        }
+        for (size_t i = 0; i < used; i++) {
+            const struct RepoTotals *repo = &repos.slots[i];
+            size_t name_len = strlen(repo->name);
+            const char *name = name_len > LEDGER_REPO_WIDTH ?
+                               repo->name + name_len - LEDGER_REPO_WIDTH : repo->name;
+            printf("%-*s %7lld %10lld %8lld %9.1f %7.1f\n", LEDGER_REPO_WIDTH, name, repo->calls,
+                   repo->input, repo->output, (double)repo->diff_bytes / 1024.0,
+                   per_kb(repo->input, repo->diff_bytes));
+        }
+    }
+
+    mem_free(repos.slots);
+    mem_free(latency.values);
+    mem_free(input.values);
+    mem_free(output.values);
+    mem_free(ledger);
+    return ok;
+}
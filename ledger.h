@@ -0,0 +1,39 @@
+/**
+ * Claude API Client - Token and latency ledger
+ *
+ * With --ledger <file> (or COMMIT_AI_LEDGER) every request sent to the API
+ * appends one NDJSON record to <file>:
+ *
+ *   {"ts":1760000000,"repo":"github.com/org/repo","backend":"anthropic",
+ *    "model":"claude-3-7-sonnet-20250219","diff_bytes":5120,"http":200,
+ *    "latency_ms":812,"input":1460,"output":41,"cache_read":0,"cache_write":0}
+ *
+ * (on one line). repo is the origin URL without credentials, or the top
+ * level directory when there is no origin. Message Batches results are
+ * recorded when they are collected, one record each, with latency_ms -1. Records are written with a
+ * single O_APPEND write, so runners sharing a file do not interleave them.
+ *
+ * --stats reads the same file and prints latency and token percentiles,
+ * totals, input tokens per KB of diff and a per-repo table sorted by input
+ * tokens: the repositories where a smaller prompt (see --digest) would
+ * save the most.
+ */
+
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <stddef.h>
+
+/* Environment variable read when --ledger is not given */
+#define LEDGER_ENV "COMMIT_AI_LEDGER"
+
+/* Ledger file appended to, or NULL (--ledger) */
+extern const char *ledger_path;
+
+/* Diff bytes behind the next request; set by whoever builds the prompt */
+extern size_t ledger_diff_bytes;
+
+void ledger_record(const char *model, long http_code, long long latency_ms, const char *response);
+int ledger_stats(const char *path);
+
+#endif /* LEDGER_H */
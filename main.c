@@ -8,500 +8,124 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
-#include <cjson/cJSON.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <errno.h>
-#include <time.h>
-#include <stdarg.h>
-#include <pwd.h>
-
-/* Debug mode flag */
-int debug_mode = 0;
-
-/* Function declarations */
-char* str_duplicate(const char *str);
-char* get_default_profile_path(void);
-char* get_default_api_key_path(void);
-void debug_print(const char *format, ...);
-int file_exists(const char* file_path);
-char* read_file(const char* file_path);
-void trim_string(char *str);
-char* read_api_key(const char* file_path);
-char* call_claude_api(const char* api_key, const char* profile, const char* git_diff);
-int parse_claude_response(const char* response, char** title, char** description);
-int save_results_to_file(const char* file_path, const char* title, const char* description);
-void display_help(const char* program_name);
+#include <curl/curl.h>
 
-// Structure to hold memory buffer for CURL responses
-struct MemoryStruct {
-    char *memory;
-    size_t size;
+#include "claude_client.h"
+#include "replay.h"
+#include "symbols.h"
+#include "git.h"
+#include "precompute.h"
+#include "batch.h"
+#include "pack.h"
+#include "route.h"
+#include "openai.h"
+#include "candidates.h"
+#include "notes.h"
+#include "remote_cache.h"
+#include "ledger.h"
+#include "eventlog.h"
+#include "latency.h"
+#include "serve.h"
+#include "keypool.h"
+#include "ingest.h"
+#include "pipeline.h"
+#include "release.h"
+
+/* Long-only options */
+enum {
+    OPT_RECORD = 256,
+    OPT_REPLAY,
+    OPT_REPLAY_SPEED,
+    OPT_DIGEST,
+    OPT_DEADLINE,
+    OPT_STAGED,
+    OPT_PRECOMPUTE,
+    OPT_WATCH,
+    OPT_DEBOUNCE,
+    OPT_DIFF_LIST,
+    OPT_BATCH_SUBMIT,
+    OPT_BATCH_COLLECT,
+    OPT_BATCH_POLL,
+    OPT_PACK,
+    OPT_PACK_TOKENS,
+    OPT_MODEL,
+    OPT_ROUTE,
+    OPT_ROUTE_THRESHOLD,
+    OPT_FAST_MODEL,
+    OPT_STRONG_MODEL,
+    OPT_ESCALATE,
+    OPT_BACKEND,
+    OPT_CANDIDATES,
+    OPT_NOTES_CACHE,
+    OPT_REMOTE_CACHE,
+    OPT_REMOTE_CACHE_TIMEOUT,
+    OPT_LEDGER,
+    OPT_STATS,
+    OPT_LOG_FILE,
+    OPT_LATENCY_FILE,
+    OPT_LATENCY_REPORT,
+    OPT_SERVE,
+    OPT_MAX_INFLIGHT,
+    OPT_TENANT_LIMIT,
+    OPT_QUEUE,
+    OPT_KEY_POOL,
+    OPT_INGEST,
+    OPT_READ_AHEAD,
+    OPT_PIPELINE,
+    OPT_RELEASE_NOTES,
+    OPT_PR
 };
 
-// Callback function for cURL to write received data
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
-    size_t realsize = size * nmemb;
-    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
-
-    char *ptr = realloc(mem->memory, mem->size + realsize + 1);
-    if (!ptr) {
-        fprintf(stderr, "Error: Not enough memory (realloc returned NULL)\n");
-        return 0;
-    }
-
-    mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->memory[mem->size] = 0;
-
-    debug_print("Received %zu bytes from API, total size: %zu", realsize, mem->size);
-
-    return realsize;
-}
-
-/* Function for string duplication (strdup might not be available in C99) */
-char* str_duplicate(const char *str) {
-    if (str == NULL) return NULL;
-
-    size_t len = strlen(str) + 1;
-    char *dup = malloc(len);
-    if (dup != NULL) {
-        memcpy(dup, str, len);
-    }
-    return dup;
-}
-
-/* Get home directory */
-const char* get_home_dir(void) {
-    const char *home_dir;
-
-    // Get home directory
-    if ((home_dir = getenv("HOME")) == NULL) {
-        struct passwd *pwd = getpwuid(getuid());
-        if (pwd == NULL) {
-            fprintf(stderr, "Error: Could not determine home directory\n");
-            return NULL;
-        }
-        home_dir = pwd->pw_dir;
-    }
-
-    return home_dir;
-}
-
-/* Get default profile path */
-char* get_default_profile_path(void) {
-    const char *home_dir = get_home_dir();
-    if (!home_dir) return NULL;
-
-    // Construct the default profile path
-    size_t path_len = strlen(home_dir) + strlen("/.config/claude/profile.txt") + 1;
-    char *path = malloc(path_len);
-    if (path == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed for default profile path\n");
-        return NULL;
-    }
-
-    snprintf(path, path_len, "%s/.config/claude/profile.txt", home_dir);
-    return path;
-}
-
-/* Get default API key path */
-char* get_default_api_key_path(void) {
-    const char *home_dir = get_home_dir();
-    if (!home_dir) return NULL;
-
-    // Construct the default API key path
-    size_t path_len = strlen(home_dir) + strlen("/.config/claude/api_key.txt") + 1;
-    char *path = malloc(path_len);
-    if (path == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed for default API key path\n");
-        return NULL;
-    }
-
-    snprintf(path, path_len, "%s/.config/claude/api_key.txt", home_dir);
-    return path;
-}
-
-/* Debug print function */
-void debug_print(const char *format, ...) {
-    if (debug_mode) {
-        va_list args;
-        va_start(args, format);
-        fprintf(stderr, "[DEBUG] ");
-        vfprintf(stderr, format, args);
-        fprintf(stderr, "\n");
-        va_end(args);
-    }
-}
-
-// Function to check if a file exists
-int file_exists(const char* file_path) {
-    return access(file_path, F_OK) == 0;
-}
-
-// Function to read file contents into a string
-char* read_file(const char* file_path) {
-    FILE *file = fopen(file_path, "rb");
-    if (!file) {
-        fprintf(stderr, "Error: Failed to open file: %s (%s)\n",
-                file_path, strerror(errno));
-        return NULL;
-    }
-
-    debug_print("Opened file: %s", file_path);
-
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    debug_print("File size: %ld bytes", file_size);
-
-    // Allocate memory for the file content
-    char *buffer = (char*)malloc(file_size + 1);
-    if (!buffer) {
-        fprintf(stderr, "Error: Memory allocation failed for file content\n");
-        fclose(file);
-        return NULL;
-    }
-
-    // Read file content
-    size_t read_size = fread(buffer, 1, file_size, file);
-    buffer[read_size] = '\0';  // Null-terminate the string
-
-    if (read_size != (size_t)file_size) {
-        fprintf(stderr, "Warning: Read %zu bytes, expected %ld bytes\n",
-                read_size, file_size);
-    }
-
-    fclose(file);
-    return buffer;
-}
-
-// Function to trim whitespace from a string
-void trim_string(char *str) {
-    if (!str) return;
-
-    // Trim leading whitespace
-    char *start = str;
-    while (*start && (*start == ' ' || *start == '\n' || *start == '\r' || *start == '\t')) {
-        start++;
-    }
-
-    if (start != str) {
-        memmove(str, start, strlen(start) + 1);
-    }
-
-    // Trim trailing whitespace
-    char *end = str + strlen(str) - 1;
-    while (end > str && (*end == ' ' || *end == '\n' || *end == '\r' || *end == '\t')) {
-        *end = '\0';
-        end--;
-    }
-
-    debug_print("Trimmed string to %zu characters", strlen(str));
-}
-
-// Function to read API key from file
-char* read_api_key(const char* file_path) {
-    char *api_key = read_file(file_path);
-    if (api_key) {
-        trim_string(api_key);
-        debug_print("Successfully read API key (length: %zu)", strlen(api_key));
-    }
-    return api_key;
-}
-
-// Function to make a request to Claude API
-char* call_claude_api(const char* api_key, const char* profile, const char* git_diff) {
-    debug_print("Preparing API request");
-
-    CURL *curl;
-    CURLcode res;
-    struct MemoryStruct chunk;
-
-    // Initialize memory chunk
-    chunk.memory = malloc(1);
-    if (!chunk.memory) {
-        fprintf(stderr, "Error: Initial memory allocation failed\n");
-        return NULL;
-    }
-
-    chunk.size = 0;
-
-    // Create payload as JSON
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        fprintf(stderr, "Error: Failed to create JSON object\n");
-        free(chunk.memory);
-        return NULL;
-    }
-
-    cJSON_AddStringToObject(root, "model", "claude-3-7-sonnet-20250219");
-    cJSON_AddNumberToObject(root, "max_tokens", 1024);
-    cJSON_AddNumberToObject(root, "temperature", 0.5);
-
-    cJSON *messages = cJSON_CreateArray();
-    if (!messages) {
-        fprintf(stderr, "Error: Failed to create JSON array\n");
-        cJSON_Delete(root);
-        free(chunk.memory);
-        return NULL;
-    }
-
-    cJSON *message = cJSON_CreateObject();
-    if (!message) {
-        fprintf(stderr, "Error: Failed to create JSON message object\n");
-        cJSON_Delete(root);
-        free(chunk.memory);
-        return NULL;
-    }
-
-    cJSON_AddStringToObject(message, "role", "user");
-
-    // Construct the content string
-    const char *content_template = "Here is my profile:\n\n%s\n\nHere is a git diff that needs review:\n\n%s\n\nPlease provide a concise title and description of the changes.";
-
-    // Calculate the length needed for the content string
-    int content_len = snprintf(NULL, 0, content_template, profile, git_diff);
-    
-    char *content = malloc(content_len + 1);
-    if (!content) {
-        fprintf(stderr, "Error: Memory allocation failed for content string\n");
-        cJSON_Delete(root);
-        free(chunk.memory);
-        return NULL;
-    }
-
-    // Format the content string
-    snprintf(content, content_len + 1, content_template, profile, git_diff);
-    debug_print("Content length: %d bytes", content_len);
-
-    cJSON_AddStringToObject(message, "content", content);
-    cJSON_AddItemToArray(messages, message);
-    cJSON_AddItemToObject(root, "messages", messages);
-
-    char *json_string = cJSON_Print(root);
-    if (!json_string) {
-        fprintf(stderr, "Error: Failed to convert JSON to string\n");
-        free(content);
-        cJSON_Delete(root);
-        free(chunk.memory);
-        return NULL;
-    }
-
-    free(content);
-
-    debug_print("JSON request payload created (length: %zu)", strlen(json_string));
-
-    // Initialize cURL
-    curl_global_init(CURL_GLOBAL_ALL);
-    curl = curl_easy_init();
-
-    char *response = NULL;
-
-    if (curl) {
-        debug_print("cURL initialized");
-
-        // Set cURL options
-        curl_easy_setopt(curl, CURLOPT_URL, "https://api.anthropic.com/v1/messages");
-
-        // Set HTTP headers
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-
-        char auth_header[512];
-        snprintf(auth_header, sizeof(auth_header), "x-api-key: %s", api_key);
-        headers = curl_slist_append(headers, auth_header);
-        headers = curl_slist_append(headers, "anthropic-version: 2023-06-01");
-
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-        // Set request data
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_string);
-
-        // Set write function
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-
-        // Set timeouts
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 120); // 2 minute timeout
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10); // 10 seconds to connect
-
-        // Enable verbose output in debug mode
-        if (debug_mode) {
-            curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-        }
-
-        debug_print("Sending API request...");
-
-        // Remember the request time
-        time_t request_start = time(NULL);
-
-        // Perform the request
-        res = curl_easy_perform(curl);
-
-        // Calculate request duration
-        time_t request_end = time(NULL);
-        debug_print("API request completed in %ld seconds", (long)(request_end - request_start));
-
-        // Check for errors
-        if (res != CURLE_OK) {
-            fprintf(stderr, "Error: cURL request failed: %s\n", curl_easy_strerror(res));
-        } else {
-            // Get HTTP response code
-            long http_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-            debug_print("HTTP response code: %ld", http_code);
-
-            if (http_code >= 200 && http_code < 300) {
-                response = str_duplicate(chunk.memory);
-                debug_print("API response received (length: %zu)", chunk.size);
-            } else {
-                fprintf(stderr, "Error: API request failed with HTTP code %ld\n", http_code);
-                fprintf(stderr, "Response: %s\n", chunk.memory);
-            }
-        }
-
-        // Clean up
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-    } else {
-        fprintf(stderr, "Error: Failed to initialize cURL\n");
-    }
-
-    curl_global_cleanup();
-    free(json_string);
-    cJSON_Delete(root);
-    free(chunk.memory);
-
-    return response;
-}
-
-// Function to parse Claude's response
-int parse_claude_response(const char* response, char** title, char** description) {
-    debug_print("Parsing API response");
-
-    if (!response || !title || !description) {
-        fprintf(stderr, "Error: Invalid parameters for response parsing\n");
-        return 0;
-    }
-
-    // Initialize output parameters
-    *title = NULL;
-    *description = NULL;
-
-    cJSON *root = cJSON_Parse(response);
-    if (!root) {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr) {
-            fprintf(stderr, "Error: JSON parsing failed near: %s\n", error_ptr);
-        } else {
-            fprintf(stderr, "Error: JSON parsing failed\n");
-        }
-        return 0;
-    }
-
-    cJSON *content = cJSON_GetObjectItem(root, "content");
-    if (!content || !cJSON_IsArray(content)) {
-        fprintf(stderr, "Error: Invalid response format (content field not found or not an array)\n");
-        cJSON_Delete(root);
-        return 0;
-    }
-
-    cJSON *first_content = cJSON_GetArrayItem(content, 0);
-    if (!first_content) {
-        fprintf(stderr, "Error: Content array is empty\n");
-        cJSON_Delete(root);
-        return 0;
-    }
-
-    cJSON *text = cJSON_GetObjectItem(first_content, "text");
-    if (!text || !cJSON_IsString(text)) {
-        fprintf(stderr, "Error: Text field not found or not a string\n");
-        cJSON_Delete(root);
-        return 0;
-    }
-
-    // Parse the text to extract title and description
-    char *text_value = text->valuestring;
-    if (!text_value) {
-        fprintf(stderr, "Error: Text value is NULL\n");
-        cJSON_Delete(root);
-        return 0;
-    }
-
-    debug_print("Response text length: %zu bytes", strlen(text_value));
-
-    char *line_start = text_value;
-    char *line_end = NULL;
-
-    // Skip empty lines at the beginning
-    while (*line_start && (*line_start == '\n' || *line_start == '\r')) {
-        line_start++;
-    }
-
-    // Find the end of the first non-empty line (title)
-    line_end = strchr(line_start, '\n');
-    if (line_end) {
-        *title = (char*)malloc(line_end - line_start + 1);
-        if (!*title) {
-            fprintf(stderr, "Error: Memory allocation failed for title\n");
-            cJSON_Delete(root);
-            return 0;
-        }
-        strncpy(*title, line_start, line_end - line_start);
-        (*title)[line_end - line_start] = '\0';
-
-        debug_print("Title extracted: \"%s\"", *title);
-
-        // Description is everything after the title
-        size_t desc_len = strlen(text_value) - (line_end - text_value) + 1;
-        *description = (char*)malloc(desc_len);
-        if (!*description) {
-            fprintf(stderr, "Error: Memory allocation failed for description\n");
-            free(*title);
-            *title = NULL;
-            cJSON_Delete(root);
-            return 0;
-        }
-        strncpy(*description, line_end + 1, desc_len - 1);
-        (*description)[desc_len - 1] = '\0';
-
-        debug_print("Description extracted (length: %zu)", strlen(*description));
-    } else {
-        // Just one line in the response
-        debug_print("No newline found, using entire response as title");
-        *title = str_duplicate(line_start);
-        *description = str_duplicate("");
-    }
-
-    cJSON_Delete(root);
-    return 1;
-}
-
-// Function to save results to file
-int save_results_to_file(const char* file_path, const char* title, const char* description) {
-    if (!file_path || !title || !description) {
-        fprintf(stderr, "Error: Invalid parameters for saving results\n");
-        return 0;
-    }
-
-    FILE *file = fopen(file_path, "w");
-    if (!file) {
-        fprintf(stderr, "Error: Failed to open output file: %s (%s)\n",
-                file_path, strerror(errno));
-        return 0;
-    }
-
-    fprintf(file, "# %s\n\n%s", title, description);
-    fclose(file);
+static const struct option long_options[] = {
+    { "help", no_argument, NULL, 'h' },
+    { "record", required_argument, NULL, OPT_RECORD },
+    { "replay", required_argument, NULL, OPT_REPLAY },
+    { "replay-speed", required_argument, NULL, OPT_REPLAY_SPEED },
+    { "digest", required_argument, NULL, OPT_DIGEST },
+    { "deadline", required_argument, NULL, OPT_DEADLINE },
+    { "staged", no_argument, NULL, OPT_STAGED },
+    { "precompute", no_argument, NULL, OPT_PRECOMPUTE },
+    { "watch", no_argument, NULL, OPT_WATCH },
+    { "debounce", required_argument, NULL, OPT_DEBOUNCE },
+    { "diff-list", required_argument, NULL, OPT_DIFF_LIST },
+    { "batch-submit", required_argument, NULL, OPT_BATCH_SUBMIT },
+    { "batch-collect", required_argument, NULL, OPT_BATCH_COLLECT },
+    { "batch-poll", required_argument, NULL, OPT_BATCH_POLL },
+    { "pack", no_argument, NULL, OPT_PACK },
+    { "pack-tokens", required_argument, NULL, OPT_PACK_TOKENS },
+    { "model", required_argument, NULL, OPT_MODEL },
+    { "route", no_argument, NULL, OPT_ROUTE },
+    { "route-threshold", required_argument, NULL, OPT_ROUTE_THRESHOLD },
+    { "fast-model", required_argument, NULL, OPT_FAST_MODEL },
+    { "strong-model", required_argument, NULL, OPT_STRONG_MODEL },
+    { "escalate", no_argument, NULL, OPT_ESCALATE },
+    { "backend", required_argument, NULL, OPT_BACKEND },
+    { "candidates", required_argument, NULL, OPT_CANDIDATES },
+    { "notes-cache", no_argument, NULL, OPT_NOTES_CACHE },
+    { "remote-cache", required_argument, NULL, OPT_REMOTE_CACHE },
+    { "remote-cache-timeout", required_argument, NULL, OPT_REMOTE_CACHE_TIMEOUT },
+    { "ledger", required_argument, NULL, OPT_LEDGER },
+    { "stats", no_argument, NULL, OPT_STATS },
+    { "log-file", required_argument, NULL, OPT_LOG_FILE },
+    { "latency-file", required_argument, NULL, OPT_LATENCY_FILE },
+    { "latency-report", no_argument, NULL, OPT_LATENCY_REPORT },
+    { "serve", required_argument, NULL, OPT_SERVE },
+    { "max-inflight", required_argument, NULL, OPT_MAX_INFLIGHT },
+    { "tenant-limit", required_argument, NULL, OPT_TENANT_LIMIT },
+    { "queue", required_argument, NULL, OPT_QUEUE },
+    { "key-pool", required_argument, NULL, OPT_KEY_POOL },
+    { "ingest", required_argument, NULL, OPT_INGEST },
+    { "read-ahead", required_argument, NULL, OPT_READ_AHEAD },
+    { "pipeline", no_argument, NULL, OPT_PIPELINE },
+    { "release-notes", required_argument, NULL, OPT_RELEASE_NOTES },
+    { "pr", required_argument, NULL, OPT_PR },
+    { NULL, 0, NULL, 0 }
+};
 
-    printf("Results saved to: %s\n", file_path);
-    return 1;
-}
+void display_help(const char* program_name);
+static int finish_request(struct Arena *arena, int status);
 
 // Function to display the help message
 void display_help(const char* program_name) {
@@ -511,20 +135,154 @@ void display_help(const char* program_name) {
     printf("  -h                Display this help message\n");
     printf("  -k <file>         Path to file containing the API key\n");
     printf("                    (default: ~/.config/claude/api_key.txt)\n");
+    printf("  --key-pool <file> Spread requests over the API keys in <file>, one per\n");
+    printf("                    line, by their rate limit budgets\n");
+    printf("                    (default: $%s)\n", KEY_POOL_ENV);
     printf("  -p <file>         Path to profile file\n");
     printf("                    (default: ~/.config/claude/profile.txt)\n");
-    printf("  -d <file>         Read git diff from a file instead of command line\n");
+    printf("  -d <file>         Read git diff from a file instead of command line; a\n");
+    printf("                    directory works like a --diff-list of its .diff files\n");
     printf("  -o <file>         Save results to the specified file\n");
+    printf("  -u <url>          Base URL of the Messages API\n");
+    printf("                    (default: $ANTHROPIC_BASE_URL or %s)\n", DEFAULT_API_BASE_URL);
     printf("  -v                Enable verbose/debug output\n");
+    printf("  --backend <name>  Server to ask: anthropic (default) or openai, an\n");
+    printf("                    OpenAI-compatible /v1/chat/completions server\n");
+    printf("                    (default URL for openai: %s)\n", OPENAI_DEFAULT_BASE_URL);
+    printf("  --model <name>    Model to ask (default: %s)\n", DEFAULT_MODEL);
+    printf("  --route           Score each diff locally and send it to the fast or the\n");
+    printf("                    strong model tier\n");
+    printf("  --route-threshold <n>\n");
+    printf("                    Score from which a diff goes to the strong tier\n");
+    printf("                    (default: %d)\n", ROUTE_DEFAULT_THRESHOLD);
+    printf("  --fast-model <name>\n");
+    printf("                    Model of the fast tier (default: %s)\n", ROUTE_DEFAULT_FAST_MODEL);
+    printf("  --strong-model <name>\n");
+    printf("                    Model of the strong tier (default: --model)\n");
+    printf("  --escalate        With --route, ask the strong tier again when a fast-tier\n");
+    printf("                    answer fails validation\n");
+    printf("  --candidates <n>  Ask for <n> alternative messages in one request and pick\n");
+    printf("                    one on the terminal, or print and save them all\n");
+    printf("  --notes-cache     Look up and store messages in git notes (%s),\n", NOTES_REF);
+    printf("                    keyed by patch-id, model and profile\n");
+    printf("  --remote-cache <url>\n");
+    printf("                    Look up and store messages in an HTTP blob store\n");
+    printf("                    (GET/PUT <url>/<key>; default: $%s)\n", REMOTE_CACHE_URL_ENV);
+    printf("  --remote-cache-timeout <ms>\n");
+    printf("                    Timeout of one cache request (default: %d)\n",
+           REMOTE_CACHE_DEFAULT_TIMEOUT_MS);
+    printf("  --ledger <file>   Append tokens, latency and status of every request to\n");
+    printf("                    <file> as NDJSON (default: $%s)\n", LEDGER_ENV);
+    printf("  --stats           Print percentiles and per-repo totals from the ledger\n");
+    printf("  --log-file <file> Append the debug events of the run to <file>, even\n");
+    printf("                    without -v (default: $%s)\n", EVENT_LOG_ENV);
+    printf("  --latency-file <file>\n");
+    printf("                    Histogram file request latencies are merged into, or\n");
+    printf("                    \"%s\" (default: $%s, else\n", LATENCY_OFF, LATENCY_ENV);
+    printf("                    $XDG_CACHE_HOME/commit-ai/latency.hist)\n");
+    printf("  --latency-report  Print p50/p90/p99/p99.9 of each request phase per model\n");
+    printf("                    and per diff size\n");
+    printf("  --serve <[host:]port>\n");
+    printf("                    Answer POST /v1/commit-message requests over HTTP\n");
+    printf("                    (host default: 127.0.0.1); --deadline limits each request\n");
+    printf("  --max-inflight <n>\n");
+    printf("                    Requests sent upstream at once (default: %d, or %d\n",
+           SERVE_DEFAULT_MAX_INFLIGHT, PIPELINE_DEFAULT_MAX_INFLIGHT);
+    printf("                    with --pipeline)\n");
+    printf("  --tenant-limit <n>\n");
+    printf("                    Requests in flight per X-Tenant (default: %d)\n", SERVE_DEFAULT_TENANT_LIMIT);
+    printf("  --queue <n>       Requests waiting before 503s are sent (default: %d)\n", SERVE_DEFAULT_QUEUE);
+    printf("  --record <dir>    Record API exchanges (request, headers, body, timing)\n");
+    printf("  --replay <dir>    Serve API exchanges from a recording, without network\n");
+    printf("  --replay-speed <x>\n");
+    printf("                    Replay pace: 1 = recorded timing (default), 0 = no delays\n");
+    printf("  --digest <mode>   Summarize changed functions, types and config keys:\n");
+    printf("                    off (default), prepend (before the full diff) or\n");
+    printf("                    compact (before a condensed diff; smaller prompt)\n");
+    printf("  --deadline <ms>   Give up on the API after <ms> and print a summary\n");
+    printf("                    generated locally from the diff instead\n");
+    printf("  --staged          Use the staged changes (git diff --cached), or the\n");
+    printf("                    message precomputed for them if it is current\n");
+    printf("  --precompute      Precompute the message for the staged changes into\n");
+    printf("                    .git/%s/ (for the post-index-change hook)\n", PRECOMPUTE_DIR);
+    printf("  --watch           Keep precomputing whenever the index changes\n");
+    printf("  --debounce <ms>   Quiet period before precomputing (default: %d)\n", DEFAULT_DEBOUNCE_MS);
+    printf("  --diff-list <file>\n");
+    printf("                    Print a message for every diff file listed in <file>,\n");
+    printf("                    one per line; with -o <dir>, also save them as\n");
+    printf("                    <dir>/<id>.md\n");
+    printf("  --ingest <mode>   How listed diffs are read ahead: auto, io_uring or\n");
+    printf("                    threads (default: auto)\n");
+    printf("  --read-ahead <n>  Listed diffs read ahead of the requests (default: %d)\n", INGEST_DEFAULT_DEPTH);
+    printf("  --pack            With --diff-list, send several small diffs per request\n");
+    printf("  --pack-tokens <n> Estimated input tokens per packed request (default: %d)\n", PACK_DEFAULT_TOKENS);
+    printf("  --pipeline        With --diff-list, prepare, send and print in separate\n");
+    printf("                    stages with up to --max-inflight requests at once\n");
+    printf("  --release-notes <range>\n");
+    printf("                    Write release notes for the commits of <range> (e.g.\n");
+    printf("                    v1.2..v1.3), keeping per-commit summaries in\n");
+    printf("                    .git/%s/%s/ for the next run\n", PRECOMPUTE_DIR, RELEASE_SUMMARY_DIR);
+    printf("  --pr <base>       Title and description of a pull request for the commits\n");
+    printf("                    of <base>..HEAD, combined from the same summaries\n");
+    printf("  --batch-submit <state>\n");
+    printf("                    Send the --diff-list diffs as one Message Batch and store\n");
+    printf("                    its id in <state>\n");
+    printf("  --batch-collect <state>\n");
+    printf("                    Wait for the batch in <state> and print every result;\n");
+    printf("                    with -o <dir>, also save them as <dir>/<id>.md\n");
+    printf("  --batch-poll <ms> Interval between batch status checks (default: %d)\n", BATCH_DEFAULT_POLL_MS);
     printf("\nExamples:\n");
     printf("  %s \"$(git diff)\"                            # Use defaults\n", program_name);
     printf("  %s -k custom_key.txt \"$(git diff)\"         # Custom API key\n", program_name);
     printf("  %s -p my_profile.txt \"$(git diff)\"         # Custom profile\n", program_name);
     printf("  %s -d changes.diff                         # Read diff from file\n", program_name);
     printf("  %s -o commit_message.md \"$(git diff)\"      # Save to file\n", program_name);
+    printf("  %s -u http://127.0.0.1:8089 -d changes.diff  # Local mock server\n", program_name);
+    printf("  %s --replay rec/ --replay-speed 0 -d x.diff  # Offline replay\n", program_name);
+    printf("  %s --digest compact -d big.diff             # Smaller prompt\n", program_name);
+    printf("  %s --deadline 2000 \"$(git diff --cached)\"   # Commit hook\n", program_name);
+    printf("  %s --staged -o commit_msg.md                # Staged changes\n", program_name);
+    printf("  %s --diff-list diffs.txt --pack -o msgs/  # Many small diffs\n", program_name);
+    printf("  %s --diff-list diffs.txt --batch-submit b.state  # Bulk job\n", program_name);
+    printf("  %s --release-notes v1.2..v1.3 -o NOTES.md   # Release notes\n", program_name);
+    printf("  %s --pr origin/main -o pr.md               # Pull request\n", program_name);
+    printf("  %s --route --escalate --staged              # Cheap model when it will do\n", program_name);
+    printf("  %s --candidates 3 --staged -o msg.md        # Pick from alternatives\n", program_name);
+    printf("  %s --backend openai --model qwen -d x.diff  # Local inference server\n", program_name);
+    printf("  %s --serve 8090 --tenant-limit 2            # Service for bots\n", program_name);
     printf("\nSee README.md for more information.\n");
 }
 
+// Function to release everything allocated for the request and pass on status
+static int finish_request(struct Arena *arena, int status) {
+    if (debug_mode || event_log_path) {
+        key_pool_summary();
+        struct ArenaStats stats;
+        arena_get_stats(arena, &stats);
+        debug_print("Arena: %zu allocations, %zu bytes peak in %zu blocks (%zu bytes)",
+                    stats.allocations, stats.peak, stats.blocks, stats.reserved);
+    }
+
+    arena_activate(NULL);
+    arena_destroy(arena);
+    latency_finish(status == 0);
+    curl_global_cleanup();
+    event_log_flush();
+    return status;
+}
+
+// Function to explain why the deadline fallback is used; only a spent budget is expected
+static void report_deadline_fallback(long deadline_ms) {
+    if (deadline_remaining_ms() == 0) {
+        fprintf(stderr, "Warning: No answer from the API within %ld ms, "
+                        "using a summary generated from the diff\n", deadline_ms);
+    } else {
+        // Refused before the budget ran out (bad key, 4xx, 5xx): the cause was printed above
+        fprintf(stderr, "Error: The API request failed before the deadline\n");
+        fprintf(stderr, "Warning: Using a summary generated from the diff\n");
+    }
+}
+
 int main(int argc, char* argv[]) {
     // Default values
     char *key_file_path = NULL;
@@ -535,10 +293,29 @@ int main(int argc, char* argv[]) {
     int use_diff_file = 0;
     int use_default_key = 1;  // Default to using the default API key
     int use_default_profile = 1;  // Default to using the default profile
+    long deadline_ms = 0;
+    int use_staged = 0;
+    int precompute_mode = 0;
+    int watch_mode = 0;
+    char *diff_list_path = NULL;
+    char *batch_submit_path = NULL;
+    char *batch_collect_path = NULL;
+    const char *strong_model = NULL;
+    const char *base_url = NULL;
+    long candidate_count = 1;
+    int stats_mode = 0;
+    int latency_report_mode = 0;
+    const char *serve_address = NULL;
+    const char *release_range = NULL;
+    const char *pr_base = NULL;
+    char *end = NULL;
+
+    // Debug events are kept in memory and written out at exit or on a crash
+    event_log_install();
 
     // Parse command line arguments
     int opt;
-    while ((opt = getopt(argc, argv, "hk:p:d:o:v")) != -1) {
+    while ((opt = getopt_long(argc, argv, "hk:p:d:o:u:v", long_options, NULL)) != -1) {
         switch (opt) {
             case 'h':
                 display_help(argv[0]);
@@ -558,9 +335,188 @@ int main(int argc, char* argv[]) {
             case 'o':
                 output_file_path = optarg;
                 break;
+            case 'u':
+                base_url = optarg;
+                break;
             case 'v':
                 debug_mode = 1;
                 break;
+            case OPT_RECORD:
+                record_dir = optarg;
+                break;
+            case OPT_REPLAY:
+                replay_dir = optarg;
+                break;
+            case OPT_REPLAY_SPEED:
+                replay_speed = atof(optarg);
+                break;
+            case OPT_DEADLINE:
+                deadline_ms = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || deadline_ms <= 0) {
+                    fprintf(stderr, "Error: Invalid deadline: %s (milliseconds)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_STAGED:
+                use_staged = 1;
+                break;
+            case OPT_PRECOMPUTE:
+                precompute_mode = 1;
+                break;
+            case OPT_WATCH:
+                watch_mode = 1;
+                break;
+            case OPT_DEBOUNCE:
+                precompute_debounce_ms = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || precompute_debounce_ms < 0) {
+                    fprintf(stderr, "Error: Invalid debounce: %s (milliseconds)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_DIFF_LIST:
+                diff_list_path = optarg;
+                break;
+            case OPT_BATCH_SUBMIT:
+                batch_submit_path = optarg;
+                break;
+            case OPT_BATCH_COLLECT:
+                batch_collect_path = optarg;
+                break;
+            case OPT_BATCH_POLL:
+                batch_poll_ms = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || batch_poll_ms <= 0) {
+                    fprintf(stderr, "Error: Invalid batch poll interval: %s (milliseconds)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_PACK:
+                pack_mode = 1;
+                break;
+            case OPT_INGEST:
+                if (!parse_ingest_mode(optarg, &ingest_mode)) {
+                    return 1;
+                }
+                break;
+            case OPT_READ_AHEAD:
+                ingest_depth = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || ingest_depth < 1 || ingest_depth > 4096) {
+                    fprintf(stderr, "Error: Invalid read-ahead: %s (1 to 4096 files)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_PACK_TOKENS:
+                pack_tokens = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || pack_tokens <= 0) {
+                    fprintf(stderr, "Error: Invalid pack token ceiling: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_MODEL:
+                api_model = optarg;
+                break;
+            case OPT_ROUTE:
+                route_mode = 1;
+                break;
+            case OPT_ROUTE_THRESHOLD:
+                route_threshold = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || route_threshold < 0) {
+                    fprintf(stderr, "Error: Invalid route threshold: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_FAST_MODEL:
+                route_fast_model = optarg;
+                break;
+            case OPT_STRONG_MODEL:
+                strong_model = optarg;
+                break;
+            case OPT_ESCALATE:
+                route_escalate = 1;
+                break;
+            case OPT_CANDIDATES:
+                candidate_count = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || candidate_count < 1 ||
+                    candidate_count > CANDIDATES_MAX) {
+                    fprintf(stderr, "Error: Invalid candidate count: %s (1 to %d)\n", optarg, CANDIDATES_MAX);
+                    return 1;
+                }
+                break;
+            case OPT_NOTES_CACHE:
+                notes_cache_mode = 1;
+                break;
+            case OPT_KEY_POOL:
+                key_pool_path = optarg;
+                break;
+            case OPT_LEDGER:
+                ledger_path = optarg;
+                break;
+            case OPT_STATS:
+                stats_mode = 1;
+                break;
+            case OPT_LOG_FILE:
+                event_log_path = optarg;
+                break;
+            case OPT_LATENCY_FILE:
+                latency_path = optarg;
+                break;
+            case OPT_LATENCY_REPORT:
+                latency_report_mode = 1;
+                break;
+            case OPT_SERVE:
+                serve_address = optarg;
+                break;
+            case OPT_MAX_INFLIGHT:
+                serve_max_inflight = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || serve_max_inflight <= 0) {
+                    fprintf(stderr, "Error: Invalid in-flight limit: %s\n", optarg);
+                    return 1;
+                }
+                pipeline_max_inflight = serve_max_inflight;
+                break;
+            case OPT_PIPELINE:
+                pipeline_mode = 1;
+                break;
+            case OPT_RELEASE_NOTES:
+                release_range = optarg;
+                break;
+            case OPT_PR:
+                pr_base = optarg;
+                break;
+            case OPT_TENANT_LIMIT:
+                serve_tenant_limit = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || serve_tenant_limit <= 0) {
+                    fprintf(stderr, "Error: Invalid tenant limit: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_QUEUE:
+                serve_queue_size = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || serve_queue_size < 0) {
+                    fprintf(stderr, "Error: Invalid queue size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_REMOTE_CACHE:
+                remote_cache_url = optarg;
+                break;
+            case OPT_REMOTE_CACHE_TIMEOUT:
+                remote_cache_timeout_ms = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || remote_cache_timeout_ms <= 0) {
+                    fprintf(stderr, "Error: Invalid remote cache timeout: %s (milliseconds)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_BACKEND:
+                api_backend = find_backend(optarg);
+                if (!api_backend) {
+                    return 1;
+                }
+                break;
+            case OPT_DIGEST:
+                if (!parse_digest_mode(optarg, &digest_mode)) {
+                    return 1;
+                }
+                break;
             default:
                 fprintf(stderr, "Unknown option: %c\n", opt);
                 display_help(argv[0]);
@@ -568,34 +524,173 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (record_dir && replay_dir) {
+        fprintf(stderr, "Error: --record and --replay cannot be combined\n");
+        return 1;
+    }
+
+    // -d <dir> is a --diff-list of the directory's .diff files
+    if (use_diff_file && is_diff_dir(git_diff_file_path)) {
+        if (diff_list_path) {
+            fprintf(stderr, "Error: -d <dir> and --diff-list cannot be combined\n");
+            return 1;
+        }
+        diff_list_path = git_diff_file_path;
+        use_diff_file = 0;
+    }
+
+    if (batch_submit_path && batch_collect_path) {
+        fprintf(stderr, "Error: --batch-submit and --batch-collect cannot be combined\n");
+        return 1;
+    }
+    if (batch_submit_path && (!diff_list_path || is_diff_dir(diff_list_path))) {
+        fprintf(stderr, "Error: --batch-submit needs a --diff-list file\n");
+        return 1;
+    }
+    if (pack_mode && (!diff_list_path || batch_submit_path)) {
+        fprintf(stderr, "Error: --pack works on a --diff-list without --batch-submit\n");
+        return 1;
+    }
+    if (pipeline_mode && (!diff_list_path || batch_submit_path)) {
+        fprintf(stderr, "Error: --pipeline works on a --diff-list without --batch-submit\n");
+        return 1;
+    }
+    if (pipeline_mode && (record_dir || replay_dir || route_escalate)) {
+        fprintf(stderr, "Error: --pipeline cannot be combined with --record, --replay or --escalate\n");
+        return 1;
+    }
+    if ((batch_submit_path || batch_collect_path) && (record_dir || replay_dir)) {
+        fprintf(stderr, "Error: Batch mode cannot be recorded or replayed\n");
+        return 1;
+    }
+
+    if (serve_address && (record_dir || replay_dir || diff_list_path || batch_submit_path ||
+                          batch_collect_path || use_staged || precompute_mode || watch_mode)) {
+        fprintf(stderr, "Error: --serve cannot be combined with other modes\n");
+        return 1;
+    }
+
+    if (release_range && pr_base) {
+        fprintf(stderr, "Error: --release-notes and --pr cannot be combined\n");
+        return 1;
+    }
+    if ((release_range || pr_base) &&
+        (record_dir || replay_dir || diff_list_path || batch_submit_path || batch_collect_path ||
+         use_staged || precompute_mode || watch_mode || serve_address || use_diff_file ||
+         route_escalate || candidate_count > 1)) {
+        fprintf(stderr, "Error: %s cannot be combined with other modes, --escalate or --candidates\n",
+                release_range ? "--release-notes" : "--pr");
+        return 1;
+    }
+
+    if ((batch_submit_path || batch_collect_path) && api_backend != &anthropic_backend) {
+        fprintf(stderr, "Error: Batch mode needs the anthropic backend\n");
+        return 1;
+    }
+
+    // -u takes precedence over the environment, which only names a Messages API host
+    const char *env_base_url = getenv("ANTHROPIC_BASE_URL");
+    if (base_url) {
+        api_base_url = base_url;
+    } else if (api_backend == &anthropic_backend && env_base_url && *env_base_url) {
+        api_base_url = env_base_url;
+    } else {
+        api_base_url = api_backend->default_base_url;
+    }
+
+    // CI runners usually configure the cache through the environment
+    const char *env_cache_url = getenv(REMOTE_CACHE_URL_ENV);
+    if (!remote_cache_url && env_cache_url && *env_cache_url) {
+        remote_cache_url = env_cache_url;
+    }
+
+    const char *env_key_pool = getenv(KEY_POOL_ENV);
+    if (!key_pool_path && env_key_pool && *env_key_pool) {
+        key_pool_path = env_key_pool;
+    }
+
+    const char *env_ledger = getenv(LEDGER_ENV);
+    if (!ledger_path && env_ledger && *env_ledger) {
+        ledger_path = env_ledger;
+    }
+
+    const char *env_log = getenv(EVENT_LOG_ENV);
+    if (!event_log_path && env_log && *env_log) {
+        event_log_path = env_log;
+    }
+
+    const char *env_latency = getenv(LATENCY_ENV);
+    if (!latency_path && env_latency && *env_latency) {
+        latency_path = env_latency;
+    }
+
+    if (route_escalate && !route_mode) {
+        fprintf(stderr, "Error: --escalate needs --route\n");
+        return 1;
+    }
+    // The strong tier is the model a run without --route would ask
+    route_strong_model = strong_model ? strong_model : api_model;
+
     if (debug_mode) {
         debug_print("Debug mode enabled");
     }
 
+    // The budget covers the whole run, not just the HTTP exchange; in the
+    // service, where the run never ends, it covers each upstream request
+    if (serve_address) {
+        serve_request_timeout_ms = deadline_ms;
+    } else if (deadline_ms > 0) {
+        api_deadline_ms = monotonic_ms() + deadline_ms;
+        debug_print("Deadline: %ld ms", deadline_ms);
+    }
+
     // Get non-option arguments (git diff)
     if (optind < argc && !use_diff_file) {
         git_diff = argv[optind];
     }
 
+    // libcurl's global state is set up once, before any thread can start a transfer
+    if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
+        fprintf(stderr, "Error: Failed to initialize cURL\n");
+        return 1;
+    }
+
+    // Everything allocated for the request lives in one arena
+    struct Arena *arena = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+    if (!arena) {
+        curl_global_cleanup();
+        return 1;
+    }
+    arena_activate(arena);
+
+    // Reading the ledger needs neither a key nor a profile
+    if (stats_mode) {
+        return finish_request(arena, ledger_stats(ledger_path) ? 0 : 1);
+    }
+    if (latency_report_mode) {
+        return finish_request(arena, latency_report() ? 0 : 1);
+    }
+
+    // Timings of the requests below go to the latency histograms
+    latency_begin();
+
     // If no key file path specified, use default
     if (use_default_key) {
         key_file_path = get_default_api_key_path();
         if (!key_file_path) {
             fprintf(stderr, "Error: Failed to determine default API key path\n");
-            return 1;
+            return finish_request(arena, 1);
         }
 
         debug_print("Using default API key from: %s", key_file_path);
     }
 
-    // Check if the key file exists
-    if (!file_exists(key_file_path)) {
+    // Check if the key file exists (a replay or a keyless local server never needs it)
+    if (!file_exists(key_file_path) && !replay_dir && !key_pool_path &&
+        (api_backend->needs_key || !use_default_key)) {
         fprintf(stderr, "Error: API key file not found at %s\n", key_file_path);
         fprintf(stderr, "Create it first or specify a key file with -k option\n");
-        if (use_default_key) {
-            free(key_file_path);
-        }
-        return 1;
+        return finish_request(arena, 1);
     }
 
     // If no profile path specified, use default
@@ -603,120 +698,199 @@ int main(int argc, char* argv[]) {
         profile_path = get_default_profile_path();
         if (!profile_path) {
             fprintf(stderr, "Error: Failed to determine default profile path\n");
-            if (use_default_key) {
-                free(key_file_path);
-            }
-            return 1;
+            return finish_request(arena, 1);
         }
 
         debug_print("Using default profile from: %s", profile_path);
     }
 
-    // Check if the profile file exists
-    if (!file_exists(profile_path)) {
+    // Check if the profile file exists (collecting a batch never needs it)
+    if (!file_exists(profile_path) && !batch_collect_path) {
         fprintf(stderr, "Error: Profile file not found at %s\n", profile_path);
         fprintf(stderr, "Create it first or specify a profile with -p option\n");
-        if (use_default_key) {
-            free(key_file_path);
-        }
-        if (use_default_profile) {
-            free(profile_path);
-        }
-        return 1;
+        return finish_request(arena, 1);
     }
 
     // Git diff is required
-    if (!git_diff && !use_diff_file) {
+    if (!git_diff && !use_diff_file && !use_staged && !precompute_mode && !watch_mode &&
+        !diff_list_path && !batch_collect_path && !serve_address && !release_range && !pr_base) {
         fprintf(stderr, "Error: Git diff is required (either as an argument or via -d option)\n");
         display_help(argv[0]);
-        if (use_default_key) {
-            free(key_file_path);
-        }
-        if (use_default_profile) {
-            free(profile_path);
-        }
-        return 1;
+        return finish_request(arena, 1);
     }
 
-    // Read API key from file
-    char *api_key = read_api_key(key_file_path);
+    // Read API key from file; with a pool, its first key stands in for requests
+    // that are not spread over the pool (message batches)
+    char *api_key;
+    if (key_pool_path) {
+        api_key = key_pool_load(key_pool_path) ? str_duplicate(key_pool_key(0)) : NULL;
+    } else {
+        api_key = file_exists(key_file_path) ? read_api_key(key_file_path) : str_duplicate("");
+    }
     if (!api_key) {
-        if (use_default_key) {
-            free(key_file_path);
-        }
-        if (use_default_profile) {
-            free(profile_path);
-        }
-        return 1;
+        return finish_request(arena, 1);
+    }
+
+    // The results of a batch are collected without building any prompt
+    if (batch_collect_path) {
+        return finish_request(arena, batch_collect(api_key, batch_collect_path, output_file_path) ? 0 : 1);
     }
 
     // Read profile from file
     char *profile = read_file(profile_path);
     if (!profile) {
-        free(api_key);
-        if (use_default_key) {
-            free(key_file_path);
-        }
-        if (use_default_profile) {
-            free(profile_path);
+        return finish_request(arena, 1);
+    }
+
+    if (batch_submit_path) {
+        return finish_request(arena, batch_submit(api_key, profile, diff_list_path,
+                                                  batch_submit_path) ? 0 : 1);
+    }
+    if (release_range) {
+        return finish_request(arena, release_notes(api_key, profile, release_range,
+                                                   output_file_path) ? 0 : 1);
+    }
+    if (diff_list_path) {
+        return finish_request(arena, process_diff_list(api_key, profile, diff_list_path,
+                                                       output_file_path) ? 0 : 1);
+    }
+
+    // The service answers requests until it is stopped; they are not runs
+    // of their own, so they stay out of the latency histograms
+    if (serve_address) {
+        latency_enabled = 0;
+        return finish_request(arena, serve_run(serve_address, api_key, profile) ? 0 : 1);
+    }
+
+    // Background modes keep the precomputed message for the staged tree current
+    if (watch_mode) {
+        return finish_request(arena, precompute_watch(api_key, profile) ? 0 : 1);
+    }
+    if (precompute_mode) {
+        return finish_request(arena, precompute_once(api_key, profile) ? 0 : 1);
+    }
+
+    char *title = NULL;
+    char *description = NULL;
+    int have_result = 0;
+
+    // A pull request is described from the summaries of its commits, not from one diff
+    if (pr_base) {
+        if (!pr_description(api_key, profile, pr_base, &title, &description)) {
+            return finish_request(arena, 1);
         }
-        return 1;
+        have_result = 1;
     }
 
-    // Read git diff from file if specified
-    char *git_diff_content = NULL;
-    if (use_diff_file) {
-        git_diff_content = read_file(git_diff_file_path);
-        if (!git_diff_content) {
-            free(api_key);
-            free(profile);
-            if (use_default_key) {
-                free(key_file_path);
+    // Read git diff from file if specified; a diff argument is used in place
+    const char *git_diff_content = git_diff;
+    if (use_staged) {
+        // A message precomputed for exactly this staged tree is returned as is
+        char *tree = candidate_count > 1 ? NULL : git_staged_tree();
+        if (tree && load_precomputed(tree, profile, &title, &description)) {
+            debug_print("Using the message precomputed for staged tree %s", tree);
+            have_result = 1;
+        } else {
+            char *staged_diff = git_staged_diff();
+            if (!staged_diff) {
+                return finish_request(arena, 1);
             }
-            if (use_default_profile) {
-                free(profile_path);
+            if (!*staged_diff) {
+                fprintf(stderr, "Error: No staged changes\n");
+                return finish_request(arena, 1);
             }
-            return 1;
+            git_diff_content = staged_diff;
         }
-    } else {
-        git_diff_content = str_duplicate(git_diff);
+    } else if (use_diff_file) {
+        git_diff_content = read_file(git_diff_file_path);
         if (!git_diff_content) {
-            fprintf(stderr, "Error: Memory allocation failed for git diff content\n");
-            free(api_key);
-            free(profile);
-            if (use_default_key) {
-                free(key_file_path);
-            }
-            if (use_default_profile) {
-                free(profile_path);
-            }
-            return 1;
+            return finish_request(arena, 1);
         }
     }
 
-    // Free paths if they were allocated
-    if (use_default_key) {
-        free(key_file_path);
+    if (!have_result && candidate_count > 1) {
+        // Alternatives come from one request; the one picked is handled like a single result
+        printf("Sending request to Anthropic API...\n");
+        struct Candidate candidates[CANDIDATES_MAX];
+        size_t received = request_candidates(api_key, profile, git_diff_content,
+                                             (size_t)candidate_count, candidates);
+        if (!received && deadline_ms) {
+            report_deadline_fallback(deadline_ms);
+            if (build_local_summary(git_diff_content, &candidates[0].title, &candidates[0].description)) {
+                received = 1;
+            }
+        }
+        if (!received) {
+            fprintf(stderr, "Failed to get candidates from Claude API\n");
+            return finish_request(arena, 1);
+        }
+
+        size_t choice = 0;
+        if (received > 1 && !choose_candidate(candidates, received, &choice)) {
+            print_candidates(candidates, received);
+            if (output_file_path) {
+                save_candidates_to_file(output_file_path, candidates, received);
+            }
+            return finish_request(arena, 0);
+        }
+        title = candidates[choice].title;
+        description = candidates[choice].description;
+        have_result = 1;
+    }
+
+    // The same change may already have a message, here or in a fetched notes ref
+    char *cache_key = NULL;
+    if (!have_result && notes_cache_mode) {
+        cache_key = notes_cache_key(git_diff_content, profile);
+        if (cache_key && notes_cache_load(cache_key, &title, &description)) {
+            have_result = 1;
+            cache_key = NULL;
+        }
     }
-    if (use_default_profile) {
-        free(profile_path);
+    char *remote_key = NULL;
+    if (!have_result && remote_cache_url) {
+        remote_key = remote_cache_key(profile, git_diff_content);
+        if (remote_key && remote_cache_get(remote_key, &title, &description)) {
+            have_result = 1;
+            remote_key = NULL;
+        }
     }
 
-    // Call Claude API
-    printf("Sending request to Anthropic API...\n");
-    char *response = call_claude_api(api_key, profile, git_diff_content);
-    if (!response) {
-        fprintf(stderr, "Failed to get response from Claude API\n");
-        free(api_key);
-        free(profile);
-        free(git_diff_content);
-        return 1;
+    if (!have_result) {
+        // Call Claude API
+        printf("Sending request to Anthropic API...\n");
+        char *response = route_claude_api(api_key, profile, git_diff_content);
+        if (!response && !deadline_ms) {
+            fprintf(stderr, "Failed to get response from Claude API\n");
+            return finish_request(arena, 1);
+        }
+
+        // Under a deadline, never leave the caller without a message
+        if (!response) {
+            report_deadline_fallback(deadline_ms);
+            if (!build_local_summary(git_diff_content, &title, &description)) {
+                return finish_request(arena, 1);
+            }
+            have_result = 1;
+        } else {
+            // Parse response
+            struct ClaudeUsage usage;
+            have_result = parse_claude_response_with_usage(response, &title, &description, &usage);
+            if (have_result) {
+                debug_print("Usage: %ld input tokens, %ld output tokens, %ld cache read, %ld cache write",
+                            usage.input_tokens, usage.output_tokens,
+                            usage.cache_read_input_tokens, usage.cache_creation_input_tokens);
+                if (cache_key) {
+                    notes_cache_store(cache_key, title, description);
+                }
+                if (remote_key) {
+                    remote_cache_put(remote_key, title, description);
+                }
+            }
+        }
     }
 
-    // Parse response
-    char *title = NULL;
-    char *description = NULL;
-    if (parse_claude_response(response, &title, &description)) {
+    if (have_result) {
         // Output result
         printf("TITLE: %s\n\n", title);
         printf("DESCRIPTION:\n%s\n", description);
@@ -725,18 +899,9 @@ int main(int argc, char* argv[]) {
         if (output_file_path) {
             save_results_to_file(output_file_path, title, description);
         }
-
-        free(title);
-        free(description);
     } else {
         fprintf(stderr, "Failed to parse Claude's response\n");
     }
 
-    // Clean up
-    free(api_key);
-    free(profile);
-    free(git_diff_content);
-    free(response);
-
-    return 0;
+    return finish_request(arena, 0);
 }
@@ -0,0 +1,157 @@
+/**
+ * Claude API Client - Message cache shared through git notes
+ *
+ * See notes.h. Every step is a short git command; a repository without the
+ * notes ref, or a directory that is not a repository at all, simply misses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "claude_client.h"
+#include "symbols.h"
+#include "route.h"
+#include "git.h"
+#include "notes.h"
+
+/* Look up and store generated messages in git notes (--notes-cache) */
+int notes_cache_mode = 0;
+
+static int append_key_text(struct MemoryStruct *key, const char *text) {
+    size_t len = strlen(text);
+    return WriteMemoryCallback((void *)text, 1, len, key) == len;
+}
+
+// Function to compute the note key for a diff; NULL if it has no patch-id
+char* notes_cache_key(const char *git_diff, const char *profile) {
+    // Outside a repository there are no notes to read or write
+    const char *const git_dir_argv[] = { "git", "rev-parse", "--git-dir", NULL };
+    char *git_dir = git_capture_quiet(git_dir_argv);
+    if (!git_dir) {
+        debug_print("Not in a git repository, not using the notes cache");
+        return NULL;
+    }
+    mem_free(git_dir);
+
+    const char *const patch_id_argv[] = { "git", "patch-id", "--stable", NULL };
+    char *patch_id = git_capture_input(patch_id_argv, git_diff, strlen(git_diff));
+    if (!patch_id) {
+        return NULL;
+    }
+
+    // "<patch-id> <commit>"; a diff git does not recognize gives no output
+    patch_id[strcspn(patch_id, " \n")] = '\0';
+    if (!*patch_id) {
+        debug_print("Diff has no patch-id, not using the notes cache");
+        mem_free(patch_id);
+        return NULL;
+    }
+
+    struct MemoryStruct key;
+    memset(&key, 0, sizeof(key));
+    char models[512];
+    char digest[32];
+    int models_len = route_describe_models(models, sizeof(models));
+    snprintf(digest, sizeof(digest), "digest %d\n", (int)digest_mode);
+    int ok = models_len > 0 && (size_t)models_len < sizeof(models) &&
+             append_key_text(&key, "commit-ai-cache 1\npatch-id ") &&
+             append_key_text(&key, patch_id) && append_key_text(&key, "\n") &&
+             append_key_text(&key, models) && append_key_text(&key, digest) &&
+             append_key_text(&key, "profile\n") && append_key_text(&key, profile);
+    mem_free(patch_id);
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed for notes cache key\n");
+        mem_free(key.memory);
+        return NULL;
+    }
+
+    const char *const hash_argv[] = { "git", "hash-object", "--stdin", NULL };
+    char *id = git_capture_input(hash_argv, key.memory, key.size);
+    mem_free(key.memory);
+    if (id) {
+        trim_string(id);
+        debug_print("Notes cache key: %s", id);
+    }
+    return id;
+}
+
+/* Read the note for key from one notes ref */
+static char* read_note(const char *ref, const char *key) {
+    char ref_option[512];
+    snprintf(ref_option, sizeof(ref_option), "--ref=%s", ref);
+    const char *const argv[] = { "git", "notes", ref_option, "show", key, NULL };
+    return git_capture_quiet(argv);
+}
+
+// Function to look up the message for key in the local and fetched notes
+int notes_cache_load(const char *key, char **title, char **description) {
+    char *note = read_note(NOTES_REF, key);
+    const char *found_in = NOTES_REF;
+
+    char *refs = NULL;
+    if (!note) {
+        const char *const argv[] = { "git", "for-each-ref", "--format=%(refname)",
+                                     NOTES_REMOTES_PREFIX, NULL };
+        refs = git_capture_quiet(argv);
+    }
+
+    // Fetched copies: refs/notes/remotes/<remote>/commit-ai
+    const char *suffix = strrchr(NOTES_REF, '/');
+    for (char *line = refs; !note && line && *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        size_t len = strlen(line);
+        size_t suffix_len = strlen(suffix);
+        if (len > suffix_len && strcmp(line + len - suffix_len, suffix) == 0) {
+            note = read_note(line, key);
+            found_in = line;
+        }
+        line = next;
+    }
+
+    int ok = 0;
+    if (note && *note) {
+        debug_print("Using the message cached in %s", found_in);
+        ok = split_response_text(note, strlen(note), title, description);
+        note = NULL;
+    }
+
+    mem_free(note);
+    mem_free(refs);
+    return ok;
+}
+
+// Function to store the message for key in the local notes ref
+int notes_cache_store(const char *key, const char *title, const char *description) {
+    size_t title_len = strlen(title);
+    size_t description_len = strlen(description);
+    char *note = mem_alloc(title_len + description_len + 2);
+    if (!note) {
+        fprintf(stderr, "Error: Memory allocation failed for note\n");
+        return 0;
+    }
+    memcpy(note, title, title_len);
+    note[title_len] = '\n';
+    memcpy(note + title_len + 1, description, description_len + 1);
+
+    const char *const hash_argv[] = { "git", "hash-object", "-w", "--stdin", NULL };
+    char *blob = git_capture_input(hash_argv, note, title_len + 1 + description_len);
+    mem_free(note);
+    if (!blob) {
+        return 0;
+    }
+    trim_string(blob);
+
+    const char *const notes_argv[] = { "git", "notes", "--ref=" NOTES_REF, "add", "-f", "-C", blob,
+                                       key, NULL };
+    int ok = git_run(notes_argv);
+    if (ok) {
+        debug_print("Stored the message in %s", NOTES_REF);
+    } else {
+        fprintf(stderr, "Warning: Failed to store the message in %s\n", NOTES_REF);
+    }
+    mem_free(blob);
+    return ok;
+}
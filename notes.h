@@ -0,0 +1,50 @@
+/**
+ * Claude API Client - Message cache shared through git notes
+ *
+ * People and CI jobs often generate messages for the same change: after a
+ * rebase, a cherry-pick, or in a review bot. With --notes-cache every
+ * message generated for a diff is stored as a note in refs/notes/commit-ai
+ * and looked up there before the API is called.
+ *
+ * A note is attached to a key rather than to a commit. The key is the blob
+ * id git gives to
+ *
+ *   commit-ai-cache 1
+ *   patch-id <git patch-id --stable of the diff>
+ *   model <backend> <model, or the routing tiers and threshold>
+ *   digest <digest mode>
+ *   profile
+ *   <profile text>
+ *
+ * so the same change has the same key after a rebase and in every clone, as
+ * long as the model, digest mode and profile match. The key object itself
+ * is never written; notes can annotate any object id.
+ *
+ * Notes travel with ordinary pushes and fetches:
+ *
+ *   git push origin refs/notes/commit-ai
+ *   git fetch origin refs/notes/commit-ai:refs/notes/remotes/origin/commit-ai
+ *
+ * Lookups check refs/notes/commit-ai first, then every
+ * refs/notes/remotes/<remote>/commit-ai. A note holds the title line and
+ * the description, byte for byte: it is written as a blob and attached with
+ * "git notes add -C", which skips git's message cleanup.
+ */
+
+#ifndef NOTES_H
+#define NOTES_H
+
+/* Notes ref results are stored in */
+#define NOTES_REF "refs/notes/commit-ai"
+
+/* Fetched copies are looked up at <prefix><remote>/commit-ai */
+#define NOTES_REMOTES_PREFIX "refs/notes/remotes/"
+
+/* Look up and store generated messages in git notes (--notes-cache) */
+extern int notes_cache_mode;
+
+char* notes_cache_key(const char *git_diff, const char *profile);
+int notes_cache_load(const char *key, char **title, char **description);
+int notes_cache_store(const char *key, const char *title, const char *description);
+
+#endif /* NOTES_H */
@@ -0,0 +1,276 @@
+/**
+ * Claude API Client - OpenAI-compatible backend
+ *
+ * See openai.h. The event stream is split into lines as it arrives; each
+ * "data:" line is parsed on its own and dropped, so memory holds the
+ * collected text and at most one partial line, not the whole stream.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+
+#include "claude_client.h"
+#include "openai.h"
+#include "probes.h"
+
+enum ReplyFormat {
+    REPLY_UNKNOWN = 0,
+    REPLY_JSON,         /* one chat.completion object (or an error) */
+    REPLY_STREAM        /* server-sent chat.completion.chunk events */
+};
+
+/* State of one response */
+struct OpenAIReader {
+    enum ReplyFormat format;
+    struct MemoryStruct raw;    /* JSON body, or the partial line of a stream */
+    struct MemoryStruct text;   /* text collected from the stream */
+    long prompt_tokens;
+    long completion_tokens;
+    char finish_reason[32];
+    int done;                   /* "data: [DONE]" seen */
+    char *error;                /* error object sent in the stream */
+    int failed;                 /* out of memory */
+    long long start;
+};
+
+static struct curl_slist* openai_add_headers(struct curl_slist *headers, const char *api_key) {
+    // Local servers usually run without a key
+    if (api_key && *api_key) {
+        size_t len = strlen(api_key) + 8;
+        char *bearer = mem_alloc(len);
+        if (bearer) {
+            snprintf(bearer, len, "Bearer %s", api_key);
+            headers = append_header(headers, "Authorization", bearer);
+            mem_free(bearer);
+        }
+    }
+    return curl_slist_append(headers, "Accept: text/event-stream");
+}
+
+/* The Messages payload with streaming and a final usage event switched on */
+static char* openai_print_payload(const cJSON *payload) {
+    cJSON *request = cJSON_Duplicate(payload, 1);
+    if (!request) {
+        return NULL;
+    }
+
+    cJSON *options = NULL;
+    char *json_string = NULL;
+    if (cJSON_AddTrueToObject(request, "stream") &&
+        (options = cJSON_AddObjectToObject(request, "stream_options")) != NULL &&
+        cJSON_AddTrueToObject(options, "include_usage")) {
+        json_string = cJSON_Print(request);
+    }
+
+    cJSON_Delete(request);
+    return json_string;
+}
+
+static void* openai_reader_open(void) {
+    struct OpenAIReader *reader = mem_calloc(1, sizeof(*reader));
+    if (!reader) {
+        fprintf(stderr, "Error: Memory allocation failed for response\n");
+        return NULL;
+    }
+    reader->start = monotonic_ms();
+    return reader;
+}
+
+static void read_usage(struct OpenAIReader *reader, const cJSON *usage) {
+    const cJSON *prompt = cJSON_GetObjectItemCaseSensitive(usage, "prompt_tokens");
+    const cJSON *completion = cJSON_GetObjectItemCaseSensitive(usage, "completion_tokens");
+    if (cJSON_IsNumber(prompt)) reader->prompt_tokens = (long)cJSON_GetNumberValue(prompt);
+    if (cJSON_IsNumber(completion)) reader->completion_tokens = (long)cJSON_GetNumberValue(completion);
+}
+
+static void read_finish_reason(struct OpenAIReader *reader, const cJSON *choice) {
+    const char *reason = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(choice, "finish_reason"));
+    if (reason) {
+        snprintf(reader->finish_reason, sizeof(reader->finish_reason), "%s", reason);
+    }
+}
+
+/* Handle one line of the event stream */
+static void read_event_line(struct OpenAIReader *reader, const char *line, size_t len) {
+    if (len > 0 && line[len - 1] == '\r') len--;
+    if (len < 5 || strncmp(line, "data:", 5) != 0) {
+        return;     // blank separators, comments, event: and id: lines
+    }
+    line += 5;
+    len -= 5;
+    while (len > 0 && *line == ' ') {
+        line++;
+        len--;
+    }
+    if (len == 6 && strncmp(line, "[DONE]", 6) == 0) {
+        reader->done = 1;
+        return;
+    }
+
+    cJSON *event = cJSON_ParseWithLength(line, len);
+    if (!event) {
+        debug_print("Skipping unparsable event: %.*s", (int)len, line);
+        return;
+    }
+
+    cJSON *error = cJSON_GetObjectItemCaseSensitive(event, "error");
+    if (error && !reader->error) {
+        reader->error = cJSON_PrintUnformatted(error);
+    }
+
+    cJSON *choice = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(event, "choices"), 0);
+    const char *content = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetObjectItemCaseSensitive(choice, "delta"), "content"));
+    if (content && *content) {
+        if (reader->text.size == 0) {
+            debug_print("First token after %lld ms", monotonic_ms() - reader->start);
+        }
+        size_t content_len = strlen(content);
+        if (WriteMemoryCallback((void *)content, 1, content_len, &reader->text) != content_len) {
+            reader->failed = 1;
+        }
+    }
+    if (choice) {
+        read_finish_reason(reader, choice);
+    }
+    read_usage(reader, cJSON_GetObjectItemCaseSensitive(event, "usage"));
+
+    cJSON_Delete(event);
+}
+
+static size_t openai_reader_write(void *contents, size_t size, size_t nmemb, void *userp) {
+    struct OpenAIReader *reader = userp;
+    size_t realsize = size * nmemb;
+    const char *data = contents;
+    PROBE1(chunk, realsize);
+
+    // The first byte that is not white space tells a stream from a plain body
+    if (reader->format == REPLY_UNKNOWN) {
+        size_t i = 0;
+        while (i < realsize && (data[i] == ' ' || data[i] == '\r' || data[i] == '\n')) i++;
+        if (i == realsize) return realsize;
+        reader->format = data[i] == '{' ? REPLY_JSON : REPLY_STREAM;
+    }
+
+    if (WriteMemoryCallback(contents, size, nmemb, &reader->raw) != realsize) {
+        return 0;
+    }
+    if (reader->format == REPLY_JSON) {
+        return realsize;
+    }
+
+    // Handle the complete lines and keep the partial one for the next write
+    char *line = reader->raw.memory;
+    char *newline;
+    while ((newline = memchr(line, '\n', reader->raw.size - (size_t)(line - reader->raw.memory))) != NULL) {
+        read_event_line(reader, line, (size_t)(newline - line));
+        line = newline + 1;
+    }
+    size_t rest = reader->raw.size - (size_t)(line - reader->raw.memory);
+    memmove(reader->raw.memory, line, rest + 1);
+    reader->raw.size = rest;
+
+    return reader->failed ? 0 : realsize;
+}
+
+/* A plain body may announce its length; an event stream never does */
+static size_t openai_reader_header(char *buffer, size_t size, size_t nitems, void *userdata) {
+    struct OpenAIReader *reader = userdata;
+    return HeaderCallback(buffer, size, nitems, &reader->raw);
+}
+
+/* Format text and usage as a Messages API response body */
+static char* messages_body(const char *text, const struct OpenAIReader *reader) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON *content = root ? cJSON_AddArrayToObject(root, "content") : NULL;
+    cJSON *block = cJSON_CreateObject();
+    if (!content || !block) {
+        fprintf(stderr, "Error: Failed to create JSON object\n");
+        cJSON_Delete(block);
+        cJSON_Delete(root);
+        return NULL;
+    }
+
+    cJSON_AddItemToArray(content, block);
+    cJSON_AddStringToObject(block, "type", "text");
+    cJSON_AddStringToObject(block, "text", text);
+    cJSON_AddStringToObject(root, "type", "message");
+    cJSON_AddStringToObject(root, "role", "assistant");
+    cJSON_AddStringToObject(root, "stop_reason", reader->finish_reason);
+    cJSON *usage = cJSON_AddObjectToObject(root, "usage");
+    if (usage) {
+        cJSON_AddNumberToObject(usage, "input_tokens", (double)reader->prompt_tokens);
+        cJSON_AddNumberToObject(usage, "output_tokens", (double)reader->completion_tokens);
+    }
+
+    char *body = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!body) {
+        fprintf(stderr, "Error: Failed to convert JSON to string\n");
+    }
+    return body;
+}
+
+/* Read a chat.completion object into a Messages API response body */
+static char* completion_to_messages(struct OpenAIReader *reader) {
+    cJSON *completion = cJSON_Parse(reader->raw.memory);
+    if (!completion) {
+        fprintf(stderr, "Error: Failed to parse chat completion\n");
+        return NULL;
+    }
+
+    cJSON *choice = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(completion, "choices"), 0);
+    const char *text = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetObjectItemCaseSensitive(choice, "message"), "content"));
+    char *body = NULL;
+    if (text) {
+        read_finish_reason(reader, choice);
+        read_usage(reader, cJSON_GetObjectItemCaseSensitive(completion, "usage"));
+        body = messages_body(text, reader);
+    } else {
+        fprintf(stderr, "Error: No message content in chat completion\n");
+    }
+
+    cJSON_Delete(completion);
+    return body;
+}
+
+static char* openai_reader_close(void *userp, long http_code) {
+    struct OpenAIReader *reader = userp;
+    char *body = NULL;
+
+    if (!http_code || reader->failed || !memory_reserve(&reader->raw, 0)) {
+        // Nothing usable was received
+    } else if (http_code < 200 || http_code >= 300) {
+        // Errors are passed on as received
+        body = reader->raw.memory;
+        reader->raw.memory = NULL;
+    } else if (reader->format == REPLY_JSON) {
+        body = completion_to_messages(reader);
+    } else if (reader->error) {
+        fprintf(stderr, "Error: Server reported an error in the stream: %s\n", reader->error);
+    } else if (!reader->done && !reader->finish_reason[0]) {
+        fprintf(stderr, "Error: Stream ended before the reply was complete\n");
+    } else if (memory_reserve(&reader->text, 0)) {
+        debug_print("Stream complete: %zu bytes of text in %zu chunks, %ld + %ld tokens",
+                    reader->text.size, reader->text.chunks,
+                    reader->prompt_tokens, reader->completion_tokens);
+        body = messages_body(reader->text.memory, reader);
+    }
+
+    mem_free(reader->error);
+    mem_free(reader->text.memory);
+    mem_free(reader->raw.memory);
+    mem_free(reader);
+    return body;
+}
+
+/* An OpenAI-compatible /v1/chat/completions server */
+const struct ApiBackend openai_backend = {
+    "openai", "/v1/chat/completions", OPENAI_DEFAULT_BASE_URL, 0,
+    openai_add_headers, openai_print_payload,
+    openai_reader_open, openai_reader_write, openai_reader_header, openai_reader_close
+};
@@ -0,0 +1,27 @@
+/**
+ * Claude API Client - OpenAI-compatible backend
+ *
+ * --backend openai sends requests to the /v1/chat/completions endpoint of a
+ * local or nearby inference server (llama.cpp's server, vLLM, Ollama and
+ * the like) instead of the Messages API. The Messages payload already has
+ * the same model, max_tokens, temperature and messages members; it is sent
+ * with "stream": true, and the key, if any, as a bearer token.
+ *
+ * The reply is read as server-sent events while it arrives: only the text
+ * of each choices[0].delta and the final usage block are kept. When the
+ * stream ends the text is handed back as a Messages API response body, so
+ * parse_claude_response() reads it like any other. Servers that ignore
+ * "stream" and answer with one chat.completion object are read as well.
+ */
+
+#ifndef OPENAI_H
+#define OPENAI_H
+
+#include "claude_client.h"
+
+/* Where llama.cpp's server listens by default */
+#define OPENAI_DEFAULT_BASE_URL "http://127.0.0.1:8080"
+
+extern const struct ApiBackend openai_backend;
+
+#endif /* OPENAI_H */
@@ -0,0 +1,891 @@
+/**
+ * Claude API Client - Packing small diffs into one request
+ *
+ * See pack.h. Diffs are grouped by their file size, so a group is decided
+ * before any diff is read; the diffs, prompt and reply of one group live in
+ * a scratch arena that is reset once the group's results are printed. The
+ * diff files themselves are read ahead by ingest.c while requests are sent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cjson/cJSON.h>
+
+#include "claude_client.h"
+#include "symbols.h"
+#include "batch.h"
+#include "pack.h"
+#include "route.h"
+#include "notes.h"
+#include "remote_cache.h"
+#include "ledger.h"
+#include "ingest.h"
+#include "pipeline.h"
+
+#define PACK_MARKER "=== COMMIT "
+#define PACK_END_MARKER "=== END COMMIT "
+
+/* Bytes a section adds around its diff */
+#define PACK_SECTION_OVERHEAD 48
+
+/* Group listed diffs into packed requests (--pack) */
+int pack_mode = 0;
+
+/* Ceiling on the estimated input tokens of a packed request (--pack-tokens) */
+long pack_tokens = PACK_DEFAULT_TOKENS;
+
+static const char *pack_intro =
+    "Here is my profile:\n\n%s\n\nHere are %zu git diffs from separate commits that need review. "
+    "Each diff is between a line \"=== COMMIT <n> ===\" and a line \"=== END COMMIT <n> ===\".\n\n";
+static const char *pack_instructions =
+    "Please provide a concise title and description of the changes in each commit. Answer with "
+    "one section per commit, in the same order. Start each section with the line "
+    "\"=== COMMIT <n> ===\", followed by the title on its own line, a blank line and the "
+    "description. Do not write anything outside the sections.";
+
+/* Diffs waiting to be sent together */
+struct Pack {
+    size_t count;
+    size_t tokens;                      /* estimated prompt tokens */
+    size_t indexes[PACK_MAX_DIFFS];     /* list index of each diff */
+    const char *paths[PACK_MAX_DIFFS];
+    char *diffs[PACK_MAX_DIFFS];        /* taken from the ingest when the pack is sent */
+};
+
+/* Everything a run over the list shares */
+struct PackRun {
+    const char *api_key;
+    const char *profile;
+    const char *output_dir;
+    struct Arena *scratch;
+    struct Ingest *ingest;
+    size_t diffs;
+    size_t requests;
+    size_t failed;
+};
+
+static size_t estimate_tokens(size_t bytes) {
+    return (bytes + PACK_BYTES_PER_TOKEN - 1) / PACK_BYTES_PER_TOKEN;
+}
+
+static int append_text(struct MemoryStruct *out, const char *text) {
+    size_t len = strlen(text);
+    return WriteMemoryCallback((void *)text, 1, len, out) == len;
+}
+
+/* Take a listed diff from the ingest; NULL (with an error printed) if it is unreadable or empty */
+static char* take_diff(struct PackRun *run, size_t index, const char *path) {
+    char *diff = ingest_take(run->ingest, index);
+    if (diff && !*diff) {
+        fprintf(stderr, "Error: Diff is empty: %s\n", path);
+        mem_free(diff);
+        diff = NULL;
+    }
+    return diff;
+}
+
+/* Ask for one diff on its own, the way a plain -d run does */
+static void run_single(struct PackRun *run, size_t index, const char *path, const char *diff) {
+    char id[BATCH_CUSTOM_ID_MAX + 1];
+    diff_list_id(index, path, id);
+
+    char *title = NULL;
+    char *description = NULL;
+    char *cache_key = diff && notes_cache_mode ? notes_cache_key(diff, run->profile) : NULL;
+    if (cache_key && notes_cache_load(cache_key, &title, &description)) {
+        if (!emit_diff_result(path, id, title, description, run->output_dir)) {
+            run->failed++;
+        }
+        return;
+    }
+    char *remote_key = diff && remote_cache_url ? remote_cache_key(run->profile, diff) : NULL;
+    if (remote_key && remote_cache_get(remote_key, &title, &description)) {
+        if (!emit_diff_result(path, id, title, description, run->output_dir)) {
+            run->failed++;
+        }
+        return;
+    }
+
+    char *response = NULL;
+    if (diff) {
+        response = route_claude_api(run->api_key, run->profile, diff);
+        run->requests++;
+    }
+
+    if (!response || !parse_claude_response(response, &title, &description) ||
+        !emit_diff_result(path, id, title, description, run->output_dir)) {
+        fprintf(stderr, "Error: No message for %s\n", path);
+        run->failed++;
+    } else {
+        if (cache_key) {
+            notes_cache_store(cache_key, title, description);
+        }
+        if (remote_key) {
+            remote_cache_put(remote_key, title, description);
+        }
+    }
+}
+
+/* Section text for one diff: the changed symbols with --digest, then the (condensed) diff */
+static int append_section_body(struct MemoryStruct *prompt, const char *diff) {
+    if (digest_mode == DIGEST_OFF) {
+        return append_text(prompt, diff);
+    }
+
+    char *digest = build_symbol_digest(diff);
+    if (!digest) return 0;
+
+    char *condensed = NULL;
+    if (*digest && digest_mode == DIGEST_COMPACT) {
+        condensed = compact_diff(diff);
+        if (!condensed) return 0;
+    }
+
+    return (!*digest || (append_text(prompt, "Changed symbols:\n") && append_text(prompt, digest) &&
+                         append_text(prompt, "\n"))) &&
+           append_text(prompt, condensed ? condensed : diff);
+}
+
+/*
+ * Function to find the "<marker><n> ===" lines of a reply, such as
+ * "=== COMMIT 2 ===", and record where the text of sections 1..count starts
+ * and how long it is, without the closing "<end_marker><n> ===" line some
+ * replies repeat. starts[] must be zeroed; a number seen twice keeps its
+ * first section.
+ */
+void find_sections(const char *text, const char *marker, const char *end_marker,
+                   size_t count, const char **starts, size_t *lens) {
+    size_t marker_len = strlen(marker);
+    const char *p = text;
+    size_t current = count;  // section being read, count for none
+
+    while ((p = strstr(p, marker)) != NULL) {
+        char *end = NULL;
+        unsigned long n = strtoul(p + marker_len, &end, 10);
+        if ((p != text && p[-1] != '\n') || end == p + marker_len || strncmp(end, " ===", 4) != 0) {
+            p += marker_len;
+            continue;
+        }
+
+        if (current < count) {
+            lens[current] = (size_t)(p - starts[current]);
+        }
+
+        const char *line_end = strchr(end, '\n');
+        const char *body = line_end ? line_end + 1 : end + strlen(end);
+        current = count;
+        if (n >= 1 && n <= count && !starts[n - 1]) {
+            current = n - 1;
+            starts[current] = body;
+        }
+        p = body;
+    }
+    if (current < count) {
+        lens[current] = strlen(starts[current]);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!starts[i]) continue;
+
+        const char *s = starts[i];
+        size_t len = lens[i];
+        while (len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r' || s[len - 1] == ' ')) len--;
+
+        // Drop a trailing end marker line
+        size_t line = len;
+        while (line > 0 && s[line - 1] != '\n') line--;
+        if (strncmp(s + line, end_marker, strlen(end_marker)) == 0) {
+            len = line;
+            while (len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r' || s[len - 1] == ' ')) len--;
+        }
+        lens[i] = len;
+    }
+}
+
+/* Prompt asking for the diffs of the given slots, one section each; NULL on failure */
+static char* build_pack_prompt(const char *profile, char *const *diffs, const size_t *slots,
+                               size_t sections) {
+    // Profile and instructions once, then a delimited section per diff
+    struct MemoryStruct prompt;
+    memset(&prompt, 0, sizeof(prompt));
+    int intro_len = snprintf(NULL, 0, pack_intro, profile, sections);
+    int ok = intro_len > 0 && memory_reserve(&prompt, (size_t)intro_len);
+    if (ok) {
+        snprintf(prompt.memory, (size_t)intro_len + 1, pack_intro, profile, sections);
+        prompt.size = (size_t)intro_len;
+    }
+    for (size_t n = 1; ok && n <= sections; n++) {
+        char marker[64];
+        snprintf(marker, sizeof(marker), "%s%zu ===\n", PACK_MARKER, n);
+        ok = append_text(&prompt, marker) && append_section_body(&prompt, diffs[slots[n - 1]]);
+        snprintf(marker, sizeof(marker), "\n%s%zu ===\n\n", PACK_END_MARKER, n);
+        ok = ok && append_text(&prompt, marker);
+    }
+    ok = ok && append_text(&prompt, pack_instructions);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to build the packed prompt\n");
+        mem_free(prompt.memory);
+        return NULL;
+    }
+    debug_print("Packed %zu diffs into one prompt of %zu bytes (about %zu tokens)",
+                sections, prompt.size, estimate_tokens(prompt.size));
+    return prompt.memory;
+}
+
+/* Model for a pack: with --route, the tier of its most demanding diff */
+static const char* pack_model(char *const *diffs, const size_t *slots, size_t sections) {
+    if (!route_mode) return api_model;
+
+    enum RouteTier tier = ROUTE_FAST;
+    for (size_t n = 0; n < sections; n++) {
+        if (route_tier(diffs[slots[n]]) == ROUTE_STRONG) tier = ROUTE_STRONG;
+    }
+    return route_tier_model(tier);
+}
+
+/* Split a packed reply into a title and description per section; NULL title where one is missing */
+static void split_pack_reply(const char *text, size_t sections, char **titles, char **descriptions) {
+    const char *starts[PACK_MAX_DIFFS];
+    size_t lens[PACK_MAX_DIFFS];
+    memset(starts, 0, sizeof(starts));
+    memset(lens, 0, sizeof(lens));
+    find_sections(text, PACK_MARKER, PACK_END_MARKER, sections, starts, lens);
+
+    for (size_t n = 0; n < sections; n++) {
+        titles[n] = NULL;
+        descriptions[n] = NULL;
+        char *section = starts[n] && lens[n] > 0 ? mem_alloc(lens[n] + 1) : NULL;
+        if (!section) continue;
+        memcpy(section, starts[n], lens[n]);
+        section[lens[n]] = '\0';
+        if (!split_response_text(section, lens[n], &titles[n], &descriptions[n])) {
+            titles[n] = NULL;
+        }
+    }
+}
+
+/* Send the diffs of a pack as one request and print a result per diff */
+static void run_pack(struct PackRun *run, const struct Pack *pack) {
+    char *const *diffs = pack->diffs;
+    size_t slots[PACK_MAX_DIFFS];   // pack slot of section n + 1
+    size_t sections = 0;
+
+    for (size_t i = 0; i < pack->count; i++) {
+        if (diffs[i]) {
+            slots[sections++] = i;
+        } else {
+            run->failed++;
+        }
+    }
+    if (sections == 0) return;
+    if (sections == 1) {
+        run_single(run, pack->indexes[slots[0]], pack->paths[slots[0]], diffs[slots[0]]);
+        return;
+    }
+
+    char *prompt = build_pack_prompt(run->profile, diffs, slots, sections);
+    if (!prompt) {
+        run->failed += sections;
+        return;
+    }
+
+    // With --route the pack goes to the tier of its most demanding diff
+    const char *model = api_model;
+    api_model = pack_model(diffs, slots, sections);
+    cJSON *payload = build_message_payload(prompt, (int)(PACK_OUTPUT_TOKENS_PER_DIFF * sections));
+    api_model = model;
+    ledger_diff_bytes = 0;
+    for (size_t n = 0; n < sections; n++) {
+        ledger_diff_bytes += strlen(diffs[slots[n]]);
+    }
+    char *response = payload ? send_claude_request(run->api_key, payload) : NULL;
+    cJSON_Delete(payload);
+    run->requests++;
+
+    size_t text_len = 0;
+    char *text = response ? extract_response_text(response, &text_len, NULL) : NULL;
+    if (!text) {
+        fprintf(stderr, "Error: No reply for %zu packed diffs starting at %s\n",
+                sections, pack->paths[slots[0]]);
+        run->failed += sections;
+        return;
+    }
+
+    char *titles[PACK_MAX_DIFFS];
+    char *descriptions[PACK_MAX_DIFFS];
+    split_pack_reply(text, sections, titles, descriptions);
+
+    for (size_t n = 0; n < sections; n++) {
+        size_t slot = slots[n];
+        const char *path = pack->paths[slot];
+        if (!titles[n]) {
+            debug_print("Section %zu missing from the packed reply, asking for %s alone", n + 1, path);
+            run_single(run, pack->indexes[slot], path, diffs[slot]);
+            continue;
+        }
+
+        char id[BATCH_CUSTOM_ID_MAX + 1];
+        diff_list_id(pack->indexes[slot], path, id);
+        if (!emit_diff_result(path, id, titles[n], descriptions[n], run->output_dir)) {
+            fprintf(stderr, "Error: No message for %s\n", path);
+            run->failed++;
+        }
+    }
+}
+
+/* Send the pending diffs and release everything they used */
+static void flush_pack(struct PackRun *run, struct Pack *pack) {
+    if (pack->count == 0) return;
+
+    for (size_t i = 0; i < pack->count; i++) {
+        pack->diffs[i] = take_diff(run, pack->indexes[i], pack->paths[i]);
+    }
+
+    struct Arena *previous = arena_activate(run->scratch);
+    if (pack->count == 1) {
+        if (pack->diffs[0]) {
+            run_single(run, pack->indexes[0], pack->paths[0], pack->diffs[0]);
+        } else {
+            run->failed++;
+        }
+    } else {
+        run_pack(run, pack);
+    }
+    arena_activate(previous);
+    arena_reset(run->scratch);
+
+    for (size_t i = 0; i < pack->count; i++) {
+        mem_free(pack->diffs[i]);
+        pack->diffs[i] = NULL;
+    }
+
+    fflush(stdout);
+    pack->count = 0;
+}
+
+/* Group the listed diffs by their file size, handing each finished pack to flush */
+static void group_paths(struct PackRun *run, const char *const *paths, size_t count,
+                        void (*flush)(struct PackRun *run, struct Pack *pack)) {
+    struct Pack pack;
+    memset(&pack, 0, sizeof(pack));
+
+    // The profile and instructions are paid once per request
+    size_t overhead = estimate_tokens(strlen(run->profile) + strlen(pack_intro) + strlen(pack_instructions));
+
+    for (size_t index = 0; index < count; index++) {
+        const char *path = paths[index];
+        run->diffs++;
+
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            fprintf(stderr, "Error: Failed to open file: %s (%s)\n", path, strerror(errno));
+            run->failed++;
+            continue;
+        }
+        size_t tokens = estimate_tokens((size_t)st.st_size + PACK_SECTION_OVERHEAD);
+
+        if (pack.count > 0 && (!pack_mode || pack.count == PACK_MAX_DIFFS ||
+                               pack.tokens + tokens > (size_t)pack_tokens)) {
+            flush(run, &pack);
+        }
+        if (pack.count == 0) {
+            pack.tokens = overhead;
+        }
+        pack.indexes[pack.count] = index;
+        pack.paths[pack.count++] = path;
+        pack.tokens += tokens;
+    }
+    if (pack.count > 0) {
+        flush(run, &pack);
+    }
+}
+
+/* Print a message for every path, reading the diffs ahead of the requests */
+static int process_paths(const char *api_key, const char *profile, const char *const *paths,
+                         size_t count, const char *output_dir) {
+    struct PackRun run;
+    memset(&run, 0, sizeof(run));
+    run.api_key = api_key;
+    run.profile = profile;
+    run.output_dir = output_dir;
+
+    run.scratch = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+    if (!run.scratch) {
+        fprintf(stderr, "Error: Memory allocation failed for diff list\n");
+        return 0;
+    }
+    long long start = monotonic_ms();
+    run.ingest = ingest_open(paths, count);
+    if (!run.ingest) {
+        arena_destroy(run.scratch);
+        return 0;
+    }
+
+    group_paths(&run, paths, count, flush_pack);
+    ingest_close(run.ingest);
+
+    printf("Processed %zu diffs with %zu requests in %lld ms, %zu failed\n",
+           run.diffs, run.requests, monotonic_ms() - start, run.failed);
+
+    arena_destroy(run.scratch);
+    return run.diffs > 0 && run.failed == 0;
+}
+
+/* One request of a --pipeline run: a pack, a section asked again, or the end marker */
+struct PipeJob {
+    struct NetRequest request;          /* first: the network stage sees only this */
+    size_t seq;                         /* place in the output order */
+    int end;                            /* no diffs; the list is over */
+    struct Pack pack;                   /* the diffs are released with the job */
+    char *titles[PACK_MAX_DIFFS];       /* per pack slot, in the request's arena */
+    char *descriptions[PACK_MAX_DIFFS];
+    char *cache_key;                    /* a single diff the caches missed */
+    char *remote_key;
+    size_t retries;                     /* sections asked again and not answered yet */
+    struct PipeJob *parent;             /* the job a section asked again belongs to */
+    size_t parent_slot;
+};
+
+/* Everything the stages of a --pipeline run share */
+struct PipeRun {
+    struct PackRun run;                 /* first: the prepare stage gets it from group_paths() */
+    const char *const *paths;
+    size_t count;
+    struct ArenaPool *arenas;
+    struct StageQueue *prepared;        /* prepare -> network */
+    struct StageQueue *answered;        /* network -> output */
+    struct StageQueue *retries;         /* output -> network */
+    struct PipeJob **waiting;           /* answered jobs by seq until their turn; count + 1 slots */
+    size_t emitted;                     /* jobs printed, in seq order; the network stage reads it */
+    struct PipeJob end_job;
+    size_t next_seq;                    /* prepare stage only */
+    long long prepare_wait_us;
+    size_t requests;                    /* output stage only */
+    size_t failed;
+    struct StageStats stats[3];
+};
+
+static void release_job(struct PipeRun *pipe, struct PipeJob *job) {
+    if (job->end) return;
+    arena_pool_release(pipe->arenas, job->request.arena);
+    for (size_t i = 0; i < job->pack.count; i++) {
+        mem_free(job->pack.diffs[i]);
+    }
+    free(job);
+}
+
+/* Build the request for a job's diffs, or answer a single diff from the caches */
+static void build_job_request(struct PipeRun *pipe, struct PipeJob *job) {
+    const char *profile = pipe->run.profile;
+    struct Pack *pack = &job->pack;
+    size_t slots[PACK_MAX_DIFFS];
+    size_t sections = 0;
+    for (size_t i = 0; i < pack->count; i++) {
+        if (pack->diffs[i]) slots[sections++] = i;
+    }
+    if (sections == 0) return;
+
+    cJSON *payload;
+    if (sections == 1) {
+        // The caches answer single diffs, as in run_single()
+        size_t slot = slots[0];
+        const char *diff = pack->diffs[slot];
+        job->cache_key = notes_cache_mode ? notes_cache_key(diff, profile) : NULL;
+        if (job->cache_key && notes_cache_load(job->cache_key, &job->titles[slot], &job->descriptions[slot])) {
+            job->cache_key = NULL;
+            return;
+        }
+        job->remote_key = remote_cache_url ? remote_cache_key(profile, diff) : NULL;
+        if (job->remote_key && remote_cache_get(job->remote_key, &job->titles[slot], &job->descriptions[slot])) {
+            job->cache_key = NULL;
+            job->remote_key = NULL;
+            return;
+        }
+        payload = build_request_payload(profile, diff);
+    } else {
+        char *prompt = build_pack_prompt(profile, pack->diffs, slots, sections);
+        payload = prompt ? build_message_payload(prompt, (int)(PACK_OUTPUT_TOKENS_PER_DIFF * sections)) : NULL;
+    }
+    net_request_set_payload(&job->request, payload, pack_model(pack->diffs, slots, sections));
+    for (size_t n = 0; n < sections; n++) {
+        job->request.diff_bytes += strlen(pack->diffs[slots[n]]);
+    }
+}
+
+/* Prepare stage: read a pack's diffs, build its request and pass it on */
+static void prepare_job(struct PackRun *run, struct Pack *pack) {
+    struct PipeRun *pipe = (struct PipeRun *)run;
+    struct PipeJob *job = calloc(1, sizeof(*job));
+    if (!job) {
+        fprintf(stderr, "Error: Memory allocation failed for pipeline job\n");
+        run->failed += pack->count;
+        pack->count = 0;
+        return;
+    }
+    job->pack = *pack;
+    job->seq = pipe->next_seq++;
+    job->request.key_slot = -1;
+    for (size_t i = 0; i < pack->count; i++) {
+        job->pack.diffs[i] = take_diff(run, pack->indexes[i], pack->paths[i]);
+    }
+    job->request.arena = arena_pool_acquire(pipe->arenas);
+    if (job->request.arena) {
+        struct Arena *previous = arena_activate(job->request.arena);
+        build_job_request(pipe, job);
+        arena_activate(previous);
+    }
+    pipe->stats[0].items++;
+    pack->count = 0;
+
+    long long wait_start = pipeline_now_us();
+    stage_queue_push(pipe->prepared, job);
+    pipe->prepare_wait_us += pipeline_now_us() - wait_start;
+}
+
+static void* prepare_stage(void *arg) {
+    struct PipeRun *pipe = arg;
+    struct StageStats *stats = &pipe->stats[0];
+    stats->start_us = pipeline_now_us();
+
+    group_paths(&pipe->run, pipe->paths, pipe->count, prepare_job);
+    pipe->end_job.seq = pipe->next_seq++;
+    stage_queue_push(pipe->prepared, &pipe->end_job);
+    stage_queue_close(pipe->prepared);
+
+    stats->end_us = pipeline_now_us();
+    stats->busy_us = stats->end_us - stats->start_us - pipe->prepare_wait_us;
+    return NULL;
+}
+
+/* Ask for one section of a packed reply again, on its own */
+static void queue_retry(struct PipeRun *pipe, struct PipeJob *parent, size_t slot) {
+    debug_print("Section missing from the packed reply, asking for %s alone", parent->pack.paths[slot]);
+    struct PipeJob *retry = calloc(1, sizeof(*retry));
+    if (!retry) {
+        fprintf(stderr, "Error: Memory allocation failed for pipeline job\n");
+        return;
+    }
+    retry->parent = parent;
+    retry->parent_slot = slot;
+    retry->request.key_slot = -1;
+    retry->request.arena = arena_pool_acquire(pipe->arenas);
+    if (retry->request.arena) {
+        char *const *diff = &parent->pack.diffs[slot];
+        size_t first = 0;
+        struct Arena *previous = arena_activate(retry->request.arena);
+        net_request_set_payload(&retry->request, build_request_payload(pipe->run.profile, *diff),
+                            pack_model(diff, &first, 1));
+        retry->request.diff_bytes = strlen(*diff);
+        arena_activate(previous);
+    }
+    if (!retry->request.body) {
+        release_job(pipe, retry);
+        return;
+    }
+    parent->retries++;
+    stage_queue_push(pipe->retries, retry);
+}
+
+/* Output stage: read the titles and descriptions out of a job's reply */
+static void answer_job(struct PipeRun *pipe, struct PipeJob *job) {
+    if (!job->request.body) return;
+
+    struct Pack *pack = &job->pack;
+    size_t slots[PACK_MAX_DIFFS];
+    size_t sections = 0;
+    for (size_t i = 0; i < pack->count; i++) {
+        if (pack->diffs[i]) slots[sections++] = i;
+    }
+
+    struct Arena *previous = arena_activate(job->request.arena);
+    const char *reply = net_request_reply(&job->request);
+    if (reply && sections == 1) {
+        if (!parse_claude_response(reply, &job->titles[slots[0]], &job->descriptions[slots[0]])) {
+            job->titles[slots[0]] = NULL;
+        }
+    } else if (reply) {
+        size_t text_len = 0;
+        char *text = extract_response_text(reply, &text_len, NULL);
+        if (!text) {
+            fprintf(stderr, "Error: No reply for %zu packed diffs starting at %s\n",
+                    sections, pack->paths[slots[0]]);
+        } else {
+            char *titles[PACK_MAX_DIFFS];
+            char *descriptions[PACK_MAX_DIFFS];
+            split_pack_reply(text, sections, titles, descriptions);
+            for (size_t n = 0; n < sections; n++) {
+                job->titles[slots[n]] = titles[n];
+                job->descriptions[slots[n]] = descriptions[n];
+                if (!titles[n]) queue_retry(pipe, job, slots[n]);
+            }
+        }
+    }
+    arena_activate(previous);
+}
+
+/* Output stage: hand the answer to a section asked again to its pack */
+static void answer_retry(struct PipeRun *pipe, struct PipeJob *retry) {
+    struct PipeJob *parent = retry->parent;
+    size_t slot = retry->parent_slot;
+    char *title = NULL;
+    char *description = NULL;
+
+    struct Arena *previous = arena_activate(retry->request.arena);
+    const char *reply = net_request_reply(&retry->request);
+    if (reply && parse_claude_response(reply, &title, &description)) {
+        arena_activate(parent->request.arena);
+        parent->titles[slot] = str_duplicate(title);
+        parent->descriptions[slot] = str_duplicate(description);
+    }
+    arena_activate(previous);
+
+    parent->retries--;
+    release_job(pipe, retry);
+}
+
+/* Output stage: print the results of a job whose turn it is */
+static void emit_job(struct PipeRun *pipe, struct PipeJob *job) {
+    struct Pack *pack = &job->pack;
+    struct Arena *previous = arena_activate(job->request.arena);
+    for (size_t i = 0; i < pack->count; i++) {
+        if (!pack->diffs[i]) {
+            pipe->failed++;
+            continue;
+        }
+
+        char id[BATCH_CUSTOM_ID_MAX + 1];
+        diff_list_id(pack->indexes[i], pack->paths[i], id);
+        if (!job->titles[i] || !job->descriptions[i] ||
+            !emit_diff_result(pack->paths[i], id, job->titles[i], job->descriptions[i], pipe->run.output_dir)) {
+            fprintf(stderr, "Error: No message for %s\n", pack->paths[i]);
+            pipe->failed++;
+            continue;
+        }
+        if (job->cache_key) {
+            notes_cache_store(job->cache_key, job->titles[i], job->descriptions[i]);
+        }
+        if (job->remote_key) {
+            remote_cache_put(job->remote_key, job->titles[i], job->descriptions[i]);
+        }
+    }
+    arena_activate(previous);
+    fflush(stdout);
+    release_job(pipe, job);
+}
+
+static void* output_stage(void *arg) {
+    struct PipeRun *pipe = arg;
+    struct StageStats *stats = &pipe->stats[2];
+    struct PipeJob **waiting = pipe->waiting;
+    size_t next_emit = 0;
+    stats->start_us = pipeline_now_us();
+
+    struct PipeJob *job;
+    while ((job = stage_queue_pop(pipe->answered)) != NULL) {
+        long long busy_start = pipeline_now_us();
+        if (!job->end) stats->items++;
+        if (job->request.body) pipe->requests++;
+
+        if (job->parent) {
+            answer_retry(pipe, job);
+        } else {
+            answer_job(pipe, job);
+            waiting[job->seq] = job;
+        }
+
+        // Results are printed in list order, a pack once its retried sections are back
+        size_t first_emit = next_emit;
+        while (next_emit <= pipe->count && waiting[next_emit] && waiting[next_emit]->retries == 0) {
+            struct PipeJob *ready = waiting[next_emit];
+            waiting[next_emit++] = NULL;
+            if (ready->end) {
+                stage_queue_close(pipe->retries);
+            } else {
+                emit_job(pipe, ready);
+            }
+        }
+
+        // Let the network stage take more of the list now that the window moved
+        if (next_emit != first_emit) {
+            __atomic_store_n(&pipe->emitted, next_emit, __ATOMIC_RELEASE);
+            stage_queue_wake_producer(pipe->answered);
+        }
+        stats->busy_us += pipeline_now_us() - busy_start;
+    }
+
+    stats->end_us = pipeline_now_us();
+    return NULL;
+}
+
+/* Print a message for every path, overlapping preparation, requests and output */
+static int process_paths_pipelined(const char *api_key, const char *profile, const char *const *paths,
+                                   size_t count, const char *output_dir) {
+    struct PipeRun pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.run.api_key = api_key;
+    pipe.run.profile = profile;
+    pipe.run.output_dir = output_dir;
+    pipe.paths = paths;
+    pipe.count = count;
+    pipe.end_job.end = 1;
+    pipe.end_job.request.key_slot = -1;
+    pipe.stats[0].name = "prepare";
+    pipe.stats[1].name = "network";
+    pipe.stats[2].name = "output";
+
+    long long start = monotonic_ms();
+    pipe.arenas = arena_pool_create(PIPELINE_QUEUE_SIZE, ARENA_DEFAULT_BLOCK_SIZE);
+    pipe.prepared = stage_queue_create(PIPELINE_QUEUE_SIZE);
+    pipe.answered = stage_queue_create(PIPELINE_QUEUE_SIZE);
+    pipe.retries = stage_queue_create(PIPELINE_QUEUE_SIZE);
+    pipe.waiting = calloc(count + 1, sizeof(*pipe.waiting));
+    if (!pipe.waiting) {
+        fprintf(stderr, "Error: Memory allocation failed for pipeline output\n");
+    }
+    pipe.run.ingest = pipe.arenas && pipe.prepared && pipe.answered && pipe.retries && pipe.waiting ?
+                      ingest_open(paths, count) : NULL;
+    pipe.stats[2].input = pipe.answered;
+
+    int ok = pipe.run.ingest != NULL;
+    pthread_t prepare_thread, output_thread;
+    if (ok && pthread_create(&output_thread, NULL, output_stage, &pipe) != 0) {
+        fprintf(stderr, "Error: Failed to start the pipeline output thread\n");
+        ok = 0;
+    }
+    if (ok) {
+        // Without a prepare thread the network and output stages still drain and stop
+        int preparing = pthread_create(&prepare_thread, NULL, prepare_stage, &pipe) == 0;
+        if (!preparing) {
+            fprintf(stderr, "Error: Failed to start the pipeline prepare thread\n");
+            pipe.run.failed = count;
+            stage_queue_push(pipe.prepared, &pipe.end_job);
+            stage_queue_close(pipe.prepared);
+        }
+        net_stage_run(pipe.prepared, pipe.retries, pipe.answered, api_key, &pipe.emitted, &pipe.stats[1]);
+        if (preparing) pthread_join(prepare_thread, NULL);
+        pthread_join(output_thread, NULL);
+
+        size_t failed = pipe.run.failed + pipe.failed;
+        printf("Processed %zu diffs with %zu requests in %lld ms, %zu failed\n",
+               pipe.run.diffs, pipe.requests, monotonic_ms() - start, failed);
+        fflush(stdout);
+        pipeline_report(pipe.stats, 3);
+        ok = pipe.run.diffs > 0 && failed == 0;
+    }
+
+    ingest_close(pipe.run.ingest);
+    stage_queue_destroy(pipe.retries);
+    stage_queue_destroy(pipe.answered);
+    stage_queue_destroy(pipe.prepared);
+    arena_pool_destroy(pipe.arenas);
+    free(pipe.waiting);
+    return ok;
+}
+
+/* Append a copy of path to a growing array of paths */
+static int add_path(char ***paths, size_t *count, size_t *capacity, const char *path) {
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        char **grown = mem_realloc(*paths, new_capacity * sizeof(*grown));
+        if (!grown) return 0;
+        *paths = grown;
+        *capacity = new_capacity;
+    }
+    char *copy = str_duplicate(path);
+    if (!copy) return 0;
+    (*paths)[(*count)++] = copy;
+    return 1;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Collect the .diff files of a directory, sorted by name; -1 on error */
+static int list_diff_dir(const char *dir_path, char ***paths, size_t *count) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        fprintf(stderr, "Error: Failed to open directory: %s (%s)\n", dir_path, strerror(errno));
+        return -1;
+    }
+
+    size_t capacity = 0;
+    int ok = 1;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 5 || strcmp(entry->d_name + len - 5, ".diff") != 0) continue;
+
+        char path[DIFF_LIST_MAX_PATH];
+        if (snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name) >= (int)sizeof(path)) {
+            fprintf(stderr, "Error: Path in diff directory is too long: %.64s...\n", entry->d_name);
+            ok = 0;
+            break;
+        }
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            ok = add_path(paths, count, &capacity, path);
+        }
+    }
+    closedir(dir);
+
+    if (!ok) return -1;
+    if (*count > 0) qsort(*paths, *count, sizeof(**paths), compare_paths);
+    return 0;
+}
+
+// Function to tell whether a --diff-list or -d path names a directory of diffs
+int is_diff_dir(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*
+ * Function to print a message for every diff in a --diff-list, or for every
+ * .diff file of a directory, packing them with --pack
+ */
+int process_diff_list(const char *api_key, const char *profile, const char *diff_list_path,
+                      const char *output_dir) {
+    char **paths = NULL;
+    size_t count = 0;
+    int more = 0;
+
+    if (is_diff_dir(diff_list_path)) {
+        more = list_diff_dir(diff_list_path, &paths, &count);
+        if (more == 0 && count == 0) {
+            fprintf(stderr, "Error: No .diff files in %s\n", diff_list_path);
+            more = -1;
+        }
+    } else {
+        char *list = read_file(diff_list_path);
+        if (!list) return 0;
+
+        const char *cursor = list;
+        char path[DIFF_LIST_MAX_PATH];
+        size_t capacity = 0;
+        while ((more = diff_list_next(&cursor, path, sizeof(path))) == 1) {
+            if (!add_path(&paths, &count, &capacity, path)) {
+                fprintf(stderr, "Error: Memory allocation failed for diff list\n");
+                more = -1;
+                break;
+            }
+        }
+        mem_free(list);
+    }
+
+    int ok = more == 0 &&
+             (pipeline_mode ? process_paths_pipelined : process_paths)(api_key, profile,
+                                                                      (const char *const *)paths,
+                                                                      count, output_dir);
+
+    for (size_t i = 0; i < count; i++) {
+        mem_free(paths[i]);
+    }
+    mem_free(paths);
+    return ok;
+}
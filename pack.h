@@ -0,0 +1,50 @@
+/**
+ * Claude API Client - Packing small diffs into one request
+ *
+ * --diff-list without --batch-submit asks for a message for every listed
+ * diff, one request per diff. For histories with many tiny commits most of
+ * each such request is the repeated profile and instructions, and most of
+ * its time the round trip. With --pack, consecutive diffs are grouped until
+ * the estimated prompt would exceed --pack-tokens, and each group is sent
+ * as one request: the profile and instructions once, then one section per
+ * diff between "=== COMMIT <n> ===" and "=== END COMMIT <n> ===" lines.
+ * The reply is asked for in the same section format and split back into a
+ * title and description per diff.
+ *
+ * A diff whose section is missing from the reply is retried on its own, and
+ * a diff that does not fit under the ceiling by itself always goes alone.
+ *
+ * A directory given as the list (or as -d) stands for its .diff files in
+ * name order.
+ */
+
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+
+/* Default ceiling on the estimated input tokens of a packed request */
+#define PACK_DEFAULT_TOKENS 4000
+
+/* Most diffs sent in one packed request */
+#define PACK_MAX_DIFFS 16
+
+/* Output tokens allowed per diff of a packed request */
+#define PACK_OUTPUT_TOKENS_PER_DIFF 512
+
+/* Bytes per token assumed when estimating prompt size */
+#define PACK_BYTES_PER_TOKEN 4
+
+/* Group listed diffs into packed requests (--pack) */
+extern int pack_mode;
+
+/* Ceiling on the estimated input tokens of a packed request (--pack-tokens) */
+extern long pack_tokens;
+
+void find_sections(const char *text, const char *marker, const char *end_marker,
+                   size_t count, const char **starts, size_t *lens);
+int is_diff_dir(const char *path);
+int process_diff_list(const char *api_key, const char *profile, const char *diff_list_path,
+                      const char *output_dir);
+
+#endif /* PACK_H */
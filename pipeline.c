@@ -0,0 +1,555 @@
+/**
+ * Claude API Client - Staged pipeline runtime
+ *
+ * See pipeline.h. Queue positions only grow; a slot is position & mask.
+ * The producer publishes an item by storing tail, the consumer frees its
+ * slot by storing head, each on its own cache line. A stage about to sleep
+ * counts itself in sleepers and looks at the queue again under the lock,
+ * and the other side checks sleepers after every push or pop, so one of
+ * the two always sees the other and no wakeup is lost. Wake functions are
+ * only called, set and cleared under the lock, so the network stage can
+ * clear them before it frees its curl_multi handle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#include "claude_client.h"
+#include "ledger.h"
+#include "latency.h"
+#include "pipeline.h"
+
+/* Longest the network stage sleeps without news */
+#define PIPELINE_POLL_MS 1000
+
+#define CACHE_LINE 64
+
+struct StageQueue {
+    size_t head;                    /* next position to pop; written by the consumer */
+    char head_pad[CACHE_LINE - sizeof(size_t)];
+    size_t tail;                    /* next position to push; written by the producer */
+    char tail_pad[CACHE_LINE - sizeof(size_t)];
+    void **slots;
+    size_t mask;
+    int closed;
+    int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    void (*wake_consumer)(void *data);     /* called after a push into an empty queue or a close */
+    void (*wake_producer)(void *data);     /* called after a pop from a full queue */
+    void *wake_data;                       /* the wake fields are guarded by lock */
+    unsigned long long pushes;      /* producer only */
+    unsigned long long occupancy_sum;
+    size_t max_occupancy;
+};
+
+/* The network stage's state */
+struct NetStage {
+    CURLM *multi;
+    const char *api_key;
+    char *url;
+    struct StageQueue *input;
+    struct StageQueue *retries;
+    struct StageQueue *output;
+    struct NetRequest *requeued;    /* refused for their key, sent again first */
+    struct NetRequest *done_head;   /* answered, waiting for room in output */
+    struct NetRequest *done_tail;
+    size_t done_count;
+    const size_t *released;         /* input items the consumer is done with, or NULL */
+    size_t taken;                   /* input items taken */
+    long inflight;
+    long long key_wait_at_ms;       /* when a key of the pool recovers, or -1 */
+    struct StageStats *stats;
+};
+
+/* Run --diff-list through the staged pipeline (--pipeline) */
+int pipeline_mode = 0;
+
+/* Requests the network stage keeps in flight (--max-inflight) */
+long pipeline_max_inflight = PIPELINE_DEFAULT_MAX_INFLIGHT;
+
+// Function to read a monotonic clock in microseconds
+long long pipeline_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Function to create a queue of at least capacity slots
+struct StageQueue* stage_queue_create(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    struct StageQueue *queue = calloc(1, sizeof(*queue));
+    void **slots = calloc(size, sizeof(*slots));
+    if (!queue || !slots) {
+        fprintf(stderr, "Error: Memory allocation failed for pipeline queue\n");
+        free(queue);
+        free(slots);
+        return NULL;
+    }
+    queue->slots = slots;
+    queue->mask = size - 1;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    return queue;
+}
+
+void stage_queue_destroy(struct StageQueue *queue) {
+    if (!queue) return;
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->slots);
+    free(queue);
+}
+
+/* Wake the other side if it sleeps on the queue */
+static void wake_sleepers(struct StageQueue *queue) {
+    if (__atomic_load_n(&queue->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_broadcast(&queue->cond);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+/* Call a wake function of the queue, if it has one */
+static void call_wake(struct StageQueue *queue, int consumer) {
+    pthread_mutex_lock(&queue->lock);
+    void (*wake)(void *) = consumer ? queue->wake_consumer : queue->wake_producer;
+    if (wake) wake(queue->wake_data);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void set_wake(struct StageQueue *queue, int consumer, void (*wake)(void *), void *data) {
+    pthread_mutex_lock(&queue->lock);
+    if (consumer) queue->wake_consumer = wake;
+    else queue->wake_producer = wake;
+    queue->wake_data = data;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static int try_push(struct StageQueue *queue, void *item) {
+    size_t tail = queue->tail;
+    size_t count = tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (count > queue->mask) return 0;
+
+    queue->slots[tail & queue->mask] = item;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    queue->pushes++;
+    queue->occupancy_sum += count + 1;
+    if (count + 1 > queue->max_occupancy) queue->max_occupancy = count + 1;
+
+    wake_sleepers(queue);
+    if (count == 0) call_wake(queue, 1);
+    return 1;
+}
+
+/* 1 with an item, 0 if the queue is empty, -1 if it is also closed */
+static int try_pop(struct StageQueue *queue, void **item) {
+    size_t head = queue->head;
+    size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        // Items pushed before the close are still taken
+        if (!__atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE)) return 0;
+        return head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) ? -1 : 0;
+    }
+
+    *item = queue->slots[head & queue->mask];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_SEQ_CST);
+
+    wake_sleepers(queue);
+    if (tail - head == queue->mask + 1) call_wake(queue, 0);
+    return 1;
+}
+
+/* Sleep until the queue has room (for_push) or an item */
+static void wait_queue(struct StageQueue *queue, int for_push) {
+    pthread_mutex_lock(&queue->lock);
+    __atomic_add_fetch(&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+        size_t count = __atomic_load_n(&queue->tail, __ATOMIC_SEQ_CST) -
+                       __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&queue->closed, __ATOMIC_SEQ_CST) ||
+            (for_push ? count <= queue->mask : count > 0)) {
+            break;
+        }
+        pthread_cond_wait(&queue->cond, &queue->lock);
+    }
+    __atomic_sub_fetch(&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Function to add an item, waiting while the queue is full; 0 if the queue was closed
+int stage_queue_push(struct StageQueue *queue, void *item) {
+    while (!try_push(queue, item)) {
+        if (__atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE)) return 0;
+        wait_queue(queue, 1);
+    }
+    return 1;
+}
+
+// Function to take the oldest item, waiting while the queue is empty; NULL once it is closed and empty
+void* stage_queue_pop(struct StageQueue *queue) {
+    void *item = NULL;
+    int got;
+    while ((got = try_pop(queue, &item)) == 0) {
+        wait_queue(queue, 0);
+    }
+    return got > 0 ? item : NULL;
+}
+
+// Function to mark the end of a queue's items; the consumer drains what is left
+void stage_queue_close(struct StageQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    __atomic_store_n(&queue->closed, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&queue->cond);
+    if (queue->wake_consumer) queue->wake_consumer(queue->wake_data);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Function to wake the producer of a queue, e.g. when it waits for something besides room
+void stage_queue_wake_producer(struct StageQueue *queue) {
+    call_wake(queue, 0);
+}
+
+static void wake_multi(void *data) {
+    curl_multi_wakeup(data);
+}
+
+static size_t net_write(void *contents, size_t size, size_t nmemb, void *userdata) {
+    struct NetRequest *request = userdata;
+    struct Arena *previous = arena_activate(request->arena);
+    size_t written = api_backend->reader_write(contents, size, nmemb, request->reader);
+    arena_activate(previous);
+    return written;
+}
+
+static size_t net_header(char *buffer, size_t size, size_t nitems, void *userdata) {
+    struct NetRequest *request = userdata;
+    if (request->key_slot >= 0) {
+        rate_limit_header(&request->limits, buffer, size * nitems);
+    }
+    struct Arena *previous = arena_activate(request->arena);
+    size_t written = api_backend->reader_header(buffer, size, nitems, request->reader);
+    arena_activate(previous);
+    return written;
+}
+
+/* Queue an item for the next stage */
+static void net_done(struct NetStage *stage, struct NetRequest *request) {
+    request->next = NULL;
+    if (stage->done_tail) stage->done_tail->next = request;
+    else stage->done_head = request;
+    stage->done_tail = request;
+    stage->done_count++;
+}
+
+/* Hand answered items to the next stage while it has room */
+static void net_flush(struct NetStage *stage) {
+    while (stage->done_head) {
+        // Once pushed the item belongs to the next stage, which may free it at once
+        struct NetRequest *next = stage->done_head->next;
+        if (!try_push(stage->output, stage->done_head)) break;
+        stage->done_head = next;
+        if (!next) stage->done_tail = NULL;
+        stage->done_count--;
+    }
+}
+
+/* Build the transfer and hand it to curl_multi */
+static void net_start(struct NetStage *stage, struct NetRequest *request, int key_slot) {
+    const char *api_key = key_slot >= 0 ? key_pool_key(key_slot) : stage->api_key;
+    request->key_slot = key_slot;
+    if (request->attempts++ == 0) stage->stats->items++;
+    request->headers = NULL;
+    rate_limit_headers_init(&request->limits);
+
+    struct Arena *previous = arena_activate(request->arena);
+    request->reader = api_backend->reader_open();
+    request->easy = request->reader ? open_api_handle(api_backend, api_key, stage->url, request->body,
+                                                      &request->headers) : NULL;
+    if (!request->easy && request->reader) {
+        api_backend->reader_close(request->reader, 0);
+    }
+    arena_activate(previous);
+    if (!request->easy) {
+        net_done(stage, request);
+        return;
+    }
+
+    CURL *easy = request->easy;
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, net_write);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void *)request);
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, net_header);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, (void *)request);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, (void *)request);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    long remaining_ms = deadline_remaining_ms();
+    if (remaining_ms >= 0) {
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, remaining_ms > 0 ? remaining_ms : 1L);
+    }
+
+    if (key_slot >= 0) {
+        key_pool_begin(key_slot, request->estimated_tokens);
+    }
+    request->sent_ms = monotonic_ms();
+    stage->inflight++;
+    curl_multi_add_handle(stage->multi, easy);
+}
+
+/* Whether new input may be taken: the output keeps up and the window has room */
+static int net_has_room(const struct NetStage *stage) {
+    if (stage->done_count >= PIPELINE_QUEUE_SIZE) return 0;
+    return !stage->released ||
+           stage->taken - __atomic_load_n(stage->released, __ATOMIC_ACQUIRE) < PIPELINE_WINDOW;
+}
+
+/* Next item to send: a requeued one, then a retry, then new work while the output keeps up */
+static struct NetRequest* net_next(struct NetStage *stage) {
+    if (stage->requeued) {
+        struct NetRequest *request = stage->requeued;
+        stage->requeued = request->next;
+        return request;
+    }
+    void *item = NULL;
+    if (try_pop(stage->retries, &item) > 0) {
+        return item;
+    }
+    if (net_has_room(stage) && try_pop(stage->input, &item) > 0) {
+        stage->taken++;
+        return item;
+    }
+    return NULL;
+}
+
+/* Start requests while there is room in flight and a key to send them with */
+static void net_dispatch(struct NetStage *stage) {
+    while (stage->inflight < pipeline_max_inflight) {
+        if (stage->key_wait_at_ms >= 0 && monotonic_ms() < stage->key_wait_at_ms) return;
+        stage->key_wait_at_ms = -1;
+
+        struct NetRequest *request = net_next(stage);
+        if (!request) return;
+        if (!request->body) {
+            net_done(stage, request);
+            continue;
+        }
+
+        int key_slot;
+        if (!key_pool_choose(request->estimated_tokens, &key_slot, &stage->key_wait_at_ms)) {
+            request->next = stage->requeued;
+            stage->requeued = request;
+            return;
+        }
+        net_start(stage, request, key_slot);
+    }
+}
+
+static void net_finish(struct NetStage *stage, struct NetRequest *request, CURLcode result) {
+    CURL *easy = request->easy;
+    long http_code = 0;
+    struct LatencyTransfer transfer = { -1, -1, -1, -1 };
+    if (result == CURLE_OK) {
+        curl_off_t connect = 0, tls = 0, ttfb = 0, total = 0;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &tls);
+        curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+        curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total);
+        transfer.connect_us = (long long)connect;
+        transfer.tls_us = tls > 0 ? (long long)(tls - connect) : -1;
+        transfer.ttfb_us = (long long)ttfb;
+        transfer.total_us = (long long)total;
+    } else {
+        fprintf(stderr, "Error: cURL request failed: %s\n", curl_easy_strerror(result));
+    }
+    curl_multi_remove_handle(stage->multi, easy);
+    curl_easy_cleanup(easy);
+    curl_slist_free_all(request->headers);
+    request->easy = NULL;
+    request->headers = NULL;
+    stage->inflight--;
+
+    long long elapsed = monotonic_ms() - request->sent_ms;
+    stage->stats->request_us += elapsed * 1000LL;
+    debug_print("Pipeline request answered %ld in %lld ms (%ld in flight)", http_code, elapsed,
+                stage->inflight);
+
+    struct Arena *previous = arena_activate(request->arena);
+    char *body = api_backend->reader_close(request->reader, http_code);
+    request->reader = NULL;
+    ledger_diff_bytes = request->diff_bytes;
+    ledger_record(request->model, http_code, elapsed, body);
+    arena_activate(previous);
+    if (result == CURLE_OK) {
+        latency_add_transfer(request->model, request->diff_bytes, &transfer);
+    }
+
+    if (request->key_slot >= 0) {
+        key_pool_finish(request->key_slot, request->estimated_tokens, http_code, &request->limits);
+        stage->key_wait_at_ms = -1;
+
+        // A request refused for its key is sent again with another one
+        if (key_pool_should_retry(http_code, request->attempts)) {
+            debug_print("HTTP %ld with key %d of the pool, trying another key", http_code,
+                        request->key_slot + 1);
+            previous = arena_activate(request->arena);
+            mem_free(body);
+            arena_activate(previous);
+            request->next = stage->requeued;
+            stage->requeued = request;
+            return;
+        }
+    }
+
+    request->response = body;
+    request->http_code = http_code;
+    net_done(stage, request);
+}
+
+static void net_read_info(struct NetStage *stage) {
+    CURLMsg *msg;
+    int left = 0;
+    while ((msg = curl_multi_info_read(stage->multi, &left)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        struct NetRequest *request = NULL;
+        CURLcode result = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+        if (request) net_finish(stage, request, result);
+    }
+}
+
+// Function to serialize a payload into a request, for model rather than the shared api_model; frees payload
+void net_request_set_payload(struct NetRequest *request, cJSON *payload, const char *model) {
+    if (!payload) return;
+    cJSON_Delete(cJSON_DetachItemFromObject(payload, "model"));
+    cJSON_AddStringToObject(payload, "model", model);
+    request->body = api_backend->print_payload(payload);
+    request->model = model;
+    request->estimated_tokens = request->body ? (long)(strlen(request->body) / 4) + 1 : 0;
+    cJSON_Delete(payload);
+}
+
+// Function to get the reply body of an answered request; NULL (with the error printed) if it failed
+const char* net_request_reply(const struct NetRequest *request) {
+    if (!request->response) {
+        return NULL;
+    }
+    if (request->http_code < 200 || request->http_code >= 300) {
+        fprintf(stderr, "Error: API request failed with HTTP code %ld\n", request->http_code);
+        fprintf(stderr, "Response: %s\n", request->response);
+        return NULL;
+    }
+    return request->response;
+}
+
+/* Nothing left to send, in flight or to hand on, and no more will come */
+static int net_finished(struct NetStage *stage) {
+    return stage->inflight == 0 && !stage->requeued && !stage->done_head &&
+           __atomic_load_n(&stage->input->closed, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&stage->retries->closed, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&stage->input->tail, __ATOMIC_ACQUIRE) == stage->input->head &&
+           __atomic_load_n(&stage->retries->tail, __ATOMIC_ACQUIRE) == stage->retries->head;
+}
+
+/*
+ * Function to run the network stage on the calling thread: send the items
+ * of input and retries, and pass every item on to output once answered.
+ * With released, input items are taken at most PIPELINE_WINDOW ahead of
+ * it; the consumer advances it atomically and then calls
+ * stage_queue_wake_producer() on output. Returns when both inputs are
+ * closed and drained, after closing output; 0 if the stage could not be
+ * set up and the items went on unanswered.
+ */
+int net_stage_run(struct StageQueue *input, struct StageQueue *retries, struct StageQueue *output,
+                  const char *api_key, const size_t *released, struct StageStats *stats) {
+    struct NetStage stage;
+    memset(&stage, 0, sizeof(stage));
+    stage.api_key = api_key;
+    stage.input = input;
+    stage.retries = retries;
+    stage.released = released;
+    stage.output = output;
+    stage.key_wait_at_ms = -1;
+    stage.stats = stats;
+    stats->input = input;
+
+    stage.multi = curl_multi_init();
+    stage.url = build_api_url(api_base_url, api_backend->path);
+    if (!stage.multi || !stage.url) {
+        fprintf(stderr, "Error: Failed to set up the network stage\n");
+        if (stage.multi) curl_multi_cleanup(stage.multi);
+        mem_free(stage.url);
+
+        // Pass everything on unanswered so that the other stages still finish
+        void *item;
+        while ((item = stage_queue_pop(input)) != NULL) stage_queue_push(output, item);
+        while ((item = stage_queue_pop(retries)) != NULL) stage_queue_push(output, item);
+        stage_queue_close(output);
+        return 0;
+    }
+
+    // The other stages wake the poll below when they hand over work or make room
+    set_wake(input, 1, wake_multi, stage.multi);
+    set_wake(retries, 1, wake_multi, stage.multi);
+    set_wake(output, 0, wake_multi, stage.multi);
+
+    stats->start_us = pipeline_now_us();
+    for (;;) {
+        long long busy_start = pipeline_now_us();
+        int running = 0;
+        curl_multi_perform(stage.multi, &running);
+        net_read_info(&stage);
+        net_flush(&stage);
+        net_dispatch(&stage);
+        net_flush(&stage);
+        stats->busy_us += pipeline_now_us() - busy_start;
+        if (net_finished(&stage)) break;
+
+        int timeout_ms = PIPELINE_POLL_MS;
+        if (stage.key_wait_at_ms >= 0) {
+            long long wait_ms = stage.key_wait_at_ms - monotonic_ms();
+            if (wait_ms < timeout_ms) timeout_ms = wait_ms > 0 ? (int)wait_ms : 0;
+        }
+        curl_multi_poll(stage.multi, NULL, 0, timeout_ms, NULL);
+    }
+    stats->end_us = pipeline_now_us();
+
+    set_wake(input, 1, NULL, NULL);
+    set_wake(retries, 1, NULL, NULL);
+    set_wake(output, 0, NULL, NULL);
+    stage_queue_close(output);
+    curl_multi_cleanup(stage.multi);
+    mem_free(stage.url);
+    return 1;
+}
+
+// Function to print the throughput, busy share and input queue fill of each stage
+void pipeline_report(const struct StageStats *stages, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const struct StageStats *stage = &stages[i];
+        double seconds = (double)(stage->end_us - stage->start_us) / 1e6;
+        if (seconds <= 0) seconds = 1e-6;
+
+        char queue[96] = "";
+        const struct StageQueue *input = stage->input;
+        if (input && input->pushes > 0) {
+            snprintf(queue, sizeof(queue), ", input queue %.1f avg %zu max of %zu",
+                     (double)input->occupancy_sum / (double)input->pushes, input->max_occupancy,
+                     input->mask + 1);
+        }
+        char inflight[64] = "";
+        if (stage->request_us > 0) {
+            snprintf(inflight, sizeof(inflight), ", %.1f requests in flight avg",
+                     (double)stage->request_us / 1e6 / seconds);
+        }
+        fprintf(stderr, "Pipeline: %-7s %5zu items, %8.1f/s, busy %3.0f%%%s%s\n", stage->name,
+                stage->items, (double)stage->items / seconds,
+                100.0 * (double)stage->busy_us / 1e6 / seconds, queue, inflight);
+    }
+}
@@ -0,0 +1,102 @@
+/**
+ * Claude API Client - Staged pipeline runtime
+ *
+ * With --pipeline, a --diff-list run overlaps its work instead of doing it
+ * one diff at a time (see pack.h for the stages of that run). This file has
+ * what the stages are built from:
+ *
+ *   - StageQueue, a bounded single-producer single-consumer ring between
+ *     two stages. Push and pop are lock-free; a stage only takes the
+ *     queue's lock to sleep when its queue is full or empty. A stage that
+ *     waits on something else (the network stage waits in curl_multi_poll)
+ *     registers a wake function instead.
+ *   - The network stage: one thread running every request on a curl_multi
+ *     handle, at most --max-inflight at once, with the key pool if any.
+ *     It never blocks on its output queue; answered requests wait in a
+ *     list until the next stage takes them, and new requests are only
+ *     started while that list is short. A consumer that puts items back
+ *     in order passes a counter of the items it has released, and the
+ *     stage takes at most PIPELINE_WINDOW items ahead of it, so a slow
+ *     request at the head of the line cannot make the consumer hold the
+ *     rest of the list.
+ *   - StageStats and pipeline_report(), which prints one "Pipeline:" line
+ *     per stage with its throughput, how busy it was and how full its
+ *     input queue ran.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <cjson/cJSON.h>
+
+#include "keypool.h"
+
+/* Slots of each queue between two stages */
+#define PIPELINE_QUEUE_SIZE 64
+
+/* Input items the network stage takes ahead of the consumer's released count */
+#define PIPELINE_WINDOW (2 * PIPELINE_QUEUE_SIZE)
+
+/* Requests in flight at once unless --max-inflight says otherwise */
+#define PIPELINE_DEFAULT_MAX_INFLIGHT 8
+
+struct StageQueue;
+struct Arena;
+struct curl_slist;
+
+/* Run --diff-list through the staged pipeline (--pipeline) */
+extern int pipeline_mode;
+
+/* Requests the network stage keeps in flight (--max-inflight) */
+extern long pipeline_max_inflight;
+
+/* Counters of one stage */
+struct StageStats {
+    const char *name;
+    size_t items;
+    long long busy_us;              /* time spent working, not waiting on queues */
+    long long start_us;
+    long long end_us;
+    long long request_us;           /* network stage: summed request durations */
+    const struct StageQueue *input; /* queue the stage takes its items from */
+};
+
+/*
+ * One upstream request. Items passed to the network stage start with this
+ * struct; an item without a body is passed on as it is.
+ */
+struct NetRequest {
+    char *body;                     /* JSON payload, or NULL */
+    const char *model;
+    long estimated_tokens;
+    size_t diff_bytes;
+    struct Arena *arena;            /* the reply is read into it */
+    char *response;                 /* reply body, or NULL */
+    long http_code;                 /* 0 if no response was received */
+
+    /* Network stage only */
+    void *reader;
+    void *easy;
+    struct curl_slist *headers;
+    int key_slot;
+    size_t attempts;
+    long long sent_ms;
+    struct RateLimitHeaders limits;
+    struct NetRequest *next;
+};
+
+long long pipeline_now_us(void);
+struct StageQueue* stage_queue_create(size_t capacity);
+void stage_queue_destroy(struct StageQueue *queue);
+int stage_queue_push(struct StageQueue *queue, void *item);
+void* stage_queue_pop(struct StageQueue *queue);
+void stage_queue_close(struct StageQueue *queue);
+void stage_queue_wake_producer(struct StageQueue *queue);
+void net_request_set_payload(struct NetRequest *request, cJSON *payload, const char *model);
+const char* net_request_reply(const struct NetRequest *request);
+int net_stage_run(struct StageQueue *input, struct StageQueue *retries, struct StageQueue *output,
+                  const char *api_key, const size_t *released, struct StageStats *stats);
+void pipeline_report(const struct StageStats *stages, size_t count);
+
+#endif /* PIPELINE_H */
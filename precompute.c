@@ -0,0 +1,487 @@
+/**
+ * Claude API Client - Speculative precompute of the commit message
+ *
+ * See precompute.h. The stored file starts with a small header followed by
+ * the message in the format save_results_to_file() writes:
+ *
+ *   commit-ai-precompute 1
+ *   tree <staged tree hash>
+ *   key <hash of profile and prompt options>
+ *
+ *   # <title>
+ *
+ *   <description>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "claude_client.h"
+#include "git.h"
+#include "symbols.h"
+#include "precompute.h"
+#include "route.h"
+#include "eventlog.h"
+#include "latency.h"
+
+#define PRECOMPUTE_FILE "precomputed.md"
+#define PRECOMPUTE_LOCK_FILE "precompute.lock"
+#define PRECOMPUTE_MAGIC "commit-ai-precompute 1"
+
+/* Quiet period before the staged diff is taken (--debounce) */
+long precompute_debounce_ms = DEFAULT_DEBOUNCE_MS;
+
+/* Set by SIGINT/SIGTERM to end --watch */
+static volatile sig_atomic_t watch_stop = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR && !watch_stop) {
+    }
+}
+
+static unsigned long long fnv1a_text(unsigned long long hash, const char *text) {
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* FNV-1a over everything that changes the answer besides the diff */
+static unsigned long long request_key(const char *profile) {
+    char models[512];
+    if (route_describe_models(models, sizeof(models)) < 0) {
+        models[0] = '\0';
+    }
+
+    unsigned long long hash = fnv1a_text(1469598103934665603ULL, profile);
+    hash = (hash ^ (unsigned char)digest_mode) * 1099511628211ULL;
+    return fnv1a_text(hash, models);
+}
+
+/* Build "<git dir>/commit-ai/<name>", creating the directory */
+static char* state_path(const char *git_directory, const char *name) {
+    size_t len = strlen(git_directory) + strlen(PRECOMPUTE_DIR) + strlen(name) + 3;
+    char *path = mem_alloc(len);
+    if (!path) {
+        fprintf(stderr, "Error: Memory allocation failed for precompute path\n");
+        return NULL;
+    }
+
+    snprintf(path, len, "%s/%s", git_directory, PRECOMPUTE_DIR);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Failed to create directory: %s (%s)\n", path, strerror(errno));
+        mem_free(path);
+        return NULL;
+    }
+
+    snprintf(path, len, "%s/%s/%s", git_directory, PRECOMPUTE_DIR, name);
+    return path;
+}
+
+/* Write the result next to its final path, then rename it into place */
+static int store_precomputed(const char *path, const char *tree, const char *profile,
+                             const char *title, const char *description) {
+    size_t tmp_len = strlen(path) + 32;
+    char *tmp_path = mem_alloc(tmp_len);
+    if (!tmp_path) {
+        fprintf(stderr, "Error: Memory allocation failed for precompute path\n");
+        return 0;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp.%ld", path, (long)getpid());
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open file: %s (%s)\n", tmp_path, strerror(errno));
+        mem_free(tmp_path);
+        return 0;
+    }
+
+    fprintf(file, "%s\ntree %s\nkey %016llx\n\n# %s\n\n%s",
+            PRECOMPUTE_MAGIC, tree, request_key(profile), title, description);
+
+    int ok = ferror(file) == 0;
+    ok &= fclose(file) == 0;
+    if (ok && rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Error: Failed to store precomputed message (%s)\n", strerror(errno));
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(tmp_path);
+    }
+
+    mem_free(tmp_path);
+    return ok;
+}
+
+// Function to load the precomputed message if it was made for tree and profile
+int load_precomputed(const char *tree, const char *profile, char **title, char **description) {
+    char *git_directory = git_dir();
+    if (!git_directory) return 0;
+
+    char *path = state_path(git_directory, PRECOMPUTE_FILE);
+    mem_free(git_directory);
+    if (!path) return 0;
+
+    char *content = file_exists(path) ? read_file(path) : NULL;
+    mem_free(path);
+    if (!content) return 0;
+
+    // Header: magic, tree and key lines, then a blank line
+    char expected[256];
+    snprintf(expected, sizeof(expected), "%s\ntree %s\nkey %016llx\n\n# ",
+             PRECOMPUTE_MAGIC, tree, request_key(profile));
+    size_t header_len = strlen(expected);
+    if (strncmp(content, expected, header_len) != 0) {
+        debug_print("Precomputed message is for another staged tree or profile");
+        mem_free(content);
+        return 0;
+    }
+
+    if (!title) {
+        mem_free(content);
+        return 1;
+    }
+
+    const char *title_start = content + header_len;
+    const char *title_end = strchr(title_start, '\n');
+    size_t title_len = title_end ? (size_t)(title_end - title_start) : strlen(title_start);
+    const char *body = title_end ? title_end + 1 : title_start + title_len;
+    while (*body == '\n') body++;
+
+    *title = mem_alloc(title_len + 1);
+    *description = str_duplicate(body);
+    if (!*title || !*description) {
+        fprintf(stderr, "Error: Memory allocation failed for precomputed message\n");
+        mem_free(*title);
+        mem_free(*description);
+        mem_free(content);
+        return 0;
+    }
+    memcpy(*title, title_start, title_len);
+    (*title)[title_len] = '\0';
+
+    mem_free(content);
+    return 1;
+}
+
+/* Ask the API about the staged diff and store the answer for tree */
+static int precompute_tree(const char *git_directory, const char *api_key,
+                           const char *profile, const char *tree) {
+    char *diff = git_staged_diff();
+    if (!diff) return 0;
+    if (!*diff) {
+        debug_print("Nothing staged, nothing to precompute");
+        mem_free(diff);
+        return 1;
+    }
+
+    debug_print("Precomputing message for staged tree %s", tree);
+    long long start = monotonic_ms();
+    char *response = route_claude_api(api_key, profile, diff);
+    mem_free(diff);
+    if (!response) return 0;
+
+    char *title = NULL;
+    char *description = NULL;
+    int ok = parse_claude_response(response, &title, &description);
+    mem_free(response);
+    if (!ok) return 0;
+
+    char *path = state_path(git_directory, PRECOMPUTE_FILE);
+    ok = path && store_precomputed(path, tree, profile, title, description);
+    if (ok) {
+        debug_print("Precomputed message for tree %s in %lld ms", tree, monotonic_ms() - start);
+    }
+
+    mem_free(path);
+    mem_free(title);
+    mem_free(description);
+    return ok;
+}
+
+/*
+ * Take the precompute lock, first killing the run that holds it: its staged
+ * tree is stale now. The lock is released when this process exits.
+ */
+static int take_precompute_lock(const char *git_directory) {
+    char *path = state_path(git_directory, PRECOMPUTE_LOCK_FILE);
+    if (!path) return -1;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to open file: %s (%s)\n", path, strerror(errno));
+        mem_free(path);
+        return -1;
+    }
+    mem_free(path);
+
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+
+    struct flock holder = lock;
+    if (fcntl(fd, F_GETLK, &holder) == 0 && holder.l_type != F_UNLCK && holder.l_pid > 0) {
+        debug_print("Cancelling stale precompute in process %ld", (long)holder.l_pid);
+        kill(holder.l_pid, SIGTERM);
+    }
+
+    while (fcntl(fd, F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Error: Failed to lock precompute state (%s)\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Function to precompute the message for the staged tree once (hook mode)
+int precompute_once(const char *api_key, const char *profile) {
+    char *git_directory = git_dir();
+    if (!git_directory) return 0;
+
+    int lock_fd = take_precompute_lock(git_directory);
+    if (lock_fd < 0) {
+        mem_free(git_directory);
+        return 0;
+    }
+
+    // A newer run started during this wait would have killed us
+    sleep_ms(precompute_debounce_ms);
+
+    int ok = 0;
+    char *tree = git_staged_tree();
+    if (tree) {
+        if (load_precomputed(tree, profile, NULL, NULL)) {
+            debug_print("Precomputed message for tree %s is current", tree);
+            ok = 1;
+        } else {
+            ok = precompute_tree(git_directory, api_key, profile, tree);
+        }
+    }
+
+    close(lock_fd);
+    mem_free(tree);
+    mem_free(git_directory);
+    return ok;
+}
+
+/* Kill the worker precomputing a stale tree and reap it */
+static void cancel_worker(pid_t *worker, const char *tree) {
+    if (*worker <= 0) return;
+
+    debug_print("Cancelling stale request for tree %s", tree);
+    kill(*worker, SIGTERM);
+    while (waitpid(*worker, NULL, 0) < 0 && errno == EINTR) {
+    }
+    *worker = -1;
+}
+
+/* Start a worker process that precomputes tree; returns its pid */
+static pid_t start_worker(const char *git_directory, const char *api_key,
+                          const char *profile, const char *tree) {
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to start precompute worker (%s)\n", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        int ok = precompute_tree(git_directory, api_key, profile, tree);
+        latency_finish(0);  // the run's start is the parent's
+        event_log_flush();  // _exit skips the atexit flush
+        _exit(ok ? 0 : 1);
+    }
+    return pid;
+}
+
+#ifdef __linux__
+/* Watch the git directory for a new index; returns the inotify fd */
+static int open_index_watch(const char *git_directory) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        debug_print("inotify unavailable (%s), polling the index", strerror(errno));
+        return -1;
+    }
+    // git writes index.lock and renames it over index
+    if (inotify_add_watch(fd, git_directory, IN_MOVED_TO | IN_CLOSE_WRITE) < 0) {
+        debug_print("Cannot watch %s (%s), polling the index", git_directory, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Drain pending events; returns 1 if one of them was for the index */
+static int read_index_events(int fd) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        for (char *p = buffer; p < buffer + n;) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (event->len && strcmp(event->name, "index") == 0) {
+                changed = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+#endif
+
+/* Modification time of the index in ms, for polling */
+static long long index_mtime_ms(const char *index_path) {
+    struct stat st;
+    if (stat(index_path, &st) != 0) return 0;
+    return (long long)st.st_mtim.tv_sec * 1000LL + st.st_mtim.tv_nsec / 1000000L;
+}
+
+// Function to keep the precomputed message current until interrupted (--watch)
+int precompute_watch(const char *api_key, const char *profile) {
+    char *git_directory = git_dir();
+    if (!git_directory) return 0;
+
+    size_t index_len = strlen(git_directory) + sizeof("/index");
+    char *index_path = mem_alloc(index_len);
+    struct ArenaPool *pool = arena_pool_create(2, ARENA_DEFAULT_BLOCK_SIZE);
+    if (!index_path || !pool) {
+        fprintf(stderr, "Error: Memory allocation failed for index watch\n");
+        mem_free(index_path);
+        mem_free(git_directory);
+        arena_pool_destroy(pool);
+        return 0;
+    }
+    snprintf(index_path, index_len, "%s/index", git_directory);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int watch_fd = -1;
+#ifdef __linux__
+    watch_fd = open_index_watch(git_directory);
+#endif
+
+    printf("Watching %s (debounce %ld ms, Ctrl-C to stop)\n", index_path, precompute_debounce_ms);
+    fflush(stdout);
+
+    char current_tree[128] = "";
+    pid_t worker = -1;
+    long long last_mtime = index_mtime_ms(index_path);
+    long long changed_at = monotonic_ms() - precompute_debounce_ms;  // check once at start
+    int pending = 1;
+
+    while (!watch_stop) {
+        event_log_flush();
+
+        long long now = monotonic_ms();
+        int timeout = 250;
+        if (pending) {
+            long long wait = changed_at + precompute_debounce_ms - now;
+            timeout = wait < 0 ? 0 : (wait < timeout ? (int)wait : timeout);
+        }
+
+        struct pollfd pfd;
+        pfd.fd = watch_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, watch_fd >= 0 ? 1 : 0, timeout);
+        if (ready < 0 && errno != EINTR) {
+            fprintf(stderr, "Error: Failed to wait for index changes (%s)\n", strerror(errno));
+            break;
+        }
+
+        // Every new event restarts the quiet period
+#ifdef __linux__
+        if (ready > 0 && read_index_events(watch_fd)) {
+            pending = 1;
+            changed_at = monotonic_ms();
+        }
+#endif
+        if (watch_fd < 0) {
+            long long mtime = index_mtime_ms(index_path);
+            if (mtime != last_mtime) {
+                last_mtime = mtime;
+                pending = 1;
+                changed_at = monotonic_ms();
+            }
+        }
+
+        // Reap a finished worker
+        if (worker > 0) {
+            int status = 0;
+            if (waitpid(worker, &status, WNOHANG) == worker) {
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    fprintf(stderr, "Warning: Precompute for tree %s failed\n", current_tree);
+                    current_tree[0] = '\0';  // retry on the next change
+                }
+                worker = -1;
+            }
+        }
+
+        if (!pending || monotonic_ms() < changed_at + precompute_debounce_ms) {
+            continue;
+        }
+        pending = 0;
+
+        // Each round's allocations live in a pooled arena
+        struct Arena *arena = arena_pool_acquire(pool);
+        struct Arena *previous = arena_activate(arena);
+
+        char *tree = git_staged_tree();
+        if (tree && strcmp(tree, current_tree) != 0) {
+            cancel_worker(&worker, current_tree);
+            snprintf(current_tree, sizeof(current_tree), "%s", tree);
+
+            if (load_precomputed(tree, profile, NULL, NULL)) {
+                debug_print("Precomputed message for tree %s is current", tree);
+            } else {
+                worker = start_worker(git_directory, api_key, profile, tree);
+            }
+        }
+
+        arena_activate(previous);
+        arena_pool_release(pool, arena);
+    }
+
+    cancel_worker(&worker, current_tree);
+    if (watch_fd >= 0) {
+        close(watch_fd);
+    }
+    arena_pool_destroy(pool);
+    mem_free(index_path);
+    mem_free(git_directory);
+    return 1;
+}
@@ -0,0 +1,37 @@
+/**
+ * Claude API Client - Speculative precompute of the commit message
+ *
+ * Takes the model latency off the commit critical path. Whenever the index
+ * changes, the staged diff is sent ahead of time and the result is stored
+ * in .git/commit-ai/precomputed.md, together with the staged tree hash
+ * (git write-tree) and a hash of the profile and prompt options. At commit
+ * time --staged returns the stored result at once if both still match, and
+ * asks the API otherwise.
+ *
+ *   --watch        stays in the foreground and watches .git/index (inotify
+ *                  on Linux, mtime polling elsewhere)
+ *   --precompute   one-shot, meant for git's post-index-change hook
+ *
+ * Both wait --debounce ms for the index to settle. A request for a staged
+ * tree that has since changed is cancelled: --watch kills its worker, and a
+ * new --precompute run kills the previous one, which it finds through the
+ * lock held on .git/commit-ai/precompute.lock.
+ */
+
+#ifndef PRECOMPUTE_H
+#define PRECOMPUTE_H
+
+/* Directory under .git holding the precomputed message */
+#define PRECOMPUTE_DIR "commit-ai"
+
+/* Default quiet period before the staged diff is taken */
+#define DEFAULT_DEBOUNCE_MS 500
+
+/* Quiet period before the staged diff is taken (--debounce) */
+extern long precompute_debounce_ms;
+
+int precompute_once(const char *api_key, const char *profile);
+int precompute_watch(const char *api_key, const char *profile);
+int load_precomputed(const char *tree, const char *profile, char **title, char **description);
+
+#endif /* PRECOMPUTE_H */
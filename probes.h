@@ -0,0 +1,38 @@
+/**
+ * Claude API Client - USDT static tracepoints
+ *
+ * Probes in the "commit_ai" provider mark the phases of a request, so a
+ * slow commit hook can be traced with perf or bpftrace without rebuilding
+ * and without -v output:
+ *
+ *   read_file__start(path)           read_file__done(path, bytes)
+ *   prompt__start()                  prompt__done(bytes)
+ *   serialize__start()               serialize__done(bytes)
+ *   http__start()                    http__done(http_code)
+ *   chunk(bytes)                     one per response chunk received
+ *   parse__start()                   parse__done(ok, text_bytes)
+ *   save__start(path)                save__done(path, bytes)
+ *
+ * With <sys/sdt.h> (systemtap-sdt-dev) the Makefile defines HAVE_SYS_SDT_H
+ * and every probe compiles to a single nop plus an ELF note; arguments are
+ * values the code has at hand anyway. Without the header, or with
+ * "make PROBES=0", the macros expand to nothing. tools/phases.bt prints a
+ * per-phase breakdown.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define PROBE(name) DTRACE_PROBE(commit_ai, name)
+#define PROBE1(name, a) DTRACE_PROBE1(commit_ai, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(commit_ai, name, a, b)
+#else
+#define PROBE(name) do { } while (0)
+#define PROBE1(name, a) do { (void)(a); } while (0)
+#define PROBE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#endif
+
+#endif /* PROBES_H */
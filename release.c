@@ -0,0 +1,943 @@
+/**
+ * Claude API Client - Release notes and pull request descriptions
+ *
+ * See release.h. Each phase is one round of requests through the network
+ * stage of pipeline.c: a prepare thread builds the requests (reading the
+ * diffs and the stored results), the calling thread sends them and an
+ * output thread parses and stores the answers. Results are copied to the
+ * heap, since the arena of a request goes back to the pool once answered.
+ *
+ * A stored summary or reduction is the header
+ *
+ *   commit-ai-summary 1             (or commit-ai-reduction 1)
+ *   key <hash of models, digest mode and profile>
+ *
+ * followed by a blank line and the text: title line and description for a
+ * summary, the bulleted section for a reduction.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "claude_client.h"
+#include "git.h"
+#include "symbols.h"
+#include "route.h"
+#include "precompute.h"
+#include "ledger.h"
+#include "pipeline.h"
+#include "release.h"
+
+#define SUMMARY_MAGIC "commit-ai-summary 1"
+#define REDUCTION_MAGIC "commit-ai-reduction 1"
+
+/* Section of the areas with a single commit */
+#define OTHER_AREA "Other changes"
+
+/* The one area of --pr, used when a long branch is condensed before the combine request */
+#define BRANCH_AREA "Branch"
+
+/* Hex digits of a commit id (SHA-256 repositories) */
+#define MAX_COMMIT_ID 64
+
+/* Areas counted per diff; files past them are not counted */
+#define MAX_DIFF_AREAS 32
+
+static const char *reduce_template =
+    "Here is my profile:\n\n%s\n\nHere are summaries of the changes %s, "
+    "each starting with \"- \":\n\n%s\n\nPlease write the release notes for these changes: a "
+    "bulleted list of what changed for users of the project, most important first, with the "
+    "summaries of one change merged into one bullet. Answer with the list only.";
+
+static const char *combine_template =
+    "Here is my profile:\n\n%s\n\nHere are summaries of the %zu commits of a branch, oldest first:"
+    "\n\n%s\n\nPlease provide a concise title and description for a pull request that merges this "
+    "branch.";
+
+struct ReleaseCommit {
+    char sha[MAX_COMMIT_ID + 1];
+    const char *subject;            /* points into the commit list */
+    char area[RELEASE_MAX_AREA];
+    char *patch_id;                 /* heap; NULL without a diff */
+    char *title;                    /* heap */
+    char *description;
+    int empty;                      /* no changes to summarize */
+};
+
+struct ReleaseArea {
+    char name[RELEASE_MAX_AREA];
+    size_t commits;
+    size_t first;                   /* first commit filed under it */
+    char **entries;                 /* heap; summaries left to reduce */
+    size_t entry_count;
+    char *notes;                    /* heap; the finished section */
+};
+
+struct Reduction {
+    struct ReleaseArea *area;
+    char *input;                    /* heap; entries of one chunk */
+    char *output;                   /* heap */
+    int final;                      /* covers the whole area */
+    char key[17];                   /* name its answer is stored under */
+};
+
+struct ReleaseRun {
+    const char *api_key;
+    const char *profile;
+    unsigned long long key;
+    char *summary_dir;
+    char *reduction_dir;
+    char *log;                      /* output of git log the commits point into */
+    struct ReleaseCommit *commits;
+    size_t commit_count;
+    struct ReleaseArea *areas;
+    size_t area_count;
+    struct Reduction *reductions;   /* the current round */
+    size_t reduction_count;
+    size_t cached;                  /* prepare thread only */
+    size_t requests;                /* output thread only */
+    size_t failed;
+};
+
+/* One request of a round */
+struct ReleaseJob {
+    struct NetRequest request;      /* first: the network stage sees only this */
+    size_t index;                   /* commit or reduction it is for */
+};
+
+/* A round of requests through the network stage */
+struct ReleaseBatch {
+    struct ReleaseRun *run;
+    size_t count;
+    void (*build)(struct ReleaseRun *run, struct ReleaseJob *job);
+    void (*finish)(struct ReleaseRun *run, struct ReleaseJob *job);
+    struct ArenaPool *arenas;
+    struct StageQueue *prepared;
+    struct StageQueue *answered;
+    size_t unsent;                  /* prepare thread: jobs it could not create */
+    long long prepare_wait_us;
+    struct StageStats stats[3];
+};
+
+/* Results outlive the arena of their request */
+static char* heap_format(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (len < 0) return NULL;
+
+    struct Arena *previous = arena_activate(NULL);
+    char *text = mem_alloc((size_t)len + 1);
+    arena_activate(previous);
+    if (!text) {
+        fprintf(stderr, "Error: Memory allocation failed for release notes\n");
+        return NULL;
+    }
+    va_start(args, format);
+    vsnprintf(text, (size_t)len + 1, format, args);
+    va_end(args);
+    return text;
+}
+
+/* FNV-1a step over a string */
+static unsigned long long hash_text(unsigned long long hash, const char *text) {
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Hash of everything besides the diff that changes a summary */
+static unsigned long long release_key(const char *profile) {
+    char models[512];
+    route_describe_models(models, sizeof(models));
+    unsigned long long hash = hash_text(1469598103934665603ULL, models);
+    hash = (hash ^ (unsigned char)digest_mode) * 1099511628211ULL;
+    return hash_text(hash, profile);
+}
+
+/* Build "<git dir>/commit-ai/<name>", creating both directories */
+static char* release_dir(const char *git_directory, const char *name) {
+    size_t len = strlen(git_directory) + strlen(PRECOMPUTE_DIR) + strlen(name) + 3;
+    char *path = mem_alloc(len);
+    if (!path) {
+        fprintf(stderr, "Error: Memory allocation failed for release notes path\n");
+        return NULL;
+    }
+    snprintf(path, len, "%s/%s", git_directory, PRECOMPUTE_DIR);
+    int ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+    snprintf(path, len, "%s/%s/%s", git_directory, PRECOMPUTE_DIR, name);
+    ok = ok && (mkdir(path, 0755) == 0 || errno == EEXIST);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to create directory: %s (%s)\n", path, strerror(errno));
+        mem_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+/* Read the text stored under name if it was made with the run's key */
+static char* load_result(const struct ReleaseRun *run, const char *dir, const char *name, const char *magic) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (!file_exists(path)) return NULL;
+    char *content = read_file(path);
+    if (!content) return NULL;
+
+    char expected[128];
+    snprintf(expected, sizeof(expected), "%s\nkey %016llx\n\n", magic, run->key);
+    size_t header_len = strlen(expected);
+    if (strncmp(content, expected, header_len) != 0) {
+        debug_print("%s was made for other models or another profile", path);
+        mem_free(content);
+        return NULL;
+    }
+    memmove(content, content + header_len, strlen(content + header_len) + 1);
+    return content;
+}
+
+/* Write text under name next to its final path, then rename it into place */
+static int store_result(const struct ReleaseRun *run, const char *dir, const char *name, const char *magic,
+                        const char *text) {
+    char path[4096];
+    char tmp_path[4200];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%ld", path, (long)getpid());
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        fprintf(stderr, "Warning: Failed to store %s (%s)\n", path, strerror(errno));
+        return 0;
+    }
+    fprintf(file, "%s\nkey %016llx\n\n%s", magic, run->key, text);
+    int ok = ferror(file) == 0;
+    ok &= fclose(file) == 0;
+    if (ok && rename(tmp_path, path) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Warning: Failed to store %s\n", path);
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+/* Area of one path: its top-level directory, or a top-level file's name without extension */
+static void path_area(const char *path, size_t len, char *area, size_t size) {
+    const char *slash = memchr(path, '/', len);
+    if (slash) {
+        len = (size_t)(slash - path);
+    } else {
+        for (size_t i = len; i > 1; i--) {
+            if (path[i - 1] == '.') {
+                len = i - 1;
+                break;
+            }
+        }
+    }
+    if (len >= size) len = size - 1;
+    memcpy(area, path, len);
+    area[len] = '\0';
+}
+
+/* File a diff under the area with the most changed lines; "" if it names no file */
+static void diff_area(const char *diff, char *area, size_t size) {
+    char names[MAX_DIFF_AREAS][RELEASE_MAX_AREA];
+    size_t lines[MAX_DIFF_AREAS];
+    size_t count = 0;
+    size_t current = MAX_DIFF_AREAS;
+
+    for (const char *line = diff; *line; ) {
+        const char *end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+
+        if (len > 11 && strncmp(line, "diff --git ", 11) == 0) {
+            // "diff --git a/<path> b/<path>": the new path follows the last " b/"
+            const char *path = NULL;
+            for (const char *p = line + 11; p + 3 <= line + len; p++) {
+                if (strncmp(p, " b/", 3) == 0) path = p + 3;
+            }
+            current = MAX_DIFF_AREAS;
+            if (path) {
+                char name[RELEASE_MAX_AREA];
+                path_area(path, (size_t)(line + len - path), name, sizeof(name));
+                for (current = 0; current < count && strcmp(names[current], name) != 0; current++) {
+                }
+                if (current == count && count < MAX_DIFF_AREAS) {
+                    memcpy(names[count], name, sizeof(name));
+                    lines[count++] = 0;
+                }
+            }
+        } else if (current < count && len > 0 && (line[0] == '+' || line[0] == '-') &&
+                   strncmp(line, "+++ ", 4) != 0 && strncmp(line, "--- ", 4) != 0) {
+            lines[current]++;
+        }
+        line = end ? end + 1 : line + len;
+    }
+
+    size_t best = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (lines[i] > lines[best]) best = i;
+    }
+    snprintf(area, size, "%s", count > 0 ? names[best] : "");
+}
+
+/* git patch-id --stable of a diff; NULL if git finds no patch in it */
+static char* diff_patch_id(const char *diff) {
+    const char *const argv[] = { "git", "patch-id", "--stable", NULL };
+    char *patch_id = git_capture_input(argv, diff, strlen(diff));
+    if (!patch_id) return NULL;
+    patch_id[strcspn(patch_id, " \n")] = '\0';
+    if (!*patch_id) {
+        mem_free(patch_id);
+        return NULL;
+    }
+    return patch_id;
+}
+
+/* Map: read a commit's diff and build the request for its summary, unless one is stored */
+static void build_summary_request(struct ReleaseRun *run, struct ReleaseJob *job) {
+    struct ReleaseCommit *commit = &run->commits[job->index];
+    const char *const argv[] = { "git", "show", "--format=", "--patch", "--no-color", "--no-ext-diff",
+                                 commit->sha, "--", NULL };
+    char *diff = git_capture(argv);
+    if (!diff) return;
+    if (!*diff) {
+        debug_print("Commit %.12s changes nothing", commit->sha);
+        commit->empty = 1;
+        return;
+    }
+    diff_area(diff, commit->area, sizeof(commit->area));
+
+    char *patch_id = diff_patch_id(diff);
+    char *stored = patch_id ? load_result(run, run->summary_dir, patch_id, SUMMARY_MAGIC) : NULL;
+    if (patch_id) {
+        commit->patch_id = heap_format("%s", patch_id);
+    }
+    if (stored) {
+        char *newline = strchr(stored, '\n');
+        if (newline) *newline = '\0';
+        commit->title = heap_format("%s", stored);
+        commit->description = heap_format("%s", newline ? newline + 1 : "");
+        if (commit->title && commit->description) {
+            run->cached++;
+            return;
+        }
+    }
+
+    // A huge diff (generated or vendored files) is cut at a line end
+    size_t len = strlen(diff);
+    if (len > RELEASE_MAX_DIFF_BYTES) {
+        size_t cut = RELEASE_MAX_DIFF_BYTES;
+        while (cut > 0 && diff[cut - 1] != '\n') cut--;
+        diff[cut] = '\0';
+        debug_print("Commit %.12s: diff of %zu bytes cut to %zu", commit->sha, len, cut);
+    }
+    const char *model = route_mode ? route_tier_model(route_tier(diff)) : api_model;
+    net_request_set_payload(&job->request, build_request_payload(run->profile, diff), model);
+    job->request.diff_bytes = strlen(diff);
+}
+
+/* Map: keep and store a commit's summary */
+static void finish_summary(struct ReleaseRun *run, struct ReleaseJob *job) {
+    struct ReleaseCommit *commit = &run->commits[job->index];
+    if (!job->request.body) {
+        if (!commit->title && !commit->empty) run->failed++;
+        return;
+    }
+    run->requests++;
+
+    const char *reply = net_request_reply(&job->request);
+    char *title = NULL;
+    char *description = NULL;
+    if (!reply || !parse_claude_response(reply, &title, &description)) {
+        fprintf(stderr, "Error: No summary for commit %.12s\n", commit->sha);
+        run->failed++;
+        return;
+    }
+    commit->title = heap_format("%s", title);
+    commit->description = heap_format("%s", description);
+    if (!commit->title || !commit->description) {
+        run->failed++;
+        return;
+    }
+
+    if (commit->patch_id) {
+        char *text = heap_format("%s\n%s", title, description);
+        if (text) store_result(run, run->summary_dir, commit->patch_id, SUMMARY_MAGIC, text);
+        mem_free(text);
+    }
+}
+
+/* Reduce: build the request for one chunk of an area, unless its answer is stored */
+static void build_reduction_request(struct ReleaseRun *run, struct ReleaseJob *job) {
+    struct Reduction *reduction = &run->reductions[job->index];
+    const char *name = reduction->area->name;
+    char topic[RELEASE_MAX_AREA + 64];
+    if (strcmp(name, BRANCH_AREA) == 0) {
+        snprintf(topic, sizeof(topic), "on a branch");
+    } else if (strcmp(name, OTHER_AREA) == 0) {
+        snprintf(topic, sizeof(topic), "in a release that touch several areas");
+    } else {
+        snprintf(topic, sizeof(topic), "in a release that touch \"%s\"", name);
+    }
+
+    int len = snprintf(NULL, 0, reduce_template, run->profile, topic, reduction->input);
+    char *prompt = len > 0 ? mem_alloc((size_t)len + 1) : NULL;
+    if (!prompt) {
+        fprintf(stderr, "Error: Memory allocation failed for release notes prompt\n");
+        return;
+    }
+    snprintf(prompt, (size_t)len + 1, reduce_template, run->profile, topic, reduction->input);
+
+    snprintf(reduction->key, sizeof(reduction->key), "%016llx",
+             hash_text(hash_text(run->key, api_model), prompt));
+    char *stored = load_result(run, run->reduction_dir, reduction->key, REDUCTION_MAGIC);
+    if (stored) {
+        reduction->output = heap_format("%s", stored);
+        if (reduction->output) return;
+    }
+
+    net_request_set_payload(&job->request, build_message_payload(prompt, RELEASE_REDUCE_MAX_TOKENS),
+                            api_model);
+}
+
+/* Reduce: keep and store the answer for one chunk; on failure its input stands in */
+static void finish_reduction(struct ReleaseRun *run, struct ReleaseJob *job) {
+    struct Reduction *reduction = &run->reductions[job->index];
+    if (reduction->output) return;
+
+    char *text = NULL;
+    if (job->request.body) {
+        run->requests++;
+        const char *reply = net_request_reply(&job->request);
+        size_t text_len = 0;
+        text = reply ? extract_response_text(reply, &text_len, NULL) : NULL;
+        if (text) trim_string(text);
+    }
+    if (!text || !*text) {
+        fprintf(stderr, "Error: No release notes for %s, using the summaries as they are\n",
+                reduction->area->name);
+        run->failed++;
+        reduction->output = heap_format("%s", reduction->input);
+        return;
+    }
+
+    reduction->output = heap_format("%s", text);
+    if (reduction->output) {
+        store_result(run, run->reduction_dir, reduction->key, REDUCTION_MAGIC, reduction->output);
+    }
+}
+
+static void* batch_prepare(void *arg) {
+    struct ReleaseBatch *batch = arg;
+    struct StageStats *stats = &batch->stats[0];
+    stats->start_us = pipeline_now_us();
+
+    for (size_t i = 0; i < batch->count; i++) {
+        struct ReleaseJob *job = calloc(1, sizeof(*job));
+        if (!job) {
+            fprintf(stderr, "Error: Memory allocation failed for release notes request\n");
+            batch->unsent = batch->count - i;
+            break;
+        }
+        job->index = i;
+        job->request.key_slot = -1;
+        job->request.arena = arena_pool_acquire(batch->arenas);
+        if (job->request.arena) {
+            struct Arena *previous = arena_activate(job->request.arena);
+            batch->build(batch->run, job);
+            arena_activate(previous);
+        }
+        stats->items++;
+
+        long long wait_start = pipeline_now_us();
+        stage_queue_push(batch->prepared, job);
+        batch->prepare_wait_us += pipeline_now_us() - wait_start;
+    }
+    stage_queue_close(batch->prepared);
+
+    stats->end_us = pipeline_now_us();
+    stats->busy_us = stats->end_us - stats->start_us - batch->prepare_wait_us;
+    return NULL;
+}
+
+static void* batch_output(void *arg) {
+    struct ReleaseBatch *batch = arg;
+    struct StageStats *stats = &batch->stats[2];
+    stats->start_us = pipeline_now_us();
+
+    struct ReleaseJob *job;
+    while ((job = stage_queue_pop(batch->answered)) != NULL) {
+        long long busy_start = pipeline_now_us();
+        stats->items++;
+        struct Arena *previous = arena_activate(job->request.arena);
+        batch->finish(batch->run, job);
+        arena_activate(previous);
+        arena_pool_release(batch->arenas, job->request.arena);
+        free(job);
+        stats->busy_us += pipeline_now_us() - busy_start;
+    }
+
+    stats->end_us = pipeline_now_us();
+    return NULL;
+}
+
+/* Send a round of count requests, built and finished by the given functions */
+static int run_batch(struct ReleaseRun *run, size_t count,
+                     void (*build)(struct ReleaseRun *run, struct ReleaseJob *job),
+                     void (*finish)(struct ReleaseRun *run, struct ReleaseJob *job)) {
+    struct ReleaseBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.run = run;
+    batch.count = count;
+    batch.build = build;
+    batch.finish = finish;
+    batch.stats[0].name = "prepare";
+    batch.stats[1].name = "network";
+    batch.stats[2].name = "output";
+
+    struct StageQueue *retries = stage_queue_create(1);
+    batch.arenas = arena_pool_create(PIPELINE_QUEUE_SIZE, ARENA_DEFAULT_BLOCK_SIZE);
+    batch.prepared = stage_queue_create(PIPELINE_QUEUE_SIZE);
+    batch.answered = stage_queue_create(PIPELINE_QUEUE_SIZE);
+    batch.stats[2].input = batch.answered;
+    int ok = retries && batch.arenas && batch.prepared && batch.answered;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed for release notes requests\n");
+    }
+
+    // Nothing is ever asked again
+    if (retries) stage_queue_close(retries);
+
+    pthread_t prepare_thread, output_thread;
+    if (ok && pthread_create(&output_thread, NULL, batch_output, &batch) != 0) {
+        fprintf(stderr, "Error: Failed to start the release notes output thread\n");
+        ok = 0;
+    }
+    if (ok) {
+        int preparing = pthread_create(&prepare_thread, NULL, batch_prepare, &batch) == 0;
+        if (!preparing) {
+            fprintf(stderr, "Error: Failed to start the release notes prepare thread\n");
+            batch.unsent = count;
+            stage_queue_close(batch.prepared);
+        }
+        net_stage_run(batch.prepared, retries, batch.answered, run->api_key, NULL, &batch.stats[1]);
+        if (preparing) pthread_join(prepare_thread, NULL);
+        pthread_join(output_thread, NULL);
+        run->failed += batch.unsent;
+        if (debug_mode) pipeline_report(batch.stats, 3);
+    }
+
+    stage_queue_destroy(batch.answered);
+    stage_queue_destroy(batch.prepared);
+    stage_queue_destroy(retries);
+    arena_pool_destroy(batch.arenas);
+    return ok;
+}
+
+/* Commits of the range, oldest first */
+static int list_commits(struct ReleaseRun *run, const char *range) {
+    const char *const argv[] = { "git", "log", "--reverse", "--no-merges", "--format=%H%x09%s", range, "--",
+                                 NULL };
+    run->log = git_capture(argv);
+    if (!run->log) return 0;
+
+    size_t lines = 0;
+    for (const char *p = run->log; *p; p++) {
+        if (*p == '\n') lines++;
+    }
+    run->commits = mem_calloc(lines + 1, sizeof(*run->commits));
+    if (!run->commits) {
+        fprintf(stderr, "Error: Memory allocation failed for commit list\n");
+        return 0;
+    }
+
+    for (char *line = run->log; *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        char *tab = strchr(line, '\t');
+        if (tab && (size_t)(tab - line) <= MAX_COMMIT_ID) {
+            struct ReleaseCommit *commit = &run->commits[run->commit_count++];
+            memcpy(commit->sha, line, (size_t)(tab - line));
+            commit->subject = tab + 1;
+        }
+        line = next ? next : line + strlen(line);
+    }
+    debug_print("%zu commits to summarize", run->commit_count);
+    return 1;
+}
+
+/* The area called name, added (with its first commit) if it is new */
+static struct ReleaseArea* find_area(struct ReleaseArea *areas, size_t *count, const char *name, size_t first) {
+    for (size_t i = 0; i < *count; i++) {
+        if (strcmp(areas[i].name, name) == 0) return &areas[i];
+    }
+    struct ReleaseArea *area = &areas[(*count)++];
+    snprintf(area->name, sizeof(area->name), "%s", name);
+    area->first = first;
+    return area;
+}
+
+/* Larger areas first, in order of their first commit; other changes last */
+static int compare_areas(const void *a, const void *b) {
+    const struct ReleaseArea *x = a;
+    const struct ReleaseArea *y = b;
+    int x_other = strcmp(x->name, OTHER_AREA) == 0;
+    int y_other = strcmp(y->name, OTHER_AREA) == 0;
+    if (x_other != y_other) return x_other - y_other;
+    if (x->commits != y->commits) return x->commits > y->commits ? -1 : 1;
+    return x->first < y->first ? -1 : x->first > y->first;
+}
+
+static int add_entry(struct ReleaseArea *area, char *entry) {
+    char **grown = entry ? mem_realloc(area->entries, (area->entry_count + 1) * sizeof(*grown)) : NULL;
+    if (!grown) {
+        fprintf(stderr, "Error: Memory allocation failed for release notes\n");
+        mem_free(entry);
+        return 0;
+    }
+    area->entries = grown;
+    area->entries[area->entry_count++] = entry;
+    return 1;
+}
+
+/* Entry of a commit for a reduce or combine request; a commit left without a summary is listed by its subject */
+static char* commit_entry(const struct ReleaseCommit *commit) {
+    char *entry = commit->title ? heap_format("- %s\n%s", commit->title, commit->description) :
+                                  heap_format("- %s", commit->subject);
+    if (entry) trim_string(entry);
+    return entry;
+}
+
+/* Group: file the summary of every commit under its area */
+static int group_commits(struct ReleaseRun *run) {
+    struct ReleaseArea *counts = mem_calloc(run->commit_count + 1, sizeof(*counts));
+    run->areas = mem_calloc(run->commit_count + 1, sizeof(*run->areas));
+    if (!counts || !run->areas) {
+        fprintf(stderr, "Error: Memory allocation failed for release notes\n");
+        mem_free(counts);
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < run->commit_count; i++) {
+        const char *name = run->commits[i].area[0] ? run->commits[i].area : OTHER_AREA;
+        find_area(counts, &count, name, i)->commits++;
+    }
+
+    int ok = 1;
+    for (size_t i = 0; ok && i < run->commit_count; i++) {
+        struct ReleaseCommit *commit = &run->commits[i];
+        const char *name = commit->area[0] ? commit->area : OTHER_AREA;
+        if (count > 1 && find_area(counts, &count, name, i)->commits == 1) {
+            name = OTHER_AREA;
+        }
+        struct ReleaseArea *area = find_area(run->areas, &run->area_count, name, i);
+        area->commits++;
+
+        ok = add_entry(area, commit_entry(commit));
+    }
+    mem_free(counts);
+
+    if (run->area_count > 1) {
+        qsort(run->areas, run->area_count, sizeof(*run->areas), compare_areas);
+    }
+    return ok;
+}
+
+/* End of the chunk of an area's entries starting at start; two entries at least */
+static size_t chunk_end(const struct ReleaseArea *area, size_t start) {
+    size_t end = start;
+    size_t bytes = 0;
+    while (end < area->entry_count) {
+        size_t len = strlen(area->entries[end]) + 2;
+        if (end - start >= 2 && bytes + len > RELEASE_REDUCE_BYTES) break;
+        bytes += len;
+        end++;
+    }
+    return end;
+}
+
+/* Join entries into one heap string, separated by blank lines */
+static char* join_entries(char *const *entries, size_t count) {
+    size_t len = 1;
+    for (size_t i = 0; i < count; i++) {
+        len += strlen(entries[i]) + 2;
+    }
+    struct Arena *previous = arena_activate(NULL);
+    char *text = mem_alloc(len);
+    arena_activate(previous);
+    if (!text) {
+        fprintf(stderr, "Error: Memory allocation failed for release notes\n");
+        return NULL;
+    }
+
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        used += (size_t)snprintf(text + used, len - used, "%s%s", i > 0 ? "\n\n" : "", entries[i]);
+    }
+    text[used] = '\0';
+    return text;
+}
+
+static void free_reductions(struct ReleaseRun *run) {
+    for (size_t i = 0; i < run->reduction_count; i++) {
+        mem_free(run->reductions[i].input);
+        mem_free(run->reductions[i].output);
+    }
+    mem_free(run->reductions);
+    run->reductions = NULL;
+    run->reduction_count = 0;
+}
+
+/*
+ * Reduce: turn the entries of every area into its section. An area whose
+ * entries do not fit one request is cut into chunks, and the answers for
+ * the chunks are its entries in the next round.
+ */
+static int reduce_areas(struct ReleaseRun *run) {
+    for (size_t round = 1; ; round++) {
+        size_t count = 0;
+        for (size_t a = 0; a < run->area_count; a++) {
+            struct ReleaseArea *area = &run->areas[a];
+            for (size_t start = 0; !area->notes && start < area->entry_count; start = chunk_end(area, start)) {
+                count++;
+            }
+        }
+        if (count == 0) return 1;
+
+        run->reductions = mem_calloc(count, sizeof(*run->reductions));
+        if (!run->reductions) {
+            fprintf(stderr, "Error: Memory allocation failed for release notes\n");
+            return 0;
+        }
+        for (size_t a = 0; a < run->area_count; a++) {
+            struct ReleaseArea *area = &run->areas[a];
+            for (size_t start = 0; !area->notes && start < area->entry_count; ) {
+                size_t end = chunk_end(area, start);
+                struct Reduction *reduction = &run->reductions[run->reduction_count++];
+                reduction->area = area;
+                reduction->final = start == 0 && end == area->entry_count;
+                reduction->input = join_entries(area->entries + start, end - start);
+                if (!reduction->input) return 0;
+                start = end;
+            }
+        }
+        debug_print("Reduce round %zu: %zu requests", round, count);
+        if (!run_batch(run, count, build_reduction_request, finish_reduction)) return 0;
+
+        // The answers of this round are the entries of the next
+        for (size_t a = 0; a < run->area_count; a++) {
+            struct ReleaseArea *area = &run->areas[a];
+            if (area->notes) continue;
+            for (size_t i = 0; i < area->entry_count; i++) {
+                mem_free(area->entries[i]);
+            }
+            area->entry_count = 0;
+        }
+        int ok = 1;
+        for (size_t i = 0; i < run->reduction_count; i++) {
+            struct Reduction *reduction = &run->reductions[i];
+            char **text = reduction->output ? &reduction->output : &reduction->input;
+            if (reduction->final) {
+                reduction->area->notes = *text;
+            } else {
+                ok = ok && add_entry(reduction->area, *text);
+            }
+            *text = NULL;
+        }
+        free_reductions(run);
+        if (!ok) return 0;
+    }
+}
+
+static int write_notes(const struct ReleaseRun *run, const char *range, const char *output_file) {
+    FILE *out = output_file ? fopen(output_file, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Error: Failed to open file for writing: %s (%s)\n", output_file, strerror(errno));
+        return 0;
+    }
+    fprintf(out, "# Release notes for %s\n", range);
+    for (size_t a = 0; a < run->area_count; a++) {
+        const struct ReleaseArea *area = &run->areas[a];
+        fprintf(out, "\n## %s\n\n%s\n", area->name, area->notes ? area->notes : "");
+    }
+
+    int ok = ferror(out) == 0;
+    if (output_file) {
+        ok &= fclose(out) == 0;
+        if (ok) printf("Release notes saved to %s\n", output_file);
+    } else {
+        fflush(out);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write the release notes\n");
+    }
+    return ok;
+}
+
+static void free_release_run(struct ReleaseRun *run) {
+    free_reductions(run);
+    for (size_t i = 0; i < run->commit_count; i++) {
+        mem_free(run->commits[i].patch_id);
+        mem_free(run->commits[i].title);
+        mem_free(run->commits[i].description);
+    }
+    for (size_t a = 0; a < run->area_count; a++) {
+        for (size_t i = 0; i < run->areas[a].entry_count; i++) {
+            mem_free(run->areas[a].entries[i]);
+        }
+        mem_free(run->areas[a].entries);
+        mem_free(run->areas[a].notes);
+    }
+    mem_free(run->areas);
+    mem_free(run->commits);
+    mem_free(run->log);
+    mem_free(run->reduction_dir);
+    mem_free(run->summary_dir);
+}
+
+/* Map: summarize the commits of range, or take their stored summaries */
+static int summarize_commits(struct ReleaseRun *run, const char *api_key, const char *profile, const char *range) {
+    memset(run, 0, sizeof(*run));
+    run->api_key = api_key;
+    run->profile = profile;
+    run->key = release_key(profile);
+
+    char *git_directory = git_dir();
+    if (!git_directory) return 0;
+    run->summary_dir = release_dir(git_directory, RELEASE_SUMMARY_DIR);
+    run->reduction_dir = run->summary_dir ? release_dir(git_directory, RELEASE_REDUCTION_DIR) : NULL;
+    mem_free(git_directory);
+
+    if (!run->reduction_dir || !list_commits(run, range)) return 0;
+    if (run->commit_count == 0) {
+        fprintf(stderr, "Error: No commits in %s\n", range);
+        return 0;
+    }
+    return run_batch(run, run->commit_count, build_summary_request, finish_summary);
+}
+
+// Function to write sectioned release notes for the commits of range
+int release_notes(const char *api_key, const char *profile, const char *range, const char *output_file) {
+    if (*range == '-') {
+        fprintf(stderr, "Error: Invalid commit range: %s\n", range);
+        return 0;
+    }
+
+    struct ReleaseRun run;
+    long long start = monotonic_ms();
+    int ok = summarize_commits(&run, api_key, profile, range) &&
+             group_commits(&run) && reduce_areas(&run) && write_notes(&run, range, output_file);
+
+    if (run.commit_count > 0) {
+        fprintf(stderr, "Summarized %zu commits (%zu cached) into %zu sections with %zu requests in %lld ms, "
+                "%zu failed\n", run.commit_count, run.cached, run.area_count, run.requests,
+                monotonic_ms() - start, run.failed);
+    }
+    free_release_run(&run);
+    return ok && run.failed == 0;
+}
+
+/* Combine: the branch's summaries, condensed first if they do not fit one request */
+static char* branch_summaries(struct ReleaseRun *run) {
+    run->areas = mem_calloc(1, sizeof(*run->areas));
+    if (!run->areas) {
+        fprintf(stderr, "Error: Memory allocation failed for pull request description\n");
+        return NULL;
+    }
+    struct ReleaseArea *area = &run->areas[0];
+    run->area_count = 1;
+    snprintf(area->name, sizeof(area->name), "%s", BRANCH_AREA);
+    for (size_t i = 0; i < run->commit_count; i++) {
+        if (!add_entry(area, commit_entry(&run->commits[i]))) return NULL;
+        area->commits++;
+    }
+
+    if (chunk_end(area, 0) == area->entry_count) {
+        return join_entries(area->entries, area->entry_count);
+    }
+    debug_print("Summaries of %zu commits do not fit one request, condensing them", run->commit_count);
+    if (!reduce_areas(run)) return NULL;
+    char *notes = area->notes;
+    area->notes = NULL;
+    return notes;
+}
+
+/* Combine: ask for the title and description over the summaries, unless the answer is stored */
+static int combine_summaries(struct ReleaseRun *run, const char *summaries, char **title, char **description) {
+    int len = snprintf(NULL, 0, combine_template, run->profile, run->commit_count, summaries);
+    char *prompt = len > 0 ? mem_alloc((size_t)len + 1) : NULL;
+    if (!prompt) {
+        fprintf(stderr, "Error: Memory allocation failed for pull request prompt\n");
+        return 0;
+    }
+    snprintf(prompt, (size_t)len + 1, combine_template, run->profile, run->commit_count, summaries);
+
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", hash_text(hash_text(run->key, api_model), prompt));
+    char *stored = load_result(run, run->reduction_dir, key, REDUCTION_MAGIC);
+    if (stored) {
+        debug_print("Using the stored pull request description %s", key);
+        mem_free(prompt);
+        return split_response_text(stored, strlen(stored), title, description);
+    }
+
+    cJSON *payload = build_message_payload(prompt, REQUEST_MAX_TOKENS);
+    mem_free(prompt);
+    ledger_diff_bytes = strlen(summaries);
+    char *response = payload ? send_claude_request(run->api_key, payload) : NULL;
+    cJSON_Delete(payload);
+    run->requests++;
+    if (!response || !parse_claude_response(response, title, description)) {
+        fprintf(stderr, "Error: No pull request description\n");
+        mem_free(response);
+        return 0;
+    }
+    mem_free(response);
+
+    char *text = heap_format("%s\n%s", *title, *description);
+    if (text) store_result(run, run->reduction_dir, key, REDUCTION_MAGIC, text);
+    mem_free(text);
+    return 1;
+}
+
+/*
+ * Function to write the title and description of a pull request for the
+ * commits between base and HEAD, from their per-commit summaries
+ */
+int pr_description(const char *api_key, const char *profile, const char *base,
+                   char **title, char **description) {
+    if (*base == '-') {
+        fprintf(stderr, "Error: Invalid base revision: %s\n", base);
+        return 0;
+    }
+    char range[1024];
+    if (snprintf(range, sizeof(range), "%s..HEAD", base) >= (int)sizeof(range)) {
+        fprintf(stderr, "Error: Base revision is too long\n");
+        return 0;
+    }
+
+    struct ReleaseRun run;
+    long long start = monotonic_ms();
+    int ok = summarize_commits(&run, api_key, profile, range);
+    char *summaries = ok ? branch_summaries(&run) : NULL;
+    ok = summaries && combine_summaries(&run, summaries, title, description);
+    mem_free(summaries);
+
+    if (run.commit_count > 0) {
+        fprintf(stderr, "Summarized %zu commits (%zu cached) with %zu requests in %lld ms, %zu failed\n",
+                run.commit_count, run.cached, run.requests, monotonic_ms() - start, run.failed);
+    }
+    free_release_run(&run);
+    return ok;
+}
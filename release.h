@@ -0,0 +1,61 @@
+/**
+ * Claude API Client - Release notes and pull request descriptions
+ *
+ * --release-notes <range> (anything git log takes, e.g. v1.2..v1.3) writes
+ * sectioned release notes for the non-merge commits of the range:
+ *
+ *   map      every commit is summarized like a single diff (title and
+ *            description), many at once through the network stage of the
+ *            staged pipeline (see pipeline.h), up to --max-inflight
+ *   group    each commit is filed under the area it changes most: its
+ *            top-level directory, or for a file at the top level the file
+ *            name without extension; areas with a single commit are merged
+ *            into "Other changes"
+ *   reduce   the summaries of an area are turned into one bulleted section.
+ *            An area too large for one prompt is reduced in chunks first,
+ *            and the chunk results again, until one request covers it
+ *
+ * Intermediate results persist under .git/commit-ai/:
+ *
+ *   summaries/<patch-id>    the summary of a commit, keyed by its
+ *                           git patch-id --stable, so it survives rebases
+ *                           and cherry-picks
+ *   reductions/<hash>       the answer to a reduce request, keyed by a hash
+ *                           of the request
+ *
+ * Both record a hash of the models, digest mode and profile and are ignored
+ * when those change. The next release, or a run after a few more commits,
+ * only sends requests for the new commits and the areas they touch.
+ *
+ * --pr <base> reuses the map phase for the commits of <base>..HEAD, then
+ * sends one combine request over their summaries for the title and
+ * description of a pull request; its answer is stored with the reductions.
+ * A push that adds one commit costs that commit's summary and the combine
+ * request, however long the branch. A branch whose summaries do not fit
+ * one request is reduced like an area first.
+ */
+
+#ifndef RELEASE_H
+#define RELEASE_H
+
+/* Directories under .git/commit-ai holding the intermediate results */
+#define RELEASE_SUMMARY_DIR "summaries"
+#define RELEASE_REDUCTION_DIR "reductions"
+
+/* Largest diff sent to be summarized; longer ones are cut at a line end */
+#define RELEASE_MAX_DIFF_BYTES (64UL * 1024)
+
+/* Summaries given to one reduce request, in bytes */
+#define RELEASE_REDUCE_BYTES (24UL * 1024)
+
+/* max_tokens of a reduce request */
+#define RELEASE_REDUCE_MAX_TOKENS 2048
+
+/* Longest area name */
+#define RELEASE_MAX_AREA 64
+
+int release_notes(const char *api_key, const char *profile, const char *range, const char *output_file);
+int pr_description(const char *api_key, const char *profile, const char *base,
+                   char **title, char **description);
+
+#endif /* RELEASE_H */
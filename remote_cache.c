@@ -0,0 +1,294 @@
+/**
+ * Claude API Client - Remote HTTP cache
+ *
+ * See remote_cache.h. Keys are SHA-256 digests computed here, so the cache
+ * works without git and gives the same key on every machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <curl/curl.h>
+
+#include "claude_client.h"
+#include "route.h"
+#include "remote_cache.h"
+
+#define SHA256_DIGEST_SIZE 32
+
+/* Base URL of the blob store, or NULL (--remote-cache) */
+const char *remote_cache_url = NULL;
+
+/* Timeout of one cache request in ms (--remote-cache-timeout) */
+long remote_cache_timeout_ms = REMOTE_CACHE_DEFAULT_TIMEOUT_MS;
+
+/* Set after a transport error; the cache is not asked again in this run */
+static int remote_cache_down = 0;
+
+struct Sha256 {
+    uint32_t state[8];
+    uint64_t length;            /* bytes hashed so far */
+    unsigned char block[64];
+    size_t used;                /* bytes waiting in block */
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_init(struct Sha256 *ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha256_block(struct Sha256 *ctx, const unsigned char *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) +
+                      sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+static void sha256_update(struct Sha256 *ctx, const void *data, size_t len) {
+    const unsigned char *p = data;
+    ctx->length += len;
+    while (len > 0) {
+        size_t take = 64 - ctx->used < len ? 64 - ctx->used : len;
+        memcpy(ctx->block + ctx->used, p, take);
+        ctx->used += take;
+        p += take;
+        len -= take;
+        if (ctx->used == 64) {
+            sha256_block(ctx, ctx->block);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void sha256_final(struct Sha256 *ctx, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    sha256_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56) {
+        sha256_update(ctx, &pad, 1);
+    }
+    unsigned char length[8];
+    for (int i = 0; i < 8; i++) {
+        length[i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha256_update(ctx, length, sizeof(length));
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)ctx->state[i];
+    }
+}
+
+// Function to compute the cache key of the request for a diff
+char* remote_cache_key(const char *profile, const char *git_diff) {
+    char *prompt = build_prompt(profile, git_diff);
+    if (!prompt) {
+        return NULL;
+    }
+
+    char header[640];
+    int models_len = route_describe_models(header, sizeof(header));
+    int header_len = models_len < 0 || (size_t)models_len >= sizeof(header) - 64 ? -1 :
+        models_len + snprintf(header + models_len, sizeof(header) - (size_t)models_len,
+                              "max_tokens %d\nprompt\n", REQUEST_MAX_TOKENS);
+    if (header_len < 0) {
+        fprintf(stderr, "Error: Model names too long for a cache key\n");
+        mem_free(prompt);
+        return NULL;
+    }
+
+    struct Sha256 ctx;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, "commit-ai-remote 1\n", strlen("commit-ai-remote 1\n"));
+    sha256_update(&ctx, header, (size_t)header_len);
+    sha256_update(&ctx, prompt, strlen(prompt));
+    sha256_final(&ctx, digest);
+    mem_free(prompt);
+
+    char *key = mem_alloc(SHA256_DIGEST_SIZE * 2 + 1);
+    if (!key) {
+        fprintf(stderr, "Error: Memory allocation failed for cache key\n");
+        return NULL;
+    }
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        snprintf(key + i * 2, 3, "%02x", digest[i]);
+    }
+    debug_print("Remote cache key: %s", key);
+    return key;
+}
+
+/* Time one cache request may take: the timeout, or a quarter of a --deadline budget */
+static long cache_budget_ms(void) {
+    long budget_ms = remote_cache_timeout_ms;
+    long remaining_ms = deadline_remaining_ms();
+    if (remaining_ms >= 0 && remaining_ms / 4 < budget_ms) {
+        budget_ms = remaining_ms / 4;
+    }
+    return budget_ms > 0 ? budget_ms : 1;
+}
+
+/*
+ * GET (body NULL) or PUT one blob. Returns 1 with *http_code set if the
+ * cache answered; a transport error or timeout turns the cache off.
+ */
+static int cache_request(const char *key, const char *body, size_t body_len,
+                         struct MemoryStruct *response, long *http_code) {
+    if (remote_cache_down) {
+        return 0;
+    }
+
+    char path[SHA256_DIGEST_SIZE * 2 + 2];
+    snprintf(path, sizeof(path), "/%s", key);
+    char *url = build_api_url(remote_cache_url, path);
+    if (!url) {
+        return 0;
+    }
+
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        fprintf(stderr, "Error: Failed to initialize cURL\n");
+        mem_free(url);
+        return 0;
+    }
+
+    struct curl_slist *headers = NULL;
+    const char *token = getenv(REMOTE_CACHE_TOKEN_ENV);
+    if (token && *token) {
+        char auth_header[512];
+        snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", token);
+        headers = curl_slist_append(headers, auth_header);
+    }
+    if (body) {
+        headers = curl_slist_append(headers, "Content-Type: text/plain; charset=utf-8");
+        headers = curl_slist_append(headers, "Expect:");
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body_len);
+    }
+
+    long budget_ms = cache_budget_ms();
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, budget_ms);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, budget_ms);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
+
+    long long start = monotonic_ms();
+    CURLcode res = curl_easy_perform(curl);
+    int answered = res == CURLE_OK;
+    if (answered) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_code);
+        debug_print("Remote cache %s %s: HTTP %ld in %lld ms", body ? "PUT" : "GET", key,
+                    *http_code, monotonic_ms() - start);
+    } else {
+        fprintf(stderr, "Warning: Remote cache unavailable, skipping it for this run: %s\n",
+                curl_easy_strerror(res));
+        remote_cache_down = 1;
+    }
+
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    mem_free(url);
+    return answered;
+}
+
+// Function to fetch the message stored under key; returns 0 on a miss
+int remote_cache_get(const char *key, char **title, char **description) {
+    struct MemoryStruct response;
+    memset(&response, 0, sizeof(response));
+    long http_code = 0;
+
+    if (cache_request(key, NULL, 0, &response, &http_code) && http_code == 200 &&
+        response.size > 0 && memory_reserve(&response, 0)) {
+        // The entry is handed over to the title and description
+        debug_print("Using the message from the remote cache");
+        return split_response_text(response.memory, response.size, title, description);
+    }
+    if (http_code != 0 && http_code != 200 && http_code != 404) {
+        fprintf(stderr, "Warning: Remote cache answered HTTP %ld\n", http_code);
+    }
+
+    mem_free(response.memory);
+    return 0;
+}
+
+// Function to store the message under key
+int remote_cache_put(const char *key, const char *title, const char *description) {
+    size_t title_len = strlen(title);
+    size_t description_len = strlen(description);
+    char *body = mem_alloc(title_len + description_len + 2);
+    if (!body) {
+        fprintf(stderr, "Error: Memory allocation failed for cache entry\n");
+        return 0;
+    }
+    memcpy(body, title, title_len);
+    body[title_len] = '\n';
+    memcpy(body + title_len + 1, description, description_len + 1);
+
+    struct MemoryStruct response;
+    memset(&response, 0, sizeof(response));
+    long http_code = 0;
+    int stored = cache_request(key, body, title_len + 1 + description_len, &response, &http_code) &&
+                 http_code >= 200 && http_code < 300;
+    if (!stored && http_code != 0) {
+        fprintf(stderr, "Warning: Remote cache refused the message: HTTP %ld\n", http_code);
+    }
+
+    mem_free(response.memory);
+    mem_free(body);
+    return stored;
+}
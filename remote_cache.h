@@ -0,0 +1,45 @@
+/**
+ * Claude API Client - Remote HTTP cache
+ *
+ * CI runners start with an empty home directory and an empty clone, so no
+ * local cache survives from one job to the next. --remote-cache <url>
+ * points the tool at a shared blob store in the style of ccache's and
+ * sccache's HTTP backends:
+ *
+ *   GET <url>/<key>   200 with the message, or 404 on a miss
+ *   PUT <url>/<key>   store the message after a successful answer
+ *
+ * The key is the SHA-256 of everything that decides the request: the
+ * backend, the model (or routing tiers), max_tokens and the full prompt,
+ * which holds the profile, the digest and the diff. Runners that send an
+ * identical request share one answer. The value is the title line followed
+ * by the description.
+ *
+ * The cache must never cost more than it saves. Every cache request has a
+ * short timeout (--remote-cache-timeout, default 300 ms; under --deadline at
+ * most a quarter of the time left), and after the first transport error the
+ * cache is skipped for the rest of the run. If COMMIT_AI_REMOTE_CACHE_TOKEN
+ * is set it is sent as a bearer token.
+ */
+
+#ifndef REMOTE_CACHE_H
+#define REMOTE_CACHE_H
+
+/* Timeout of one cache request unless --remote-cache-timeout is given */
+#define REMOTE_CACHE_DEFAULT_TIMEOUT_MS 300
+
+/* Environment variables read when the options are not given */
+#define REMOTE_CACHE_URL_ENV "COMMIT_AI_REMOTE_CACHE"
+#define REMOTE_CACHE_TOKEN_ENV "COMMIT_AI_REMOTE_CACHE_TOKEN"
+
+/* Base URL of the blob store, or NULL (--remote-cache) */
+extern const char *remote_cache_url;
+
+/* Timeout of one cache request in ms (--remote-cache-timeout) */
+extern long remote_cache_timeout_ms;
+
+char* remote_cache_key(const char *profile, const char *git_diff);
+int remote_cache_get(const char *key, char **title, char **description);
+int remote_cache_put(const char *key, const char *title, const char *description);
+
+#endif /* REMOTE_CACHE_H */
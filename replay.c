@@ -0,0 +1,327 @@
+/**
+ * Claude API Client - Record/replay of API exchanges
+ *
+ * See replay.h for the directory layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "claude_client.h"
+#include "replay.h"
+
+/* Directory to record exchanges into, or NULL */
+const char *record_dir = NULL;
+
+/* Directory to replay exchanges from, or NULL */
+const char *replay_dir = NULL;
+
+/* Replay pace: 1.0 is the recorded timing, 2.0 twice as fast, 0 no delays */
+double replay_speed = 1.0;
+
+/* Exchange counters, so the Nth call replays the Nth recording */
+static unsigned record_index = 0;
+static unsigned replay_index = 0;
+
+struct Recorder {
+    response_callback write_fn;
+    void *write_data;
+    header_callback header_fn;
+    void *header_data;
+    FILE *headers;
+    FILE *body;
+    FILE *timing;
+    long headers_us;
+    long long start_us;
+};
+
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* Sleep until offset_us after start_us; returns 0 if the --deadline came first */
+static int sleep_until_us(long long start_us, long offset_us) {
+    long long target = start_us;
+    if (replay_speed > 0.0) {
+        target += (long long)((double)offset_us / replay_speed);
+    }
+
+    int in_time = 1;
+    if (api_deadline_ms && target > api_deadline_ms * 1000LL) {
+        target = api_deadline_ms * 1000LL;
+        in_time = 0;
+    }
+
+    long long now = monotonic_us();
+    if (target > now) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)((target - now) / 1000000LL);
+        ts.tv_nsec = (long)(((target - now) % 1000000LL) * 1000);
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    }
+    return in_time;
+}
+
+/* Build "<dir>/<index>.<suffix>" */
+static char* exchange_path(const char *dir, unsigned index, const char *suffix) {
+    size_t len = strlen(dir) + strlen(suffix) + 16;
+    char *path = mem_alloc(len);
+    if (!path) {
+        fprintf(stderr, "Error: Memory allocation failed for replay path\n");
+        return NULL;
+    }
+    snprintf(path, len, "%s/%u.%s", dir, index, suffix);
+    return path;
+}
+
+static FILE* open_exchange_file(const char *dir, unsigned index, const char *suffix, const char *mode) {
+    char *path = exchange_path(dir, index, suffix);
+    if (!path) return NULL;
+
+    FILE *file = fopen(path, mode);
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open file: %s (%s)\n", path, strerror(errno));
+    }
+    mem_free(path);
+    return file;
+}
+
+// Function to start recording one exchange
+struct Recorder* recorder_open(const char *dir, const char *request_body,
+                               response_callback write_fn, void *write_data,
+                               header_callback header_fn, void *header_data) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Failed to create record directory: %s (%s)\n", dir, strerror(errno));
+        return NULL;
+    }
+
+    unsigned index = record_index++;
+    FILE *request = open_exchange_file(dir, index, "request.json", "wb");
+    if (!request) return NULL;
+    fputs(request_body, request);
+    fclose(request);
+
+    struct Recorder *recorder = mem_calloc(1, sizeof(*recorder));
+    if (!recorder) {
+        fprintf(stderr, "Error: Memory allocation failed for recorder\n");
+        return NULL;
+    }
+
+    recorder->write_fn = write_fn;
+    recorder->write_data = write_data;
+    recorder->header_fn = header_fn;
+    recorder->header_data = header_data;
+    recorder->headers = open_exchange_file(dir, index, "headers", "wb");
+    recorder->body = open_exchange_file(dir, index, "body", "wb");
+    recorder->timing = open_exchange_file(dir, index, "timing", "w");
+    if (!recorder->headers || !recorder->body || !recorder->timing) {
+        if (recorder->headers) fclose(recorder->headers);
+        if (recorder->body) fclose(recorder->body);
+        if (recorder->timing) fclose(recorder->timing);
+        mem_free(recorder);
+        return NULL;
+    }
+
+    recorder->start_us = monotonic_us();
+    debug_print("Recording exchange %u into %s", index, dir);
+    return recorder;
+}
+
+// Callback for cURL header lines while recording; forwards to the real sink
+size_t recorder_header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    struct Recorder *recorder = (struct Recorder *)userdata;
+    size_t realsize = size * nitems;
+
+    fwrite(buffer, 1, realsize, recorder->headers);
+    recorder->headers_us = (long)(monotonic_us() - recorder->start_us);
+    return recorder->header_fn ? recorder->header_fn(buffer, size, nitems, recorder->header_data) : realsize;
+}
+
+// Callback for cURL body data while recording; forwards to the real sink
+size_t recorder_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    struct Recorder *recorder = (struct Recorder *)userp;
+    size_t realsize = size * nmemb;
+
+    fwrite(contents, 1, realsize, recorder->body);
+    fprintf(recorder->timing, "chunk %ld %zu\n",
+            (long)(monotonic_us() - recorder->start_us), realsize);
+
+    return recorder->write_fn(contents, size, nmemb, recorder->write_data);
+}
+
+// Function to finish recording; writes the status and end time
+int recorder_close(struct Recorder *recorder, long http_code) {
+    if (!recorder) return 0;
+
+    fprintf(recorder->timing, "status %ld\n", http_code);
+    fprintf(recorder->timing, "headers %ld\n", recorder->headers_us);
+    fprintf(recorder->timing, "end %ld\n", (long)(monotonic_us() - recorder->start_us));
+
+    int ok = ferror(recorder->headers) == 0 && ferror(recorder->body) == 0 &&
+             ferror(recorder->timing) == 0;
+    ok &= fclose(recorder->headers) == 0;
+    ok &= fclose(recorder->body) == 0;
+    ok &= fclose(recorder->timing) == 0;
+    mem_free(recorder);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write recording\n");
+    }
+    return ok;
+}
+
+/* Feed the recorded header lines through header_fn */
+static int replay_headers(const char *dir, unsigned index, header_callback header_fn, void *header_data) {
+    char *path = exchange_path(dir, index, "headers");
+    if (!path) return 0;
+    char *headers = read_file(path);
+    mem_free(path);
+    if (!headers) return 0;
+
+    char *line = headers;
+    while (*line) {
+        char *next = strchr(line, '\n');
+        size_t len = next ? (size_t)(next - line) + 1 : strlen(line);
+        if (header_fn(line, 1, len, header_data) != len) {
+            mem_free(headers);
+            return 0;
+        }
+        line += len;
+    }
+
+    mem_free(headers);
+    return 1;
+}
+
+/* Timing entries of one recorded exchange */
+struct ReplayChunk {
+    long offset_us;
+    size_t length;
+};
+
+// Function to serve one recorded exchange through write_fn
+int replay_exchange(const char *dir, const char *request_body,
+                    response_callback write_fn, void *write_data,
+                    header_callback header_fn, void *header_data, long *http_code) {
+    unsigned index = replay_index++;
+    debug_print("Replaying exchange %u from %s", index, dir);
+
+    // Warn when the request differs from the one that was recorded
+    char *request_path = exchange_path(dir, index, "request.json");
+    if (!request_path) return 0;
+    if (!file_exists(request_path)) {
+        fprintf(stderr, "Error: No recorded exchange %u in %s\n", index, dir);
+        mem_free(request_path);
+        return 0;
+    }
+    char *recorded_request = read_file(request_path);
+    mem_free(request_path);
+    if (!recorded_request) return 0;
+    if (strcmp(recorded_request, request_body) != 0) {
+        fprintf(stderr, "Warning: Request differs from recorded exchange %u\n", index);
+    }
+    mem_free(recorded_request);
+
+    FILE *timing = open_exchange_file(dir, index, "timing", "r");
+    if (!timing) return 0;
+
+    FILE *body = open_exchange_file(dir, index, "body", "rb");
+    if (!body) {
+        fclose(timing);
+        return 0;
+    }
+
+    // Load the timeline
+    struct ReplayChunk *chunks = NULL;
+    size_t chunk_count = 0, chunk_capacity = 0;
+    long headers_us = 0, end_us = 0;
+    *http_code = 0;
+
+    char line[128];
+    while (fgets(line, sizeof(line), timing)) {
+        long offset = 0;
+        size_t length = 0;
+        if (sscanf(line, "chunk %ld %zu", &offset, &length) == 2) {
+            if (chunk_count == chunk_capacity) {
+                size_t new_capacity = chunk_capacity ? chunk_capacity * 2 : 64;
+                struct ReplayChunk *grown = mem_realloc(chunks, new_capacity * sizeof(*chunks));
+                if (!grown) {
+                    fprintf(stderr, "Error: Memory allocation failed for replay timeline\n");
+                    mem_free(chunks);
+                    fclose(timing);
+                    fclose(body);
+                    return 0;
+                }
+                chunks = grown;
+                chunk_capacity = new_capacity;
+            }
+            chunks[chunk_count].offset_us = offset;
+            chunks[chunk_count].length = length;
+            chunk_count++;
+        } else if (sscanf(line, "status %ld", &offset) == 1) {
+            *http_code = offset;
+        } else if (sscanf(line, "headers %ld", &offset) == 1) {
+            headers_us = offset;
+        } else if (sscanf(line, "end %ld", &offset) == 1) {
+            end_us = offset;
+        }
+    }
+    fclose(timing);
+
+    // Feed the body back chunk by chunk at the requested pace
+    long long start_us = monotonic_us();
+    char *buffer = NULL;
+    size_t buffer_size = 0;
+
+    int ok = sleep_until_us(start_us, headers_us);
+    if (ok && header_fn) {
+        ok = replay_headers(dir, index, header_fn, header_data);
+    }
+    for (size_t i = 0; ok && i < chunk_count; i++) {
+        if (chunks[i].length > buffer_size) {
+            char *grown = mem_realloc(buffer, chunks[i].length);
+            if (!grown) {
+                fprintf(stderr, "Error: Memory allocation failed for replay buffer\n");
+                ok = 0;
+                break;
+            }
+            buffer = grown;
+            buffer_size = chunks[i].length;
+        }
+
+        if (fread(buffer, 1, chunks[i].length, body) != chunks[i].length) {
+            fprintf(stderr, "Error: Recorded body for exchange %u is truncated\n", index);
+            ok = 0;
+            break;
+        }
+
+        if (!sleep_until_us(start_us, chunks[i].offset_us)) {
+            ok = 0;
+            break;
+        }
+        if (write_fn(buffer, 1, chunks[i].length, write_data) != chunks[i].length) {
+            ok = 0;
+        }
+    }
+    if (ok && !sleep_until_us(start_us, end_us)) {
+        ok = 0;
+    }
+    if (!ok && deadline_remaining_ms() == 0) {
+        fprintf(stderr, "Error: Deadline reached while replaying exchange %u\n", index);
+    }
+
+    mem_free(buffer);
+    mem_free(chunks);
+    fclose(body);
+
+    debug_print("Replayed %zu chunks in %lld us", chunk_count, monotonic_us() - start_us);
+    return ok && *http_code != 0;
+}
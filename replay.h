@@ -0,0 +1,50 @@
+/**
+ * Claude API Client - Record/replay of API exchanges
+ *
+ * --record <dir> captures every exchange made by call_claude_api(): the
+ * request body, the response headers, the response body and the arrival
+ * time of each chunk. --replay <dir> serves the same exchanges back through
+ * the normal write callback without touching the network, either at the
+ * recorded pace or accelerated by --replay-speed.
+ *
+ * Exchanges are numbered in call order, so a run that makes the same calls
+ * replays deterministically. Files for exchange N in <dir>:
+ *
+ *   N.request.json   request body as sent
+ *   N.headers        raw response header lines
+ *   N.body           raw response body
+ *   N.timing         status, header arrival and per-chunk offsets (us)
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+
+/* Callback shape shared with libcurl's CURLOPT_WRITEFUNCTION/HEADERFUNCTION */
+typedef size_t (*response_callback)(void *contents, size_t size, size_t nmemb, void *userp);
+typedef size_t (*header_callback)(char *buffer, size_t size, size_t nitems, void *userdata);
+
+/* Directory to record exchanges into, or NULL */
+extern const char *record_dir;
+
+/* Directory to replay exchanges from, or NULL */
+extern const char *replay_dir;
+
+/* Replay pace: 1.0 is the recorded timing, 2.0 twice as fast, 0 no delays */
+extern double replay_speed;
+
+struct Recorder;
+
+struct Recorder* recorder_open(const char *dir, const char *request_body,
+                               response_callback write_fn, void *write_data,
+                               header_callback header_fn, void *header_data);
+size_t recorder_header_callback(char *buffer, size_t size, size_t nitems, void *userdata);
+size_t recorder_write_callback(void *contents, size_t size, size_t nmemb, void *userp);
+int recorder_close(struct Recorder *recorder, long http_code);
+
+int replay_exchange(const char *dir, const char *request_body,
+                    response_callback write_fn, void *write_data,
+                    header_callback header_fn, void *header_data, long *http_code);
+
+#endif /* REPLAY_H */
@@ -0,0 +1,127 @@
+/**
+ * Claude API Client - Model cascade routing
+ *
+ * See route.h for how diffs are scored and when a tier is escalated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "claude_client.h"
+#include "route.h"
+
+/* Pick a model tier per diff (--route) */
+int route_mode = 0;
+
+/* Ask the strong tier again when a fast-tier answer fails validation (--escalate) */
+int route_escalate = 0;
+
+/* Score from which a diff goes to the strong tier (--route-threshold) */
+long route_threshold = ROUTE_DEFAULT_THRESHOLD;
+
+/* Models of the two tiers (--fast-model, --strong-model) */
+const char *route_fast_model = ROUTE_DEFAULT_FAST_MODEL;
+const char *route_strong_model = ROUTE_DEFAULT_STRONG_MODEL;
+
+static const char *const tier_names[] = { "fast", "strong" };
+
+// Function to score a diff for routing; -1 if it could not be read
+long route_score(const char *git_diff, struct DiffStats *stats) {
+    if (!measure_diff(git_diff, stats)) {
+        return -1;
+    }
+    return (long)(stats->lines + ROUTE_FILE_WEIGHT * stats->files +
+                  ROUTE_LANGUAGE_WEIGHT * stats->languages + ROUTE_SYMBOL_WEIGHT * stats->symbols);
+}
+
+// Function to pick the tier for a diff and log the decision
+enum RouteTier route_tier(const char *git_diff) {
+    struct DiffStats stats;
+    long score = route_score(git_diff, &stats);
+
+    // A diff that cannot be measured is not assumed to be simple
+    enum RouteTier tier = score >= 0 && score < route_threshold ? ROUTE_FAST : ROUTE_STRONG;
+    if (score < 0) {
+        fprintf(stderr, "Route: diff could not be scored -> %s (%s)\n",
+                tier_names[tier], route_tier_model(tier));
+    } else {
+        fprintf(stderr, "Route: score %ld (%zu lines, %zu files, %zu languages, %zu symbols; "
+                        "threshold %ld) -> %s (%s)\n",
+                score, stats.lines, stats.files, stats.languages, stats.symbols,
+                route_threshold, tier_names[tier], route_tier_model(tier));
+    }
+    return tier;
+}
+
+// Function to get the model of a tier
+const char* route_tier_model(enum RouteTier tier) {
+    return tier == ROUTE_FAST ? route_fast_model : route_strong_model;
+}
+
+// Function to describe the backend and models a diff may be sent to, for cache keys
+int route_describe_models(char *buf, size_t size) {
+    if (route_mode) {
+        return snprintf(buf, size, "model %s route %s %s %ld\n", api_backend->name,
+                        route_fast_model, route_strong_model, route_threshold);
+    }
+    return snprintf(buf, size, "model %s %s\n", api_backend->name, api_model);
+}
+
+/* Send the diff to one tier and log how long it took */
+static char* ask_tier(const char *api_key, const char *profile, const char *git_diff,
+                      enum RouteTier tier) {
+    const char *previous = api_model;
+    api_model = route_tier_model(tier);
+
+    long long start = monotonic_ms();
+    char *response = call_claude_api(api_key, profile, git_diff);
+    fprintf(stderr, "Route: %s tier %s in %lld ms\n", tier_names[tier],
+            response ? "answered" : "failed", monotonic_ms() - start);
+
+    api_model = previous;
+    return response;
+}
+
+/* Check that a response has a title of sensible length and a description */
+static int response_is_valid(const char *response) {
+    char *title = NULL;
+    char *description = NULL;
+    if (!parse_claude_response(response, &title, &description)) {
+        return 0;
+    }
+
+    size_t title_len = strlen(title);
+    int has_description = description[strspn(description, " \r\n\t")] != '\0';
+    int valid = title_len > 0 && title_len <= ROUTE_MAX_TITLE && has_description;
+    if (!valid) {
+        fprintf(stderr, "Route: fast tier answer failed validation (%zu character title, %s)\n",
+                title_len, has_description ? "with description" : "no description");
+    }
+
+    mem_free(title);
+    mem_free(description);
+    return valid;
+}
+
+// Function to make the API request for a diff on the tier its score picks
+char* route_claude_api(const char *api_key, const char *profile, const char *git_diff) {
+    if (!route_mode) {
+        return call_claude_api(api_key, profile, git_diff);
+    }
+
+    enum RouteTier tier = route_tier(git_diff);
+    char *response = ask_tier(api_key, profile, git_diff, tier);
+    if (tier == ROUTE_STRONG || !route_escalate || (response && response_is_valid(response))) {
+        return response;
+    }
+
+    // Nothing is left to escalate with once the deadline has passed
+    if (deadline_remaining_ms() == 0) {
+        return response;
+    }
+
+    fprintf(stderr, "Route: escalating to strong (%s)\n", route_strong_model);
+    mem_free(response);
+    return ask_tier(api_key, profile, git_diff, ROUTE_STRONG);
+}
@@ -0,0 +1,65 @@
+/**
+ * Claude API Client - Model cascade routing
+ *
+ * With --route, each diff is scored locally before anything is sent, from
+ * the counts measure_diff() takes in one pass over it:
+ *
+ *   score = changed lines + ROUTE_FILE_WEIGHT * files
+ *         + ROUTE_LANGUAGE_WEIGHT * languages + ROUTE_SYMBOL_WEIGHT * symbols
+ *
+ * Diffs scoring below --route-threshold go to the fast tier (--fast-model),
+ * the rest to the strong tier (--strong-model, by default --model). With
+ * --escalate, a diff whose fast-tier answer is missing or fails validation
+ * (no title, a title longer than ROUTE_MAX_TITLE or no description) is
+ * asked again of the strong tier.
+ *
+ * Every decision is logged to stderr as a "Route:" line with the score and
+ * its parts, followed by one line per tier asked with its latency, so the
+ * threshold can be tuned from real runs.
+ */
+
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include "symbols.h"
+
+/* Default models of the two tiers */
+#define ROUTE_DEFAULT_FAST_MODEL "claude-3-5-haiku-20241022"
+#define ROUTE_DEFAULT_STRONG_MODEL DEFAULT_MODEL
+
+/* Score from which a diff goes to the strong tier */
+#define ROUTE_DEFAULT_THRESHOLD 400
+
+/* Score added per file, distinct language and changed symbol */
+#define ROUTE_FILE_WEIGHT 20
+#define ROUTE_LANGUAGE_WEIGHT 50
+#define ROUTE_SYMBOL_WEIGHT 10
+
+/* Longest title a fast-tier answer may have and still pass validation */
+#define ROUTE_MAX_TITLE 72
+
+enum RouteTier {
+    ROUTE_FAST = 0,
+    ROUTE_STRONG
+};
+
+/* Pick a model tier per diff (--route) */
+extern int route_mode;
+
+/* Ask the strong tier again when a fast-tier answer fails validation (--escalate) */
+extern int route_escalate;
+
+/* Score from which a diff goes to the strong tier (--route-threshold) */
+extern long route_threshold;
+
+/* Models of the two tiers (--fast-model, --strong-model) */
+extern const char *route_fast_model;
+extern const char *route_strong_model;
+
+long route_score(const char *git_diff, struct DiffStats *stats);
+enum RouteTier route_tier(const char *git_diff);
+const char* route_tier_model(enum RouteTier tier);
+int route_describe_models(char *buf, size_t size);
+char* route_claude_api(const char *api_key, const char *profile, const char *git_diff);
+
+#endif /* ROUTE_H */
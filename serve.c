@@ -0,0 +1,1164 @@
+/**
+ * Claude API Client - HTTP service mode for bots and CI
+ *
+ * See serve.h. One epoll instance watches the listening socket, every
+ * client connection and every socket cURL opens for an upstream request
+ * (CURLMOPT_SOCKETFUNCTION); cURL's timer (CURLMOPT_TIMERFUNCTION) bounds
+ * the epoll_wait() timeout. Each upstream request builds its prompt,
+ * payload and response in an arena taken from a pool, and the cURL
+ * callbacks activate that arena while they run, since requests interleave
+ * on the one thread.
+ *
+ * Responses are queued on the connection and written when the socket is
+ * writable, so no handler ever closes a connection under its caller.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+
+#include "claude_client.h"
+#include "eventlog.h"
+#include "keypool.h"
+#include "ledger.h"
+#include "serve.h"
+
+/* Upstream requests in flight at once (--max-inflight) */
+long serve_max_inflight = SERVE_DEFAULT_MAX_INFLIGHT;
+
+/* Upstream requests in flight per tenant (--tenant-limit) */
+long serve_tenant_limit = SERVE_DEFAULT_TENANT_LIMIT;
+
+/* Requests waiting for an upstream slot (--queue) */
+long serve_queue_size = SERVE_DEFAULT_QUEUE;
+
+/* Timeout of one upstream request in ms, or 0 for the defaults (--deadline) */
+long serve_request_timeout_ms = 0;
+
+#ifdef __linux__
+
+#define SERVE_PATH "/v1/commit-message"
+#define SERVE_MAX_HEAD_BYTES (16 * 1024)
+#define SERVE_MAX_TENANTS 256
+#define SERVE_TENANT_LEN 64
+#define SERVE_OTHER_TENANT "_other"
+#define SERVE_MAX_EVENTS 64
+#define SERVE_RETRY_AFTER_MAX 60
+
+/* Latency assumed for the Retry-After estimate before any request finished */
+#define SERVE_INITIAL_LATENCY_MS 2000.0
+
+/* Upper bounds of the duration histogram buckets, in seconds */
+static const double duration_bounds[] = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0 };
+#define DURATION_BUCKETS (sizeof(duration_bounds) / sizeof(duration_bounds[0]))
+
+/* Status codes counted per tenant in /metrics */
+static const int counted_codes[] = { 200, 400, 404, 405, 411, 413, 502, 503 };
+#define COUNTED_CODES (sizeof(counted_codes) / sizeof(counted_codes[0]))
+
+struct DurationHistogram {
+    unsigned long long buckets[DURATION_BUCKETS];
+    unsigned long long count;
+    double sum;
+};
+
+struct ServeTenant {
+    char name[SERVE_TENANT_LEN];
+    long inflight;
+    long queued;
+    unsigned long long responses[COUNTED_CODES];
+    unsigned long long shed;
+};
+
+enum WatchKind {
+    WATCH_LISTENER,
+    WATCH_CONN,
+    WATCH_CURL
+};
+
+/* What an epoll event is for; the first member of everything watched */
+struct ServeWatch {
+    enum WatchKind kind;
+    int fd;                         /* -1 once cURL released the socket */
+    struct ServeWatch *next_dead;   /* released watches, freed after the event batch */
+};
+
+enum ConnState {
+    CONN_READING,                   /* waiting for a complete request */
+    CONN_WAITING,                   /* request queued or sent upstream */
+    CONN_WRITING                    /* response being written */
+};
+
+struct ServeJob;
+
+struct ServeConn {
+    struct ServeWatch watch;
+    enum ConnState state;
+    struct ServeConn *prev, *next;
+    char *in;
+    size_t in_len, in_cap;
+    char *out;
+    size_t out_len, out_sent;
+    int keep_alive;
+    long long started_ms;           /* request read completely */
+    struct ServeJob *job;
+};
+
+/* One diff on its way upstream */
+struct ServeJob {
+    struct ServeConn *conn;         /* NULL once the client went away */
+    struct ServeTenant *tenant;
+    struct ServeJob *next;          /* in the queue or the in-flight list */
+    char *diff;
+    const char *model;
+    long long sent_ms;
+    struct Arena *arena;
+    void *reader;
+    CURL *easy;
+    struct curl_slist *headers;
+    int key_slot;                   /* key of the pool it was sent with, or -1 */
+    long estimated_tokens;
+    size_t attempts;
+    struct RateLimitHeaders limits;
+};
+
+struct Server {
+    int epoll_fd;
+    struct ServeWatch listener;
+    CURLM *multi;
+    long long timer_at_ms;          /* cURL timeout, or -1 */
+    long long key_wait_at_ms;       /* when a key of the pool recovers, or -1 */
+    const char *api_key;
+    const char *profile;
+    struct ArenaPool *pool;
+    struct ServeConn *conns;
+    long conn_count;
+    struct ServeJob *queue_head, *queue_tail;
+    long queue_depth;
+    struct ServeJob *running;
+    long inflight;
+    struct ServeTenant *tenants;
+    size_t tenant_count;
+    double upstream_ms;             /* moving average of upstream latency */
+    struct DurationHistogram request_hist;
+    struct DurationHistogram upstream_hist;
+    struct ServeWatch *dead;
+};
+
+/* Parsed request head */
+struct HttpRequest {
+    char method[8];
+    char path[256];
+    long long content_length;       /* -1 without the header */
+    int chunked;
+    int keep_alive;
+    char tenant[SERVE_TENANT_LEN];
+};
+
+/* Growable text for /metrics */
+struct TextBuffer {
+    char *data;
+    size_t len, cap;
+    int failed;
+};
+
+/* Set by SIGINT/SIGTERM to end the service */
+static volatile sig_atomic_t serve_stop = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+static void text_append(struct TextBuffer *text, const char *format, ...) {
+    if (text->failed) return;
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(text->data ? text->data + text->len : NULL,
+                          text->data ? text->cap - text->len : 0, format, args);
+        va_end(args);
+        if (n < 0) {
+            text->failed = 1;
+            return;
+        }
+        if (text->data && text->len + (size_t)n < text->cap) {
+            text->len += (size_t)n;
+            return;
+        }
+        size_t cap = text->cap ? text->cap * 2 : 4096;
+        while (cap < text->len + (size_t)n + 1) cap *= 2;
+        char *data = mem_realloc(text->data, cap);
+        if (!data) {
+            text->failed = 1;
+            return;
+        }
+        text->data = data;
+        text->cap = cap;
+    }
+}
+
+static void histogram_add(struct DurationHistogram *hist, long long ms) {
+    double seconds = (double)ms / 1000.0;
+    for (size_t i = 0; i < DURATION_BUCKETS; i++) {
+        if (seconds <= duration_bounds[i]) hist->buckets[i]++;
+    }
+    hist->count++;
+    hist->sum += seconds;
+}
+
+static void histogram_print(struct TextBuffer *text, const char *name, const char *help,
+                            const struct DurationHistogram *hist) {
+    text_append(text, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (size_t i = 0; i < DURATION_BUCKETS; i++) {
+        text_append(text, "%s_bucket{le=\"%g\"} %llu\n", name, duration_bounds[i], hist->buckets[i]);
+    }
+    text_append(text, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.3f\n%s_count %llu\n",
+                name, hist->count, name, hist->sum, name, hist->count);
+}
+
+static int watch_ctl(struct Server *server, int op, struct ServeWatch *watch, unsigned int events) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = watch;
+    return epoll_ctl(server->epoll_fd, op, watch->fd, &event);
+}
+
+/* The tenant named name; names are cut to letters, digits and "._-" */
+static struct ServeTenant* find_tenant(struct Server *server, const char *name) {
+    char clean[SERVE_TENANT_LEN];
+    size_t len = 0;
+    for (const char *p = name; *p && len + 1 < sizeof(clean); p++) {
+        char c = *p;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '.' || c == '_' || c == '-') {
+            clean[len++] = c;
+        }
+    }
+    clean[len] = '\0';
+    if (len == 0) snprintf(clean, sizeof(clean), "default");
+
+    for (size_t i = 0; i < server->tenant_count; i++) {
+        if (strcmp(server->tenants[i].name, clean) == 0) return &server->tenants[i];
+    }
+    // The last slot takes every tenant beyond the table
+    if (server->tenant_count == SERVE_MAX_TENANTS - 1) {
+        snprintf(clean, sizeof(clean), "%s", SERVE_OTHER_TENANT);
+        for (size_t i = 0; i < server->tenant_count; i++) {
+            if (strcmp(server->tenants[i].name, clean) == 0) return &server->tenants[i];
+        }
+    }
+    struct ServeTenant *tenant = &server->tenants[server->tenant_count++];
+    snprintf(tenant->name, sizeof(tenant->name), "%s", clean);
+    return tenant;
+}
+
+static void count_response(struct ServeTenant *tenant, int code) {
+    for (size_t i = 0; i < COUNTED_CODES; i++) {
+        if (counted_codes[i] == code) tenant->responses[i]++;
+    }
+}
+
+/* Seconds a shed client should wait: the queue ahead of it at the recent pace */
+static long retry_after_seconds(const struct Server *server) {
+    double seconds = (double)(server->queue_depth + 1) * server->upstream_ms /
+                     (double)serve_max_inflight / 1000.0;
+    long retry = (long)(seconds + 0.999);
+    if (retry < 1) retry = 1;
+    return retry < SERVE_RETRY_AFTER_MAX ? retry : SERVE_RETRY_AFTER_MAX;
+}
+
+static const char* status_text(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+/* Queue a response on conn; it is written when the socket is writable */
+static void respond(struct Server *server, struct ServeConn *conn, int code, const char *content_type,
+                    const char *body, size_t body_len, long retry_after) {
+    char head[512];
+    char retry[64] = "";
+    if (retry_after > 0) {
+        snprintf(retry, sizeof(retry), "Retry-After: %ld\r\n", retry_after);
+    }
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s"
+                            "Connection: %s\r\n\r\n",
+                            code, status_text(code), content_type, body_len, retry,
+                            conn->keep_alive ? "keep-alive" : "close");
+
+    char *out = mem_alloc((size_t)head_len + body_len);
+    if (!out) {
+        fprintf(stderr, "Error: Memory allocation failed for a response\n");
+        conn->keep_alive = 0;
+        conn->out_len = conn->out_sent = 0;
+    } else {
+        memcpy(out, head, (size_t)head_len);
+        memcpy(out + head_len, body, body_len);
+        conn->out = out;
+        conn->out_len = (size_t)head_len + body_len;
+        conn->out_sent = 0;
+    }
+    conn->state = CONN_WRITING;
+    watch_ctl(server, EPOLL_CTL_MOD, &conn->watch, EPOLLIN | EPOLLOUT);
+}
+
+static void respond_json(struct Server *server, struct ServeConn *conn, int code, const char *json,
+                         long retry_after) {
+    respond(server, conn, code, "application/json", json, strlen(json), retry_after);
+}
+
+/* Answer a diff request and count it for its tenant */
+static void respond_tenant(struct Server *server, struct ServeConn *conn, struct ServeTenant *tenant,
+                           int code, const char *json, long retry_after) {
+    count_response(tenant, code);
+    histogram_add(&server->request_hist, monotonic_ms() - conn->started_ms);
+    respond_json(server, conn, code, json, retry_after);
+}
+
+static void free_job(struct ServeJob *job) {
+    mem_free(job->diff);
+    mem_free(job);
+}
+
+static void close_conn(struct Server *server, struct ServeConn *conn) {
+    debug_print("Connection %d closed", conn->watch.fd);
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->watch.fd, NULL);
+    close(conn->watch.fd);
+
+    // A queued request is dropped; one upstream finishes with nobody to tell
+    struct ServeJob *job = conn->job;
+    if (job) {
+        job->conn = NULL;
+        if (!job->easy) {
+            struct ServeJob **link = &server->queue_head;
+            struct ServeJob *prev = NULL;
+            while (*link && *link != job) {
+                prev = *link;
+                link = &(*link)->next;
+            }
+            if (*link) {
+                *link = job->next;
+                if (server->queue_tail == job) server->queue_tail = prev;
+                server->queue_depth--;
+                job->tenant->queued--;
+                free_job(job);
+            }
+        }
+    }
+
+    if (conn->prev) conn->prev->next = conn->next;
+    else server->conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    server->conn_count--;
+
+    mem_free(conn->in);
+    mem_free(conn->out);
+    mem_free(conn);
+}
+
+/* cURL callbacks run with the job's arena active */
+static size_t serve_write(void *contents, size_t size, size_t nmemb, void *userdata) {
+    struct ServeJob *job = userdata;
+    struct Arena *previous = arena_activate(job->arena);
+    size_t written = api_backend->reader_write(contents, size, nmemb, job->reader);
+    arena_activate(previous);
+    return written;
+}
+
+static size_t serve_header(char *buffer, size_t size, size_t nitems, void *userdata) {
+    struct ServeJob *job = userdata;
+    if (job->key_slot >= 0) {
+        rate_limit_header(&job->limits, buffer, size * nitems);
+    }
+    struct Arena *previous = arena_activate(job->arena);
+    size_t written = api_backend->reader_header(buffer, size, nitems, job->reader);
+    arena_activate(previous);
+    return written;
+}
+
+/* Build the request and hand it to curl_multi; answers the client itself on failure */
+static void start_job(struct Server *server, struct ServeJob *job, int key_slot) {
+    const char *api_key = key_slot >= 0 ? key_pool_key(key_slot) : server->api_key;
+    job->key_slot = key_slot;
+    job->model = api_model;
+    job->attempts++;
+    rate_limit_headers_init(&job->limits);
+    job->arena = arena_pool_acquire(server->pool);
+    char *json = NULL;
+    char *url = NULL;
+    if (job->arena) {
+        struct Arena *previous = arena_activate(job->arena);
+        cJSON *payload = build_request_payload(server->profile, job->diff);
+        json = payload ? api_backend->print_payload(payload) : NULL;
+        cJSON_Delete(payload);
+        url = build_api_url(api_base_url, api_backend->path);
+        job->reader = json && url ? api_backend->reader_open() : NULL;
+        job->easy = job->reader ? open_api_handle(api_backend, api_key, url, json,
+                                                  &job->headers) : NULL;
+        arena_activate(previous);
+    }
+
+    if (!job->easy) {
+        if (job->reader) {
+            struct Arena *previous = arena_activate(job->arena);
+            api_backend->reader_close(job->reader, 0);
+            arena_activate(previous);
+        }
+        if (job->arena) arena_pool_release(server->pool, job->arena);
+        if (job->conn) {
+            job->conn->job = NULL;
+            respond_tenant(server, job->conn, job->tenant, 502,
+                           "{\"error\":\"failed to build the upstream request\"}", 0);
+        }
+        free_job(job);
+        return;
+    }
+
+    // The payload stays in the arena until the transfer is done
+    curl_easy_setopt(job->easy, CURLOPT_WRITEFUNCTION, serve_write);
+    curl_easy_setopt(job->easy, CURLOPT_WRITEDATA, (void *)job);
+    curl_easy_setopt(job->easy, CURLOPT_HEADERFUNCTION, serve_header);
+    curl_easy_setopt(job->easy, CURLOPT_HEADERDATA, (void *)job);
+    curl_easy_setopt(job->easy, CURLOPT_PRIVATE, (void *)job);
+    curl_easy_setopt(job->easy, CURLOPT_NOSIGNAL, 1L);
+    if (serve_request_timeout_ms > 0) {
+        curl_easy_setopt(job->easy, CURLOPT_TIMEOUT_MS, serve_request_timeout_ms);
+    }
+
+    if (key_slot >= 0) {
+        key_pool_begin(key_slot, job->estimated_tokens);
+    }
+    job->sent_ms = monotonic_ms();
+    job->next = server->running;
+    server->running = job;
+    server->inflight++;
+    job->tenant->inflight++;
+    debug_print("Tenant %s: request sent (%ld in flight, %ld for the tenant)",
+                job->tenant->name, server->inflight, job->tenant->inflight);
+    curl_multi_add_handle(server->multi, job->easy);
+}
+
+/* Start queued requests, oldest first, while their tenants and the keys have room */
+static void dispatch(struct Server *server) {
+    while (server->inflight < serve_max_inflight && server->key_wait_at_ms < 0) {
+        struct ServeJob **link = &server->queue_head;
+        struct ServeJob *prev = NULL;
+        while (*link && (*link)->tenant->inflight >= serve_tenant_limit) {
+            prev = *link;
+            link = &(*link)->next;
+        }
+        struct ServeJob *job = *link;
+        int key_slot;
+        if (!job || !key_pool_choose(job->estimated_tokens, &key_slot, &server->key_wait_at_ms)) return;
+
+        *link = job->next;
+        if (server->queue_tail == job) server->queue_tail = prev;
+        server->queue_depth--;
+        job->tenant->queued--;
+        start_job(server, job, key_slot);
+    }
+}
+
+/* Put a job refused for its key back at the head of the queue */
+static void requeue_job(struct Server *server, struct ServeJob *job) {
+    job->easy = NULL;
+    job->headers = NULL;
+    job->reader = NULL;
+    job->arena = NULL;
+    job->next = server->queue_head;
+    server->queue_head = job;
+    if (!server->queue_tail) server->queue_tail = job;
+    server->queue_depth++;
+    job->tenant->queued++;
+}
+
+static void finish_job(struct Server *server, struct ServeJob *job, CURLcode result) {
+    long http_code = 0;
+    if (result == CURLE_OK) {
+        curl_easy_getinfo(job->easy, CURLINFO_RESPONSE_CODE, &http_code);
+    }
+    curl_multi_remove_handle(server->multi, job->easy);
+    curl_easy_cleanup(job->easy);
+    curl_slist_free_all(job->headers);
+
+    struct ServeJob **link = &server->running;
+    while (*link && *link != job) link = &(*link)->next;
+    if (*link) *link = job->next;
+    server->inflight--;
+    job->tenant->inflight--;
+
+    long long elapsed = monotonic_ms() - job->sent_ms;
+    histogram_add(&server->upstream_hist, elapsed);
+    server->upstream_ms = server->upstream_ms * 0.8 + (double)elapsed * 0.2;
+    debug_print("Tenant %s: upstream answered %ld in %lld ms", job->tenant->name, http_code, elapsed);
+
+    // Every attempt goes to the ledger, one refused for its key included
+    struct Arena *previous = arena_activate(job->arena);
+    char *body = api_backend->reader_close(job->reader, http_code);
+    ledger_diff_bytes = strlen(job->diff);
+    ledger_record(job->model, http_code, elapsed, body);
+    arena_activate(previous);
+
+    if (job->key_slot >= 0) {
+        key_pool_finish(job->key_slot, job->estimated_tokens, http_code, &job->limits);
+        server->key_wait_at_ms = -1;
+
+        // A request refused for its key is sent again with another one
+        if (job->conn && key_pool_should_retry(http_code, job->attempts)) {
+            previous = arena_activate(job->arena);
+            mem_free(body);
+            arena_activate(previous);
+            arena_pool_release(server->pool, job->arena);
+            debug_print("Tenant %s: HTTP %ld with key %d of the pool, trying another key",
+                        job->tenant->name, http_code, job->key_slot + 1);
+            requeue_job(server, job);
+            dispatch(server);
+            return;
+        }
+    }
+
+    // The answer is built in the job's arena, then copied into the response
+    previous = arena_activate(job->arena);
+    char *title = NULL;
+    char *description = NULL;
+    char *json = NULL;
+    char error[256];
+    int code = 502;
+    long retry_after = 0;
+    if (result != CURLE_OK) {
+        snprintf(error, sizeof(error), "{\"error\":\"upstream request failed: %s\"}",
+                 curl_easy_strerror(result));
+    } else if (http_code == 429 || http_code == 529) {
+        code = 503;
+        retry_after = retry_after_seconds(server);
+        snprintf(error, sizeof(error), "{\"error\":\"upstream is busy (HTTP %ld)\"}", http_code);
+    } else if (http_code < 200 || http_code >= 300) {
+        snprintf(error, sizeof(error), "{\"error\":\"upstream answered HTTP %ld\"}", http_code);
+    } else if (!body || !parse_claude_response(body, &title, &description)) {
+        snprintf(error, sizeof(error), "{\"error\":\"unreadable upstream response\"}");
+    } else {
+        cJSON *answer = cJSON_CreateObject();
+        if (answer && cJSON_AddStringToObject(answer, "title", title) &&
+            cJSON_AddStringToObject(answer, "description", description)) {
+            json = cJSON_PrintUnformatted(answer);
+        }
+        cJSON_Delete(answer);
+        code = json ? 200 : 502;
+        snprintf(error, sizeof(error), "{\"error\":\"out of memory\"}");
+    }
+    arena_activate(previous);
+
+    if (job->conn) {
+        job->conn->job = NULL;
+        respond_tenant(server, job->conn, job->tenant, code, json ? json : error, retry_after);
+    }
+    arena_pool_release(server->pool, job->arena);
+    free_job(job);
+    dispatch(server);
+}
+
+static void read_multi_info(struct Server *server) {
+    CURLMsg *msg;
+    int left = 0;
+    while ((msg = curl_multi_info_read(server->multi, &left)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        struct ServeJob *job = NULL;
+        CURLcode result = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&job);
+        if (job) finish_job(server, job, result);
+    }
+}
+
+static int serve_socket_callback(CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp) {
+    (void)easy;
+    struct Server *server = userp;
+    struct ServeWatch *watch = socketp;
+
+    if (what == CURL_POLL_REMOVE) {
+        if (watch) {
+            epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+            watch->fd = -1;
+            watch->next_dead = server->dead;
+            server->dead = watch;
+        }
+        return 0;
+    }
+
+    unsigned int events = ((what & CURL_POLL_IN) ? EPOLLIN : 0) | ((what & CURL_POLL_OUT) ? EPOLLOUT : 0);
+    if (!watch) {
+        watch = mem_calloc(1, sizeof(*watch));
+        if (!watch) return -1;
+        watch->kind = WATCH_CURL;
+        watch->fd = fd;
+        curl_multi_assign(server->multi, fd, watch);
+        return watch_ctl(server, EPOLL_CTL_ADD, watch, events) == 0 ? 0 : -1;
+    }
+    return watch_ctl(server, EPOLL_CTL_MOD, watch, events) == 0 ? 0 : -1;
+}
+
+static int serve_timer_callback(CURLM *multi, long timeout_ms, void *userp) {
+    (void)multi;
+    struct Server *server = userp;
+    server->timer_at_ms = timeout_ms < 0 ? -1 : monotonic_ms() + timeout_ms;
+    return 0;
+}
+
+static void handle_metrics(struct Server *server, struct ServeConn *conn) {
+    struct TextBuffer text;
+    memset(&text, 0, sizeof(text));
+
+    text_append(&text, "# HELP commit_ai_queue_depth Requests waiting for an upstream slot\n"
+                "# TYPE commit_ai_queue_depth gauge\ncommit_ai_queue_depth %ld\n", server->queue_depth);
+    text_append(&text, "# HELP commit_ai_inflight_requests Requests sent upstream and not answered\n"
+                "# TYPE commit_ai_inflight_requests gauge\ncommit_ai_inflight_requests %ld\n",
+                server->inflight);
+    text_append(&text, "# HELP commit_ai_connections Open client connections\n"
+                "# TYPE commit_ai_connections gauge\ncommit_ai_connections %ld\n", server->conn_count);
+
+    text_append(&text, "# HELP commit_ai_tenant_inflight_requests Requests in flight per tenant\n"
+                "# TYPE commit_ai_tenant_inflight_requests gauge\n");
+    for (size_t i = 0; i < server->tenant_count; i++) {
+        text_append(&text, "commit_ai_tenant_inflight_requests{tenant=\"%s\"} %ld\n",
+                    server->tenants[i].name, server->tenants[i].inflight);
+    }
+    text_append(&text, "# HELP commit_ai_tenant_queued_requests Requests waiting per tenant\n"
+                "# TYPE commit_ai_tenant_queued_requests gauge\n");
+    for (size_t i = 0; i < server->tenant_count; i++) {
+        text_append(&text, "commit_ai_tenant_queued_requests{tenant=\"%s\"} %ld\n",
+                    server->tenants[i].name, server->tenants[i].queued);
+    }
+    text_append(&text, "# HELP commit_ai_requests_total Diff requests answered, by status\n"
+                "# TYPE commit_ai_requests_total counter\n");
+    for (size_t i = 0; i < server->tenant_count; i++) {
+        for (size_t c = 0; c < COUNTED_CODES; c++) {
+            if (!server->tenants[i].responses[c]) continue;
+            text_append(&text, "commit_ai_requests_total{tenant=\"%s\",code=\"%d\"} %llu\n",
+                        server->tenants[i].name, counted_codes[c], server->tenants[i].responses[c]);
+        }
+    }
+    text_append(&text, "# HELP commit_ai_shed_total Requests refused because the queue was full\n"
+                "# TYPE commit_ai_shed_total counter\n");
+    for (size_t i = 0; i < server->tenant_count; i++) {
+        text_append(&text, "commit_ai_shed_total{tenant=\"%s\"} %llu\n",
+                    server->tenants[i].name, server->tenants[i].shed);
+    }
+    histogram_print(&text, "commit_ai_request_duration_seconds",
+                    "Time from request to answer, queueing included", &server->request_hist);
+    histogram_print(&text, "commit_ai_upstream_duration_seconds",
+                    "Time of the upstream API request", &server->upstream_hist);
+
+    if (text.failed) {
+        respond_json(server, conn, 502, "{\"error\":\"out of memory\"}", 0);
+    } else {
+        respond(server, conn, 200, "text/plain; version=0.0.4", text.data, text.len, 0);
+    }
+    mem_free(text.data);
+}
+
+/* Admit a diff: start it, queue it or shed it */
+static void handle_diff(struct Server *server, struct ServeConn *conn, const struct HttpRequest *request,
+                        const char *body, size_t body_len) {
+    struct ServeTenant *tenant = find_tenant(server, request->tenant);
+    if (body_len == 0) {
+        respond_tenant(server, conn, tenant, 400, "{\"error\":\"empty diff\"}", 0);
+        return;
+    }
+
+    // A tenant's new request waits behind its queued ones
+    long estimated_tokens = (long)((body_len + strlen(server->profile)) / 4) + 1;
+    int key_slot = -1;
+    int can_start = server->inflight < serve_max_inflight && tenant->inflight < serve_tenant_limit &&
+                    tenant->queued == 0 && server->key_wait_at_ms < 0 &&
+                    key_pool_choose(estimated_tokens, &key_slot, &server->key_wait_at_ms);
+    int can_queue = server->queue_depth < serve_queue_size &&
+                    tenant->queued < serve_tenant_limit * SERVE_TENANT_QUEUE_FACTOR;
+    if (!can_start && !can_queue) {
+        tenant->shed++;
+        long retry_after = retry_after_seconds(server);
+        debug_print("Tenant %s: shed (%ld queued), retry after %ld s",
+                    tenant->name, server->queue_depth, retry_after);
+        respond_tenant(server, conn, tenant, 503, "{\"error\":\"overloaded, retry later\"}", retry_after);
+        return;
+    }
+
+    struct ServeJob *job = mem_calloc(1, sizeof(*job));
+    char *diff = mem_alloc(body_len + 1);
+    if (!job || !diff) {
+        mem_free(job);
+        mem_free(diff);
+        respond_tenant(server, conn, tenant, 503, "{\"error\":\"out of memory\"}", 1);
+        return;
+    }
+    memcpy(diff, body, body_len);
+    diff[body_len] = '\0';
+    job->diff = diff;
+    job->conn = conn;
+    job->tenant = tenant;
+    job->key_slot = -1;
+    job->estimated_tokens = estimated_tokens;
+    conn->job = job;
+    conn->state = CONN_WAITING;
+
+    if (can_start) {
+        start_job(server, job, key_slot);
+        return;
+    }
+    if (server->queue_tail) server->queue_tail->next = job;
+    else server->queue_head = job;
+    server->queue_tail = job;
+    server->queue_depth++;
+    tenant->queued++;
+    debug_print("Tenant %s: queued (%ld waiting)", tenant->name, server->queue_depth);
+}
+
+/* Value of a header line if it is name, else NULL; value_len gets its length */
+static const char* header_value(const char *line, size_t len, const char *name, size_t *value_len) {
+    size_t name_len = strlen(name);
+    if (len <= name_len || line[name_len] != ':' || strncasecmp(line, name, name_len) != 0) {
+        return NULL;
+    }
+    const char *value = line + name_len + 1;
+    const char *end = line + len;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    *value_len = (size_t)(end - value);
+    return value;
+}
+
+/* Parse the request head (head_len bytes, ending in a blank line) */
+static int parse_head(const char *head, size_t head_len, struct HttpRequest *request) {
+    memset(request, 0, sizeof(*request));
+    request->content_length = -1;
+
+    const char *line_end = memchr(head, '\r', head_len);
+    if (!line_end) return 0;
+    char version[16];
+    char line[512];
+    size_t line_len = (size_t)(line_end - head);
+    if (line_len >= sizeof(line)) return 0;
+    memcpy(line, head, line_len);
+    line[line_len] = '\0';
+    if (sscanf(line, "%7s %255s %15s", request->method, request->path, version) != 3 ||
+        strncmp(version, "HTTP/1.", 7) != 0) {
+        return 0;
+    }
+    request->keep_alive = strcmp(version, "HTTP/1.0") != 0;
+
+    for (const char *p = line_end + 2; p < head + head_len - 2; ) {
+        const char *end = memchr(p, '\r', (size_t)(head + head_len - p));
+        if (!end) break;
+        size_t len = (size_t)(end - p);
+        size_t value_len = 0;
+        const char *value;
+        if ((value = header_value(p, len, "Content-Length", &value_len)) != NULL) {
+            request->content_length = strtoll(value, NULL, 10);
+            if (request->content_length < 0) return 0;
+        } else if ((value = header_value(p, len, "Transfer-Encoding", &value_len)) != NULL) {
+            request->chunked = value_len > 0;
+        } else if ((value = header_value(p, len, "Connection", &value_len)) != NULL) {
+            if (value_len == 5 && strncasecmp(value, "close", 5) == 0) request->keep_alive = 0;
+            if (value_len == 10 && strncasecmp(value, "keep-alive", 10) == 0) request->keep_alive = 1;
+        } else if ((value = header_value(p, len, SERVE_TENANT_HEADER, &value_len)) != NULL) {
+            if (value_len >= sizeof(request->tenant)) value_len = sizeof(request->tenant) - 1;
+            memcpy(request->tenant, value, value_len);
+            request->tenant[value_len] = '\0';
+        }
+        p = end + 2;
+    }
+    return 1;
+}
+
+/* Length of the request head including its blank line, or 0 if incomplete */
+static size_t head_length(const char *data, size_t len) {
+    if (len > SERVE_MAX_HEAD_BYTES) len = SERVE_MAX_HEAD_BYTES;
+    for (size_t i = 3; i < len; i++) {
+        if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/* Answer a broken request and close the connection after it */
+static void reject(struct Server *server, struct ServeConn *conn, int code, const char *json) {
+    conn->keep_alive = 0;
+    conn->in_len = 0;
+    respond_json(server, conn, code, json, 0);
+}
+
+/* Handle every complete request in the input buffer */
+static void process_input(struct Server *server, struct ServeConn *conn) {
+    while (conn->state == CONN_READING && conn->in_len > 0) {
+        size_t head = head_length(conn->in, conn->in_len);
+        if (!head) {
+            if (conn->in_len >= SERVE_MAX_HEAD_BYTES) {
+                reject(server, conn, 400, "{\"error\":\"request head too large\"}");
+            }
+            return;
+        }
+
+        struct HttpRequest request;
+        if (!parse_head(conn->in, head, &request)) {
+            reject(server, conn, 400, "{\"error\":\"malformed request\"}");
+            return;
+        }
+        if (request.chunked || (strcmp(request.method, "POST") == 0 && request.content_length < 0)) {
+            reject(server, conn, 411, "{\"error\":\"Content-Length required\"}");
+            return;
+        }
+        if (request.content_length > (long long)SERVE_MAX_BODY) {
+            reject(server, conn, 413, "{\"error\":\"diff too large\"}");
+            return;
+        }
+
+        size_t body_len = request.content_length > 0 ? (size_t)request.content_length : 0;
+        if (conn->in_len < head + body_len) return;
+
+        conn->keep_alive = request.keep_alive;
+        conn->started_ms = monotonic_ms();
+        const char *body = conn->in + head;
+        if (strcmp(request.path, SERVE_PATH) == 0) {
+            if (strcmp(request.method, "POST") == 0) {
+                handle_diff(server, conn, &request, body, body_len);
+            } else {
+                respond_json(server, conn, 405, "{\"error\":\"use POST\"}", 0);
+            }
+        } else if (strcmp(request.path, "/metrics") == 0 && strcmp(request.method, "GET") == 0) {
+            handle_metrics(server, conn);
+        } else if (strcmp(request.path, "/healthz") == 0 && strcmp(request.method, "GET") == 0) {
+            respond(server, conn, 200, "text/plain", "ok\n", 3, 0);
+        } else {
+            respond_json(server, conn, 404, "{\"error\":\"not found\"}", 0);
+        }
+
+        // Keep pipelined bytes for after the response
+        memmove(conn->in, conn->in + head + body_len, conn->in_len - head - body_len);
+        conn->in_len -= head + body_len;
+    }
+}
+
+/* Read what the client sent; returns 0 if the connection was closed */
+static int read_conn(struct Server *server, struct ServeConn *conn) {
+    const size_t limit = SERVE_MAX_HEAD_BYTES + SERVE_MAX_BODY;
+    for (;;) {
+        if (conn->in_cap - conn->in_len < 4096 && conn->in_cap < limit) {
+            size_t cap = conn->in_cap ? conn->in_cap * 2 : 16384;
+            if (cap > limit) cap = limit;
+            char *in = mem_realloc(conn->in, cap);
+            if (!in) {
+                close_conn(server, conn);
+                return 0;
+            }
+            conn->in = in;
+            conn->in_cap = cap;
+        }
+        if (conn->in_len == conn->in_cap) {
+            // More than one maximal request: not a client we serve
+            close_conn(server, conn);
+            return 0;
+        }
+
+        ssize_t n = recv(conn->watch.fd, conn->in + conn->in_len, conn->in_cap - conn->in_len, 0);
+        if (n > 0) {
+            conn->in_len += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        close_conn(server, conn);
+        return 0;
+    }
+
+    process_input(server, conn);
+    return 1;
+}
+
+static void write_conn(struct Server *server, struct ServeConn *conn) {
+    while (conn->out_sent < conn->out_len) {
+        ssize_t n = send(conn->watch.fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent,
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->out_sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        close_conn(server, conn);
+        return;
+    }
+
+    mem_free(conn->out);
+    conn->out = NULL;
+    conn->out_len = conn->out_sent = 0;
+    if (!conn->keep_alive) {
+        close_conn(server, conn);
+        return;
+    }
+    conn->state = CONN_READING;
+    watch_ctl(server, EPOLL_CTL_MOD, &conn->watch, EPOLLIN);
+    process_input(server, conn);
+}
+
+static void accept_conns(struct Server *server) {
+    for (;;) {
+        int fd = accept(server->listener.fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "Warning: Failed to accept a connection (%s)\n", strerror(errno));
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        struct ServeConn *conn = mem_calloc(1, sizeof(*conn));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->watch.kind = WATCH_CONN;
+        conn->watch.fd = fd;
+        conn->state = CONN_READING;
+        if (watch_ctl(server, EPOLL_CTL_ADD, &conn->watch, EPOLLIN) != 0) {
+            close(fd);
+            mem_free(conn);
+            continue;
+        }
+        conn->next = server->conns;
+        if (server->conns) server->conns->prev = conn;
+        server->conns = conn;
+        server->conn_count++;
+        debug_print("Connection %d accepted", fd);
+    }
+}
+
+/* Listen on [host:]port; host defaults to 127.0.0.1 */
+static int open_listener(const char *address) {
+    char host[256] = "127.0.0.1";
+    const char *port = address;
+    const char *colon = strrchr(address, ':');
+    if (colon) {
+        size_t host_len = (size_t)(colon - address);
+        if (host_len >= sizeof(host)) host_len = sizeof(host) - 1;
+        memcpy(host, address, host_len);
+        host[host_len] = '\0';
+        port = colon + 1;
+    }
+
+    struct addrinfo hints, *found = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int rc = getaddrinfo(*host ? host : NULL, port, &hints, &found);
+    if (rc != 0) {
+        fprintf(stderr, "Error: Invalid service address %s (%s)\n", address, gai_strerror(rc));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = found; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 512) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to listen on %s (%s)\n", address, strerror(errno));
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void free_dead_watches(struct Server *server) {
+    while (server->dead) {
+        struct ServeWatch *watch = server->dead;
+        server->dead = watch->next_dead;
+        mem_free(watch);
+    }
+}
+
+static void run_loop(struct Server *server) {
+    struct epoll_event events[SERVE_MAX_EVENTS];
+    int running = 0;
+
+    while (!serve_stop) {
+        event_log_flush();
+
+        int timeout = 1000;
+        long long now = monotonic_ms();
+        if (server->timer_at_ms >= 0) {
+            long long wait = server->timer_at_ms - now;
+            timeout = wait <= 0 ? 0 : (wait < timeout ? (int)wait : timeout);
+        }
+        if (server->key_wait_at_ms >= 0) {
+            long long wait = server->key_wait_at_ms - now;
+            timeout = wait <= 0 ? 0 : (wait < timeout ? (int)wait : timeout);
+        }
+
+        int ready = epoll_wait(server->epoll_fd, events, SERVE_MAX_EVENTS, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: Failed to wait for events (%s)\n", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            struct ServeWatch *watch = events[i].data.ptr;
+            unsigned int flags = events[i].events;
+            if (watch->kind == WATCH_LISTENER) {
+                accept_conns(server);
+            } else if (watch->kind == WATCH_CONN) {
+                struct ServeConn *conn = (struct ServeConn *)watch;
+                int open = 1;
+                if (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    open = read_conn(server, conn);
+                }
+                if (open && (flags & EPOLLOUT) && conn->state == CONN_WRITING) {
+                    write_conn(server, conn);
+                }
+            } else if (watch->fd >= 0) {
+                int action = ((flags & EPOLLIN) ? CURL_CSELECT_IN : 0) |
+                             ((flags & EPOLLOUT) ? CURL_CSELECT_OUT : 0) |
+                             ((flags & (EPOLLERR | EPOLLHUP)) ? CURL_CSELECT_ERR : 0);
+                curl_multi_socket_action(server->multi, watch->fd, action, &running);
+            }
+        }
+
+        if (server->timer_at_ms >= 0 && monotonic_ms() >= server->timer_at_ms) {
+            server->timer_at_ms = -1;
+            curl_multi_socket_action(server->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+        read_multi_info(server);
+        if (server->key_wait_at_ms >= 0 && monotonic_ms() >= server->key_wait_at_ms) {
+            server->key_wait_at_ms = -1;
+            dispatch(server);
+        }
+        free_dead_watches(server);
+    }
+}
+
+// Function to answer diff requests over HTTP until interrupted (--serve)
+int serve_run(const char *address, const char *api_key, const char *profile) {
+    struct Server server;
+    memset(&server, 0, sizeof(server));
+    server.api_key = api_key;
+    server.profile = profile;
+    server.timer_at_ms = -1;
+    server.key_wait_at_ms = -1;
+    server.upstream_ms = SERVE_INITIAL_LATENCY_MS;
+    server.listener.kind = WATCH_LISTENER;
+
+    server.listener.fd = open_listener(address);
+    if (server.listener.fd < 0) return 0;
+
+    // Requests interleave on this thread; each brings its own arena
+    struct Arena *previous = arena_activate(NULL);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.pool = arena_pool_create((size_t)serve_max_inflight, ARENA_DEFAULT_BLOCK_SIZE);
+    server.tenants = mem_calloc(SERVE_MAX_TENANTS, sizeof(*server.tenants));
+    server.multi = curl_multi_init();
+    if (server.epoll_fd < 0 || !server.pool || !server.tenants || !server.multi ||
+        watch_ctl(&server, EPOLL_CTL_ADD, &server.listener, EPOLLIN) != 0) {
+        fprintf(stderr, "Error: Failed to set up the service (%s)\n", strerror(errno));
+        if (server.multi) curl_multi_cleanup(server.multi);
+        mem_free(server.tenants);
+        arena_pool_destroy(server.pool);
+        if (server.epoll_fd >= 0) close(server.epoll_fd);
+        close(server.listener.fd);
+        arena_activate(previous);
+        return 0;
+    }
+    curl_multi_setopt(server.multi, CURLMOPT_SOCKETFUNCTION, serve_socket_callback);
+    curl_multi_setopt(server.multi, CURLMOPT_SOCKETDATA, &server);
+    curl_multi_setopt(server.multi, CURLMOPT_TIMERFUNCTION, serve_timer_callback);
+    curl_multi_setopt(server.multi, CURLMOPT_TIMERDATA, &server);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serving on http://%s%s (%ld in flight, %ld per tenant, queue %ld; Ctrl-C to stop)\n",
+           strchr(address, ':') ? "" : "127.0.0.1:", address, serve_max_inflight, serve_tenant_limit,
+           serve_queue_size);
+    fflush(stdout);
+
+    run_loop(&server);
+
+    // Drop whatever is still open
+    while (server.conns) close_conn(&server, server.conns);
+    while (server.running) {
+        struct ServeJob *job = server.running;
+        server.running = job->next;
+        curl_multi_remove_handle(server.multi, job->easy);
+        curl_easy_cleanup(job->easy);
+        curl_slist_free_all(job->headers);
+        struct Arena *job_previous = arena_activate(job->arena);
+        mem_free(api_backend->reader_close(job->reader, 0));
+        arena_activate(job_previous);
+        arena_pool_release(server.pool, job->arena);
+        free_job(job);
+    }
+    free_dead_watches(&server);
+    curl_multi_cleanup(server.multi);
+    mem_free(server.tenants);
+    arena_pool_destroy(server.pool);
+    close(server.epoll_fd);
+    close(server.listener.fd);
+    arena_activate(previous);
+
+    printf("Service stopped\n");
+    return 1;
+}
+
+#else
+
+// Function to answer diff requests over HTTP until interrupted (--serve)
+int serve_run(const char *address, const char *api_key, const char *profile) {
+    (void)address;
+    (void)api_key;
+    (void)profile;
+    fprintf(stderr, "Error: --serve needs Linux (epoll)\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * Claude API Client - HTTP service mode for bots and CI
+ *
+ * --serve [host:]port keeps one warm process answering many clients:
+ *
+ *   POST /v1/commit-message   body: a git diff; header X-Tenant: <name>
+ *                             200 {"title": "...", "description": "..."}
+ *   GET  /metrics             Prometheus text format
+ *   GET  /healthz             200 ok
+ *
+ * Everything runs on one thread: an epoll loop accepts and reads clients
+ * and drives the upstream requests through curl_multi, so a slow API call
+ * holds a few kilobytes, not a process or a thread. The profile and key are
+ * read once at startup; the prompt is built as for a single diff.
+ *
+ * Admission control: at most --max-inflight requests are sent upstream at
+ * once, and at most --tenant-limit per tenant. Others wait in one FIFO
+ * queue of --queue entries, in which a tenant may hold SERVE_TENANT_QUEUE_FACTOR
+ * times its limit. A request that does not fit is shed at once with 503
+ * and a Retry-After estimated from the queue and the recent upstream
+ * latency, so bots back off instead of piling up. Upstream 429 and 529
+ * answers are passed on the same way.
+ *
+ * Linux only (epoll).
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+/* Upstream requests in flight at once (--max-inflight) */
+#define SERVE_DEFAULT_MAX_INFLIGHT 32
+
+/* Upstream requests in flight per tenant (--tenant-limit) */
+#define SERVE_DEFAULT_TENANT_LIMIT 4
+
+/* Requests waiting for an upstream slot (--queue) */
+#define SERVE_DEFAULT_QUEUE 64
+
+/* Waiting requests a tenant may hold, in multiples of its limit */
+#define SERVE_TENANT_QUEUE_FACTOR 4
+
+/* Largest diff accepted in a request body */
+#define SERVE_MAX_BODY (8UL * 1024 * 1024)
+
+/* Header naming the tenant; requests without it belong to "default" */
+#define SERVE_TENANT_HEADER "X-Tenant"
+
+/* Limits set from the command line */
+extern long serve_max_inflight;
+extern long serve_tenant_limit;
+extern long serve_queue_size;
+
+/* Timeout of one upstream request in ms, or 0 for the defaults (--deadline) */
+extern long serve_request_timeout_ms;
+
+int serve_run(const char *address, const char *api_key, const char *profile);
+
+#endif /* SERVE_H */
@@ -0,0 +1,1107 @@
+/**
+ * Claude API Client - Changed-symbol digest
+ *
+ * See symbols.h for what the digest contains and how the prompt uses it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "claude_client.h"
+#include "symbols.h"
+
+/* How build_prompt() uses the digest */
+enum DigestMode digest_mode = DIGEST_OFF;
+
+/* Longest symbol name kept; longer names are truncated */
+#define MAX_SYMBOL_NAME 96
+
+/* Tokens looked at per line; definitions start near the front */
+#define MAX_LINE_TOKENS 48
+
+/* Character classes shared by all tokenizers */
+enum {
+    CC_OTHER = 0,
+    CC_SPACE,
+    CC_IDENT,       /* letters, '_', '$' and UTF-8 bytes */
+    CC_DIGIT
+};
+
+#define O CC_OTHER
+#define S CC_SPACE
+#define I CC_IDENT
+#define D CC_DIGIT
+static const unsigned char char_class[256] = {
+    /* 0x00 */ O, O, O, O, O, O, O, O, O, S, O, S, S, S, O, O,
+    /* 0x10 */ O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    /* 0x20 */ S, O, O, O, I, O, O, O, O, O, O, O, O, O, O, O,
+    /* 0x30 */ D, D, D, D, D, D, D, D, D, D, O, O, O, O, O, O,
+    /* 0x40 */ O, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0x50 */ I, I, I, I, I, I, I, I, I, I, I, O, O, O, O, I,
+    /* 0x60 */ O, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0x70 */ I, I, I, I, I, I, I, I, I, I, I, O, O, O, O, O,
+    /* 0x80 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0x90 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0xA0 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0xB0 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0xC0 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0xD0 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0xE0 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    /* 0xF0 */ I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I
+};
+#undef O
+#undef S
+#undef I
+#undef D
+
+/*
+ * One entry per language. A definition is found by, in order: a
+ * preprocessor #define, a "type name(" declaration in languages that have
+ * them, or a keyword that introduces a named definition. type_keywords
+ * (struct, class, ...) only count when the name is followed by '{', ':',
+ * ';' or the end of the line, so parameters like "struct foo *p" are not
+ * taken for definitions. toplevel_keywords only count at column 0.
+ */
+struct LanguageSpec {
+    const char *name;
+    const char *const *extensions;
+    const char *line_comment;
+    const char *block_open;
+    const char *block_close;
+    const char *quotes;
+    const char *const *def_keywords;
+    const char *const *type_keywords;
+    const char *const *toplevel_keywords;
+    int call_definitions;
+    int preprocessor;
+    int config_keys;
+};
+
+static const char *const no_words[] = { NULL };
+
+static const char *const c_extensions[] = {
+    "c", "h", "cc", "cpp", "cxx", "hh", "hpp", "hxx", "inl", "ino", "cu", NULL
+};
+static const char *const c_type_keywords[] = {
+    "struct", "union", "enum", "class", "namespace", NULL
+};
+
+static const char *const go_extensions[] = { "go", NULL };
+static const char *const go_def_keywords[] = { "func", "type", NULL };
+static const char *const go_toplevel_keywords[] = { "const", "var", NULL };
+
+static const char *const python_extensions[] = { "py", "pyi", "pyw", NULL };
+static const char *const python_def_keywords[] = { "def", "class", NULL };
+
+static const char *const rust_extensions[] = { "rs", NULL };
+static const char *const rust_def_keywords[] = {
+    "fn", "struct", "enum", "trait", "mod", "type", "union", "impl", "macro_rules", NULL
+};
+static const char *const rust_toplevel_keywords[] = { "const", "static", NULL };
+
+static const char *const java_extensions[] = { "java", NULL };
+static const char *const java_def_keywords[] = {
+    "class", "interface", "enum", "record", NULL
+};
+
+static const char *const ts_extensions[] = {
+    "ts", "tsx", "mts", "cts", "js", "jsx", "mjs", "cjs", NULL
+};
+static const char *const ts_def_keywords[] = {
+    "function", "class", "interface", "type", "enum", "namespace", NULL
+};
+static const char *const ts_toplevel_keywords[] = { "const", "let", "var", NULL };
+
+static const char *const config_extensions[] = {
+    "json", "yaml", "yml", "toml", "ini", "cfg", "conf", "properties", NULL
+};
+
+static const struct LanguageSpec languages[] = {
+    { "C/C++", c_extensions, "//", "/*", "*/", "\"'",
+      no_words, c_type_keywords, no_words, 1, 1, 0 },
+    { "Go", go_extensions, "//", "/*", "*/", "\"'`",
+      go_def_keywords, no_words, go_toplevel_keywords, 0, 0, 0 },
+    { "Python", python_extensions, "#", NULL, NULL, "\"'",
+      python_def_keywords, no_words, no_words, 0, 0, 0 },
+    { "Rust", rust_extensions, "//", "/*", "*/", "\"",
+      rust_def_keywords, no_words, rust_toplevel_keywords, 0, 0, 0 },
+    { "Java", java_extensions, "//", "/*", "*/", "\"'",
+      java_def_keywords, no_words, no_words, 1, 0, 0 },
+    { "TypeScript", ts_extensions, "//", "/*", "*/", "\"'`",
+      ts_def_keywords, no_words, ts_toplevel_keywords, 1, 0, 0 },
+    { "config", config_extensions, "#", NULL, NULL, "\"'",
+      no_words, no_words, no_words, 0, 0, 1 }
+};
+
+/* Words that can precede '(' without making the line a definition */
+static const char *const call_stop_words[] = {
+    "if", "for", "while", "switch", "return", "sizeof", "catch", "new", "else",
+    "case", "do", "throw", "delete", "defined", "typeof", "await", "yield",
+    "assert", "goto", "alignof", "decltype", "static_assert", "using", NULL
+};
+
+struct Token {
+    const char *start;
+    size_t len;
+    char punct;         /* 0 for an identifier, else the character */
+};
+
+static const struct LanguageSpec* language_for_path(const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    const char *ext = strrchr(base, '.');
+    if (!ext) return NULL;
+    ext++;
+
+    for (size_t l = 0; l < sizeof(languages) / sizeof(languages[0]); l++) {
+        for (const char *const *e = languages[l].extensions; *e; e++) {
+            if (strcmp(ext, *e) == 0) {
+                return &languages[l];
+            }
+        }
+    }
+    return NULL;
+}
+
+static int starts_with(const char *s, size_t len, const char *prefix) {
+    size_t n = strlen(prefix);
+    return len >= n && memcmp(s, prefix, n) == 0;
+}
+
+static int token_is(const struct Token *t, const char *word) {
+    return t->punct == 0 && t->len == strlen(word) && memcmp(t->start, word, t->len) == 0;
+}
+
+static int token_in(const struct Token *t, const char *const *words) {
+    for (; *words; words++) {
+        if (token_is(t, *words)) return 1;
+    }
+    return 0;
+}
+
+/* Split one source line into identifiers and punctuation, skipping comments and strings */
+static size_t tokenize_line(const struct LanguageSpec *lang, const char *line, size_t len,
+                            int *in_block, struct Token *tokens, size_t max_tokens) {
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i < len && count < max_tokens) {
+        if (*in_block) {
+            const char *close = lang->block_close;
+            size_t close_len = strlen(close);
+            while (i < len && !starts_with(line + i, len - i, close)) i++;
+            if (i == len) break;
+            i += close_len;
+            *in_block = 0;
+            continue;
+        }
+
+        unsigned char c = (unsigned char)line[i];
+        int cls = char_class[c];
+
+        if (cls == CC_SPACE) {
+            i++;
+        } else if (lang->line_comment && starts_with(line + i, len - i, lang->line_comment)) {
+            break;
+        } else if (lang->block_open && starts_with(line + i, len - i, lang->block_open)) {
+            i += strlen(lang->block_open);
+            *in_block = 1;
+        } else if (cls == CC_OTHER && strchr(lang->quotes, c)) {
+            size_t j = i + 1;
+            while (j < len && line[j] != (char)c) {
+                j += (line[j] == '\\') ? 2 : 1;
+            }
+            tokens[count].start = line + i;
+            tokens[count].len = (j < len ? j + 1 : len) - i;
+            tokens[count].punct = '"';
+            count++;
+            i = j + 1;
+        } else if (cls == CC_IDENT) {
+            size_t j = i + 1;
+            while (j < len && (char_class[(unsigned char)line[j]] == CC_IDENT ||
+                               char_class[(unsigned char)line[j]] == CC_DIGIT)) {
+                j++;
+            }
+            tokens[count].start = line + i;
+            tokens[count].len = j - i;
+            tokens[count].punct = 0;
+            count++;
+            i = j;
+        } else if (cls == CC_DIGIT) {
+            size_t j = i + 1;
+            while (j < len && (char_class[(unsigned char)line[j]] != CC_SPACE &&
+                               (char_class[(unsigned char)line[j]] != CC_OTHER || line[j] == '.'))) {
+                j++;
+            }
+            tokens[count].start = line + i;
+            tokens[count].len = j - i;
+            tokens[count].punct = '0';
+            count++;
+            i = j;
+        } else {
+            tokens[count].start = line + i;
+            tokens[count].len = 1;
+            tokens[count].punct = (char)c;
+            count++;
+            i++;
+        }
+    }
+
+    return count;
+}
+
+static void copy_name(char *name, const char *start, size_t len) {
+    if (len >= MAX_SYMBOL_NAME) {
+        len = MAX_SYMBOL_NAME - 1;
+    }
+    memcpy(name, start, len);
+    name[len] = '\0';
+}
+
+/* Skip a balanced (...) or <...> group starting at tokens[i]; returns the index after it */
+static size_t skip_group(const struct Token *tokens, size_t count, size_t i, char open, char close) {
+    int depth = 0;
+    for (; i < count; i++) {
+        if (tokens[i].punct == open) depth++;
+        if (tokens[i].punct == close && --depth == 0) return i + 1;
+    }
+    return count;
+}
+
+/* "type name(" or "type Class::name(" declarations */
+static int find_call_definition(const struct Token *t, size_t count, char *name) {
+    size_t k = 0;
+    while (k < count && t[k].punct != '(') {
+        if (t[k].punct == '=') return 0;
+        k++;
+    }
+    if (k == count || k < 2) return 0;
+
+    // typedef int (*name)(...) and other function pointers
+    if (k + 3 < count && t[k + 1].punct == '*' && t[k + 2].punct == 0 && t[k + 3].punct == ')') {
+        copy_name(name, t[k + 2].start, t[k + 2].len);
+        return 1;
+    }
+
+    if (t[k - 1].punct != 0) return 0;
+    if (token_in(&t[k - 1], call_stop_words) || (t[0].punct == 0 && token_in(&t[0], call_stop_words))) {
+        return 0;
+    }
+
+    // Class::name( is a definition even without a return type (constructors)
+    if (k >= 4 && t[k - 2].punct == ':' && t[k - 3].punct == ':' && t[k - 4].punct == 0) {
+        size_t scope_len = (size_t)(t[k - 1].start + t[k - 1].len - t[k - 4].start);
+        copy_name(name, t[k - 4].start, scope_len);
+        return 1;
+    }
+
+    const struct Token *prev = &t[k - 2];
+    int typed = (prev->punct == 0 && !token_in(prev, call_stop_words)) ||
+                prev->punct == '*' || prev->punct == '&' ||
+                (prev->punct == '>' && !(k >= 3 && t[k - 3].punct == '-'));
+    if (!typed) return 0;
+
+    copy_name(name, t[k - 1].start, t[k - 1].len);
+    return 1;
+}
+
+/* Keyword-introduced definitions: def, fn, func, class, struct ... */
+static int find_keyword_definition(const struct LanguageSpec *lang, const struct Token *t,
+                                   size_t count, int at_column0, char *name) {
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (t[i].punct == '=' || t[i].punct == '{') return 0;
+        if (lang->call_definitions && t[i].punct == '(') return 0;
+        if (t[i].punct != 0) continue;
+
+        int is_def = token_in(&t[i], lang->def_keywords);
+        int is_type = token_in(&t[i], lang->type_keywords);
+        int is_toplevel = at_column0 && token_in(&t[i], lang->toplevel_keywords);
+        if (!is_def && !is_type && !is_toplevel) continue;
+
+        size_t j = i + 1;
+        if (j < count && t[j].punct == '!') j++;
+        if (j < count && t[j].punct == '(') j = skip_group(t, count, j, '(', ')');
+        if (j < count && t[j].punct == '<') j = skip_group(t, count, j, '<', '>');
+        if (j >= count || t[j].punct != 0) continue;
+
+        if (is_type && j + 1 < count && t[j + 1].punct != '{' &&
+            t[j + 1].punct != ':' && t[j + 1].punct != ';') {
+            continue;
+        }
+
+        copy_name(name, t[j].start, t[j].len);
+        return 1;
+    }
+    return 0;
+}
+
+/* key: value, key = value, "key": value and [section] lines */
+static int find_config_key(const char *line, size_t len, char *name) {
+    size_t i = 0;
+    while (i < len && (char_class[(unsigned char)line[i]] == CC_SPACE || line[i] == '-')) i++;
+    if (i == len || line[i] == '#' || line[i] == ';') return 0;
+
+    if (line[i] == '[') {
+        const char *close = memchr(line + i, ']', len - i);
+        if (!close) return 0;
+        while (close + 1 < line + len && close[1] == ']') close++;
+        copy_name(name, line + i, (size_t)(close - (line + i)) + 1);
+        return 1;
+    }
+
+    size_t start = i;
+    size_t end;
+    if (line[i] == '"') {
+        start = ++i;
+        while (i < len && line[i] != '"') i++;
+        if (i == len) return 0;
+        end = i++;
+    } else {
+        while (i < len && (char_class[(unsigned char)line[i]] == CC_IDENT ||
+                           char_class[(unsigned char)line[i]] == CC_DIGIT ||
+                           line[i] == '.' || line[i] == '-')) {
+            i++;
+        }
+        end = i;
+    }
+    while (i < len && char_class[(unsigned char)line[i]] == CC_SPACE) i++;
+    if (end == start || i == len || (line[i] != ':' && line[i] != '=')) return 0;
+
+    copy_name(name, line + start, end - start);
+    return 1;
+}
+
+/* Find the symbol a source line defines, if any */
+static int find_definition(const struct LanguageSpec *lang, const char *line, size_t len,
+                           int *in_block, char *name) {
+    if (lang->config_keys) {
+        return find_config_key(line, len, name);
+    }
+
+    struct Token tokens[MAX_LINE_TOKENS];
+    size_t count = tokenize_line(lang, line, len, in_block, tokens, MAX_LINE_TOKENS);
+    if (count < 2) return 0;
+
+    if (lang->preprocessor && tokens[0].punct == '#' && count >= 3 &&
+        token_is(&tokens[1], "define") && tokens[2].punct == 0) {
+        copy_name(name, tokens[2].start, tokens[2].len);
+        return 1;
+    }
+
+    if (lang->call_definitions && find_call_definition(tokens, count, name)) {
+        return 1;
+    }
+
+    int at_column0 = len > 0 && char_class[(unsigned char)line[0]] != CC_SPACE;
+    return find_keyword_definition(lang, tokens, count, at_column0, name);
+}
+
+/* Changed lines that carry no meaning: blank or comment only */
+static int is_low_value_line(const struct LanguageSpec *lang, const char *line, size_t len) {
+    size_t i = 0;
+    while (i < len && (char_class[(unsigned char)line[i]] == CC_SPACE || line[i] == '\n')) i++;
+    if (i == len) return 1;
+    if (!lang) return 0;
+
+    if (lang->line_comment && starts_with(line + i, len - i, lang->line_comment)) return 1;
+    if (lang->block_open && (starts_with(line + i, len - i, lang->block_open) ||
+                             (line[i] == '*' && !starts_with(line + i, len - i, "*/") &&
+                              (i + 1 == len || line[i + 1] == ' ')))) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Unified diff walker. Hunk line counts from the "@@ -a,b +c,d @@" header
+ * decide where a hunk ends, so removed lines that start with "--" are not
+ * mistaken for file headers.
+ */
+enum DiffLineKind {
+    DIFF_END = 0,
+    DIFF_FILE_START,    /* "diff --git", or "---" opening a plain diff */
+    DIFF_FILE_HEADER,   /* index, ---, +++, mode and rename lines */
+    DIFF_HUNK,
+    DIFF_ADDED,
+    DIFF_REMOVED,
+    DIFF_CONTEXT,
+    DIFF_OTHER          /* "\ No newline at end of file" */
+};
+
+struct DiffWalker {
+    const char *pos;
+    long old_left;
+    long new_left;
+    int file_has_hunks;
+};
+
+static long parse_hunk_count(const char *s, long *count) {
+    char *end = NULL;
+    long start = strtol(s, &end, 10);
+    *count = 1;
+    if (end && *end == ',') {
+        *count = strtol(end + 1, NULL, 10);
+    }
+    return start;
+}
+
+static enum DiffLineKind diff_next(struct DiffWalker *w, const char **line, size_t *len) {
+    if (!*w->pos) return DIFF_END;
+
+    const char *start = w->pos;
+    const char *newline = strchr(start, '\n');
+    *line = start;
+    *len = newline ? (size_t)(newline - start) : strlen(start);
+    w->pos = newline ? newline + 1 : start + *len;
+
+    if (w->old_left > 0 || w->new_left > 0) {
+        char c = *len ? start[0] : ' ';
+        if (c == '+') {
+            w->new_left--;
+            return DIFF_ADDED;
+        }
+        if (c == '-') {
+            w->old_left--;
+            return DIFF_REMOVED;
+        }
+        if (c == ' ') {
+            w->old_left--;
+            w->new_left--;
+            return DIFF_CONTEXT;
+        }
+        if (c == '\\') {
+            return DIFF_OTHER;
+        }
+        // Truncated hunk: treat the line as a header
+        w->old_left = w->new_left = 0;
+    }
+
+    if (starts_with(start, *len, "diff ")) {
+        w->file_has_hunks = 0;
+        return DIFF_FILE_START;
+    }
+    if (starts_with(start, *len, "@@ -")) {
+        const char *plus = strstr(start, " +");
+        parse_hunk_count(start + 4, &w->old_left);
+        if (plus && plus < start + *len) {
+            parse_hunk_count(plus + 2, &w->new_left);
+        }
+        w->file_has_hunks = 1;
+        return DIFF_HUNK;
+    }
+    if (starts_with(start, *len, "--- ") && w->file_has_hunks) {
+        w->file_has_hunks = 0;
+        return DIFF_FILE_START;
+    }
+    if (starts_with(start, *len, "\\")) {
+        return DIFF_OTHER;
+    }
+    return DIFF_FILE_HEADER;
+}
+
+/* Path named by a "diff --git a/x b/x", "+++ b/x" or "--- a/x" line, or 0 */
+static int diff_line_path(const char *line, size_t len, char *path, size_t path_size) {
+    const char *p = NULL;
+    size_t n = 0;
+
+    if (starts_with(line, len, "diff --git ")) {
+        const char *b = NULL;
+        for (const char *s = line; s + 3 <= line + len; s++) {
+            if (memcmp(s, " b/", 3) == 0) b = s;
+        }
+        if (!b) return 0;
+        p = b + 3;
+        n = (size_t)(line + len - p);
+    } else if (starts_with(line, len, "+++ ") || starts_with(line, len, "--- ")) {
+        p = line + 4;
+        n = len - 4;
+        if (starts_with(p, n, "/dev/null")) return 0;
+        if (starts_with(p, n, "a/") || starts_with(p, n, "b/")) {
+            p += 2;
+            n -= 2;
+        }
+        // Plain diffs append a tab and a timestamp
+        const char *tab = memchr(p, '\t', n);
+        if (tab) n = (size_t)(tab - p);
+    } else {
+        return 0;
+    }
+
+    while (n > 0 && (p[n - 1] == '\r' || p[n - 1] == ' ')) n--;
+    if (n == 0) return 0;
+    if (n >= path_size) n = path_size - 1;
+    memcpy(path, p, n);
+    path[n] = '\0';
+    return 1;
+}
+
+/* Text after the second "@@" of a hunk header: the enclosing function */
+static const char* hunk_context(const char *line, size_t len, size_t *context_len) {
+    const char *end = line + len;
+    const char *p = line + 2;
+    while (p + 1 < end && !(p[0] == '@' && p[1] == '@')) p++;
+    if (p + 1 >= end) return NULL;
+    p += 2;
+    while (p < end && *p == ' ') p++;
+    *context_len = (size_t)(end - p);
+    return *context_len ? p : NULL;
+}
+
+/* Output buffer helpers on top of WriteMemoryCallback's geometric growth */
+static int append_text(struct MemoryStruct *out, const char *text, size_t len) {
+    if (len == 0) return 1;
+    return WriteMemoryCallback((void *)text, 1, len, out) == len;
+}
+
+static int append_format(struct MemoryStruct *out, const char *format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if ((size_t)len >= sizeof(buffer)) len = (int)sizeof(buffer) - 1;
+    return append_text(out, buffer, (size_t)len);
+}
+
+static char* finish_output(struct MemoryStruct *out, int ok, const char *what) {
+    if (ok && memory_reserve(out, 0)) {
+        return out->memory;
+    }
+    fprintf(stderr, "Error: Memory allocation failed for %s\n", what);
+    mem_free(out->memory);
+    return NULL;
+}
+
+#define SYMBOL_ADDED   0x1  /* defined on an added line */
+#define SYMBOL_REMOVED 0x2  /* defined on a removed line */
+#define SYMBOL_BODY    0x4  /* lines inside it changed */
+
+struct Symbol {
+    char name[MAX_SYMBOL_NAME];
+    unsigned flags;
+};
+
+/* Symbols of the file being walked */
+struct FileDigest {
+    char path[512];
+    const struct LanguageSpec *lang;
+    struct Symbol symbols[DIGEST_MAX_SYMBOLS_PER_FILE];
+    size_t count;
+    size_t dropped;
+    size_t added_lines;
+    size_t removed_lines;
+    int created;
+    int deleted;
+};
+
+/* Per-file numbers kept for the local summary */
+struct FileStat {
+    char path[512];
+    size_t added_lines;
+    size_t removed_lines;
+    int created;
+    int deleted;
+    const char *language;   /* name from the language table, or NULL */
+    size_t symbols_changed; /* including the ones dropped from the digest */
+    char symbols[2][MAX_SYMBOL_NAME];
+    size_t symbol_count;
+};
+
+struct DiffSummary {
+    struct FileStat *files;
+    size_t count;
+    size_t capacity;
+};
+
+static void file_set_path(struct FileDigest *file, const char *line, size_t len) {
+    if (diff_line_path(line, len, file->path, sizeof(file->path))) {
+        file->lang = language_for_path(file->path);
+    }
+}
+
+static void file_add_symbol(struct FileDigest *file, const char *name, unsigned flags) {
+    for (size_t i = 0; i < file->count; i++) {
+        if (strcmp(file->symbols[i].name, name) == 0) {
+            file->symbols[i].flags |= flags;
+            return;
+        }
+    }
+    if (file->count == DIGEST_MAX_SYMBOLS_PER_FILE) {
+        file->dropped++;
+        return;
+    }
+    strcpy(file->symbols[file->count].name, name);
+    file->symbols[file->count].flags = flags;
+    file->count++;
+}
+
+static int append_symbol_list(struct MemoryStruct *out, const struct FileDigest *file,
+                              const char *label, unsigned want) {
+    int ok = 1;
+    int listed = 0;
+    for (size_t i = 0; ok && i < file->count; i++) {
+        unsigned flags = file->symbols[i].flags;
+        unsigned kind = (flags & SYMBOL_ADDED) && (flags & SYMBOL_REMOVED) ? SYMBOL_BODY :
+                        (flags & SYMBOL_ADDED) ? SYMBOL_ADDED :
+                        (flags & SYMBOL_REMOVED) ? SYMBOL_REMOVED : SYMBOL_BODY;
+        if (kind != want) continue;
+        if (listed) {
+            ok = append_format(out, ", %s", file->symbols[i].name);
+        } else {
+            ok = append_format(out, "  %s: %s", label, file->symbols[i].name);
+        }
+        listed = 1;
+    }
+    if (ok && listed) ok = append_text(out, "\n", 1);
+    return ok;
+}
+
+static int summary_add_file(struct DiffSummary *summary, const struct FileDigest *file) {
+    if (summary->count == summary->capacity) {
+        size_t capacity = summary->capacity ? summary->capacity * 2 : 16;
+        struct FileStat *grown = mem_realloc(summary->files, capacity * sizeof(*grown));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed for diff summary\n");
+            return 0;
+        }
+        summary->files = grown;
+        summary->capacity = capacity;
+    }
+
+    struct FileStat *stat = &summary->files[summary->count++];
+    memset(stat, 0, sizeof(*stat));
+    strcpy(stat->path, file->path);
+    stat->added_lines = file->added_lines;
+    stat->removed_lines = file->removed_lines;
+    stat->created = file->created;
+    stat->deleted = file->deleted;
+    stat->language = file->lang ? file->lang->name : NULL;
+    stat->symbols_changed = file->count + file->dropped;
+    for (size_t i = 0; i < file->count && stat->symbol_count < 2; i++) {
+        strcpy(stat->symbols[stat->symbol_count++], file->symbols[i].name);
+    }
+    return 1;
+}
+
+static int flush_file(struct MemoryStruct *out, struct FileDigest *file, struct DiffSummary *summary) {
+    int ok = 1;
+    if (summary && file->path[0] &&
+        (file->added_lines || file->removed_lines || file->created || file->deleted)) {
+        ok = summary_add_file(summary, file);
+    }
+    if (ok && out && file->path[0] && (file->added_lines || file->removed_lines || file->count)) {
+        if (file->lang) {
+            ok = append_format(out, "%s (%s, +%zu -%zu)\n", file->path, file->lang->name,
+                               file->added_lines, file->removed_lines);
+        } else {
+            ok = append_format(out, "%s (+%zu -%zu)\n", file->path,
+                               file->added_lines, file->removed_lines);
+        }
+        ok = ok && append_symbol_list(out, file, "modified", SYMBOL_BODY);
+        ok = ok && append_symbol_list(out, file, "added", SYMBOL_ADDED);
+        ok = ok && append_symbol_list(out, file, "removed", SYMBOL_REMOVED);
+        if (ok && file->dropped) {
+            ok = append_format(out, "  (%zu more symbols)\n", file->dropped);
+        }
+    }
+
+    file->path[0] = '\0';
+    file->lang = NULL;
+    file->count = 0;
+    file->dropped = 0;
+    file->added_lines = 0;
+    file->removed_lines = 0;
+    file->created = 0;
+    file->deleted = 0;
+    return ok;
+}
+
+// Function to parse a --digest argument
+int parse_digest_mode(const char *name, enum DigestMode *mode) {
+    if (strcmp(name, "off") == 0) {
+        *mode = DIGEST_OFF;
+    } else if (strcmp(name, "prepend") == 0) {
+        *mode = DIGEST_PREPEND;
+    } else if (strcmp(name, "compact") == 0) {
+        *mode = DIGEST_COMPACT;
+    } else {
+        fprintf(stderr, "Error: Unknown digest mode: %s (use off, prepend or compact)\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/* Walk a diff, appending the digest to out and per-file numbers to summary, each if given */
+static int walk_digest(const char *git_diff, struct MemoryStruct *out, struct DiffSummary *summary) {
+    struct FileDigest *file = mem_calloc(1, sizeof(*file));
+    if (!file) {
+        fprintf(stderr, "Error: Memory allocation failed for symbol digest\n");
+        return 0;
+    }
+
+    struct DiffWalker walker;
+    memset(&walker, 0, sizeof(walker));
+    walker.pos = git_diff;
+
+    char scope[MAX_SYMBOL_NAME] = "";
+    char name[MAX_SYMBOL_NAME];
+    int old_block = 0, new_block = 0;
+    int ok = 1;
+    const char *line;
+    size_t len;
+    enum DiffLineKind kind;
+
+    while (ok && (kind = diff_next(&walker, &line, &len)) != DIFF_END) {
+        switch (kind) {
+            case DIFF_FILE_START:
+                ok = flush_file(out, file, summary);
+                file_set_path(file, line, len);
+                file->created = starts_with(line, len, "--- /dev/null");
+                break;
+            case DIFF_FILE_HEADER:
+                if (!file->path[0] || starts_with(line, len, "+++ ")) {
+                    file_set_path(file, line, len);
+                }
+                if (starts_with(line, len, "new file") || starts_with(line, len, "--- /dev/null")) {
+                    file->created = 1;
+                } else if (starts_with(line, len, "deleted file") || starts_with(line, len, "+++ /dev/null")) {
+                    file->deleted = 1;
+                }
+                break;
+            case DIFF_HUNK: {
+                size_t context_len = 0;
+                const char *context = hunk_context(line, len, &context_len);
+                int in_block = 0;
+                scope[0] = '\0';
+                old_block = new_block = 0;
+                if (context && file->lang && !file->lang->config_keys) {
+                    find_definition(file->lang, context, context_len, &in_block, scope);
+                }
+                break;
+            }
+            case DIFF_CONTEXT:
+                if (file->lang && find_definition(file->lang, line + 1, len - 1, &new_block, name) &&
+                    !file->lang->config_keys) {
+                    strcpy(scope, name);
+                }
+                old_block = new_block;
+                break;
+            case DIFF_ADDED:
+            case DIFF_REMOVED: {
+                int added = kind == DIFF_ADDED;
+                if (added) {
+                    file->added_lines++;
+                } else {
+                    file->removed_lines++;
+                }
+                if (!file->lang || is_low_value_line(file->lang, line + 1, len - 1)) {
+                    break;
+                }
+                if (find_definition(file->lang, line + 1, len - 1, added ? &new_block : &old_block, name)) {
+                    file_add_symbol(file, name, added ? SYMBOL_ADDED : SYMBOL_REMOVED);
+                    if (!file->lang->config_keys) {
+                        strcpy(scope, name);
+                    }
+                } else if (scope[0]) {
+                    file_add_symbol(file, scope, SYMBOL_BODY);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    ok = ok && flush_file(out, file, summary);
+    mem_free(file);
+    return ok;
+}
+
+// Function to list the symbols each file of a diff adds, removes or modifies
+char* build_symbol_digest(const char *git_diff) {
+    struct MemoryStruct out;
+    memset(&out, 0, sizeof(out));
+
+    int ok = walk_digest(git_diff, &out, NULL);
+    char *digest = finish_output(&out, ok, "symbol digest");
+    if (digest) {
+        debug_print("Symbol digest: %zu bytes for a %zu byte diff", out.size, strlen(git_diff));
+    }
+    return digest;
+}
+
+/* Count the changed lines of the hunk the walker is in that compact mode keeps */
+static size_t count_hunk_changes(const struct DiffWalker *walker, const struct LanguageSpec *lang) {
+    struct DiffWalker ahead = *walker;
+    const char *line;
+    size_t len;
+    size_t changed = 0;
+    enum DiffLineKind kind;
+
+    while (ahead.old_left > 0 || ahead.new_left > 0) {
+        kind = diff_next(&ahead, &line, &len);
+        if (kind == DIFF_ADDED || kind == DIFF_REMOVED) {
+            changed += !is_low_value_line(lang, line + 1, len - 1);
+        } else if (kind != DIFF_CONTEXT && kind != DIFF_OTHER) {
+            break;
+        }
+    }
+    return changed;
+}
+
+// Function to count the files, changed lines, languages and symbols of a diff
+int measure_diff(const char *git_diff, struct DiffStats *stats) {
+    struct DiffSummary summary;
+    memset(&summary, 0, sizeof(summary));
+    memset(stats, 0, sizeof(*stats));
+
+    int ok = walk_digest(git_diff, NULL, &summary);
+
+    // Distinct languages, compared by their table entry name
+    const char *seen[sizeof(languages) / sizeof(languages[0])];
+    for (size_t i = 0; ok && i < summary.count; i++) {
+        const struct FileStat *file = &summary.files[i];
+        stats->files++;
+        stats->lines += file->added_lines + file->removed_lines;
+        stats->symbols += file->symbols_changed;
+
+        int known = !file->language;
+        for (size_t j = 0; j < stats->languages && !known; j++) {
+            known = seen[j] == file->language;
+        }
+        if (!known) {
+            seen[stats->languages++] = file->language;
+        }
+    }
+
+    mem_free(summary.files);
+    return ok;
+}
+
+// Function to condense a diff to its file headers, hunk headers and meaningful changed lines
+char* compact_diff(const char *git_diff) {
+    struct MemoryStruct out;
+    memset(&out, 0, sizeof(out));
+
+    struct DiffWalker walker;
+    memset(&walker, 0, sizeof(walker));
+    walker.pos = git_diff;
+
+    char path[512] = "";
+    const struct LanguageSpec *lang = NULL;
+    size_t hunk_changes = 0, hunk_kept = 0;
+    int git_header = 0;
+    int ok = 1;
+    const char *line;
+    size_t len;
+    enum DiffLineKind kind;
+
+    while (ok && (kind = diff_next(&walker, &line, &len)) != DIFF_END) {
+        switch (kind) {
+            case DIFF_FILE_START:
+                git_header = starts_with(line, len, "diff --git ");
+                /* fall through */
+            case DIFF_FILE_HEADER:
+                if (diff_line_path(line, len, path, sizeof(path))) {
+                    lang = language_for_path(path);
+                }
+                // The diff --git line already names the file
+                if (!starts_with(line, len, "index ") &&
+                    !(git_header && (starts_with(line, len, "--- ") || starts_with(line, len, "+++ ")))) {
+                    ok = append_text(&out, line, len) && append_text(&out, "\n", 1);
+                }
+                break;
+            case DIFF_HUNK:
+                hunk_changes = count_hunk_changes(&walker, lang);
+                hunk_kept = 0;
+                ok = append_text(&out, line, len) && append_text(&out, "\n", 1);
+                break;
+            case DIFF_ADDED:
+            case DIFF_REMOVED:
+                if (is_low_value_line(lang, line + 1, len - 1)) {
+                    break;
+                }
+                if (hunk_changes <= COMPACT_MAX_HUNK_LINES || hunk_kept < COMPACT_KEPT_HUNK_LINES) {
+                    ok = append_text(&out, line, len) && append_text(&out, "\n", 1);
+                } else if (hunk_kept == COMPACT_KEPT_HUNK_LINES) {
+                    ok = append_format(&out, "[... %zu more changed lines]\n",
+                                       hunk_changes - COMPACT_KEPT_HUNK_LINES);
+                }
+                hunk_kept++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    char *condensed = finish_output(&out, ok, "condensed diff");
+    if (condensed) {
+        debug_print("Condensed diff: %zu bytes from %zu", out.size, strlen(git_diff));
+    }
+    return condensed;
+}
+
+static const char* path_basename(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/* Length of the directory part two paths share, up to and excluding a '/' */
+static size_t common_dir_length(const char *a, size_t a_len, const char *b) {
+    size_t common = 0;
+    for (size_t i = 0; i < a_len && a[i] && a[i] == b[i]; i++) {
+        if (a[i] == '/') common = i;
+    }
+    return common;
+}
+
+/* Index of the file with the most changed lines, skipping one index */
+static size_t largest_file(const struct DiffSummary *summary, size_t skip) {
+    size_t best = summary->count;
+    for (size_t i = 0; i < summary->count; i++) {
+        if (i == skip) continue;
+        size_t lines = summary->files[i].added_lines + summary->files[i].removed_lines;
+        if (best == summary->count ||
+            lines > summary->files[best].added_lines + summary->files[best].removed_lines) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void build_local_title(const struct DiffSummary *summary, char *title, size_t size) {
+    size_t created = 0, deleted = 0;
+    for (size_t i = 0; i < summary->count; i++) {
+        created += summary->files[i].created;
+        deleted += summary->files[i].deleted;
+    }
+    const char *verb = created == summary->count ? "Add" :
+                       deleted == summary->count ? "Remove" : "Update";
+
+    if (summary->count == 0) {
+        snprintf(title, size, "Update files");
+        return;
+    }
+
+    if (summary->count == 1) {
+        const struct FileStat *file = &summary->files[0];
+        const char *base = path_basename(file->path);
+        if (file->created || file->deleted || file->symbol_count == 0) {
+            snprintf(title, size, "%s %s", verb, base);
+        } else if (file->symbol_count == 1) {
+            snprintf(title, size, "Update %s in %s", file->symbols[0], base);
+        } else {
+            snprintf(title, size, "Update %s and %s in %s", file->symbols[0], file->symbols[1], base);
+        }
+    } else {
+        // Files under one directory are named by the directory
+        size_t dir_len = strlen(summary->files[0].path);
+        for (size_t i = 1; i < summary->count && dir_len > 0; i++) {
+            dir_len = common_dir_length(summary->files[0].path, dir_len, summary->files[i].path);
+        }
+
+        size_t first = largest_file(summary, summary->count);
+        size_t second = largest_file(summary, first);
+        const char *a = path_basename(summary->files[first].path);
+        const char *b = path_basename(summary->files[second].path);
+
+        if (dir_len > 0) {
+            snprintf(title, size, "%s %zu files in %.*s", verb, summary->count, (int)dir_len,
+                     summary->files[0].path);
+        } else if (summary->count == 2) {
+            snprintf(title, size, "%s %s and %s", verb, a, b);
+        } else {
+            snprintf(title, size, "%s %s, %s and %zu more file%s", verb, a, b, summary->count - 2,
+                     summary->count == 3 ? "" : "s");
+        }
+    }
+
+    // Keep to a commit subject line
+    if (strlen(title) > LOCAL_TITLE_MAX) {
+        snprintf(title, size, "%s %zu file%s", verb, summary->count, summary->count == 1 ? "" : "s");
+    }
+}
+
+// Function to describe a diff without the API: diffstat, directories and changed symbols
+int build_local_summary(const char *git_diff, char **title, char **description) {
+    struct MemoryStruct digest;
+    memset(&digest, 0, sizeof(digest));
+    struct DiffSummary summary;
+    memset(&summary, 0, sizeof(summary));
+
+    int ok = walk_digest(git_diff, &digest, &summary);
+
+    // Room for two paths and two symbols; over-long titles are shortened after formatting
+    char title_buffer[1280];
+    build_local_title(&summary, title_buffer, sizeof(title_buffer));
+
+    struct MemoryStruct out;
+    memset(&out, 0, sizeof(out));
+
+    size_t added = 0, removed = 0;
+    for (size_t i = 0; i < summary.count; i++) {
+        added += summary.files[i].added_lines;
+        removed += summary.files[i].removed_lines;
+    }
+
+    if (ok && summary.count == 0) {
+        ok = append_format(&out, "No file changes could be read from the diff.");
+    } else if (ok) {
+        ok = append_format(&out, "%zu file%s changed, %zu insertion%s(+), %zu deletion%s(-)\n\n",
+                           summary.count, summary.count == 1 ? "" : "s",
+                           added, added == 1 ? "" : "s", removed, removed == 1 ? "" : "s");
+
+        // Top-level directories, in order of first appearance
+        ok = ok && append_text(&out, "Touched directories:", 20);
+        size_t listed = 0;
+        for (size_t i = 0; ok && i < summary.count && listed < LOCAL_MAX_DIRECTORIES; i++) {
+            const char *path = summary.files[i].path;
+            const char *slash = strchr(path, '/');
+            size_t len = slash ? (size_t)(slash - path) : 0;
+
+            int seen = 0;
+            for (size_t j = 0; j < i && !seen; j++) {
+                const char *other = summary.files[j].path;
+                const char *other_slash = strchr(other, '/');
+                size_t other_len = other_slash ? (size_t)(other_slash - other) : 0;
+                seen = other_len == len && strncmp(path, other, len) == 0;
+            }
+            if (seen) continue;
+
+            if (len) {
+                ok = append_format(&out, " %.*s/", (int)len, path);
+            } else {
+                ok = append_text(&out, " ./", 3);
+            }
+            listed++;
+        }
+        ok = ok && append_text(&out, "\n\n", 2);
+
+        ok = ok && append_text(&out, "Changed files and symbols:\n", 27);
+        ok = ok && append_text(&out, digest.memory, digest.size);
+
+        // No trailing newline, like a parsed API description
+        while (ok && out.size > 0 && out.memory[out.size - 1] == '\n') {
+            out.memory[--out.size] = '\0';
+        }
+    }
+
+    mem_free(summary.files);
+    mem_free(digest.memory);
+
+    char *text = finish_output(&out, ok, "local summary");
+    if (!text) {
+        return 0;
+    }
+
+    *title = str_duplicate(title_buffer);
+    if (!*title) {
+        fprintf(stderr, "Error: Memory allocation failed for local summary\n");
+        mem_free(text);
+        return 0;
+    }
+    *description = text;
+    return 1;
+}
@@ -0,0 +1,70 @@
+/**
+ * Claude API Client - Changed-symbol digest
+ *
+ * A local pass over a unified diff that finds the functions, types and
+ * config keys each hunk adds, removes or modifies. Each supported language
+ * (C/C++, Go, Python, Rust, Java, TypeScript/JavaScript and config files)
+ * is described by one table entry: file extensions, comment and quote
+ * syntax, and the keywords that introduce a named definition. The
+ * "@@ ... @@ func" hunk header is the fallback for the enclosing symbol when
+ * no definition is visible in the hunk.
+ *
+ * With --digest the digest is added to the prompt:
+ *
+ *   prepend   digest followed by the full diff
+ *   compact   digest followed by a condensed diff: context lines, index
+ *             and ---/+++ lines and blank or comment-only changes are
+ *             dropped, and long hunks are cut to their first lines
+ *
+ * build_local_summary() turns the same pass into a title and description
+ * (diffstat, touched directories, changed symbols) for when the API does
+ * not answer within --deadline.
+ *
+ * measure_diff() reduces the same pass to a few counts, which --route uses
+ * to pick a model tier.
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+
+enum DigestMode {
+    DIGEST_OFF = 0,
+    DIGEST_PREPEND,
+    DIGEST_COMPACT
+};
+
+/* Size and spread of a diff, as counted by measure_diff() */
+struct DiffStats {
+    size_t files;
+    size_t lines;       /* added plus removed */
+    size_t languages;   /* distinct recognized languages */
+    size_t symbols;     /* functions, types and keys touched */
+};
+
+/* How build_prompt() uses the digest */
+extern enum DigestMode digest_mode;
+
+/* Symbols listed per file before the rest are only counted */
+#define DIGEST_MAX_SYMBOLS_PER_FILE 64
+
+/* Hunks with more changed lines than this are cut in compact mode */
+#define COMPACT_MAX_HUNK_LINES 16
+
+/* Changed lines kept from a hunk that is cut */
+#define COMPACT_KEPT_HUNK_LINES 8
+
+/* Longest title build_local_summary() writes */
+#define LOCAL_TITLE_MAX 72
+
+/* Top-level directories listed by build_local_summary() */
+#define LOCAL_MAX_DIRECTORIES 8
+
+int parse_digest_mode(const char *name, enum DigestMode *mode);
+char* build_symbol_digest(const char *git_diff);
+char* compact_diff(const char *git_diff);
+int build_local_summary(const char *git_diff, char **title, char **description);
+int measure_diff(const char *git_diff, struct DiffStats *stats);
+
+#endif /* SYMBOLS_H */
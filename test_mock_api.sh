@@ -0,0 +1,531 @@
+#!/bin/bash
+# test_mock_api.sh - Offline end-to-end tests for git-commit-ai against the
+# bundled mock Messages API server (no API key or network access needed)
+
+# Colors for output
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+YELLOW='\033[0;33m'
+NC='\033[0m' # No Color
+
+PROGRAM_NAME="git-commit-ai"
+MOCK_SERVER="./release/mock_server"
+LOAD_DRIVER="./release/load_driver"
+PORT="${MOCK_PORT:-18089}"
+BASE_URL="http://127.0.0.1:${PORT}"
+FAILURES=0
+
+echo -e "${YELLOW}${PROGRAM_NAME} Offline Test Script${NC}"
+echo "--------------------------------"
+
+# Check if the program and tools exist
+if [ ! -f "./${PROGRAM_NAME}" ] || [ ! -f "$MOCK_SERVER" ] || [ ! -f "$LOAD_DRIVER" ]; then
+    echo -e "${RED}Error: ${PROGRAM_NAME} or the test tools are missing${NC}"
+    echo "Please run 'make all tools' first"
+    exit 1
+fi
+
+# Create temporary directory
+TEMP_DIR=$(mktemp -d)
+MOCK_PID=""
+
+# Keep the latency histograms of the test runs out of ~/.cache
+export XDG_CACHE_HOME="$TEMP_DIR/cache"
+
+cleanup() {
+    if [ -n "$MOCK_PID" ]; then
+        kill "$MOCK_PID" 2>/dev/null
+        wait "$MOCK_PID" 2>/dev/null
+    fi
+    rm -rf "$TEMP_DIR"
+}
+trap cleanup EXIT
+
+# Start the mock server with the given options and wait until it answers
+start_mock() {
+    if [ -n "$MOCK_PID" ]; then
+        kill "$MOCK_PID" 2>/dev/null
+        wait "$MOCK_PID" 2>/dev/null
+    fi
+    "$MOCK_SERVER" -p "$PORT" "$@" > "$TEMP_DIR/mock.log" 2>&1 &
+    MOCK_PID=$!
+    for _ in $(seq 1 50); do
+        if grep -q "listening" "$TEMP_DIR/mock.log" 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    echo -e "${RED}Error: mock server did not start${NC}"
+    cat "$TEMP_DIR/mock.log"
+    exit 1
+}
+
+pass() {
+    echo -e "${GREEN}$1 successful!${NC}"
+}
+
+fail() {
+    echo -e "${RED}$1 failed${NC}"
+    FAILURES=$((FAILURES + 1))
+}
+
+# Test fixtures
+echo "sk-ant-mock-key" > "$TEMP_DIR/api_key.txt"
+echo "I am a C developer who prefers short imperative commit titles." > "$TEMP_DIR/profile.txt"
+cat > "$TEMP_DIR/test.diff" << ENDDIFF
+diff --git a/main.c b/main.c
+index 12345..67890 100644
+--- a/main.c
++++ b/main.c
+@@ -25,6 +25,9 @@ int main(int argc, char *argv[]) {
+
+     process_data(buffer);
+
++    // Free resources properly
++    free(buffer);
++
+     return 0;
+ }
+ENDDIFF
+
+COMMON_ARGS=(-u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" -d "$TEMP_DIR/test.diff")
+OUTPUT_FILE="$TEMP_DIR/result.md"
+
+# Test 1: Plain response through -u
+echo -e "${YELLOW}Test 1: Non-streaming response via -u...${NC}"
+start_mock
+rm -f "$OUTPUT_FILE"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" -o "$OUTPUT_FILE" > /dev/null &&
+   grep -q "^# Add mock response for offline testing" "$OUTPUT_FILE"; then
+    pass "Test 1"
+else
+    fail "Test 1"
+fi
+
+# Test 2: Base URL from the environment, chunked transfer with a trailing slash
+echo -e "${YELLOW}Test 2: Chunked response via ANTHROPIC_BASE_URL...${NC}"
+start_mock -c 7 -e 1
+rm -f "$OUTPUT_FILE"
+if ANTHROPIC_BASE_URL="${BASE_URL}/" ./${PROGRAM_NAME} -k "$TEMP_DIR/api_key.txt" \
+       -p "$TEMP_DIR/profile.txt" -d "$TEMP_DIR/test.diff" -o "$OUTPUT_FILE" > /dev/null &&
+   grep -q "^# Add mock response for offline testing" "$OUTPUT_FILE"; then
+    pass "Test 2"
+else
+    fail "Test 2"
+fi
+
+# Test 3: Injected 429 must surface as a failure
+echo -e "${YELLOW}Test 3: Injected 429 response...${NC}"
+start_mock -q 1
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" > /dev/null 2> "$TEMP_DIR/err.txt"; then
+    fail "Test 3"
+elif grep -q "HTTP code 429" "$TEMP_DIR/err.txt"; then
+    pass "Test 3"
+else
+    fail "Test 3"
+fi
+
+# Test 4: Load driver against a latency distribution
+echo -e "${YELLOW}Test 4: Load driver with 20 invocations at concurrency 4...${NC}"
+start_mock -l uniform:5:20
+if "$LOAD_DRIVER" -n 20 -c 4 -- ./${PROGRAM_NAME} "${COMMON_ARGS[@]}"; then
+    pass "Test 4"
+else
+    fail "Test 4"
+fi
+
+# Test 5: Record against the mock, then replay with the server stopped
+echo -e "${YELLOW}Test 5: Record and replay an exchange...${NC}"
+start_mock -c 16 -e 2
+RECORD_DIR="$TEMP_DIR/recording"
+./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --record "$RECORD_DIR" > "$TEMP_DIR/recorded.txt"
+kill "$MOCK_PID" 2>/dev/null
+wait "$MOCK_PID" 2>/dev/null
+MOCK_PID=""
+if ./${PROGRAM_NAME} -u "http://127.0.0.1:1" -k "$TEMP_DIR/missing_key.txt" \
+       -p "$TEMP_DIR/profile.txt" -d "$TEMP_DIR/test.diff" \
+       --replay "$RECORD_DIR" --replay-speed 0 > "$TEMP_DIR/replayed.txt" &&
+   [ -s "$TEMP_DIR/recorded.txt" ] && cmp -s "$TEMP_DIR/recorded.txt" "$TEMP_DIR/replayed.txt"; then
+    pass "Test 5"
+else
+    fail "Test 5"
+fi
+
+# Test 6: The compact digest names the changed function and drops context lines
+echo -e "${YELLOW}Test 6: Compact symbol digest in the request...${NC}"
+start_mock
+DIGEST_DIR="$TEMP_DIR/digest"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --digest compact --record "$DIGEST_DIR" > /dev/null &&
+   grep -q "modified: main" "$DIGEST_DIR/0.request.json" &&
+   ! grep -q "process_data" "$DIGEST_DIR/0.request.json"; then
+    pass "Test 6"
+else
+    fail "Test 6"
+fi
+
+# Test 7: A slow API under --deadline falls back to a local summary in time
+echo -e "${YELLOW}Test 7: Deadline with local fallback...${NC}"
+start_mock -l fixed:3000
+rm -f "$OUTPUT_FILE"
+START_MS=$(date +%s%3N)
+./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --deadline 300 -o "$OUTPUT_FILE" > /dev/null 2> "$TEMP_DIR/err.txt"
+STATUS=$?
+ELAPSED_MS=$(( $(date +%s%3N) - START_MS ))
+if [ "$STATUS" -eq 0 ] && [ "$ELAPSED_MS" -lt 2000 ] &&
+   grep -q "^# Update main in main.c" "$OUTPUT_FILE" &&
+   grep -q "1 file changed, 3 insertions" "$OUTPUT_FILE"; then
+    pass "Test 7"
+else
+    fail "Test 7"
+fi
+
+# Test 8: Precompute for the staged tree, then --staged with the server stopped
+echo -e "${YELLOW}Test 8: Precomputed message for staged changes...${NC}"
+start_mock
+PROGRAM_PATH="$PWD/${PROGRAM_NAME}"
+REPO_DIR="$TEMP_DIR/repo"
+STAGED_ARGS=(-k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt")
+git init -q "$REPO_DIR" && cp "$TEMP_DIR/test.diff" "$REPO_DIR/staged.txt" &&
+    git -C "$REPO_DIR" add staged.txt
+(cd "$REPO_DIR" && "$PROGRAM_PATH" -u "$BASE_URL" "${STAGED_ARGS[@]}" --precompute --debounce 0)
+kill "$MOCK_PID" 2>/dev/null
+wait "$MOCK_PID" 2>/dev/null
+MOCK_PID=""
+rm -f "$OUTPUT_FILE"
+if (cd "$REPO_DIR" && "$PROGRAM_PATH" -u "http://127.0.0.1:1" "${STAGED_ARGS[@]}" \
+        --staged -o "$OUTPUT_FILE" > /dev/null) &&
+   grep -q "^# Add mock response" "$OUTPUT_FILE"; then
+    pass "Test 8"
+else
+    fail "Test 8"
+fi
+
+# Test 9: Submit three diffs as one message batch, then poll and collect the results into the ledger
+echo -e "${YELLOW}Test 9: Message batch submit and collect...${NC}"
+start_mock -b 300
+BATCH_DIR="$TEMP_DIR/batch"
+mkdir -p "$BATCH_DIR/results"
+for i in 1 2 3; do
+    cp "$TEMP_DIR/test.diff" "$BATCH_DIR/change$i.diff"
+    echo "$BATCH_DIR/change$i.diff" >> "$BATCH_DIR/diffs.txt"
+done
+BATCH_ARGS=(-u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt")
+if ./${PROGRAM_NAME} "${BATCH_ARGS[@]}" --diff-list "$BATCH_DIR/diffs.txt" \
+       --batch-submit "$BATCH_DIR/batch.state" > /dev/null &&
+   ./${PROGRAM_NAME} "${BATCH_ARGS[@]}" --batch-collect "$BATCH_DIR/batch.state" \
+       --batch-poll 100 -o "$BATCH_DIR/results" --ledger "$BATCH_DIR/ledger.ndjson" > "$BATCH_DIR/collect.txt" &&
+   grep -q "in_progress" "$BATCH_DIR/collect.txt" &&
+   grep -q "3 succeeded, 0 failed" "$BATCH_DIR/collect.txt" &&
+   grep -q "^# Add mock response" "$BATCH_DIR/results/2-change3_diff.md" &&
+   [ "$(grep -c '"http":200,"latency_ms":-1' "$BATCH_DIR/ledger.ndjson")" = "3" ]; then
+    pass "Test 9"
+else
+    fail "Test 9"
+fi
+
+# Test 10: Six small diffs packed into one request and split back per diff
+echo -e "${YELLOW}Test 10: Packed request for a diff list...${NC}"
+start_mock
+PACK_DIR="$TEMP_DIR/pack"
+mkdir -p "$PACK_DIR/results"
+for i in 1 2 3 4 5 6; do
+    cp "$TEMP_DIR/test.diff" "$PACK_DIR/fix$i.diff"
+    echo "$PACK_DIR/fix$i.diff" >> "$PACK_DIR/diffs.txt"
+done
+if ./${PROGRAM_NAME} -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+       --diff-list "$PACK_DIR/diffs.txt" --pack -o "$PACK_DIR/results" > "$PACK_DIR/out.txt" &&
+   grep -q "Processed 6 diffs with 1 requests" "$PACK_DIR/out.txt" &&
+   grep -q "^# Add mock response.*(5)" "$PACK_DIR/results/4-fix5_diff.md"; then
+    pass "Test 10"
+else
+    fail "Test 10"
+fi
+
+# Test 11: A small diff is routed to the fast tier and escalated when its answer has no description
+echo -e "${YELLOW}Test 11: Routing with escalation...${NC}"
+start_mock -v -m mock-fast
+rm -f "$OUTPUT_FILE"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --route --escalate --fast-model mock-fast \
+       --strong-model mock-strong -o "$OUTPUT_FILE" > /dev/null 2> "$TEMP_DIR/route.log" &&
+   grep -q "^Route: score .* -> fast (mock-fast)" "$TEMP_DIR/route.log" &&
+   grep -q "^Route: escalating to strong (mock-strong)" "$TEMP_DIR/route.log" &&
+   grep -q "model=mock-strong" "$TEMP_DIR/mock.log" &&
+   grep -q "^This response was generated" "$OUTPUT_FILE"; then
+    pass "Test 11"
+else
+    fail "Test 11"
+fi
+
+# Test 12: Streamed chat completion from an OpenAI-compatible server, read back as a message
+echo -e "${YELLOW}Test 12: OpenAI-compatible backend...${NC}"
+start_mock -v -e 1
+rm -f "$OUTPUT_FILE"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --backend openai --model local-model -o "$OUTPUT_FILE" > /dev/null &&
+   grep -q "chat stream model=local-model" "$TEMP_DIR/mock.log" &&
+   grep -q "^# Add mock response for offline testing" "$OUTPUT_FILE" &&
+   grep -q "^This response was generated" "$OUTPUT_FILE"; then
+    pass "Test 12"
+else
+    fail "Test 12"
+fi
+
+# Test 13: Three candidates from one request, all saved when not on a terminal
+echo -e "${YELLOW}Test 13: Candidates from one request...${NC}"
+start_mock -v
+rm -f "$OUTPUT_FILE"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --candidates 3 -o "$OUTPUT_FILE" < /dev/null > /dev/null &&
+   [ "$(grep -c "200 plain" "$TEMP_DIR/mock.log")" -eq 1 ] &&
+   grep -q "^# Add mock response for offline testing (1)" "$OUTPUT_FILE" &&
+   grep -q "^# Add mock response for offline testing (3)" "$OUTPUT_FILE" &&
+   [ "$(grep -c "^---$" "$OUTPUT_FILE")" -eq 2 ]; then
+    pass "Test 13"
+else
+    fail "Test 13"
+fi
+
+# Test 14: A message stored as a git note in one clone is reused from a fetched ref in another
+echo -e "${YELLOW}Test 14: Message cache in git notes...${NC}"
+start_mock -v
+NOTES_DIR="$TEMP_DIR/notes"
+PROGRAM_PATH="$PWD/${PROGRAM_NAME}"
+export GIT_AUTHOR_NAME=test GIT_AUTHOR_EMAIL=test@example.com
+export GIT_COMMITTER_NAME=test GIT_COMMITTER_EMAIL=test@example.com
+git init -q --bare "$NOTES_DIR/shared.git" &&
+    git init -q "$NOTES_DIR/a" && git init -q "$NOTES_DIR/b" &&
+    git -C "$NOTES_DIR/a" remote add origin "$NOTES_DIR/shared.git" &&
+    git -C "$NOTES_DIR/b" remote add origin "$NOTES_DIR/shared.git"
+rm -f "$OUTPUT_FILE"
+if (cd "$NOTES_DIR/a" && "$PROGRAM_PATH" "${COMMON_ARGS[@]}" --notes-cache > /dev/null &&
+        git push -q origin refs/notes/commit-ai) &&
+   (cd "$NOTES_DIR/b" && git fetch -q origin refs/notes/commit-ai:refs/notes/remotes/origin/commit-ai &&
+        "$PROGRAM_PATH" "${COMMON_ARGS[@]}" --notes-cache -o "$OUTPUT_FILE" > /dev/null) &&
+   [ "$(grep -c "200 plain" "$TEMP_DIR/mock.log")" -eq 1 ] &&
+   grep -q "^# Add mock response for offline testing" "$OUTPUT_FILE" &&
+   grep -q "^This response was generated" "$OUTPUT_FILE"; then
+    pass "Test 14"
+else
+    fail "Test 14"
+fi
+
+# Test 15: A second run is answered from the remote cache; a slow cache is skipped within its timeout
+echo -e "${YELLOW}Test 15: Remote HTTP cache...${NC}"
+start_mock -v
+rm -f "$OUTPUT_FILE"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --remote-cache "$BASE_URL/cache" > /dev/null &&
+   ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --remote-cache "$BASE_URL/cache" -o "$OUTPUT_FILE" > /dev/null &&
+   [ "$(grep -c "200 plain" "$TEMP_DIR/mock.log")" -eq 1 ] &&
+   grep -q "cache GET .* hit" "$TEMP_DIR/mock.log" &&
+   grep -q "^This response was generated" "$OUTPUT_FILE"; then
+    start_mock -v -k 3000
+    START_MS=$(date +%s%3N)
+    if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --remote-cache "$BASE_URL/cache" \
+           --remote-cache-timeout 200 > /dev/null 2> "$TEMP_DIR/cache.log" &&
+       [ $(( $(date +%s%3N) - START_MS )) -lt 2000 ] &&
+       grep -q "Remote cache unavailable" "$TEMP_DIR/cache.log" &&
+       [ "$(grep -c "200 plain" "$TEMP_DIR/mock.log")" -eq 1 ]; then
+        pass "Test 15"
+    else
+        fail "Test 15"
+    fi
+else
+    fail "Test 15"
+fi
+
+# Test 16: Every request appends a ledger record, and --stats adds them up
+echo -e "${YELLOW}Test 16: Token ledger and --stats...${NC}"
+start_mock
+LEDGER="$TEMP_DIR/ledger.ndjson"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --ledger "$LEDGER" > /dev/null &&
+   COMMIT_AI_LEDGER="$LEDGER" ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" > /dev/null &&
+   [ "$(grep -c '"http":200,.*"output":[1-9]' "$LEDGER")" -eq 2 ] &&
+   ./${PROGRAM_NAME} --stats --ledger "$LEDGER" > "$TEMP_DIR/stats.txt" &&
+   grep -q "^Calls: 2 (0 failed), 1 repos" "$TEMP_DIR/stats.txt" &&
+   grep -q "^Input tokens per KB of diff: [1-9]" "$TEMP_DIR/stats.txt"; then
+    pass "Test 16"
+else
+    fail "Test 16"
+fi
+
+# Test 17: --log-file keeps the debug events without printing them
+echo -e "${YELLOW}Test 17: Debug event log file...${NC}"
+start_mock
+EVENT_LOG="$TEMP_DIR/events.log"
+if ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --log-file "$EVENT_LOG" > /dev/null 2> "$TEMP_DIR/stderr.txt" &&
+   [ ! -s "$TEMP_DIR/stderr.txt" ] &&
+   grep -q "^# commit-ai pid [0-9]" "$EVENT_LOG" &&
+   grep -q "^\[DEBUG +[0-9.]*ms\] HTTP response code: 200$" "$EVENT_LOG" &&
+   grep -q "^\[DEBUG +[0-9.]*ms\] Arena: [0-9]* allocations" "$EVENT_LOG"; then
+    pass "Test 17"
+else
+    fail "Test 17"
+fi
+
+# Test 18: Concurrent runs merge their timings into one histogram file
+echo -e "${YELLOW}Test 18: Latency histograms and --latency-report...${NC}"
+start_mock
+LATENCY_FILE="$TEMP_DIR/latency.hist"
+LATENCY_PIDS=()
+for _ in 1 2 3 4; do
+    ./${PROGRAM_NAME} "${COMMON_ARGS[@]}" --latency-file "$LATENCY_FILE" > /dev/null &
+    LATENCY_PIDS+=($!)
+done
+LATENCY_OK=1
+for pid in "${LATENCY_PIDS[@]}"; do
+    wait "$pid" || LATENCY_OK=0
+done
+if [ "$LATENCY_OK" -eq 1 ] &&
+   COMMIT_AI_LATENCY="$LATENCY_FILE" ./${PROGRAM_NAME} --latency-report > "$TEMP_DIR/latency.txt" &&
+   grep -q "^Diff size <4K" "$TEMP_DIR/latency.txt" &&
+   [ "$(grep -c "^  e2e  *4 " "$TEMP_DIR/latency.txt")" -eq 2 ] &&
+   [ "$(grep -c "^  ttfb  *4 " "$TEMP_DIR/latency.txt")" -eq 2 ] &&
+   [ -s "$XDG_CACHE_HOME/commit-ai/latency.hist" ] &&
+   ! ./${PROGRAM_NAME} --latency-report --latency-file off 2> /dev/null; then
+    pass "Test 18"
+else
+    fail "Test 18"
+fi
+
+# Test 19: The HTTP service answers diffs, sheds what does not fit its queue and fills the ledger
+echo -e "${YELLOW}Test 19: HTTP service mode...${NC}"
+start_mock -l fixed:1000
+SERVE_URL="http://127.0.0.1:$((PORT + 1))"
+./${PROGRAM_NAME} -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" -u "$BASE_URL" \
+    --serve "$((PORT + 1))" --max-inflight 1 --queue 1 --ledger "$TEMP_DIR/serve_ledger.ndjson" \
+    > "$TEMP_DIR/serve.log" 2>&1 &
+SERVE_PID=$!
+for _ in $(seq 1 50); do
+    grep -q "Serving on" "$TEMP_DIR/serve.log" 2>/dev/null && break
+    sleep 0.1
+done
+SERVE_PIDS=()
+for i in 1 2 3; do
+    curl -s -D "$TEMP_DIR/serve_headers$i" -o "$TEMP_DIR/serve_body$i" -H "X-Tenant: ci" \
+        --data-binary "@$TEMP_DIR/test.diff" "$SERVE_URL/v1/commit-message" &
+    SERVE_PIDS+=($!)
+    sleep 0.1
+done
+wait "${SERVE_PIDS[@]}"
+curl -s "$SERVE_URL/metrics" > "$TEMP_DIR/serve_metrics"
+kill "$SERVE_PID" 2>/dev/null
+wait "$SERVE_PID" 2>/dev/null
+if [ "$(grep -l "^HTTP/1.1 200" "$TEMP_DIR"/serve_headers* | wc -l)" -eq 2 ] &&
+   grep -q "^Retry-After: [0-9]" "$TEMP_DIR/serve_headers3" &&
+   grep -q '"title":"Add mock response for offline testing"' "$TEMP_DIR/serve_body1" &&
+   grep -q '^commit_ai_queue_depth 0' "$TEMP_DIR/serve_metrics" &&
+   grep -q '^commit_ai_requests_total{tenant="ci",code="503"} 1' "$TEMP_DIR/serve_metrics" &&
+   grep -q '^commit_ai_upstream_duration_seconds_count 2' "$TEMP_DIR/serve_metrics" &&
+   [ "$(grep -c '"http":200' "$TEMP_DIR/serve_ledger.ndjson")" = "2" ]; then
+    pass "Test 19"
+else
+    fail "Test 19"
+fi
+
+# Test 20: A key pool spreads a diff list over keys that each allow two requests a minute
+echo -e "${YELLOW}Test 20: API key pool...${NC}"
+start_mock -r 2
+printf "# keys\nsk-ant-pool-1\n\nsk-ant-pool-2\nsk-ant-pool-3\n" > "$TEMP_DIR/key_pool.txt"
+if ./${PROGRAM_NAME} -u "$BASE_URL" -p "$TEMP_DIR/profile.txt" --key-pool "$TEMP_DIR/key_pool.txt" \
+       --diff-list "$PACK_DIR/diffs.txt" > "$TEMP_DIR/pool_out.txt" 2>&1 &&
+   grep -q "Processed 6 diffs with 6 requests.*, 0 failed" "$TEMP_DIR/pool_out.txt" &&
+   ! ./${PROGRAM_NAME} -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+       --diff-list "$PACK_DIR/diffs.txt" > "$TEMP_DIR/single_out.txt" 2>&1 &&
+   grep -q ", 4 failed" "$TEMP_DIR/single_out.txt"; then
+    pass "Test 20"
+else
+    fail "Test 20"
+fi
+
+# Test 21: A directory of diffs is read ahead, through io_uring or the reader threads
+echo -e "${YELLOW}Test 21: Diff directory ingestion...${NC}"
+start_mock
+INGEST_DIR="$TEMP_DIR/ingest"
+mkdir -p "$INGEST_DIR"
+cp "$PACK_DIR"/*.diff "$INGEST_DIR/"
+echo "not a diff" > "$INGEST_DIR/notes.txt"
+if ./${PROGRAM_NAME} -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+       -d "$INGEST_DIR" --pack > "$TEMP_DIR/ingest_out.txt" 2>&1 &&
+   grep -q "Processed 6 diffs with 1 requests.*, 0 failed" "$TEMP_DIR/ingest_out.txt" &&
+   ./${PROGRAM_NAME} -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+       -d "$INGEST_DIR" --ingest threads --read-ahead 2 > "$TEMP_DIR/ingest_threads.txt" 2>&1 &&
+   grep -q "Processed 6 diffs with 6 requests.*, 0 failed" "$TEMP_DIR/ingest_threads.txt"; then
+    pass "Test 21"
+else
+    fail "Test 21"
+fi
+
+# Test 22: The staged pipeline overlaps requests and prints in list order
+echo -e "${YELLOW}Test 22: Staged pipeline...${NC}"
+start_mock -l fixed:200
+if ./${PROGRAM_NAME} -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+       --diff-list "$PACK_DIR/diffs.txt" > "$TEMP_DIR/serial_out.txt" 2>/dev/null &&
+   ./${PROGRAM_NAME} -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+       --diff-list "$PACK_DIR/diffs.txt" --pipeline > "$TEMP_DIR/pipeline_out.txt" 2> "$TEMP_DIR/pipeline_err.txt" &&
+   grep -q "Processed 6 diffs with 6 requests.*, 0 failed" "$TEMP_DIR/pipeline_out.txt" &&
+   grep -q "Pipeline: network .*requests in flight" "$TEMP_DIR/pipeline_err.txt" &&
+   diff <(grep -v "^Processed" "$TEMP_DIR/serial_out.txt") <(grep -v "^Processed" "$TEMP_DIR/pipeline_out.txt") > /dev/null &&
+   ./${PROGRAM_NAME} -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+       --diff-list "$PACK_DIR/diffs.txt" --pipeline --pack 2>/dev/null |
+       grep -q "Processed 6 diffs with 1 requests.*, 0 failed"; then
+    pass "Test 22"
+else
+    fail "Test 22"
+fi
+
+# Test 23: Release notes reuse the stored summaries of a tag range
+echo -e "${YELLOW}Test 23: Release notes...${NC}"
+start_mock
+RELEASE_REPO="$TEMP_DIR/release_repo"
+PROGRAM_PATH="$(pwd)/${PROGRAM_NAME}"
+mkdir -p "$RELEASE_REPO/src" &&
+(
+    cd "$RELEASE_REPO" &&
+    git init -q && git config user.email test@example.com && git config user.name Test &&
+    echo "int a;" > src/a.c && git add -A && git commit -qm "Add a" && git tag v1 &&
+    echo "int b;" > src/b.c && git add -A && git commit -qm "Add b" &&
+    echo "int c;" > src/c.c && git add -A && git commit -qm "Add c" &&
+    echo "notes" > README.md && git add -A && git commit -qm "Add readme" && git tag v2
+) > /dev/null 2>&1
+if (cd "$RELEASE_REPO" &&
+    "$PROGRAM_PATH" -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+        --release-notes v1..v2 > "$TEMP_DIR/release_out.txt" 2> "$TEMP_DIR/release_err.txt" &&
+    "$PROGRAM_PATH" -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+        --release-notes v1..v2 > /dev/null 2> "$TEMP_DIR/release_rerun.txt") &&
+   grep -q "^# Release notes for v1..v2" "$TEMP_DIR/release_out.txt" &&
+   grep -q "^## src" "$TEMP_DIR/release_out.txt" &&
+   grep -q "^## Other changes" "$TEMP_DIR/release_out.txt" &&
+   grep -q "Summarized 3 commits (0 cached) into 2 sections with 5 requests.*, 0 failed" "$TEMP_DIR/release_err.txt" &&
+   grep -q "Summarized 3 commits (3 cached) into 2 sections with 0 requests.*, 0 failed" "$TEMP_DIR/release_rerun.txt"; then
+    pass "Test 23"
+else
+    fail "Test 23"
+fi
+
+# Test 24: A pull request description summarizes only the commits it has not seen
+echo -e "${YELLOW}Test 24: Pull request description...${NC}"
+(
+    cd "$RELEASE_REPO" &&
+    git checkout -q -b feature v2 &&
+    echo "int d;" > src/d.c && git add -A && git commit -qm "Add d" &&
+    echo "int e;" > src/e.c && git add -A && git commit -qm "Add e"
+) > /dev/null 2>&1
+if (cd "$RELEASE_REPO" &&
+    "$PROGRAM_PATH" -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+        --pr v2 > "$TEMP_DIR/pr_out.txt" 2> "$TEMP_DIR/pr_err.txt" &&
+    echo "int f;" > src/f.c && git add -A && git commit -qm "Add f" &&
+    "$PROGRAM_PATH" -u "$BASE_URL" -k "$TEMP_DIR/api_key.txt" -p "$TEMP_DIR/profile.txt" \
+        --pr v2 > /dev/null 2> "$TEMP_DIR/pr_push.txt") &&
+   grep -q "^TITLE: " "$TEMP_DIR/pr_out.txt" &&
+   grep -q "Summarized 2 commits (0 cached) with 3 requests.*, 0 failed" "$TEMP_DIR/pr_err.txt" &&
+   grep -q "Summarized 3 commits (2 cached) with 2 requests.*, 0 failed" "$TEMP_DIR/pr_push.txt"; then
+    pass "Test 24"
+else
+    fail "Test 24"
+fi
+
+echo "--------------------------------"
+if [ "$FAILURES" -eq 0 ]; then
+    echo -e "${GREEN}All offline tests passed${NC}"
+else
+    echo -e "${RED}${FAILURES} offline test(s) failed${NC}"
+    exit 1
+fi
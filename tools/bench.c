@@ -0,0 +1,665 @@
+/**
+ * Claude API Client - Microbenchmarks
+ *
+ * Measures the CPU-side hot paths of the client in isolation on a synthetic
+ * diff corpus: read_file(), build_prompt() with and without the compact
+ * symbol digest, cJSON_Print() of the request payload, WriteMemoryCallback()
+ * growth under many small chunks and parse_claude_response(), then a whole
+ * request lifecycle once on the heap, once in a pooled arena and once with
+ * the debug event log recording. No network access or API key is needed.
+ *
+ * Results are reported as throughput (MB/s of input), allocator calls per
+ * run and peak live heap per run. Allocations are counted by replacing
+ * malloc/calloc/realloc/free and the aligned entry points in this binary,
+ * which also covers the allocations made inside libcjson.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "claude_client.h"
+#include "symbols.h"
+#include "eventlog.h"
+
+#define BENCH_DEFAULT_MIN_TIME 0.5
+#define BENCH_DEFAULT_CHUNK 1024
+#define BENCH_MAX_ITERATIONS 1000000
+
+/* Corpus sizes exercised by every benchmark, smallest first */
+static const size_t bench_sizes[] = {
+    1024UL,
+    16UL * 1024,
+    256UL * 1024,
+    4UL * 1024 * 1024,
+    64UL * 1024 * 1024,
+    500UL * 1024 * 1024
+};
+
+/* Allocation counters maintained by the allocator replacements below */
+struct AllocStats {
+    unsigned long long calls;
+    unsigned long long bytes;
+    size_t live;    /* usable bytes currently allocated */
+    size_t peak;    /* high-water mark of live */
+};
+
+static struct AllocStats alloc_stats;
+
+#ifdef __GLIBC__
+/*
+ * glibc allows the allocator to be replaced by defining these entry points
+ * in the executable; a replacement must cover the aligned ones as well, or
+ * their blocks reach our free() uncounted. Forwarding to the __libc_*
+ * versions keeps the real allocator while letting us count every call,
+ * including those made by shared libraries.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+extern void __libc_free(void *ptr);
+
+static void *track_allocation(void *ptr) {
+    if (ptr) {
+        alloc_stats.live += malloc_usable_size(ptr);
+        if (alloc_stats.live > alloc_stats.peak) {
+            alloc_stats.peak = alloc_stats.live;
+        }
+    }
+    return ptr;
+}
+
+void *malloc(size_t size) {
+    alloc_stats.calls++;
+    alloc_stats.bytes += size;
+    return track_allocation(__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    alloc_stats.calls++;
+    alloc_stats.bytes += nmemb * size;
+    return track_allocation(__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size) {
+    alloc_stats.calls++;
+    alloc_stats.bytes += size;
+    if (ptr) {
+        alloc_stats.live -= malloc_usable_size(ptr);
+    }
+    void *result = __libc_realloc(ptr, size);
+    if (!result && ptr && size > 0) {
+        // The old block is still allocated
+        track_allocation(ptr);
+        return NULL;
+    }
+    return track_allocation(result);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    alloc_stats.calls++;
+    alloc_stats.bytes += size;
+    return track_allocation(__libc_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    // Same checks as glibc: a power of two multiple of sizeof(void *)
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+        return EINVAL;
+    }
+    void *ptr = memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    alloc_stats.calls++;
+    alloc_stats.bytes += size;
+    return track_allocation(__libc_valloc(size));
+}
+
+void *pvalloc(size_t size) {
+    alloc_stats.calls++;
+    alloc_stats.bytes += size;
+    return track_allocation(__libc_pvalloc(size));
+}
+
+void free(void *ptr) {
+    if (ptr) {
+        alloc_stats.live -= malloc_usable_size(ptr);
+    }
+    __libc_free(ptr);
+}
+#define BENCH_COUNTS_ALLOCATIONS 1
+#else
+#define BENCH_COUNTS_ALLOCATIONS 0
+#endif
+
+/* Shared state for one corpus size */
+struct BenchContext {
+    size_t size;
+    size_t chunk_size;
+    char *diff;              /* synthetic git diff, size bytes */
+    const char *profile;     /* short developer profile */
+    char *diff_path;         /* diff written to a temporary file */
+    cJSON *payload;          /* request payload built from diff */
+    char *response;          /* synthetic Messages API response */
+};
+
+typedef int (*bench_fn)(struct BenchContext *ctx);
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Format a byte count as a short human readable string */
+static void format_size(size_t bytes, char *buf, size_t buf_len) {
+    if (bytes >= 1024UL * 1024) {
+        snprintf(buf, buf_len, "%zu MB", bytes / (1024UL * 1024));
+    } else if (bytes >= 1024) {
+        snprintf(buf, buf_len, "%zu KB", bytes / 1024);
+    } else {
+        snprintf(buf, buf_len, "%zu B", bytes);
+    }
+}
+
+/* Parse a size argument with an optional K/M/G suffix */
+static int parse_size(const char *arg, size_t *out) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg) {
+        return 0;
+    }
+
+    switch (*end) {
+        case 'k': case 'K': value *= 1024ULL; end++; break;
+        case 'm': case 'M': value *= 1024ULL * 1024; end++; break;
+        case 'g': case 'G': value *= 1024ULL * 1024 * 1024; end++; break;
+        default: break;
+    }
+
+    if (*end != '\0') {
+        return 0;
+    }
+
+    *out = (size_t)value;
+    return 1;
+}
+
+/* Small deterministic PRNG so every run sees the same corpus */
+static unsigned long corpus_seed = 0x2545F491UL;
+
+static unsigned long corpus_rand(void) {
+    corpus_seed = corpus_seed * 1103515245UL + 12345UL;
+    return (corpus_seed >> 16) & 0x7FFF;
+}
+
+/*
+ * Generate a diff-like corpus of exactly size bytes. The text mixes file
+ * headers, hunk headers, context and changed lines, and includes quotes,
+ * backslashes and tabs so that JSON escaping does realistic work.
+ */
+static char* generate_diff_corpus(size_t size) {
+    static const char *const line_bodies[] = {
+        "    if (!buffer) {",
+        "        fprintf(stderr, \"Error: allocation failed\\n\");",
+        "        return NULL;",
+        "    }",
+        "\tsize_t len = strlen(name) + 1;",
+        "    memcpy(&out[offset], src, count);",
+        "    snprintf(path, sizeof(path), \"%s/%s\", dir, file);",
+        "    for (size_t i = 0; i < count; i++) {",
+        "        total += values[i] * weights[i];",
+        "    debug_print(\"Processed %zu items\", count);"
+    };
+    const size_t body_count = sizeof(line_bodies) / sizeof(line_bodies[0]);
+
+    char *corpus = malloc(size + 1);
+    if (!corpus) {
+        fprintf(stderr, "Error: Memory allocation failed for corpus\n");
+        return NULL;
+    }
+
+    size_t pos = 0;
+    unsigned file_index = 0;
+    char line[256];
+
+    while (pos < size) {
+        int len;
+        unsigned long r = corpus_rand();
+
+        if (r % 97 == 0 || pos == 0) {
+            len = snprintf(line, sizeof(line),
+                           "diff --git a/src/module_%u.c b/src/module_%u.c\n"
+                           "index 1a2b3c4..5d6e7f8 100644\n"
+                           "--- a/src/module_%u.c\n+++ b/src/module_%u.c\n",
+                           file_index, file_index, file_index, file_index);
+            file_index++;
+        } else if (r % 13 == 0) {
+            unsigned long start = corpus_rand() % 2000 + 1;
+            len = snprintf(line, sizeof(line),
+                           "@@ -%lu,7 +%lu,8 @@ static int handler_%lu(struct context *ctx)\n",
+                           start, start, corpus_rand() % 500);
+        } else {
+            const char prefix = (r % 5 == 0) ? '-' : ((r % 5 == 1) ? '+' : ' ');
+            len = snprintf(line, sizeof(line), "%c%s\n",
+                           prefix, line_bodies[corpus_rand() % body_count]);
+        }
+
+        size_t copy = (size_t)len;
+        if (copy > size - pos) {
+            copy = size - pos;
+        }
+        memcpy(corpus + pos, line, copy);
+        pos += copy;
+    }
+
+    corpus[size] = '\0';
+    return corpus;
+}
+
+/* Build a Messages API response whose text field carries the corpus */
+static char* generate_response(const char *text) {
+    cJSON *root = cJSON_CreateObject();
+    if (!root) {
+        return NULL;
+    }
+
+    cJSON_AddStringToObject(root, "id", "msg_bench");
+    cJSON_AddStringToObject(root, "type", "message");
+    cJSON_AddStringToObject(root, "role", "assistant");
+    cJSON_AddStringToObject(root, "model", "claude-3-7-sonnet-20250219");
+
+    cJSON *content = cJSON_AddArrayToObject(root, "content");
+    cJSON *block = cJSON_CreateObject();
+    cJSON_AddItemToArray(content, block);
+    cJSON_AddStringToObject(block, "type", "text");
+
+    size_t text_len = strlen(text);
+    char *body = malloc(text_len + 64);
+    if (!body) {
+        cJSON_Delete(root);
+        return NULL;
+    }
+    snprintf(body, text_len + 64, "Refactor module handlers\n\n%s", text);
+    cJSON_AddStringToObject(block, "text", body);
+    free(body);
+
+    cJSON_AddStringToObject(root, "stop_reason", "end_turn");
+    cJSON *usage = cJSON_AddObjectToObject(root, "usage");
+    cJSON_AddNumberToObject(usage, "input_tokens", (double)(text_len / 4));
+    cJSON_AddNumberToObject(usage, "output_tokens", (double)(text_len / 4));
+
+    char *response = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return response;
+}
+
+/* Write the corpus to a temporary file for the read_file benchmark */
+static char* write_temp_file(const char *data, size_t size) {
+    const char *tmp_dir = getenv("TMPDIR");
+    if (!tmp_dir) {
+        tmp_dir = "/tmp";
+    }
+
+    size_t path_len = strlen(tmp_dir) + strlen("/git-commit-ai-bench-XXXXXX") + 1;
+    char *path = malloc(path_len);
+    if (!path) {
+        return NULL;
+    }
+    snprintf(path, path_len, "%s/git-commit-ai-bench-XXXXXX", tmp_dir);
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create temporary file (%s)\n", strerror(errno));
+        free(path);
+        return NULL;
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: Failed to write temporary file (%s)\n", strerror(errno));
+            close(fd);
+            unlink(path);
+            free(path);
+            return NULL;
+        }
+        written += (size_t)n;
+    }
+
+    close(fd);
+    return path;
+}
+
+/* Benchmarks: each returns 1 on success, 0 on failure */
+
+static int bench_read_file(struct BenchContext *ctx) {
+    char *content = read_file(ctx->diff_path);
+    if (!content) return 0;
+    free(content);
+    return 1;
+}
+
+static int bench_build_prompt(struct BenchContext *ctx) {
+    char *prompt = build_prompt(ctx->profile, ctx->diff);
+    if (!prompt) return 0;
+    free(prompt);
+    return 1;
+}
+
+static int bench_build_prompt_compact(struct BenchContext *ctx) {
+    digest_mode = DIGEST_COMPACT;
+    char *prompt = build_prompt(ctx->profile, ctx->diff);
+    digest_mode = DIGEST_OFF;
+    if (!prompt) return 0;
+    free(prompt);
+    return 1;
+}
+
+static int bench_json_print(struct BenchContext *ctx) {
+    char *json_string = cJSON_Print(ctx->payload);
+    if (!json_string) return 0;
+    free(json_string);
+    return 1;
+}
+
+static int feed_write_callback(struct BenchContext *ctx, int preallocate) {
+    struct MemoryStruct chunk;
+    memset(&chunk, 0, sizeof(chunk));
+
+    // Simulate the Content-Length header arriving before the body
+    if (preallocate) {
+        char header[64];
+        int len = snprintf(header, sizeof(header), "Content-Length: %zu\r\n", ctx->size);
+        HeaderCallback(header, 1, (size_t)len, &chunk);
+    }
+
+    for (size_t offset = 0; offset < ctx->size; offset += ctx->chunk_size) {
+        size_t n = ctx->size - offset;
+        if (n > ctx->chunk_size) {
+            n = ctx->chunk_size;
+        }
+        if (WriteMemoryCallback(ctx->diff + offset, 1, n, &chunk) != n) {
+            free(chunk.memory);
+            return 0;
+        }
+    }
+
+    free(chunk.memory);
+    return 1;
+}
+
+static int bench_write_callback(struct BenchContext *ctx) {
+    return feed_write_callback(ctx, 0);
+}
+
+static int bench_write_callback_prealloc(struct BenchContext *ctx) {
+    return feed_write_callback(ctx, 1);
+}
+
+static int bench_parse_response(struct BenchContext *ctx) {
+    char *title = NULL;
+    char *description = NULL;
+    if (!parse_claude_response(ctx->response, &title, &description)) return 0;
+    free(title);
+    free(description);
+    return 1;
+}
+
+/*
+ * One request end to end without the network: build and print the payload,
+ * receive the response in chunks after its Content-Length, then parse it.
+ */
+static int request_lifecycle(struct BenchContext *ctx) {
+    cJSON *root = build_request_payload(ctx->profile, ctx->diff);
+    if (!root) return 0;
+    char *json_string = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (!json_string) return 0;
+
+    size_t response_len = strlen(ctx->response);
+    struct MemoryStruct chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    char header[64];
+    int len = snprintf(header, sizeof(header), "Content-Length: %zu\r\n", response_len);
+    HeaderCallback(header, 1, (size_t)len, &chunk);
+
+    int ok = 1;
+    for (size_t offset = 0; ok && offset < response_len; offset += ctx->chunk_size) {
+        size_t n = response_len - offset;
+        if (n > ctx->chunk_size) {
+            n = ctx->chunk_size;
+        }
+        ok = WriteMemoryCallback(ctx->response + offset, 1, n, &chunk) == n;
+    }
+
+    char *title = NULL;
+    char *description = NULL;
+    if (ok && parse_claude_response(chunk.memory, &title, &description)) {
+        mem_free(title);
+        mem_free(description);
+    } else {
+        ok = 0;
+    }
+
+    mem_free(chunk.memory);
+    cJSON_free(json_string);
+    return ok;
+}
+
+static int bench_lifecycle(struct BenchContext *ctx) {
+    return request_lifecycle(ctx);
+}
+
+/* Pool shared by the arena variant, as a long-running mode would use it */
+static struct ArenaPool *bench_pool = NULL;
+
+static int bench_lifecycle_arena(struct BenchContext *ctx) {
+    struct Arena *arena = arena_pool_acquire(bench_pool);
+    if (!arena) return 0;
+    arena_activate(arena);
+    int ok = request_lifecycle(ctx);
+    arena_activate(NULL);
+    arena_pool_release(bench_pool, arena);
+    return ok;
+}
+
+/* Debug events go to the ring as with --log-file; the ring is never flushed */
+static int bench_lifecycle_log(struct BenchContext *ctx) {
+    event_log_path = "/dev/null";
+    int ok = request_lifecycle(ctx);
+    event_log_path = NULL;
+    return ok;
+}
+
+/* Run one benchmark until min_time has elapsed and print its result line */
+static int run_bench(const char *name, bench_fn fn, struct BenchContext *ctx,
+                     size_t input_bytes, double min_time) {
+    /* Warm-up run so page cache and allocator state are steady */
+    if (!fn(ctx)) {
+        fprintf(stderr, "Error: Benchmark %s failed\n", name);
+        return 0;
+    }
+
+    struct AllocStats before = alloc_stats;
+    unsigned long iterations = 0;
+    size_t peak = 0;
+    double start = now_seconds();
+    double elapsed = 0.0;
+
+    do {
+        // Peak is measured per run, relative to the heap in use before it
+        size_t baseline = alloc_stats.live;
+        alloc_stats.peak = baseline;
+        if (!fn(ctx)) {
+            fprintf(stderr, "Error: Benchmark %s failed\n", name);
+            return 0;
+        }
+        if (alloc_stats.peak - baseline > peak) {
+            peak = alloc_stats.peak - baseline;
+        }
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_time && iterations < BENCH_MAX_ITERATIONS);
+
+    struct AllocStats after = alloc_stats;
+    char size_buf[32];
+    format_size(ctx->size, size_buf, sizeof(size_buf));
+
+    double mb_per_sec = ((double)input_bytes * (double)iterations) / (1024.0 * 1024.0) / elapsed;
+    if (BENCH_COUNTS_ALLOCATIONS) {
+        printf("%-28s %8s %9lu %11.1f %12.1f %14.1f %12.1f\n", name, size_buf, iterations, mb_per_sec,
+               (double)(after.calls - before.calls) / (double)iterations,
+               (double)(after.bytes - before.bytes) / (double)iterations / 1024.0,
+               (double)peak / 1024.0);
+    } else {
+        printf("%-28s %8s %9lu %11.1f %12s %14s %12s\n", name, size_buf, iterations, mb_per_sec,
+               "n/a", "n/a", "n/a");
+    }
+    fflush(stdout);
+    return 1;
+}
+
+static void display_help(const char *program_name) {
+    printf("Microbenchmarks for git-commit-ai hot paths\n");
+    printf("\nUsage: %s [options]\n", program_name);
+    printf("\nOptions:\n");
+    printf("  -h                Display this help message\n");
+    printf("  -m <size>         Largest corpus size to run (default: 500M)\n");
+    printf("  -t <seconds>      Minimum time per benchmark (default: %.1f)\n", BENCH_DEFAULT_MIN_TIME);
+    printf("  -c <size>         Chunk size for the write callback benchmark (default: %d)\n",
+           BENCH_DEFAULT_CHUNK);
+    printf("  -f <name>         Only run benchmarks whose name contains <name>\n");
+    printf("\nSizes accept K, M and G suffixes.\n");
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_size = bench_sizes[sizeof(bench_sizes) / sizeof(bench_sizes[0]) - 1];
+    size_t chunk_size = BENCH_DEFAULT_CHUNK;
+    double min_time = BENCH_DEFAULT_MIN_TIME;
+    const char *filter = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hm:t:c:f:")) != -1) {
+        switch (opt) {
+            case 'h':
+                display_help(argv[0]);
+                return 0;
+            case 'm':
+                if (!parse_size(optarg, &max_size)) {
+                    fprintf(stderr, "Error: Invalid size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                min_time = atof(optarg);
+                break;
+            case 'c':
+                if (!parse_size(optarg, &chunk_size) || chunk_size == 0) {
+                    fprintf(stderr, "Error: Invalid chunk size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                display_help(argv[0]);
+                return 1;
+        }
+    }
+
+    static const struct {
+        const char *name;
+        bench_fn fn;
+    } benches[] = {
+        { "read_file", bench_read_file },
+        { "build_prompt", bench_build_prompt },
+        { "build_prompt+compact", bench_build_prompt_compact },
+        { "cJSON_Print", bench_json_print },
+        { "WriteMemoryCallback", bench_write_callback },
+        { "WriteMemoryCallback+length", bench_write_callback_prealloc },
+        { "parse_claude_response", bench_parse_response },
+        { "request_lifecycle", bench_lifecycle },
+        { "request_lifecycle+arena", bench_lifecycle_arena },
+        { "request_lifecycle+log", bench_lifecycle_log }
+    };
+    const size_t bench_count = sizeof(benches) / sizeof(benches[0]);
+
+    bench_pool = arena_pool_create(1, ARENA_DEFAULT_BLOCK_SIZE);
+    if (!bench_pool) {
+        return 1;
+    }
+
+    printf("%-28s %8s %9s %11s %12s %14s %12s\n",
+           "benchmark", "size", "iters", "MB/s", "allocs/run", "KB alloc/run", "peak KB");
+
+    int status = 0;
+    for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+        if (bench_sizes[s] > max_size) {
+            break;
+        }
+
+        struct BenchContext ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.size = bench_sizes[s];
+        ctx.chunk_size = chunk_size;
+        ctx.profile = "I am a C developer. I prefer short imperative commit titles.";
+
+        ctx.diff = generate_diff_corpus(ctx.size);
+        ctx.diff_path = ctx.diff ? write_temp_file(ctx.diff, ctx.size) : NULL;
+        ctx.payload = ctx.diff ? build_request_payload(ctx.profile, ctx.diff) : NULL;
+        ctx.response = ctx.diff ? generate_response(ctx.diff) : NULL;
+
+        if (!ctx.diff || !ctx.diff_path || !ctx.payload || !ctx.response) {
+            fprintf(stderr, "Error: Failed to prepare %zu byte corpus\n", ctx.size);
+            status = 1;
+        } else {
+            size_t response_len = strlen(ctx.response);
+            for (size_t b = 0; b < bench_count; b++) {
+                if (filter && !strstr(benches[b].name, filter)) {
+                    continue;
+                }
+                /* parse_claude_response consumes the response, not the diff */
+                size_t input_bytes = (benches[b].fn == bench_parse_response) ? response_len : ctx.size;
+                if (!run_bench(benches[b].name, benches[b].fn, &ctx, input_bytes, min_time)) {
+                    status = 1;
+                }
+            }
+        }
+
+        if (ctx.diff_path) {
+            unlink(ctx.diff_path);
+            free(ctx.diff_path);
+        }
+        cJSON_Delete(ctx.payload);
+        free(ctx.response);
+        free(ctx.diff);
+    }
+
+    arena_pool_destroy(bench_pool);
+    return status;
+}
@@ -0,0 +1,188 @@
+/**
+ * Claude API Client - Load driver
+ *
+ * Runs a command (normally git-commit-ai pointed at the mock server with -u)
+ * a fixed number of times with a bounded number of concurrent invocations,
+ * then reports throughput and the latency distribution of the invocations.
+ *
+ * Example:
+ *   release/load_driver -n 500 -c 32 -- ./git-commit-ai -u http://127.0.0.1:8089 -d x.diff
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define DRIVER_DEFAULT_TOTAL 100
+#define DRIVER_DEFAULT_CONCURRENCY 8
+
+/* One running invocation */
+struct Slot {
+    pid_t pid;
+    double start;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile over sorted samples */
+static double percentile(const double *sorted, size_t count, double p) {
+    if (count == 0) return 0.0;
+    size_t rank = (size_t)(p / 100.0 * (double)count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+static pid_t spawn(char *const argv[], int quiet) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (quiet) {
+            int devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0) {
+                dup2(devnull, STDOUT_FILENO);
+                dup2(devnull, STDERR_FILENO);
+                close(devnull);
+            }
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void display_help(const char *program_name) {
+    printf("Load driver for git-commit-ai\n");
+    printf("\nUsage: %s [options] -- <command> [args...]\n", program_name);
+    printf("\nOptions:\n");
+    printf("  -h                Display this help message\n");
+    printf("  -n <count>        Total number of invocations (default: %d)\n", DRIVER_DEFAULT_TOTAL);
+    printf("  -c <count>        Concurrent invocations (default: %d)\n", DRIVER_DEFAULT_CONCURRENCY);
+    printf("  -s                Show the output of the invocations\n");
+}
+
+int main(int argc, char *argv[]) {
+    long total = DRIVER_DEFAULT_TOTAL;
+    long concurrency = DRIVER_DEFAULT_CONCURRENCY;
+    int quiet = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hn:c:s")) != -1) {
+        switch (opt) {
+            case 'h':
+                display_help(argv[0]);
+                return 0;
+            case 'n':
+                total = atol(optarg);
+                break;
+            case 'c':
+                concurrency = atol(optarg);
+                break;
+            case 's':
+                quiet = 0;
+                break;
+            default:
+                display_help(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc || total <= 0 || concurrency <= 0) {
+        display_help(argv[0]);
+        return 1;
+    }
+    if (concurrency > total) {
+        concurrency = total;
+    }
+
+    char **command = &argv[optind];
+    double *latencies = malloc((size_t)total * sizeof(double));
+    struct Slot *slots = calloc((size_t)concurrency, sizeof(struct Slot));
+    if (!latencies || !slots) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(latencies);
+        free(slots);
+        return 1;
+    }
+
+    long started = 0, finished = 0, failures = 0;
+    size_t samples = 0;
+    double run_start = now_seconds();
+
+    while (finished < total) {
+        // Keep every slot busy while invocations remain
+        for (long i = 0; i < concurrency && started < total; i++) {
+            if (slots[i].pid != 0) continue;
+            slots[i].start = now_seconds();
+            slots[i].pid = spawn(command, quiet);
+            if (slots[i].pid < 0) {
+                fprintf(stderr, "Error: fork() failed (%s)\n", strerror(errno));
+                slots[i].pid = 0;
+                failures++;
+                finished++;
+            }
+            started++;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        double end = now_seconds();
+        for (long i = 0; i < concurrency; i++) {
+            if (slots[i].pid != pid) continue;
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                latencies[samples++] = (end - slots[i].start) * 1000.0;
+            } else {
+                failures++;
+            }
+            finished++;
+            slots[i].pid = 0;
+            break;
+        }
+    }
+
+    double wall = now_seconds() - run_start;
+    qsort(latencies, samples, sizeof(double), compare_doubles);
+
+    double sum = 0.0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += latencies[i];
+    }
+
+    printf("Invocations:   %ld (%ld failed) at concurrency %ld\n", finished, failures, concurrency);
+    printf("Wall time:     %.3f s\n", wall);
+    printf("Throughput:    %.1f invocations/s\n", wall > 0.0 ? (double)samples / wall : 0.0);
+    if (samples > 0) {
+        printf("Latency (ms):  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+               sum / (double)samples,
+               percentile(latencies, samples, 50.0),
+               percentile(latencies, samples, 90.0),
+               percentile(latencies, samples, 99.0),
+               percentile(latencies, samples, 99.9),
+               latencies[samples - 1]);
+    }
+
+    free(latencies);
+    free(slots);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,1274 @@
+/**
+ * Claude API Client - Local mock Messages API server
+ *
+ * A small stand-in for POST /v1/messages used for offline end-to-end and
+ * load testing. It answers with canned Messages API responses and can
+ * simulate the behaviour that matters for performance work:
+ *
+ *   - configurable latency distributions for time to first byte
+ *   - non-streaming responses, optionally sent with chunked transfer
+ *   - streaming (server-sent events) responses when the request sets
+ *     "stream": true, with a configurable delay between events
+ *   - packed prompts ("=== COMMIT <n> ===" sections) answered with one
+ *     section per diff
+ *   - candidates prompts ("=== CANDIDATE <n> ===" sections) answered with
+ *     one section per candidate
+ *   - 429 (rate limited) and 529 (overloaded) injection
+ *   - anthropic-ratelimit-* response headers backed by a per-minute window
+ *     for each API key
+ *   - the Message Batches endpoints (create, retrieve, JSONL results), with
+ *     batches that end after a configurable time
+ *   - an OpenAI-compatible POST /v1/chat/completions with the same text,
+ *     plain or streamed as chat.completion.chunk events
+ *   - a blob store for --remote-cache under /cache/ (GET and PUT), with a
+ *     configurable delay to exercise the client's cache timeout
+ *
+ * Each connection is served by its own thread and supports keep-alive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define MOCK_DEFAULT_PORT 8089
+#define MOCK_MAX_HEADER_BYTES (64 * 1024)
+#define MOCK_CUSTOM_ID_SIZE 65
+#define MOCK_BATCHES_PATH "/v1/messages/batches"
+#define MOCK_CACHE_PATH "/cache/"
+#define MOCK_MAX_KEYS 64
+#define MOCK_KEY_SIZE 128
+#define MOCK_MAX_SECTIONS 16    /* the client's PACK_MAX_DIFFS; CANDIDATES_MAX is lower */
+#define MOCK_DEFAULT_TEXT "Add mock response for offline testing\n\nThis response was generated by the local mock Messages API server. It contains a title line followed by a short description."
+
+/* Latency distributions for the delay before the first response byte */
+enum DistKind {
+    DIST_FIXED,
+    DIST_UNIFORM,
+    DIST_NORMAL,
+    DIST_LOGNORMAL,
+    DIST_EXPONENTIAL
+};
+
+struct LatencyDist {
+    enum DistKind kind;
+    double a;   /* fixed value, min, mean or median (ms) */
+    double b;   /* max, standard deviation (ms) or sigma */
+};
+
+/* Server configuration */
+struct MockConfig {
+    int port;
+    struct LatencyDist latency;
+    long event_delay_ms;        /* delay between streamed events or chunks */
+    size_t chunk_size;          /* body chunk size when chunked is set */
+    int chunked;                /* chunked transfer for non-streaming replies */
+    double rate_429;            /* probability of an injected 429 */
+    double rate_529;            /* probability of an injected 529 */
+    long requests_per_minute;   /* advertised and enforced request limit */
+    long tokens_per_minute;     /* advertised and enforced token limit */
+    long batch_ms;              /* time a message batch takes to end */
+    char *text;                 /* assistant text returned in every reply */
+    const char *weak_model;     /* model whose replies have no description */
+    long cache_delay_ms;        /* delay before a /cache/ request is answered */
+    int verbose;
+};
+
+static struct MockConfig config;
+
+/* Rate limit window of one API key */
+struct RateWindow {
+    char key[MOCK_KEY_SIZE];
+    time_t start;
+    long requests;
+    long tokens;
+};
+
+/* Rate limit windows by key, protected by window_lock; keys beyond the
+ * table share the last window */
+static pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct RateWindow windows[MOCK_MAX_KEYS];
+static size_t window_count;
+static unsigned long request_counter;
+
+/* Per-connection state */
+struct Connection {
+    int fd;
+    uint64_t rng;
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+/* Parsed request */
+struct Request {
+    char method[16];
+    char path[256];
+    size_t content_length;
+    char api_key[MOCK_KEY_SIZE];    /* x-api-key or bearer token */
+    int expect_continue;
+    int close_after;
+    char *body;
+};
+
+/* xorshift64* generator, one per connection so threads never contend */
+static double rng_uniform(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (double)((x * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static double rng_normal(uint64_t *state) {
+    double u1 = rng_uniform(state);
+    double u2 = rng_uniform(state);
+    if (u1 < 1e-12) u1 = 1e-12;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * 3.14159265358979323846 * u2);
+}
+
+static double sample_latency_ms(const struct LatencyDist *dist, uint64_t *state) {
+    double value = 0.0;
+    switch (dist->kind) {
+        case DIST_FIXED:
+            value = dist->a;
+            break;
+        case DIST_UNIFORM:
+            value = dist->a + (dist->b - dist->a) * rng_uniform(state);
+            break;
+        case DIST_NORMAL:
+            value = dist->a + dist->b * rng_normal(state);
+            break;
+        case DIST_LOGNORMAL:
+            value = dist->a * exp(dist->b * rng_normal(state));
+            break;
+        case DIST_EXPONENTIAL:
+            value = -dist->a * log(1.0 - rng_uniform(state));
+            break;
+    }
+    return value < 0.0 ? 0.0 : value;
+}
+
+/* Parse "fixed:MS", "uniform:MIN:MAX", "normal:MEAN:SD", "lognormal:MEDIAN:SIGMA" or "exp:MEAN" */
+static int parse_latency(const char *spec, struct LatencyDist *dist) {
+    char kind[16];
+    double a = 0.0, b = 0.0;
+    const char *colon = strchr(spec, ':');
+    if (!colon || (size_t)(colon - spec) >= sizeof(kind)) {
+        return 0;
+    }
+    memcpy(kind, spec, (size_t)(colon - spec));
+    kind[colon - spec] = '\0';
+
+    int fields = sscanf(colon + 1, "%lf:%lf", &a, &b);
+    if (strcmp(kind, "fixed") == 0 && fields >= 1) {
+        dist->kind = DIST_FIXED;
+    } else if (strcmp(kind, "uniform") == 0 && fields == 2) {
+        dist->kind = DIST_UNIFORM;
+    } else if (strcmp(kind, "normal") == 0 && fields == 2) {
+        dist->kind = DIST_NORMAL;
+    } else if (strcmp(kind, "lognormal") == 0 && fields == 2) {
+        dist->kind = DIST_LOGNORMAL;
+    } else if (strcmp(kind, "exp") == 0 && fields >= 1) {
+        dist->kind = DIST_EXPONENTIAL;
+    } else {
+        return 0;
+    }
+    dist->a = a;
+    dist->b = b;
+    return 1;
+}
+
+static void sleep_ms(double ms) {
+    if (ms <= 0.0) return;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ms / 1000.0);
+    ts.tv_nsec = (long)((ms - (double)ts.tv_sec * 1000.0) * 1e6);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static int send_chunk(int fd, const char *data, size_t len) {
+    char size_line[32];
+    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+    return send_all(fd, size_line, (size_t)n) && send_all(fd, data, len) && send_all(fd, "\r\n", 2);
+}
+
+/* Append text to a growable buffer with JSON string escaping */
+static int append_escaped(char **out, size_t *len, size_t *cap, const char *text) {
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        char esc[8];
+        const char *piece = esc;
+        size_t piece_len;
+        switch (*p) {
+            case '"': piece = "\\\""; piece_len = 2; break;
+            case '\\': piece = "\\\\"; piece_len = 2; break;
+            case '\n': piece = "\\n"; piece_len = 2; break;
+            case '\r': piece = "\\r"; piece_len = 2; break;
+            case '\t': piece = "\\t"; piece_len = 2; break;
+            default:
+                if (*p < 0x20) {
+                    piece_len = (size_t)snprintf(esc, sizeof(esc), "\\u%04x", *p);
+                } else {
+                    esc[0] = (char)*p;
+                    piece_len = 1;
+                }
+                break;
+        }
+        if (*len + piece_len + 1 > *cap) {
+            size_t new_cap = (*cap ? *cap * 2 : 256) + piece_len;
+            char *grown = realloc(*out, new_cap);
+            if (!grown) return 0;
+            *out = grown;
+            *cap = new_cap;
+        }
+        memcpy(*out + *len, piece, piece_len);
+        *len += piece_len;
+        (*out)[*len] = '\0';
+    }
+    return 1;
+}
+
+static char* escape_json(const char *text) {
+    char *out = NULL;
+    size_t len = 0, cap = 0;
+    if (!append_escaped(&out, &len, &cap, text)) {
+        free(out);
+        return NULL;
+    }
+    if (!out) {
+        out = calloc(1, 1);
+    }
+    return out;
+}
+
+/* Find a top-level-looking "key": "value" pair and copy the value */
+static void find_json_string(const char *body, const char *key, char *out, size_t out_len) {
+    char needle[64];
+    snprintf(needle, sizeof(needle), "\"%s\"", key);
+    out[0] = '\0';
+
+    const char *p = body ? strstr(body, needle) : NULL;
+    if (!p) return;
+    p += strlen(needle);
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ':') p++;
+    if (*p != '"') return;
+    p++;
+
+    size_t i = 0;
+    while (*p && *p != '"' && i + 1 < out_len) {
+        out[i++] = *p++;
+    }
+    out[i] = '\0';
+}
+
+static int request_wants_stream(const char *body) {
+    const char *p = body ? strstr(body, "\"stream\"") : NULL;
+    if (!p) return 0;
+    p += strlen("\"stream\"");
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ':') p++;
+    return strncmp(p, "true", 4) == 0;
+}
+
+static void format_rfc3339(time_t t, char *buf, size_t len) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, len, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+/*
+ * Account one request against the per-minute window and format the
+ * anthropic-ratelimit-* headers. Returns 1 if the request exceeds a limit.
+ */
+static int account_rate_limit(const char *key, long tokens, char *headers, size_t headers_len,
+                              long *retry_after) {
+    pthread_mutex_lock(&window_lock);
+
+    struct RateWindow *window = NULL;
+    for (size_t i = 0; i < window_count && !window; i++) {
+        if (strcmp(windows[i].key, key) == 0) window = &windows[i];
+    }
+    if (!window && window_count < MOCK_MAX_KEYS) {
+        window = &windows[window_count++];
+        snprintf(window->key, sizeof(window->key), "%s", key);
+    }
+    if (!window) window = &windows[MOCK_MAX_KEYS - 1];
+
+    time_t now = time(NULL);
+    if (now - window->start >= 60) {
+        window->start = now;
+        window->requests = 0;
+        window->tokens = 0;
+    }
+
+    int limited = 0;
+    if ((config.requests_per_minute > 0 && window->requests + 1 > config.requests_per_minute) ||
+        (config.tokens_per_minute > 0 && window->tokens + tokens > config.tokens_per_minute)) {
+        limited = 1;
+    } else {
+        window->requests++;
+        window->tokens += tokens;
+    }
+
+    long requests_remaining = config.requests_per_minute - window->requests;
+    long tokens_remaining = config.tokens_per_minute - window->tokens;
+    time_t reset = window->start + 60;
+    *retry_after = (long)(reset - now);
+    if (*retry_after < 1) *retry_after = 1;
+
+    pthread_mutex_unlock(&window_lock);
+
+    char reset_buf[32];
+    format_rfc3339(reset, reset_buf, sizeof(reset_buf));
+    snprintf(headers, headers_len,
+             "anthropic-ratelimit-requests-limit: %ld\r\n"
+             "anthropic-ratelimit-requests-remaining: %ld\r\n"
+             "anthropic-ratelimit-requests-reset: %s\r\n"
+             "anthropic-ratelimit-tokens-limit: %ld\r\n"
+             "anthropic-ratelimit-tokens-remaining: %ld\r\n"
+             "anthropic-ratelimit-tokens-reset: %s\r\n",
+             config.requests_per_minute, requests_remaining < 0 ? 0 : requests_remaining, reset_buf,
+             config.tokens_per_minute, tokens_remaining < 0 ? 0 : tokens_remaining, reset_buf);
+    return limited;
+}
+
+static int send_simple(int fd, int status, const char *reason, const char *extra_headers,
+                       const char *content_type, const char *body, int close_after) {
+    char head[2048];
+    size_t body_len = body ? strlen(body) : 0;
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %zu\r\n"
+                     "%s%s"
+                     "\r\n",
+                     status, reason, content_type, body_len,
+                     extra_headers ? extra_headers : "",
+                     close_after ? "Connection: close\r\n" : "");
+    return send_all(fd, head, (size_t)n) && (body_len == 0 || send_all(fd, body, body_len));
+}
+
+static int send_error(int fd, int status, const char *reason, const char *type,
+                      const char *message, const char *extra_headers, int close_after) {
+    char body[512];
+    snprintf(body, sizeof(body),
+             "{\"type\":\"error\",\"error\":{\"type\":\"%s\",\"message\":\"%s\"}}", type, message);
+    return send_simple(fd, status, reason, extra_headers, "application/json", body, close_after);
+}
+
+/* Body of a Messages API reply with the given text; *len gets its length */
+static char* format_message(const char *model, unsigned long id, long input_tokens,
+                            const char *text, int *len) {
+    char *escaped = escape_json(text);
+    if (!escaped) return NULL;
+
+    long output_tokens = (long)(strlen(text) / 4) + 1;
+    size_t body_len = strlen(escaped) + strlen(model) + 512;
+    char *body = malloc(body_len);
+    if (!body) {
+        free(escaped);
+        return NULL;
+    }
+    *len = snprintf(body, body_len,
+                    "{\"id\":\"msg_mock_%lu\",\"type\":\"message\",\"role\":\"assistant\","
+                    "\"model\":\"%s\",\"content\":[{\"type\":\"text\",\"text\":\"%s\"}],"
+                    "\"stop_reason\":\"end_turn\",\"stop_sequence\":null,"
+                    "\"usage\":{\"input_tokens\":%ld,\"output_tokens\":%ld,"
+                    "\"cache_creation_input_tokens\":0,\"cache_read_input_tokens\":0}}",
+                    id, model, escaped, input_tokens, output_tokens);
+    free(escaped);
+    return body;
+}
+
+/* Body of an OpenAI-compatible chat.completion with the given text */
+static char* format_chat_completion(const char *model, unsigned long id, long input_tokens,
+                                    const char *text, int *len) {
+    char *escaped = escape_json(text);
+    if (!escaped) return NULL;
+
+    long output_tokens = (long)(strlen(text) / 4) + 1;
+    size_t body_len = strlen(escaped) + strlen(model) + 512;
+    char *body = malloc(body_len);
+    if (!body) {
+        free(escaped);
+        return NULL;
+    }
+    *len = snprintf(body, body_len,
+                    "{\"id\":\"chatcmpl-mock-%lu\",\"object\":\"chat.completion\",\"model\":\"%s\","
+                    "\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":\"%s\"},"
+                    "\"finish_reason\":\"stop\"}],"
+                    "\"usage\":{\"prompt_tokens\":%ld,\"completion_tokens\":%ld,\"total_tokens\":%ld}}",
+                    id, model, escaped, input_tokens, output_tokens, input_tokens + output_tokens);
+    free(escaped);
+    return body;
+}
+
+/* Non-streaming JSON reply, optionally with chunked transfer; takes ownership of body */
+static int send_message(int fd, const struct Request *req, unsigned long id,
+                        char *body, int n, const char *rate_headers) {
+    if (!body) return 0;
+
+    char head[2048];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: application/json\r\n"
+                            "request-id: req_mock_%lu\r\n"
+                            "%s%s%s"
+                            "\r\n",
+                            id, rate_headers,
+                            config.chunked ? "Transfer-Encoding: chunked\r\n" : "",
+                            req->close_after ? "Connection: close\r\n" : "");
+
+    int ok;
+    if (!config.chunked) {
+        char length_header[64];
+        int l = snprintf(length_header, sizeof(length_header), "Content-Length: %d\r\n\r\n", n);
+        /* Replace the final blank line with the Content-Length header */
+        ok = send_all(fd, head, (size_t)head_len - 2) &&
+             send_all(fd, length_header, (size_t)l) &&
+             send_all(fd, body, (size_t)n);
+    } else {
+        ok = send_all(fd, head, (size_t)head_len);
+        for (size_t off = 0; ok && off < (size_t)n; off += config.chunk_size) {
+            size_t piece = (size_t)n - off;
+            if (piece > config.chunk_size) piece = config.chunk_size;
+            if (off > 0) sleep_ms((double)config.event_delay_ms);
+            ok = send_chunk(fd, body + off, piece);
+        }
+        ok = ok && send_all(fd, "0\r\n\r\n", 5);
+    }
+    free(body);
+    return ok;
+}
+
+static int send_event(int fd, const char *event, const char *data) {
+    size_t len = strlen(event) + strlen(data) + 32;
+    char *frame = malloc(len);
+    if (!frame) return 0;
+    int n = snprintf(frame, len, "event: %s\ndata: %s\n\n", event, data);
+    int ok = send_chunk(fd, frame, (size_t)n);
+    free(frame);
+    return ok;
+}
+
+/* Response head of an event stream */
+static int send_stream_head(int fd, const struct Request *req, unsigned long id,
+                            const char *rate_headers) {
+    char head[2048];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: text/event-stream\r\n"
+                            "Cache-Control: no-cache\r\n"
+                            "Transfer-Encoding: chunked\r\n"
+                            "request-id: req_mock_%lu\r\n"
+                            "%s%s"
+                            "\r\n",
+                            id, rate_headers, req->close_after ? "Connection: close\r\n" : "");
+    return send_all(fd, head, (size_t)head_len);
+}
+
+/* Copy the next word of text, with its trailing space or newline, to piece */
+static size_t next_piece(const char *text, size_t text_len, size_t off, char *piece, size_t piece_size) {
+    size_t end = off;
+    while (end < text_len && text[end] != ' ' && text[end] != '\n') end++;
+    if (end < text_len) end++;
+
+    size_t piece_len = end - off;
+    if (piece_len >= piece_size) piece_len = piece_size - 1;
+    memcpy(piece, text + off, piece_len);
+    piece[piece_len] = '\0';
+    return piece_len;
+}
+
+/* Streaming Messages API reply as server-sent events */
+static int send_stream(int fd, const struct Request *req, const char *model, unsigned long id,
+                       long input_tokens, const char *text, const char *rate_headers) {
+    if (!send_stream_head(fd, req, id, rate_headers)) return 0;
+
+    char data[1024];
+    snprintf(data, sizeof(data),
+             "{\"type\":\"message_start\",\"message\":{\"id\":\"msg_mock_%lu\",\"type\":\"message\","
+             "\"role\":\"assistant\",\"model\":\"%s\",\"content\":[],\"stop_reason\":null,"
+             "\"usage\":{\"input_tokens\":%ld,\"output_tokens\":1}}}",
+             id, model, input_tokens);
+    if (!send_event(fd, "message_start", data)) return 0;
+    if (!send_event(fd, "content_block_start",
+                    "{\"type\":\"content_block_start\",\"index\":0,"
+                    "\"content_block\":{\"type\":\"text\",\"text\":\"\"}}")) return 0;
+
+    /* Stream the text a word at a time */
+    size_t text_len = strlen(text);
+    size_t off = 0;
+    while (off < text_len) {
+        char piece[512];
+        off += next_piece(text, text_len, off, piece, sizeof(piece));
+
+        char *escaped = escape_json(piece);
+        if (!escaped) return 0;
+        size_t delta_len = strlen(escaped) + 128;
+        char *delta = malloc(delta_len);
+        if (!delta) {
+            free(escaped);
+            return 0;
+        }
+        snprintf(delta, delta_len,
+                 "{\"type\":\"content_block_delta\",\"index\":0,"
+                 "\"delta\":{\"type\":\"text_delta\",\"text\":\"%s\"}}", escaped);
+        free(escaped);
+
+        sleep_ms((double)config.event_delay_ms);
+        int ok = send_event(fd, "content_block_delta", delta);
+        free(delta);
+        if (!ok) return 0;
+    }
+
+    snprintf(data, sizeof(data),
+             "{\"type\":\"message_delta\",\"delta\":{\"stop_reason\":\"end_turn\",\"stop_sequence\":null},"
+             "\"usage\":{\"output_tokens\":%ld}}", (long)(text_len / 4) + 1);
+    return send_event(fd, "content_block_stop", "{\"type\":\"content_block_stop\",\"index\":0}") &&
+           send_event(fd, "message_delta", data) &&
+           send_event(fd, "message_stop", "{\"type\":\"message_stop\"}") &&
+           send_all(fd, "0\r\n\r\n", 5);
+}
+
+/* Streaming chat completion: one chat.completion.chunk per word, then usage and [DONE] */
+static int send_chat_stream(int fd, const struct Request *req, const char *model, unsigned long id,
+                            long input_tokens, const char *text, const char *rate_headers) {
+    if (!send_stream_head(fd, req, id, rate_headers)) return 0;
+
+    size_t text_len = strlen(text);
+    size_t off = 0;
+    while (off < text_len) {
+        char piece[512];
+        off += next_piece(text, text_len, off, piece, sizeof(piece));
+
+        char *escaped = escape_json(piece);
+        if (!escaped) return 0;
+        size_t frame_len = strlen(escaped) + strlen(model) + 256;
+        char *frame = malloc(frame_len);
+        if (!frame) {
+            free(escaped);
+            return 0;
+        }
+        int n = snprintf(frame, frame_len,
+                         "data: {\"id\":\"chatcmpl-mock-%lu\",\"object\":\"chat.completion.chunk\","
+                         "\"model\":\"%s\",\"choices\":[{\"index\":0,"
+                         "\"delta\":{\"content\":\"%s\"},\"finish_reason\":null}]}\n\n",
+                         id, model, escaped);
+        free(escaped);
+
+        sleep_ms((double)config.event_delay_ms);
+        int ok = send_chunk(fd, frame, (size_t)n);
+        free(frame);
+        if (!ok) return 0;
+    }
+
+    long output_tokens = (long)(text_len / 4) + 1;
+    char frame[1024];
+    int n = snprintf(frame, sizeof(frame),
+                     "data: {\"id\":\"chatcmpl-mock-%lu\",\"object\":\"chat.completion.chunk\","
+                     "\"model\":\"%s\",\"choices\":[{\"index\":0,\"delta\":{},\"finish_reason\":\"stop\"}]}\n\n"
+                     "data: {\"id\":\"chatcmpl-mock-%lu\",\"object\":\"chat.completion.chunk\","
+                     "\"model\":\"%s\",\"choices\":[],"
+                     "\"usage\":{\"prompt_tokens\":%ld,\"completion_tokens\":%ld,\"total_tokens\":%ld}}\n\n"
+                     "data: [DONE]\n\n",
+                     id, model, id, model, input_tokens, output_tokens, input_tokens + output_tokens);
+    return send_chunk(fd, frame, (size_t)n) && send_all(fd, "0\r\n\r\n", 5);
+}
+
+/*
+ * Reply text for a sectioned prompt: one "=== <word> <n> ===" section with
+ * the configured text for every "=== <word> <n> ===" line in the request
+ * (COMMIT for --pack, CANDIDATE for --candidates), or NULL if there are
+ * fewer than two. Numbers above MOCK_MAX_SECTIONS are not answered.
+ */
+static char* sectioned_text(const char *body, const char *word) {
+    char marker[32];
+    snprintf(marker, sizeof(marker), "=== %s ", word);
+    size_t sections = 0;
+    for (const char *p = strstr(body, marker); p; p = strstr(p + 1, marker)) {
+        unsigned long n;
+        char close[4];
+        if (sscanf(p + strlen(marker), "%lu %3[=]", &n, close) == 2 && n > sections) {
+            sections = n > MOCK_MAX_SECTIONS ? MOCK_MAX_SECTIONS : n;
+        }
+    }
+    if (sections < 2) return NULL;
+
+    const char *newline = strchr(config.text, '\n');
+    size_t title_len = newline ? (size_t)(newline - config.text) : strlen(config.text);
+    const char *description = newline ? newline : "";
+
+    size_t per_section = strlen(config.text) + 64;
+    if (per_section > (SIZE_MAX - 1) / sections) return NULL;
+    size_t cap = sections * per_section + 1;
+    char *text = malloc(cap);
+    if (!text) return NULL;
+    text[0] = '\0';
+    size_t len = 0;
+    for (size_t n = 1; n <= sections && len < cap; n++) {
+        int written = snprintf(text + len, cap - len, "%s%zu ===\n%.*s (%zu)%s\n\n",
+                               marker, n, (int)title_len, config.text, n, description);
+        if (written < 0) break;
+        len += (size_t)written;
+    }
+    return text;
+}
+
+/* POST /v1/messages, or /v1/chat/completions when chat is set */
+static int handle_messages(struct Connection *conn, const struct Request *req, int chat) {
+    unsigned long id;
+    pthread_mutex_lock(&window_lock);
+    id = ++request_counter;
+    pthread_mutex_unlock(&window_lock);
+
+    char model[128];
+    find_json_string(req->body, "model", model, sizeof(model));
+    if (!model[0]) {
+        snprintf(model, sizeof(model), "claude-mock");
+    }
+    long input_tokens = (long)(req->content_length / 4) + 1;
+
+    char rate_headers[1024];
+    long retry_after = 1;
+    int limited = account_rate_limit(req->api_key, input_tokens, rate_headers, sizeof(rate_headers),
+                                     &retry_after);
+
+    /* Latency before the first byte applies to every outcome */
+    sleep_ms(sample_latency_ms(&config.latency, &conn->rng));
+
+    double roll = rng_uniform(&conn->rng);
+    char extra[1200];
+    if (limited || roll < config.rate_429) {
+        snprintf(extra, sizeof(extra), "%sretry-after: %ld\r\n", rate_headers, retry_after);
+        if (config.verbose) fprintf(stderr, "[mock] #%lu 429\n", id);
+        return send_error(conn->fd, 429, "Too Many Requests", "rate_limit_error",
+                          "Number of requests has exceeded your rate limit", extra, req->close_after);
+    }
+    if (roll < config.rate_429 + config.rate_529) {
+        snprintf(extra, sizeof(extra), "%sretry-after: 1\r\n", rate_headers);
+        if (config.verbose) fprintf(stderr, "[mock] #%lu 529\n", id);
+        return send_error(conn->fd, 529, "Overloaded", "overloaded_error", "Overloaded",
+                          extra, req->close_after);
+    }
+
+    /* A packed prompt gets one section per diff, a candidates prompt one per candidate */
+    char *packed = sectioned_text(req->body, "COMMIT");
+    if (!packed) packed = sectioned_text(req->body, "CANDIDATE");
+    const char *text = packed ? packed : config.text;
+
+    /* The weak model answers with the title line only */
+    char title[256];
+    if (!packed && config.weak_model && strcmp(model, config.weak_model) == 0) {
+        size_t title_len = strcspn(config.text, "\n");
+        snprintf(title, sizeof(title), "%.*s", (int)title_len, config.text);
+        text = title;
+    }
+
+    int stream = request_wants_stream(req->body);
+    if (config.verbose) {
+        fprintf(stderr, "[mock] #%lu 200 %s%s model=%s body=%zu bytes\n",
+                id, chat ? "chat " : "", stream ? "stream" : (config.chunked ? "chunked" : "plain"),
+                model, req->content_length);
+    }
+    int ok;
+    if (stream) {
+        ok = chat ? send_chat_stream(conn->fd, req, model, id, input_tokens, text, rate_headers)
+                  : send_stream(conn->fd, req, model, id, input_tokens, text, rate_headers);
+    } else {
+        int n = 0;
+        char *body = chat ? format_chat_completion(model, id, input_tokens, text, &n)
+                          : format_message(model, id, input_tokens, text, &n);
+        ok = send_message(conn->fd, req, id, body, n, rate_headers);
+    }
+    free(packed);
+    return ok;
+}
+
+/*
+ * Message Batches: a submitted batch "processes" for config.batch_ms and then
+ * ends with one result per request. Batches stay in memory for the life of
+ * the server.
+ */
+struct MockBatch {
+    unsigned long number;
+    struct timespec ready;          /* CLOCK_MONOTONIC time the batch ends */
+    time_t created;
+    char model[128];
+    size_t count;
+    char (*custom_ids)[MOCK_CUSTOM_ID_SIZE];
+    long *input_tokens;
+    unsigned char *errored;         /* results answered with overloaded_error */
+    struct MockBatch *next;
+};
+
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct MockBatch *batches;
+static unsigned long batch_counter;
+
+static int batch_has_ended(const struct MockBatch *batch) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > batch->ready.tv_sec ||
+           (now.tv_sec == batch->ready.tv_sec && now.tv_nsec >= batch->ready.tv_nsec);
+}
+
+/* Find a batch by the id in a request path; batches are never freed */
+static struct MockBatch* find_batch(const char *id, size_t id_len) {
+    struct MockBatch *found = NULL;
+    pthread_mutex_lock(&batch_lock);
+    for (struct MockBatch *batch = batches; batch && !found; batch = batch->next) {
+        char name[64];
+        int n = snprintf(name, sizeof(name), "msgbatch_mock_%lu", batch->number);
+        if ((size_t)n == id_len && strncmp(name, id, id_len) == 0) {
+            found = batch;
+        }
+    }
+    pthread_mutex_unlock(&batch_lock);
+    return found;
+}
+
+/* Message Batch object as returned by create and retrieve */
+static int send_batch(int fd, const struct Request *req, const struct MockBatch *batch) {
+    int ended = batch_has_ended(batch);
+    size_t errored = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        errored += batch->errored[i];
+    }
+
+    char created[32], expires[32], ended_at[40], results_url[192];
+    format_rfc3339(batch->created, created, sizeof(created));
+    format_rfc3339(batch->created + 24 * 3600, expires, sizeof(expires));
+    if (ended) {
+        char stamp[32];
+        format_rfc3339(time(NULL), stamp, sizeof(stamp));
+        snprintf(ended_at, sizeof(ended_at), "\"%s\"", stamp);
+        snprintf(results_url, sizeof(results_url),
+                 "\"http://127.0.0.1:%d/v1/messages/batches/msgbatch_mock_%lu/results\"",
+                 config.port, batch->number);
+    } else {
+        snprintf(ended_at, sizeof(ended_at), "null");
+        snprintf(results_url, sizeof(results_url), "null");
+    }
+
+    char body[1024];
+    snprintf(body, sizeof(body),
+             "{\"id\":\"msgbatch_mock_%lu\",\"type\":\"message_batch\",\"processing_status\":\"%s\","
+             "\"request_counts\":{\"processing\":%zu,\"succeeded\":%zu,\"errored\":%zu,"
+             "\"canceled\":0,\"expired\":0},\"ended_at\":%s,\"created_at\":\"%s\","
+             "\"expires_at\":\"%s\",\"cancel_initiated_at\":null,\"archived_at\":null,"
+             "\"results_url\":%s}",
+             batch->number, ended ? "ended" : "in_progress",
+             ended ? 0 : batch->count, ended ? batch->count - errored : 0, ended ? errored : 0,
+             ended_at, created, expires, results_url);
+    return send_simple(fd, 200, "OK", NULL, "application/json", body, req->close_after);
+}
+
+/* POST /v1/messages/batches: remember the custom_ids and answer with the new batch */
+static int handle_batch_create(struct Connection *conn, const struct Request *req) {
+    struct MockBatch *batch = calloc(1, sizeof(*batch));
+    if (!batch) return 0;
+
+    size_t capacity = 0;
+    for (const char *p = strstr(req->body, "\"custom_id\""); p; p = strstr(p + 1, "\"custom_id\"")) {
+        capacity++;
+    }
+    if (capacity == 0) {
+        free(batch);
+        return send_error(conn->fd, 400, "Bad Request", "invalid_request_error",
+                          "requests: at least one request is required", NULL, req->close_after);
+    }
+
+    batch->custom_ids = calloc(capacity, sizeof(*batch->custom_ids));
+    batch->input_tokens = calloc(capacity, sizeof(*batch->input_tokens));
+    batch->errored = calloc(capacity, 1);
+    if (!batch->custom_ids || !batch->input_tokens || !batch->errored) {
+        free(batch->custom_ids);
+        free(batch->input_tokens);
+        free(batch->errored);
+        free(batch);
+        return 0;
+    }
+
+    // Requests are sized by the distance to the next custom_id
+    const char *end = req->body + req->content_length;
+    for (const char *p = strstr(req->body, "\"custom_id\""); p; ) {
+        const char *next = strstr(p + 1, "\"custom_id\"");
+        size_t i = batch->count++;
+        find_json_string(p, "custom_id", batch->custom_ids[i], MOCK_CUSTOM_ID_SIZE);
+        batch->input_tokens[i] = (long)(((next ? next : end) - p) / 4) + 1;
+        batch->errored[i] = rng_uniform(&conn->rng) < config.rate_529;
+        p = next;
+    }
+
+    find_json_string(req->body, "model", batch->model, sizeof(batch->model));
+    if (!batch->model[0]) {
+        snprintf(batch->model, sizeof(batch->model), "claude-mock");
+    }
+
+    batch->created = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &batch->ready);
+    batch->ready.tv_sec += config.batch_ms / 1000;
+    batch->ready.tv_nsec += (config.batch_ms % 1000) * 1000000L;
+    if (batch->ready.tv_nsec >= 1000000000L) {
+        batch->ready.tv_sec++;
+        batch->ready.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&batch_lock);
+    batch->number = ++batch_counter;
+    batch->next = batches;
+    batches = batch;
+    pthread_mutex_unlock(&batch_lock);
+
+    if (config.verbose) {
+        fprintf(stderr, "[mock] batch %lu created with %zu requests, body=%zu bytes\n",
+                batch->number, batch->count, req->content_length);
+    }
+    return send_batch(conn->fd, req, batch);
+}
+
+/* GET .../results: JSONL with one line per request, streamed a line per chunk */
+static int send_batch_results(int fd, const struct Request *req, const struct MockBatch *batch) {
+    char head[512];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: application/x-jsonl\r\n"
+                            "Transfer-Encoding: chunked\r\n"
+                            "%s"
+                            "\r\n",
+                            req->close_after ? "Connection: close\r\n" : "");
+    if (!send_all(fd, head, (size_t)head_len)) return 0;
+
+    for (size_t i = 0; i < batch->count; i++) {
+        int ok;
+        if (batch->errored[i]) {
+            char text[512];
+            int n = snprintf(text, sizeof(text),
+                             "{\"custom_id\":\"%s\",\"result\":{\"type\":\"errored\",\"error\":"
+                             "{\"type\":\"error\",\"error\":{\"type\":\"overloaded_error\","
+                             "\"message\":\"Overloaded\"}}}}\n", batch->custom_ids[i]);
+            ok = send_chunk(fd, text, (size_t)n);
+        } else {
+            int message_len = 0;
+            char *message = format_message(batch->model, batch->number * 100000 + i,
+                                           batch->input_tokens[i], config.text, &message_len);
+            if (!message) return 0;
+            size_t len = (size_t)message_len + MOCK_CUSTOM_ID_SIZE + 96;
+            char *line = malloc(len);
+            if (!line) {
+                free(message);
+                return 0;
+            }
+            int n = snprintf(line, len,
+                             "{\"custom_id\":\"%s\",\"result\":{\"type\":\"succeeded\",\"message\":%s}}\n",
+                             batch->custom_ids[i], message);
+            free(message);
+            ok = send_chunk(fd, line, (size_t)n);
+            free(line);
+        }
+        if (!ok) return 0;
+        sleep_ms((double)config.event_delay_ms);
+    }
+    return send_all(fd, "0\r\n\r\n", 5);
+}
+
+/* GET /v1/messages/batches/<id>[/results] */
+static int handle_batch_get(struct Connection *conn, const struct Request *req) {
+    const char *id = req->path + strlen(MOCK_BATCHES_PATH "/");
+    const char *slash = strchr(id, '/');
+    size_t id_len = slash ? (size_t)(slash - id) : strlen(id);
+
+    const struct MockBatch *batch = find_batch(id, id_len);
+    if (!batch) {
+        return send_error(conn->fd, 404, "Not Found", "not_found_error", "Batch not found",
+                          NULL, req->close_after);
+    }
+    if (!slash) {
+        return send_batch(conn->fd, req, batch);
+    }
+    if (strcmp(slash, "/results") != 0) {
+        return send_error(conn->fd, 404, "Not Found", "not_found_error", "Unknown endpoint",
+                          NULL, req->close_after);
+    }
+    if (!batch_has_ended(batch)) {
+        return send_error(conn->fd, 400, "Bad Request", "invalid_request_error",
+                          "Batch is still processing", NULL, req->close_after);
+    }
+    if (config.verbose) {
+        fprintf(stderr, "[mock] batch %lu results, %zu lines\n", batch->number, batch->count);
+    }
+    return send_batch_results(conn->fd, req, batch);
+}
+
+/* Remote cache blobs, kept for the life of the server */
+struct MockBlob {
+    char key[128];
+    char *data;
+    size_t len;
+    struct MockBlob *next;
+};
+
+static pthread_mutex_t blob_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct MockBlob *blobs;
+
+/* GET or PUT /cache/<key> */
+static int handle_cache(struct Connection *conn, const struct Request *req) {
+    const char *key = req->path + strlen(MOCK_CACHE_PATH);
+    sleep_ms((double)config.cache_delay_ms);
+    if (!*key || strlen(key) >= sizeof(((struct MockBlob *)NULL)->key)) {
+        return send_simple(conn->fd, 400, "Bad Request", NULL, "text/plain", "bad key\n",
+                           req->close_after);
+    }
+
+    int put = strcmp(req->method, "PUT") == 0;
+    pthread_mutex_lock(&blob_lock);
+    struct MockBlob *blob = blobs;
+    while (blob && strcmp(blob->key, key) != 0) {
+        blob = blob->next;
+    }
+    if (put) {
+        char *data = malloc(req->content_length + 1);
+        if (data && !blob && (blob = calloc(1, sizeof(*blob))) != NULL) {
+            snprintf(blob->key, sizeof(blob->key), "%s", key);
+            blob->next = blobs;
+            blobs = blob;
+        }
+        if (data && blob) {
+            memcpy(data, req->body, req->content_length);
+            data[req->content_length] = '\0';
+            free(blob->data);
+            blob->data = data;
+            blob->len = req->content_length;
+        } else {
+            free(data);
+        }
+    }
+
+    /* Copy the blob so it can be sent without holding the lock */
+    char *copy = blob && !put ? strdup(blob->data) : NULL;
+    pthread_mutex_unlock(&blob_lock);
+
+    if (config.verbose) {
+        fprintf(stderr, "[mock] cache %s %s %s\n", req->method, key,
+                put ? "stored" : copy ? "hit" : "miss");
+    }
+    int ok;
+    if (put) {
+        ok = send_simple(conn->fd, 201, "Created", NULL, "text/plain", NULL, req->close_after);
+    } else if (copy) {
+        ok = send_simple(conn->fd, 200, "OK", NULL, "text/plain; charset=utf-8", copy,
+                         req->close_after);
+    } else {
+        ok = send_simple(conn->fd, 404, "Not Found", NULL, "text/plain", "miss\n", req->close_after);
+    }
+    free(copy);
+    return ok;
+}
+
+/* Read more bytes into the connection buffer; returns 0 on EOF or error */
+static int fill_buffer(struct Connection *conn) {
+    if (conn->len + 4096 + 1 > conn->cap) {
+        size_t new_cap = conn->cap ? conn->cap * 2 : 16384;
+        while (new_cap < conn->len + 4096 + 1) new_cap *= 2;
+        char *grown = realloc(conn->buf, new_cap);
+        if (!grown) return 0;
+        conn->buf = grown;
+        conn->cap = new_cap;
+    }
+    for (;;) {
+        ssize_t n = recv(conn->fd, conn->buf + conn->len, conn->cap - conn->len - 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        conn->len += (size_t)n;
+        conn->buf[conn->len] = '\0';
+        return 1;
+    }
+}
+
+/* Read and parse one request; returns bytes consumed from the buffer, 0 on close */
+static size_t read_request(struct Connection *conn, struct Request *req) {
+    char *header_end;
+    while ((header_end = conn->len ? strstr(conn->buf, "\r\n\r\n") : NULL) == NULL) {
+        if (conn->len > MOCK_MAX_HEADER_BYTES || !fill_buffer(conn)) return 0;
+    }
+    size_t header_len = (size_t)(header_end - conn->buf) + 4;
+
+    memset(req, 0, sizeof(*req));
+    if (sscanf(conn->buf, "%15s %255s", req->method, req->path) != 2) return 0;
+
+    /* Scan header lines */
+    char *line = strstr(conn->buf, "\r\n") + 2;
+    while (line < header_end) {
+        char *eol = strstr(line, "\r\n");
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            req->content_length = (size_t)strtoull(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "x-api-key:", 10) == 0 ||
+                   strncasecmp(line, "Authorization: Bearer ", 22) == 0) {
+            char *v = line + (line[0] == 'x' || line[0] == 'X' ? 10 : 22);
+            while (*v == ' ') v++;
+            size_t len = (size_t)(eol - v);
+            if (len >= sizeof(req->api_key)) len = sizeof(req->api_key) - 1;
+            memcpy(req->api_key, v, len);
+            req->api_key[len] = '\0';
+        } else if (strncasecmp(line, "Expect:", 7) == 0 && strstr(line, "100-continue") < eol) {
+            req->expect_continue = 1;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            char *v = line + 11;
+            while (*v == ' ') v++;
+            if (strncasecmp(v, "close", 5) == 0) req->close_after = 1;
+        }
+        line = eol + 2;
+    }
+
+    if (req->expect_continue && conn->len - header_len < req->content_length) {
+        const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (!send_all(conn->fd, cont, strlen(cont))) return 0;
+    }
+
+    while (conn->len - header_len < req->content_length) {
+        if (!fill_buffer(conn)) return 0;
+    }
+
+    req->body = conn->buf + header_len;
+    return header_len + req->content_length;
+}
+
+static void *handle_connection(void *arg) {
+    struct Connection *conn = arg;
+
+    for (;;) {
+        struct Request req;
+        size_t consumed = read_request(conn, &req);
+        if (consumed == 0) break;
+
+        /* Terminate the body in place while it is handled */
+        char saved = conn->buf[consumed];
+        conn->buf[consumed] = '\0';
+
+        int ok;
+        if (strcmp(req.method, "POST") == 0 && strcmp(req.path, "/v1/messages") == 0) {
+            ok = handle_messages(conn, &req, 0);
+        } else if (strcmp(req.method, "POST") == 0 && strcmp(req.path, "/v1/chat/completions") == 0) {
+            ok = handle_messages(conn, &req, 1);
+        } else if (strcmp(req.method, "POST") == 0 && strcmp(req.path, MOCK_BATCHES_PATH) == 0) {
+            ok = handle_batch_create(conn, &req);
+        } else if (strcmp(req.method, "GET") == 0 &&
+                   strncmp(req.path, MOCK_BATCHES_PATH "/", strlen(MOCK_BATCHES_PATH "/")) == 0) {
+            ok = handle_batch_get(conn, &req);
+        } else if ((strcmp(req.method, "GET") == 0 || strcmp(req.method, "PUT") == 0) &&
+                   strncmp(req.path, MOCK_CACHE_PATH, strlen(MOCK_CACHE_PATH)) == 0) {
+            ok = handle_cache(conn, &req);
+        } else if (strcmp(req.method, "GET") == 0 && strcmp(req.path, "/health") == 0) {
+            ok = send_simple(conn->fd, 200, "OK", NULL, "text/plain", "ok\n", req.close_after);
+        } else {
+            ok = send_error(conn->fd, 404, "Not Found", "not_found_error", "Unknown endpoint",
+                            NULL, req.close_after);
+        }
+
+        conn->buf[consumed] = saved;
+        memmove(conn->buf, conn->buf + consumed, conn->len - consumed);
+        conn->len -= consumed;
+        conn->buf[conn->len] = '\0';
+
+        if (!ok || req.close_after) break;
+    }
+
+    close(conn->fd);
+    free(conn->buf);
+    free(conn);
+    return NULL;
+}
+
+static void display_help(const char *program_name) {
+    printf("Local mock of the Claude Messages API\n");
+    printf("\nUsage: %s [options]\n", program_name);
+    printf("\nOptions:\n");
+    printf("  -h                Display this help message\n");
+    printf("  -p <port>         Port to listen on (default: %d)\n", MOCK_DEFAULT_PORT);
+    printf("  -l <dist>         Time to first byte in ms (default: fixed:0)\n");
+    printf("                    fixed:MS, uniform:MIN:MAX, normal:MEAN:SD,\n");
+    printf("                    lognormal:MEDIAN:SIGMA or exp:MEAN\n");
+    printf("  -e <ms>           Delay between streamed events, body chunks or batch results\n");
+    printf("  -c <bytes>        Send non-streaming replies chunked, in pieces of <bytes>\n");
+    printf("  -q <p>            Probability of an injected 429 response\n");
+    printf("  -Q <p>            Probability of an injected 529 response (and of an\n");
+    printf("                    errored result in a message batch)\n");
+    printf("  -r <n>            Requests per minute limit per API key (default: 4000)\n");
+    printf("  -T <n>            Input tokens per minute limit per API key (default: 400000)\n");
+    printf("  -b <ms>           Time until a message batch ends (default: 1000)\n");
+    printf("  -t <file>         Return the contents of <file> as the assistant text\n");
+    printf("  -m <model>        Answer requests for <model> with the title line only\n");
+    printf("  -k <ms>           Delay before a %s request is answered\n", MOCK_CACHE_PATH);
+    printf("  -v                Log every request to stderr\n");
+    printf("\nStreaming replies are sent when the request body sets \"stream\": true.\n");
+    printf("Packed prompts (--pack) get one \"=== COMMIT <n> ===\" section per diff, and\n");
+    printf("--candidates prompts one \"=== CANDIDATE <n> ===\" section per candidate.\n");
+    printf("POST /v1/chat/completions answers like an OpenAI-compatible server.\n");
+    printf("GET and PUT %s<key> serve as a --remote-cache blob store.\n", MOCK_CACHE_PATH);
+}
+
+int main(int argc, char *argv[]) {
+    config.port = MOCK_DEFAULT_PORT;
+    config.latency.kind = DIST_FIXED;
+    config.chunk_size = 256;
+    config.requests_per_minute = 4000;
+    config.tokens_per_minute = 400000;
+    config.batch_ms = 1000;
+
+    const char *text_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "hp:l:e:c:q:Q:r:T:b:t:m:k:v")) != -1) {
+        switch (opt) {
+            case 'h':
+                display_help(argv[0]);
+                return 0;
+            case 'p':
+                config.port = atoi(optarg);
+                break;
+            case 'l':
+                if (!parse_latency(optarg, &config.latency)) {
+                    fprintf(stderr, "Error: Invalid latency distribution: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e':
+                config.event_delay_ms = atol(optarg);
+                break;
+            case 'c':
+                config.chunked = 1;
+                config.chunk_size = (size_t)atol(optarg);
+                if (config.chunk_size == 0) config.chunk_size = 256;
+                break;
+            case 'q':
+                config.rate_429 = atof(optarg);
+                break;
+            case 'Q':
+                config.rate_529 = atof(optarg);
+                break;
+            case 'r':
+                config.requests_per_minute = atol(optarg);
+                break;
+            case 'T':
+                config.tokens_per_minute = atol(optarg);
+                break;
+            case 'b':
+                config.batch_ms = atol(optarg);
+                break;
+            case 't':
+                text_path = optarg;
+                break;
+            case 'm':
+                config.weak_model = optarg;
+                break;
+            case 'k':
+                config.cache_delay_ms = atol(optarg);
+                break;
+            case 'v':
+                config.verbose = 1;
+                break;
+            default:
+                display_help(argv[0]);
+                return 1;
+        }
+    }
+
+    if (text_path) {
+        FILE *file = fopen(text_path, "rb");
+        if (!file) {
+            fprintf(stderr, "Error: Failed to open file: %s (%s)\n", text_path, strerror(errno));
+            return 1;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        config.text = malloc((size_t)size + 1);
+        if (!config.text) {
+            fclose(file);
+            return 1;
+        }
+        config.text[fread(config.text, 1, (size_t)size, file)] = '\0';
+        fclose(file);
+    } else {
+        config.text = MOCK_DEFAULT_TEXT;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        fprintf(stderr, "Error: socket() failed (%s)\n", strerror(errno));
+        return 1;
+    }
+    int one = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)config.port);
+    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server_fd, 512) != 0) {
+        fprintf(stderr, "Error: Failed to listen on port %d (%s)\n", config.port, strerror(errno));
+        close(server_fd);
+        return 1;
+    }
+
+    printf("Mock Messages API listening on http://127.0.0.1:%d\n", config.port);
+    fflush(stdout);
+
+    uint64_t seed = (uint64_t)time(NULL) ^ 0x9E3779B97F4A7C15ULL;
+    for (;;) {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: accept() failed (%s)\n", strerror(errno));
+            continue;
+        }
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct Connection *conn = calloc(1, sizeof(*conn));
+        if (!conn) {
+            close(client_fd);
+            continue;
+        }
+        conn->fd = client_fd;
+        seed += 0x9E3779B97F4A7C15ULL;
+        conn->rng = seed | 1;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, handle_connection, conn) != 0) {
+            close(client_fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}